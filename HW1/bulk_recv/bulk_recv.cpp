@@ -0,0 +1,215 @@
+// Receives one file from bulk-send into a memory-mapped output file. Keeps
+// acknowledging for a while after the last chunk, in case the sender missed
+// the final acknowledgement, then syncs the file and exits.
+#include <chrono>
+#include <cmath>
+#include <csignal>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <string>
+
+#include <socket_wrapper/bulk_transfer.h>
+#include <socket_wrapper/event_loop.h>
+#include <socket_wrapper/logger.h>
+#include <socket_wrapper/loss_shim.h>
+#include <socket_wrapper/socket_headers.h>
+#include <socket_wrapper/socket_options.h>
+#include <socket_wrapper/socket_wrapper.h>
+
+using namespace std::chrono_literals;
+
+
+namespace
+{
+
+struct Options
+{
+    int                                   port = 0;
+    std::string                           file;
+    std::chrono::milliseconds             linger = 1000ms; // quiet time after completion
+    socket_wrapper::SocketProfile         profile = socket_wrapper::SocketProfile::none;
+    socket_wrapper::BulkReceiver::Options transfer;
+    socket_wrapper::LossShim::Options     shim;
+};
+
+
+socket_wrapper::EventLoop* running_loop = nullptr;
+
+
+void stop_handler(int)
+{
+    if (running_loop) running_loop->stop();
+}
+
+
+bool parse_options(int argc, char const* argv[], Options& opts)
+{
+    int positional = 0;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        const std::string name      = argv[i];
+        const bool        has_value = i + 1 < argc;
+
+        try
+        {
+            if ("--linger" == name && has_value)
+                opts.linger = std::chrono::milliseconds(std::stoul(argv[++i]));
+            else if ("--batch" == name && has_value)
+                opts.transfer.batch = std::stoul(argv[++i]);
+            else if ("--profile" == name && has_value)
+            {
+                if (!socket_wrapper::parse_socket_profile(argv[++i], opts.profile)) return false;
+            }
+            else if ("--loss" == name && has_value)
+                opts.shim.loss = std::stod(argv[++i]) / 100;
+            else if ("--delay" == name && has_value)
+                opts.shim.delay = std::chrono::microseconds(std::llround(std::stod(argv[++i]) * 1000));
+            else if ("--jitter" == name && has_value)
+                opts.shim.jitter = std::chrono::microseconds(std::llround(std::stod(argv[++i]) * 1000));
+            else if ("--reorder" == name && has_value)
+                opts.shim.reorder = std::stod(argv[++i]) / 100;
+            else if (name.starts_with("--"))
+                return false;
+            else if (0 == positional)
+                opts.port = std::stoi(argv[i]), ++positional;
+            else if (1 == positional)
+                opts.file = argv[i], ++positional;
+            else
+                return false;
+        }
+        catch (const std::exception&)
+        {
+            return false;
+        }
+    }
+
+    return 2 == positional && opts.port > 0 && opts.port < 65536 && opts.transfer.batch > 0 && opts.shim.loss >= 0 &&
+           opts.shim.loss < 1 && opts.shim.reorder >= 0 && opts.shim.reorder <= 1;
+}
+
+}
+
+
+int main(int argc, char const* argv[])
+{
+    Options opts;
+
+    if (!parse_options(argc, argv, opts))
+    {
+        std::cout << "Usage: " << argv[0]
+                  << " <port> <file> [--linger <ms>] [--batch <n>] [--profile none|low-latency|high-throughput]\n"
+                     "    [--loss <%>] [--delay <ms>] [--jitter <ms>] [--reorder <%>]\n";
+        return EXIT_FAILURE;
+    }
+
+    socket_wrapper::SocketWrapper sock_wrap;
+    socket_wrapper::Logger        logger(STDERR_FILENO);
+    socket_wrapper::MappedFile    file;
+
+    socket_wrapper::EventLoop                 loop;
+    std::unique_ptr<socket_wrapper::LossShim> shim;
+
+    if (opts.shim.enabled())
+    {
+        shim               = std::make_unique<socket_wrapper::LossShim>(loop, opts.shim);
+        opts.transfer.shim = shim.get();
+    }
+
+    sockaddr_in addr = {
+        .sin_family = PF_INET,
+        .sin_port   = htons(opts.port),
+    };
+
+    addr.sin_addr.s_addr = INADDR_ANY;
+
+    using Clock = socket_wrapper::EventLoop::Clock;
+
+    Clock::time_point start;
+    Clock::time_point completed;
+
+    socket_wrapper::BulkReceiver receiver(
+        loop,
+        reinterpret_cast<const sockaddr*>(&addr),
+        sizeof(addr),
+        [&](uint64_t size, std::span<char>& storage) {
+            if (!file.create(opts.file, size))
+            {
+                logger.error("{}: {}", opts.file, sock_wrap.get_last_error_string());
+                return false;
+            }
+            storage = { file.data(), file.size() };
+            start   = Clock::now();
+            logger.info("Receiving {} bytes into {}", size, opts.file);
+            return true;
+        },
+        [&] { completed = Clock::now(); },
+        opts.transfer);
+
+    if (!receiver.opened())
+    {
+        logger.error("socket: {}", sock_wrap.get_last_error_string());
+        return EXIT_FAILURE;
+    }
+
+    // Bursts of a whole window arrive between two reads.
+    socket_wrapper::set_option<socket_wrapper::option::ReceiveBuffer>(receiver.socket(), 8 << 20);
+
+    // Last: the profile's buffer sizes win.
+    socket_wrapper::apply_socket_profile(receiver.socket(), opts.profile, [&](const char* option, int error) {
+        logger.warning("{} ({} profile): {}",
+                       option,
+                       socket_wrapper::socket_profile_name(opts.profile),
+                       std::strerror(error));
+    });
+
+    // Done once the sender has gone quiet after the last chunk.
+    loop.add_timer(
+        100ms,
+        [&] {
+            if (receiver.complete() && Clock::now() - receiver.last_packet_time() >= opts.linger) loop.stop();
+        },
+        100ms);
+
+    running_loop = &loop;
+    std::signal(SIGINT, stop_handler);
+    std::signal(SIGTERM, stop_handler);
+
+    logger.info("Waiting for a transfer on the port {}...", opts.port);
+    loop.run();
+
+    running_loop = nullptr;
+
+    const auto& stats = receiver.stats();
+
+    if (!receiver.complete())
+    {
+        logger.warning("Interrupted with {} of {} bytes", receiver.received_bytes(), receiver.size());
+    }
+    else
+    {
+        const double elapsed = std::chrono::duration<double>(completed - start).count();
+
+        logger.info("Done: {} bytes in {} s, {} Mbit/s",
+                    receiver.size(),
+                    std::round(elapsed * 1000) / 1000,
+                    std::round(receiver.size() * 8 / std::max(elapsed, 1e-9) / 1e4) / 100);
+    }
+
+    logger.info("{} packets, {} duplicates, {} foreign, {} acks", stats.packets, stats.duplicates, stats.foreign, stats.acks);
+    if (shim)
+    {
+        const auto& s = shim->stats();
+        logger.info("Shim: {} passed, {} dropped, {} delayed, {} reordered", s.passed, s.dropped, s.delayed, s.reordered);
+    }
+
+    if (receiver.complete() && file.sync() != 0)
+    {
+        logger.error("msync: {}", sock_wrap.get_last_error_string());
+        return EXIT_FAILURE;
+    }
+
+    return receiver.complete() ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,256 @@
+// Sends a file to bulk-recv over the reliable UDP transfer, with the
+// congestion controller of choice and, for testing on loopback, an emulated
+// lossy path in front of the socket.
+#include <chrono>
+#include <cmath>
+#include <csignal>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <string>
+
+#include <socket_wrapper/bulk_transfer.h>
+#include <socket_wrapper/congestion_control.h>
+#include <socket_wrapper/event_loop.h>
+#include <socket_wrapper/logger.h>
+#include <socket_wrapper/loss_shim.h>
+#include <socket_wrapper/resolver.h>
+#include <socket_wrapper/socket_headers.h>
+#include <socket_wrapper/socket_options.h>
+#include <socket_wrapper/socket_wrapper.h>
+
+using namespace std::chrono_literals;
+
+
+namespace
+{
+
+struct Options
+{
+    std::string                         host;
+    int                                 port = 0;
+    std::string                         file;
+    std::string                         congestion = "bbr";
+    socket_wrapper::SocketProfile       profile    = socket_wrapper::SocketProfile::none;
+    socket_wrapper::BulkSender::Options transfer;
+    socket_wrapper::LossShim::Options   shim;
+};
+
+
+socket_wrapper::EventLoop* running_loop = nullptr;
+
+
+void stop_handler(int)
+{
+    if (running_loop) running_loop->stop();
+}
+
+
+bool parse_options(int argc, char const* argv[], Options& opts)
+{
+    int positional = 0;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        const std::string name      = argv[i];
+        const bool        has_value = i + 1 < argc;
+
+        try
+        {
+            if ("--cc" == name && has_value)
+                opts.congestion = argv[++i];
+            else if ("--chunk" == name && has_value)
+                opts.transfer.chunk_size = std::stoul(argv[++i]);
+            else if ("--batch" == name && has_value)
+                opts.transfer.batch = std::stoul(argv[++i]);
+            else if ("--profile" == name && has_value)
+            {
+                if (!socket_wrapper::parse_socket_profile(argv[++i], opts.profile)) return false;
+            }
+            else if ("--loss" == name && has_value)
+                opts.shim.loss = std::stod(argv[++i]) / 100;
+            else if ("--delay" == name && has_value)
+                opts.shim.delay = std::chrono::microseconds(std::llround(std::stod(argv[++i]) * 1000));
+            else if ("--jitter" == name && has_value)
+                opts.shim.jitter = std::chrono::microseconds(std::llround(std::stod(argv[++i]) * 1000));
+            else if ("--reorder" == name && has_value)
+                opts.shim.reorder = std::stod(argv[++i]) / 100;
+            else if (name.starts_with("--"))
+                return false;
+            else if (0 == positional)
+                opts.host = argv[i], ++positional;
+            else if (1 == positional)
+                opts.port = std::stoi(argv[i]), ++positional;
+            else if (2 == positional)
+                opts.file = argv[i], ++positional;
+            else
+                return false;
+        }
+        catch (const std::exception&)
+        {
+            return false;
+        }
+    }
+
+    // The chunk and header must fit one datagram.
+    return 3 == positional && opts.port > 0 && opts.port < 65536 && opts.transfer.chunk_size > 0 &&
+           opts.transfer.chunk_size <= 65507 - socket_wrapper::BulkSender::header_size && opts.transfer.batch > 0 &&
+           opts.shim.loss >= 0 && opts.shim.loss < 1 && opts.shim.reorder >= 0 && opts.shim.reorder <= 1;
+}
+
+}
+
+
+int main(int argc, char const* argv[])
+{
+    Options opts;
+
+    if (!parse_options(argc, argv, opts))
+    {
+        std::cout << "Usage: " << argv[0]
+                  << " <host-name> <port> <file> [--cc newreno|bbr] [--chunk <bytes>] [--batch <n>]\n"
+                     "    [--profile none|low-latency|high-throughput] [--loss <%>] [--delay <ms>] [--jitter <ms>]\n"
+                     "    [--reorder <%>]\n";
+        return EXIT_FAILURE;
+    }
+
+    socket_wrapper::SocketWrapper sock_wrap;
+    socket_wrapper::Logger        logger(STDERR_FILENO);
+    socket_wrapper::MappedFile    file;
+
+    const size_t mss        = opts.transfer.chunk_size + socket_wrapper::BulkSender::header_size;
+    auto         congestion = socket_wrapper::make_congestion_controller(opts.congestion, mss);
+
+    if (!congestion)
+    {
+        logger.error("Unknown congestion control \"{}\"", opts.congestion);
+        return EXIT_FAILURE;
+    }
+
+    if (!file.open(opts.file))
+    {
+        logger.error("{}: {}", opts.file, sock_wrap.get_last_error_string());
+        return EXIT_FAILURE;
+    }
+
+    socket_wrapper::Resolver resolver;
+    const auto               resolved = resolver.resolve(opts.host, AF_INET).get();
+
+    if (resolved.error != 0 || resolved.addresses.empty())
+    {
+        logger.error("{}: {}", opts.host, gai_strerror(resolved.error));
+        return EXIT_FAILURE;
+    }
+
+    sockaddr_in addr = *reinterpret_cast<const sockaddr_in*>(&resolved.addresses.front());
+    addr.sin_port    = htons(opts.port);
+
+    socket_wrapper::EventLoop                 loop;
+    std::unique_ptr<socket_wrapper::LossShim> shim;
+
+    if (opts.shim.enabled())
+    {
+        shim               = std::make_unique<socket_wrapper::LossShim>(loop, opts.shim);
+        opts.transfer.shim = shim.get();
+    }
+
+    int        result = -1;
+    const auto start  = socket_wrapper::EventLoop::Clock::now();
+
+    socket_wrapper::BulkSender sender(
+        loop,
+        reinterpret_cast<const sockaddr*>(&addr),
+        sizeof(addr),
+        { file.data(), file.size() },
+        std::move(congestion),
+        [&](int error) {
+            result = error;
+            loop.stop();
+        },
+        opts.transfer);
+
+    if (!sender.opened())
+    {
+        logger.error("socket: {}", sock_wrap.get_last_error_string());
+        return EXIT_FAILURE;
+    }
+
+    // A window of a few thousand datagrams must not overflow the socket.
+    socket_wrapper::set_option<socket_wrapper::option::SendBuffer>(sender.socket(), 4 << 20);
+    socket_wrapper::set_option<socket_wrapper::option::ReceiveBuffer>(sender.socket(), 1 << 20);
+
+    // Last: the profile's buffer sizes win.
+    socket_wrapper::apply_socket_profile(sender.socket(), opts.profile, [&](const char* option, int error) {
+        logger.warning("{} ({} profile): {}",
+                       option,
+                       socket_wrapper::socket_profile_name(opts.profile),
+                       std::strerror(error));
+    });
+
+    logger.info("Sending {} ({} bytes) to {}:{} with {}, {} byte chunks",
+                opts.file,
+                file.size(),
+                inet_ntoa(addr.sin_addr),
+                opts.port,
+                sender.congestion().name(),
+                opts.transfer.chunk_size);
+
+    uint64_t last_acked = 0;
+
+    loop.add_timer(
+        1s,
+        [&] {
+            const uint64_t acked = sender.acked_bytes();
+
+            logger.info("{}% acked, {} Mbit/s, {} bytes in flight, window {}, srtt {} us",
+                        sender.size() ? acked * 100 / sender.size() : 100,
+                        std::round((acked - last_acked) * 8 / 1e4) / 100,
+                        sender.in_flight(),
+                        sender.congestion().window(),
+                        std::chrono::duration_cast<std::chrono::microseconds>(sender.rtt().smoothed()).count());
+            last_acked = acked;
+        },
+        1s);
+
+    running_loop = &loop;
+    std::signal(SIGINT, stop_handler);
+    std::signal(SIGTERM, stop_handler);
+
+    sender.start();
+    loop.run();
+
+    running_loop = nullptr;
+
+    const double elapsed = std::chrono::duration<double>(socket_wrapper::EventLoop::Clock::now() - start).count();
+    const auto&  stats   = sender.stats();
+
+    if (result > 0)
+        logger.error("Transfer failed: {}", std::strerror(result));
+    else if (result < 0)
+        logger.warning("Interrupted");
+    else
+        logger.info("Done: {} bytes in {} s, {} Mbit/s",
+                    sender.size(),
+                    std::round(elapsed * 1000) / 1000,
+                    std::round(sender.size() * 8 / std::max(elapsed, 1e-9) / 1e4) / 100);
+
+    logger.info("{} packets, {} retransmitted ({} spurious), {} declared lost ({} spurious), {} timeouts, {} acks",
+                stats.packets,
+                stats.retransmitted,
+                stats.spurious_retransmitted,
+                stats.lost,
+                stats.spurious,
+                stats.timeouts,
+                stats.acks);
+    logger.info("RTT min {} us, smoothed {} us",
+                std::chrono::duration_cast<std::chrono::microseconds>(sender.rtt().min()).count(),
+                std::chrono::duration_cast<std::chrono::microseconds>(sender.rtt().smoothed()).count());
+    if (shim)
+    {
+        const auto& s = shim->stats();
+        logger.info("Shim: {} passed, {} dropped, {} delayed, {} reordered", s.passed, s.dropped, s.delayed, s.reordered);
+    }
+
+    return result == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -1,8 +1,20 @@
+#include <algorithm>
+#include <atomic>
 #include <chrono>
+#include <cmath>
+#include <csignal>
 #include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <future>
 #include <iomanip>
 #include <iostream>
+#include <limits>
+#include <span>
 #include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
 
 #ifdef _WIN32
 #include <process.h>
@@ -13,9 +25,18 @@
 #include <unistd.h>
 #endif
 
+#include <socket_wrapper/checksum.h>
+#include <socket_wrapper/datagram_batch.h>
+#include <socket_wrapper/event_loop.h>
+#include <socket_wrapper/histogram.h>
+#include <socket_wrapper/logger.h>
+#include <socket_wrapper/resolver.h>
 #include <socket_wrapper/socket_class.h>
 #include <socket_wrapper/socket_headers.h>
+#include <socket_wrapper/socket_message.h>
+#include <socket_wrapper/socket_options.h>
 #include <socket_wrapper/socket_wrapper.h>
+#include <socket_wrapper/timestamping.h>
 
 using namespace std::chrono_literals;
 using namespace std::chrono;
@@ -77,191 +98,1514 @@ typedef struct ip_hdr
 } IPV4_HDR, *PIPV4_HDR;
 #pragma pack(pop)
 
-void CreatePacket(char* icmp_data, int datasize, uint16_t sequence)
+size_t IpHeaderLength(const ip_hdr* header)
 {
-    icmphdr* header   = nullptr;
-    char*    datapart = nullptr;
+    return (header->ip_verlen & 0x0f) * sizeof(uint32_t);
+}
+
+// Every request carries the same payload, so it is filled and summed once
+// and sent from here next to each header.
+struct EchoPayload
+{
+    EchoPayload()
+    {
+        memset(data, 'a', sizeof(data));
+        sum = socket_wrapper::checksum_sum(data, sizeof(data));
+    }
+
+    char     data[ping_packet_size - sizeof(icmphdr)];
+    uint16_t sum;
+};
+
+const EchoPayload echo_payload;
+
+
+icmphdr CreateEchoRequest(uint16_t id, uint16_t sequence)
+{
+    icmphdr header = {};
+
+    header.type             = ICMP_ECHO;
+    header.code             = 0;
+    header.un.echo.id       = id;
+    header.un.echo.sequence = sequence;
+
+    // The header has an even length, so the sums combine.
+    header.checksum = static_cast<uint16_t>(
+        ~socket_wrapper::checksum_add(socket_wrapper::checksum_sum(&header, sizeof(header)), echo_payload.sum));
+
+    return header;
+}
 
-    header                   = reinterpret_cast<icmphdr*>(icmp_data);
-    header->type             = ICMP_ECHO;
-    header->code             = 0;
-    header->checksum         = 0;
-    header->un.echo.id       = htons(getpid());
-    header->un.echo.sequence = sequence;
+// The header and the shared payload leave as one datagram, gathered by the
+// kernel instead of being copied into a packet buffer first.
+ssize_t SendEchoRequest(const socket_wrapper::Socket& sock,
+                        const icmphdr&                header,
+                        const sockaddr_in&            to,
+                        std::span<const char>         control = {})
+{
+    const iovec buffers[] = {
+        { const_cast<icmphdr*>(&header), sizeof(header) },
+        { const_cast<char*>(echo_payload.data), sizeof(echo_payload.data) },
+    };
 
-    datapart = icmp_data + sizeof(icmphdr);
-    memset(datapart, 'a', datasize - sizeof(icmphdr));
+    return socket_wrapper::send_message(sock, buffers, reinterpret_cast<const sockaddr*>(&to), sizeof(to), control);
 }
 
-void DecodePacket(char*                                 buf,
-                  std::chrono::steady_clock::time_point start_time,
-                  sockaddr_in*                          from)
+// Echo reply to one of our requests (identifier `id`), nullptr for any
+// other ICMP message a raw socket sees.
+const icmphdr* FindEchoReply(const char* buf, ssize_t len, uint16_t id)
 {
-    ip_hdr*        ip_header   = reinterpret_cast<ip_hdr*>(buf);
-    icmphdr*       icmp_header = nullptr;
-    unsigned short ip_hdr_len  = ip_header->ip_verlen & 0x0f * sizeof(uint32_t);
-    static int     icmpcount   = 0;
-    const int      ICMP_MIN    = 8;
+    const auto* ip = reinterpret_cast<const ip_hdr*>(buf);
+    if (static_cast<size_t>(len) < sizeof(ip_hdr) ||
+        static_cast<size_t>(len) < IpHeaderLength(ip) + sizeof(icmphdr))
+        return nullptr;
+
+    const auto* icmp = reinterpret_cast<const icmphdr*>(buf + IpHeaderLength(ip));
+    if (icmp->type != ICMP_ECHO_REPLY || icmp->code != 0 || icmp->un.echo.id != id) return nullptr;
+
+    return icmp;
+}
 
-    icmp_header = reinterpret_cast<icmphdr*>(buf + ip_hdr_len);
+int64_t ToNs(const timespec& ts)
+{
+    return static_cast<int64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+}
 
-    auto end_time = std::chrono::steady_clock::now();
+// Kernel software stamps use CLOCK_REALTIME, so the user space fallback does too.
+int64_t RealtimeNs()
+{
+    return duration_cast<nanoseconds>(system_clock::now().time_since_epoch()).count();
+}
+
+enum class StampSource
+{
+    hardware,
+    kernel,
+    user,
+};
+
+const char* stamp_source_names[] = { "hardware", "kernel", "user space" };
+
+// Send time of one probe, 0 where a stamp is missing.
+struct ProbeTimes
+{
+    int64_t user_ns     = 0;
+    int64_t software_ns = 0;
+    int64_t hardware_ns = 0;
+};
 
-    if ((icmp_header->type == ICMP_ECHO_REPLY) && (icmp_header->code == 0))
+// RTT from the best pair of stamps taken by the same clock.
+int64_t RoundTripNs(const ProbeTimes& sent, const socket_wrapper::PacketTimestamp& received, StampSource& source)
+{
+    if (sent.hardware_ns && received.has_hardware())
+    {
+        source = StampSource::hardware;
+        return ToNs(received.hardware) - sent.hardware_ns;
+    }
+    if (sent.software_ns && received.has_software())
     {
-        std::cout << "Receiving packet from " << inet_ntoa(from->sin_addr)
-                  << ":\nICMP sequence = " << icmp_header->un.echo.sequence
-                  << "\nResponse with id = " << icmp_header->un.echo.id
-                  << "\nTime: "
-                  << std::round(std::chrono::duration_cast<
-                                std::chrono::duration<double, std::milli>>(end_time - start_time).count() * 10) / 10
-                  << " ms\n\n";
+        source = StampSource::kernel;
+        return ToNs(received.software) - sent.software_ns;
     }
-    icmpcount++;
+
+    source = StampSource::user;
+    return (received.has_software() ? ToNs(received.software) : RealtimeNs()) - sent.user_ns;
 }
 
-uint16_t Checksum(char* buffer)
+// Drains the TX timestamps from the error queue and calls
+// on_probe(destination, sequence, stamps) for each of our echo requests.
+template <typename F>
+void ReadTxTimestamps(SocketDescriptorType sock, uint16_t id, F&& on_probe)
 {
-    const uint16_t* buf = reinterpret_cast<const uint16_t*>(buffer);
-    size_t          len = sizeof(buffer);
-    uint32_t        sum = 0;
+    char                            buf[MAX_PACKET_SIZE];
+    socket_wrapper::PacketTimestamp ts;
+    ssize_t                         len;
 
-    for (sum = 0; len > 1; len -= 2)
-        sum += *buf++;
-    if (1 == len)
-        sum += *reinterpret_cast<const uint8_t*>(buf);
-    sum = (sum >> 16) + (sum & 0xffff);
-    sum += (sum >> 16);
+    while ((len = socket_wrapper::read_tx_timestamp(sock, buf, sizeof(buf), ts)) >= 0)
+    {
+        // The looped copy starts with a link layer header of unknown size,
+        // but ends with the request after an option-less IPv4 header.
+        if (static_cast<size_t>(len) < sizeof(ip_hdr) + ping_packet_size) continue;
 
-    uint16_t result = sum;
+        const auto* ip   = reinterpret_cast<const ip_hdr*>(buf + len - ping_packet_size - sizeof(ip_hdr));
+        const auto* icmp = reinterpret_cast<const icmphdr*>(buf + len - ping_packet_size);
+        if (icmp->type != ICMP_ECHO || icmp->un.echo.id != id) continue;
 
-    return ~result;
+        on_probe(ip->ip_destaddr, ntohs(icmp->un.echo.sequence), ts);
+    }
 }
 
-int main(int argc, const char* argv[])
+void SetTxTimes(ProbeTimes& times, const socket_wrapper::PacketTimestamp& ts)
+{
+    if (ts.has_software()) times.software_ns = ToNs(ts.software);
+    if (ts.has_hardware()) times.hardware_ns = ToNs(ts.hardware);
+}
+
+// RTT distribution, plus jitter as the mean difference of consecutive RTTs
+// of the same target.
+struct RttStats
+{
+    socket_wrapper::Histogram histogram;
+    double                    jitter_sum_ns = 0;
+    size_t                    jitter_count  = 0;
+    size_t                    sources[3]    = {};
+
+    void record(int64_t rtt_ns, int64_t previous_ns, StampSource source)
+    {
+        histogram.record(static_cast<uint64_t>(std::max<int64_t>(rtt_ns, 0)));
+        ++sources[static_cast<size_t>(source)];
+
+        if (previous_ns >= 0)
+        {
+            jitter_sum_ns += std::abs(rtt_ns - previous_ns);
+            ++jitter_count;
+        }
+    }
+
+    void report(socket_wrapper::Logger& logger) const
+    {
+        if (histogram.count() == 0) return;
+
+        auto us = [](double ns) { return std::round(ns) / 1000; };
+
+        logger.info("rtt min/p50/p99/p99.9/max = {}/{}/{}/{}/{} us",
+                    us(histogram.min()),
+                    us(histogram.percentile(50)),
+                    us(histogram.percentile(99)),
+                    us(histogram.percentile(99.9)),
+                    us(histogram.max()));
+        logger.info("rtt mean = {} us, stddev = {} us, jitter = {} us",
+                    us(histogram.mean()),
+                    us(histogram.stddev()),
+                    us(jitter_count ? jitter_sum_ns / jitter_count : 0));
+        logger.info("{} rtt(s) from {} hardware, {} kernel, {} user space timestamps",
+                    histogram.count(),
+                    sources[0],
+                    sources[1],
+                    sources[2]);
+    }
+};
+
+// fping-style sweep: one non-blocking raw socket, probes paced by a token
+// bucket, replies matched by (source address, sequence) and timeouts driven
+// by event loop timers instead of blocking receives.
+struct SweepOptions
+{
+    std::vector<std::string> hosts;
+    size_t                   count    = 1;
+    double                   rate     = 1000; // probes per second, all targets together
+    milliseconds             interval = 1000ms; // between probes to one target
+    milliseconds             timeout  = 1000ms;
+    std::string              interface; // NIC to enable hardware timestamps on
+    bool                     verbose  = false;
+
+    socket_wrapper::SocketProfile profile = socket_wrapper::SocketProfile::none;
+};
+
+struct SweepTarget
+{
+    std::string name;
+    sockaddr_in addr;
+    size_t      transmitted = 0;
+    size_t      received    = 0;
+    double      min_ms      = std::numeric_limits<double>::max();
+    double      max_ms      = 0;
+    double      sum_ms      = 0;
+    int64_t     last_rtt_ns = -1;
+
+    std::vector<ProbeTimes> sent;
+    // Non-zero while the probe is outstanding.
+    std::vector<socket_wrapper::EventLoop::TimerId> timers;
+};
+
+class Sweep
+{
+public:
+    Sweep(socket_wrapper::Socket&   sock,
+          std::vector<SweepTarget>& targets,
+          const SweepOptions&       opts,
+          RttStats&                 stats,
+          socket_wrapper::Logger&   logger)
+        : sock_(sock)
+        , targets_(targets)
+        , opts_(opts)
+        , stats_(stats)
+        , logger_(logger)
+        , id_(htons(getpid()))
+    {
+        for (size_t i = 0; i < targets_.size(); ++i)
+        {
+            by_address_.emplace(targets_[i].addr.sin_addr.s_addr, i);
+            targets_[i].sent.resize(opts_.count);
+            targets_[i].timers.resize(opts_.count);
+        }
+
+        header_ = CreateEchoRequest(id_, 0);
+    }
+
+    void run()
+    {
+        if (loop_.add(sock_, socket_wrapper::EventLoop::readable, [this](uint32_t) { receive(); }) != 0)
+        {
+            throw std::runtime_error("Event loop registration failed!");
+        }
+
+        last_tick_   = steady_clock::now();
+        round_start_ = last_tick_;
+        send_timer_  = loop_.add_timer(1ms, [this] { send(); }, 1ms);
+
+        loop_.run();
+    }
+
+private:
+    void send()
+    {
+        const auto now = steady_clock::now();
+
+        // Bursts are capped, so a stalled loop does not flood the network.
+        tokens_ = std::min(tokens_ + opts_.rate * duration<double>(now - last_tick_).count(),
+                           std::max(opts_.rate / 100, 1.0));
+        last_tick_ = now;
+
+        while (tokens_ >= 1 && round_ < opts_.count)
+        {
+            if (next_target_ == 0 && now < round_start_) break;
+
+            SweepTarget& target = targets_[next_target_];
+
+            set_sequence(static_cast<uint16_t>(round_));
+
+            if (SendEchoRequest(sock_, header_, target.addr) < 0)
+            {
+                // Retry on the next tick, the socket buffer is full.
+                if (errno == EAGAIN || errno == EWOULDBLOCK || errno == ENOBUFS) break;
+                logger_.warning("sendmsg {}: {}", target.name, std::strerror(errno));
+            }
+            else
+            {
+                const size_t t = next_target_;
+                const size_t r = round_;
+
+                target.sent[r]         = ProbeTimes();
+                target.sent[r].user_ns = RealtimeNs();
+                target.timers[r]       = loop_.add_timer(opts_.timeout, [this, t, r] { expire(t, r); });
+                ++target.transmitted;
+                ++outstanding_;
+            }
+
+            tokens_ -= 1;
+
+            if (++next_target_ == targets_.size())
+            {
+                next_target_ = 0;
+                ++round_;
+                round_start_ = std::max(now, round_start_ + opts_.interval);
+            }
+        }
+
+        read_tx_timestamps();
+
+        if (round_ == opts_.count)
+        {
+            loop_.cancel_timer(send_timer_);
+            finish_if_done();
+        }
+    }
+
+    // Only the sequence of the header template changes between rounds, so
+    // the checksum is patched instead of summing the header again.
+    void set_sequence(uint16_t sequence)
+    {
+        const uint16_t value = htons(sequence);
+
+        header_.checksum         = socket_wrapper::checksum_update(header_.checksum, header_.un.echo.sequence, value);
+        header_.un.echo.sequence = value;
+    }
+
+    void read_tx_timestamps()
+    {
+        ReadTxTimestamps(sock_, id_, [this](in_addr_t dest, uint16_t r, const auto& ts) {
+            auto found = by_address_.find(dest);
+            if (found == by_address_.end()) return;
+
+            SweepTarget& target = targets_[found->second];
+            if (r < target.timers.size() && target.timers[r] != 0) SetTxTimes(target.sent[r], ts);
+        });
+    }
+
+    void receive()
+    {
+        char                            buffer[MAX_PACKET_SIZE];
+        sockaddr_in                     from;
+        socklen_t                       from_len = sizeof(from);
+        socket_wrapper::PacketTimestamp rx;
+        ssize_t                         len;
+
+        // TX stamps are queued before the replies can arrive.
+        read_tx_timestamps();
+
+        while ((len = socket_wrapper::recv_timestamped(sock_,
+                                                       buffer,
+                                                       sizeof(buffer),
+                                                       0,
+                                                       reinterpret_cast<sockaddr*>(&from),
+                                                       &from_len,
+                                                       rx)) >= 0)
+        {
+            from_len = sizeof(from);
+
+            const icmphdr* icmp = FindEchoReply(buffer, len, id_);
+            if (icmp == nullptr) continue;
+
+            auto found = by_address_.find(from.sin_addr.s_addr);
+            if (found == by_address_.end()) continue;
+
+            SweepTarget&   target = targets_[found->second];
+            const uint16_t r      = ntohs(icmp->un.echo.sequence);
+            // Duplicates and replies after the timeout are ignored.
+            if (r >= target.timers.size() || target.timers[r] == 0) continue;
+
+            loop_.cancel_timer(target.timers[r]);
+            target.timers[r] = 0;
+            --outstanding_;
+
+            StampSource   source;
+            const int64_t rtt_ns = RoundTripNs(target.sent[r], rx, source);
+            const double  ms     = rtt_ns / 1e6;
+
+            stats_.record(rtt_ns, target.last_rtt_ns, source);
+            target.last_rtt_ns = rtt_ns;
+
+            ++target.received;
+            target.sum_ms += ms;
+            target.min_ms = std::min(target.min_ms, ms);
+            target.max_ms = std::max(target.max_ms, ms);
+
+            logger_.debug("{} : [{}], {} bytes, {} us ({})",
+                          target.name,
+                          r,
+                          len,
+                          std::round(rtt_ns) / 1000,
+                          stamp_source_names[static_cast<size_t>(source)]);
+        }
+
+        if (errno != EAGAIN && errno != EWOULDBLOCK)
+        {
+            logger_.error("recvfrom: {}", std::strerror(errno));
+        }
+
+        finish_if_done();
+    }
+
+    void expire(size_t t, size_t r)
+    {
+        SweepTarget& target = targets_[t];
+
+        target.timers[r] = 0;
+        --outstanding_;
+
+        logger_.debug("{} : [{}], timed out", target.name, r);
+
+        finish_if_done();
+    }
+
+    void finish_if_done()
+    {
+        if (round_ == opts_.count && outstanding_ == 0) loop_.stop();
+    }
+
+private:
+    socket_wrapper::Socket&              sock_;
+    std::vector<SweepTarget>&            targets_;
+    const SweepOptions&                  opts_;
+    RttStats&                            stats_;
+    socket_wrapper::Logger&              logger_;
+    const uint16_t                       id_;
+    socket_wrapper::EventLoop            loop_;
+    std::unordered_map<uint32_t, size_t> by_address_;
+    icmphdr                              header_;
+
+    socket_wrapper::EventLoop::TimerId send_timer_  = 0;
+    steady_clock::time_point           last_tick_;
+    steady_clock::time_point           round_start_;
+    double                             tokens_      = 0;
+    size_t                             round_       = 0;
+    size_t                             next_target_ = 0;
+    size_t                             outstanding_ = 0;
+};
+
+// Applies a socket profile, warning about the options the socket refused.
+static void apply_profile(const socket_wrapper::Socket& sock,
+                          socket_wrapper::SocketProfile profile,
+                          socket_wrapper::Logger&       logger)
 {
+    socket_wrapper::apply_socket_profile(sock, profile, [&](const char* option, int error) {
+        logger.warning("{} ({} profile): {}",
+                       option,
+                       socket_wrapper::socket_profile_name(profile),
+                       std::strerror(error));
+    });
+}
+
+int sweep_main(int argc, const char* argv[])
+{
+    SweepOptions opts;
+    std::string  targets_file;
+    bool         valid = true;
 
-    if (argc != 3)
+    for (int i = 1; i < argc && valid; ++i)
     {
-        std::cout << "Usage: " << argv[0] << " <number of pings> <host-name>\n";
+        const std::string name      = argv[i];
+        const bool        has_value = i + 1 < argc;
+
+        try
+        {
+            if ("--count" == name && has_value)
+                opts.count = std::stoul(argv[++i]);
+            else if ("--rate" == name && has_value)
+                opts.rate = std::stod(argv[++i]);
+            else if ("--interval" == name && has_value)
+                opts.interval = milliseconds(std::stoul(argv[++i]));
+            else if ("--timeout" == name && has_value)
+                opts.timeout = milliseconds(std::stoul(argv[++i]));
+            else if ("--file" == name && has_value)
+                targets_file = argv[++i];
+            else if ("--interface" == name && has_value)
+                opts.interface = argv[++i];
+            else if ("--verbose" == name)
+                opts.verbose = true;
+            else if ("--profile" == name && has_value)
+                valid = socket_wrapper::parse_socket_profile(argv[++i], opts.profile);
+            else if (name.rfind("--", 0) == 0)
+                valid = false;
+            else
+                opts.hosts.push_back(name);
+        }
+        catch (const std::exception&)
+        {
+            valid = false;
+        }
+    }
+
+    if (!targets_file.empty())
+    {
+        std::ifstream file_stream;
+        if (targets_file != "-") file_stream.open(targets_file);
+
+        std::istream& in = targets_file == "-" ? std::cin : file_stream;
+        if (!in) valid = false;
+
+        std::string host;
+        while (in >> host) opts.hosts.push_back(host);
+    }
+
+    if (!valid || opts.hosts.empty() || opts.count == 0 || opts.count > 65536 || opts.rate <= 0)
+    {
+        std::cout << "Usage: " << argv[0]
+                  << " [--count <n>] [--rate <pps>] [--interval <ms>] [--timeout <ms>]"
+                     " [--file <path|->] [--interface <nic>] [--verbose]\n"
+                     "    [--profile none|low-latency|high-throughput] <host-name>...\n";
         return EXIT_FAILURE;
     }
 
     socket_wrapper::SocketWrapper sock_wrap;
-    std::string                   hostname  = { argv[2] };
-    const struct hostent*         dest_addr = gethostbyname(hostname.c_str());
+    socket_wrapper::Logger        logger(STDERR_FILENO);
+    socket_wrapper::Resolver      resolver(5min, 30s, 16);
+
+    if (opts.verbose) logger.set_level(socket_wrapper::LogLevel::debug);
+
+    std::vector<std::future<socket_wrapper::ResolvedHost>> lookups;
+    for (const auto& host : opts.hosts) lookups.push_back(resolver.resolve(host, AF_INET));
+
+    std::vector<SweepTarget>                  targets;
+    std::unordered_map<uint32_t, std::string> seen;
+
+    for (size_t i = 0; i < lookups.size(); ++i)
+    {
+        const auto resolved = lookups[i].get();
+
+        if (resolved.error != 0 || resolved.addresses.empty())
+        {
+            logger.warning("{}: {}", opts.hosts[i], gai_strerror(resolved.error));
+            continue;
+        }
+
+        SweepTarget target;
+        target.name          = opts.hosts[i];
+        target.addr          = *reinterpret_cast<const sockaddr_in*>(&resolved.addresses.front());
+        target.addr.sin_port = 0;
+
+        // Replies are matched by source address, one target per address.
+        auto duplicate = seen.emplace(target.addr.sin_addr.s_addr, target.name);
+        if (!duplicate.second)
+        {
+            logger.warning("{} duplicates {}, skipped", target.name, duplicate.first->second);
+            continue;
+        }
+
+        targets.push_back(std::move(target));
+    }
+
+    if (targets.empty()) return EXIT_FAILURE;
+
+    socket_wrapper::Socket sock(AF_INET, SOCK_RAW, IPPROTO_ICMP);
+
+    if (!sock || sock.set_nonblocking() != 0)
+    {
+        logger.error("socket: {}", sock_wrap.get_last_error_string());
+        return EXIT_FAILURE;
+    }
+
+    // A sweep answers in bursts, the default buffer would overflow.
+    socket_wrapper::set_option<socket_wrapper::option::ReceiveBuffer>(sock, 4 << 20);
+    apply_profile(sock, opts.profile, logger);
+
+    if (!opts.interface.empty() &&
+        socket_wrapper::enable_hardware_timestamps(sock, opts.interface.c_str()) != 0)
+    {
+        logger.warning("No hardware timestamps on {}: {}", opts.interface, std::strerror(errno));
+    }
+    if (socket_wrapper::enable_timestamping(sock,
+                                            socket_wrapper::timestamp_rx | socket_wrapper::timestamp_tx |
+                                                socket_wrapper::timestamp_hardware) < 0)
+    {
+        logger.warning("No kernel timestamps, RTTs are measured in user space");
+    }
+
+    logger.info("Sweeping {} target(s), {} probe(s) each at {} pps", targets.size(), opts.count, opts.rate);
+
+    RttStats   stats;
+    const auto start = steady_clock::now();
+    Sweep(sock, targets, opts, stats, logger).run();
+    const double elapsed = duration<double>(steady_clock::now() - start).count();
+
+    size_t alive = 0;
+
+    for (const auto& t : targets)
+    {
+        const size_t loss = (t.transmitted - t.received) * 100 / std::max<size_t>(t.transmitted, 1);
+
+        std::cout << t.name << " : xmt/rcv/%loss = " << t.transmitted << '/' << t.received << '/'
+                  << loss << '%';
+        if (t.received > 0)
+        {
+            ++alive;
+            std::cout << std::fixed << std::setprecision(3) << ", min/avg/max = " << t.min_ms
+                      << '/' << t.sum_ms / t.received << '/' << t.max_ms;
+        }
+        std::cout << '\n';
+    }
+
+    logger.info("{} of {} target(s) alive, {} s", alive, targets.size(), std::round(elapsed * 1000) / 1000);
+    stats.report(logger);
+
+    return alive > 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+// Flood mode: echo requests as fast as the socket takes them (or at a fixed
+// rate), sent in sendmmsg() batches from preallocated packets of which only
+// the sequence and send time are patched, with the checksum updated
+// incrementally. A receiver thread counts the replies in recvmmsg() batches
+// and takes the RTT from the send time the reply echoes back.
+struct FloodOptions
+{
+    std::string  host;
+    double       seconds = 10;
+    size_t       count   = 0; // 0: until --seconds are over
+    double       rate    = 0; // probes per second, 0: no limit
+    size_t       batch   = 64;
+    milliseconds timeout = 1000ms; // wait for late replies
+
+    socket_wrapper::SocketProfile profile = socket_wrapper::SocketProfile::none;
+};
+
+struct FloodCounters
+{
+    std::atomic<uint64_t> sent{ 0 };
+    // Steady clock time the last request went out, 0 while sending.
+    std::atomic<int64_t> finished_ns{ 0 };
+
+    uint64_t send_errors  = 0;
+    uint64_t received     = 0; // duplicates not included
+    uint64_t duplicates   = 0;
+    uint32_t socket_drops = 0;
+    RttStats stats;
+};
+
+static std::atomic<bool> flood_interrupted{ false };
+
+static void flood_stop_handler(int)
+{
+    flood_interrupted = true;
+}
+
+int64_t SteadyNs()
+{
+    return duration_cast<nanoseconds>(steady_clock::now().time_since_epoch()).count();
+}
+
+// The send time takes the first 8 bytes of the payload.
+void StampFloodRequest(char* packet, uint16_t sequence, int64_t sent_ns)
+{
+    auto*          header = reinterpret_cast<icmphdr*>(packet);
+    char*          stamp  = packet + sizeof(icmphdr);
+    const uint16_t value  = htons(sequence);
+    uint32_t       old_words[2];
+    uint32_t       new_words[2];
+
+    std::memcpy(old_words, stamp, sizeof(old_words));
+    std::memcpy(new_words, &sent_ns, sizeof(new_words));
+
+    uint16_t checksum = socket_wrapper::checksum_update(header->checksum, header->un.echo.sequence, value);
+    checksum          = socket_wrapper::checksum_update(checksum, old_words[0], new_words[0]);
+    checksum          = socket_wrapper::checksum_update(checksum, old_words[1], new_words[1]);
+
+    header->checksum         = checksum;
+    header->un.echo.sequence = value;
+    std::memcpy(stamp, &sent_ns, sizeof(sent_ns));
+}
+
+void FloodSend(const socket_wrapper::Socket& sock,
+               const sockaddr_in&            to,
+               uint16_t                      id,
+               const FloodOptions&           opts,
+               FloodCounters&                counters,
+               socket_wrapper::Logger&       logger)
+{
+    socket_wrapper::DatagramBatch requests(opts.batch, ping_packet_size);
+    const icmphdr                 header = CreateEchoRequest(id, 0);
+
+    for (size_t i = 0; i < requests.depth(); ++i)
+    {
+        std::memcpy(requests.data(i), &header, sizeof(header));
+        std::memcpy(requests.data(i) + sizeof(header), echo_payload.data, sizeof(echo_payload.data));
+        requests.set_length(i, ping_packet_size);
+        requests.set_address(i, reinterpret_cast<const sockaddr*>(&to), sizeof(to));
+    }
+
+    const auto start     = steady_clock::now();
+    const auto finish    = start + duration_cast<steady_clock::duration>(duration<double>(opts.seconds));
+    auto       last_tick = start;
+    double     tokens    = 0;
+    uint64_t   sent      = 0;
+    uint16_t   sequence  = 0;
+
+    while (!flood_interrupted && (opts.count == 0 || sent < opts.count))
+    {
+        const auto now = steady_clock::now();
+        if (opts.seconds > 0 && now >= finish) break;
+
+        size_t n = requests.depth();
+        if (opts.count) n = std::min<uint64_t>(n, opts.count - sent);
+
+        if (opts.rate > 0)
+        {
+            // At most one batch of credit, so a stall does not turn into a burst.
+            tokens    = std::min(tokens + opts.rate * duration<double>(now - last_tick).count(),
+                              static_cast<double>(requests.depth()));
+            last_tick = now;
+
+            if (tokens < 1)
+            {
+                std::this_thread::sleep_for(duration<double>((1 - tokens) / opts.rate));
+                continue;
+            }
+            n = std::min(n, static_cast<size_t>(tokens));
+        }
+
+        // One clock read per batch, the whole batch leaves in one call.
+        const int64_t sent_ns = SteadyNs();
+        for (size_t i = 0; i < n; ++i) StampFloodRequest(requests.data(i), static_cast<uint16_t>(sequence + i), sent_ns);
+
+        const int result = requests.send(sock, n);
+        if (result < 0)
+        {
+            if (errno == ENOBUFS || errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)
+            {
+                ++counters.send_errors;
+                std::this_thread::yield();
+                continue;
+            }
+            logger.error("sendmmsg: {}", std::strerror(errno));
+            break;
+        }
+
+        sequence += static_cast<uint16_t>(result);
+        sent += result;
+        tokens -= result;
+        counters.sent.store(sent, std::memory_order_relaxed);
+    }
+
+    counters.finished_ns = SteadyNs();
+}
+
+void FloodReceive(const socket_wrapper::Socket& sock,
+                  uint16_t                      id,
+                  const FloodOptions&           opts,
+                  FloodCounters&                counters,
+                  socket_wrapper::Logger&       logger)
+{
+    socket_wrapper::DatagramBatch replies(opts.batch, MAX_PACKET_SIZE);
+    int64_t                       previous_rtt_ns = -1;
+    const int64_t                 timeout_ns      = duration_cast<nanoseconds>(opts.timeout).count();
+    // Send time of the request last answered, per sequence. Sequences wrap
+    // every 65536 requests but each send has its own time, so a second reply
+    // with the same one is a duplicate.
+    std::vector<int64_t>          answered(UINT16_MAX + 1, -1);
 
-    if (dest_addr == nullptr)
+    while (true)
     {
-        if (sock_wrap.get_last_error_code())
+        // Blocks for the first datagram only, up to the receive timeout.
+        const int     n   = replies.receive(sock, MSG_WAITFORONE);
+        const int64_t now = SteadyNs();
+
+        if (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+        {
+            logger.error("recvmmsg: {}", std::strerror(errno));
+            break;
+        }
+
+        for (int i = 0; i < n; ++i)
+        {
+            const ssize_t  len   = static_cast<ssize_t>(replies.length(i));
+            const icmphdr* reply = FindEchoReply(replies.data(i), len, id);
+            if (reply == nullptr) continue;
+
+            // The request was echoed back, send time included.
+            const char* stamp = reinterpret_cast<const char*>(reply) + sizeof(icmphdr);
+            if (stamp + sizeof(int64_t) > replies.data(i) + len) continue;
+
+            int64_t sent_ns;
+            std::memcpy(&sent_ns, stamp, sizeof(sent_ns));
+
+            const int64_t rtt_ns = now - sent_ns;
+            if (rtt_ns < 0) continue;
+
+            int64_t& answered_ns = answered[ntohs(reply->un.echo.sequence)];
+            if (answered_ns == sent_ns)
+            {
+                ++counters.duplicates;
+                continue;
+            }
+            answered_ns = sent_ns;
+
+            counters.stats.record(rtt_ns, previous_rtt_ns, StampSource::user);
+            previous_rtt_ns = rtt_ns;
+            ++counters.received;
+        }
+
+        if (n > 0) counters.socket_drops = replies.socket_drops();
+
+        const int64_t finished = counters.finished_ns.load();
+        if (finished != 0 && (counters.received >= counters.sent.load() || now > finished + timeout_ns)) break;
+    }
+}
+
+int flood_main(int argc, const char* argv[])
+{
+    FloodOptions opts;
+    bool         valid = true;
+
+    for (int i = 2; i < argc && valid; ++i)
+    {
+        const std::string name      = argv[i];
+        const bool        has_value = i + 1 < argc;
+
+        try
+        {
+            if ("--seconds" == name && has_value)
+                opts.seconds = std::stod(argv[++i]);
+            else if ("--count" == name && has_value)
+                opts.count = std::stoul(argv[++i]);
+            else if ("--rate" == name && has_value)
+                opts.rate = std::stod(argv[++i]);
+            else if ("--batch" == name && has_value)
+                opts.batch = std::stoul(argv[++i]);
+            else if ("--timeout" == name && has_value)
+                opts.timeout = milliseconds(std::stoul(argv[++i]));
+            else if ("--profile" == name && has_value)
+                valid = socket_wrapper::parse_socket_profile(argv[++i], opts.profile);
+            else if (name.rfind("--", 0) == 0 || !opts.host.empty())
+                valid = false;
+            else
+                opts.host = name;
+        }
+        catch (const std::exception&)
         {
-            std::cout << "DEST_ADDR\n";
-            std::cerr << sock_wrap.get_last_error_string() << std::endl;
+            valid = false;
         }
+    }
 
+    if (!valid || opts.host.empty() || opts.seconds < 0 || (opts.seconds == 0 && opts.count == 0) ||
+        opts.rate < 0 || opts.batch == 0 || opts.batch > 1024)
+    {
+        std::cout << "Usage: " << argv[0]
+                  << " --flood [--seconds <s>] [--count <n>] [--rate <pps>] [--batch <n>] [--timeout <ms>]\n"
+                     "    [--profile none|low-latency|high-throughput] <host-name>\n";
+        return EXIT_FAILURE;
+    }
+
+    socket_wrapper::SocketWrapper sock_wrap;
+    socket_wrapper::Logger        logger(STDERR_FILENO);
+    socket_wrapper::Resolver      resolver;
+    const auto                    resolved = resolver.resolve(opts.host, AF_INET).get();
+
+    if (resolved.error != 0 || resolved.addresses.empty())
+    {
+        logger.error("{}: {}", opts.host, gai_strerror(resolved.error));
         return EXIT_FAILURE;
     }
 
+    sockaddr_in addr = *reinterpret_cast<const sockaddr_in*>(&resolved.addresses.front());
+    addr.sin_port    = 0;
+
     socket_wrapper::Socket sock(AF_INET, SOCK_RAW, IPPROTO_ICMP);
 
     if (!sock)
     {
-        std::cerr << sock_wrap.get_last_error_string() << std::endl;
+        logger.error("socket: {}", sock_wrap.get_last_error_string());
+        return EXIT_FAILURE;
+    }
+
+    // The receiver wakes up regularly to see whether sending is over.
+    if (socket_wrapper::set_option<socket_wrapper::option::ReceiveTimeout>(sock, 100ms) != 0)
+    {
+        throw std::runtime_error("Recv timeout setting failed!");
+    }
+    socket_wrapper::set_option<socket_wrapper::option::ReceiveBuffer>(sock, 8 << 20);
+    socket_wrapper::set_option<socket_wrapper::option::SendBuffer>(sock, 4 << 20);
+    socket_wrapper::enable_rx_drop_counter(sock);
+    apply_profile(sock, opts.profile, logger);
+
+    std::signal(SIGINT, flood_stop_handler);
+    std::signal(SIGTERM, flood_stop_handler);
+
+    logger.info("Flooding \"{}\" [{}] with {} byte requests, {} per batch, {}",
+                opts.host,
+                inet_ntoa(addr.sin_addr),
+                ping_packet_size,
+                opts.batch,
+                opts.rate > 0 ? std::to_string(static_cast<uint64_t>(opts.rate)) + " pps" : std::string("no rate limit"));
+
+    const uint16_t id = htons(getpid());
+    FloodCounters  counters;
+
+    const auto  start = steady_clock::now();
+    std::thread receiver([&] { FloodReceive(sock, id, opts, counters, logger); });
+
+    FloodSend(sock, addr, id, opts, counters, logger);
+    const double send_elapsed = duration<double>(steady_clock::now() - start).count();
+
+    receiver.join();
+
+    const uint64_t sent     = counters.sent;
+    const uint64_t received = std::min(counters.received, sent);
+
+    logger.info("{} packets transmitted, {} received, +{} duplicates, {}% packet loss",
+                sent,
+                counters.received,
+                counters.duplicates,
+                std::round((sent - received) * 10000.0 / std::max<uint64_t>(sent, 1)) / 100);
+    logger.info("{} pps sent over {} s, {} send retries, {} dropped by the receive queue",
+                std::round(sent / std::max(send_elapsed, 1e-9)),
+                std::round(send_elapsed * 1000) / 1000,
+                counters.send_errors,
+                counters.socket_drops);
+    counters.stats.report(logger);
+
+    return received > 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+// mtr-style path tracer: every round sends one echo request per TTL at
+// once, with the TTL set per message (IP_TTL control message), so the whole
+// path answers within one round trip plus the timeout. Routers answer with
+// Time Exceeded quoting our request, matched back to its probe by the
+// sequence in the quoted ICMP header. Rounds repeat every --interval and
+// accumulate per-hop loss and latency.
+struct TraceOptions
+{
+    std::string  host;
+    size_t       count    = 10; // rounds, 0: until interrupted
+    size_t       max_hops = 30;
+    milliseconds interval = 1000ms;
+    milliseconds timeout  = 1000ms;
+    std::string  interface; // NIC to enable hardware timestamps on
+    bool         verbose  = false;
+
+    socket_wrapper::SocketProfile profile = socket_wrapper::SocketProfile::none;
+};
+
+struct TraceHop
+{
+    // Every router seen answering at this TTL, more than one with ECMP.
+    std::vector<in_addr_t>    addresses;
+    size_t                    sent     = 0;
+    size_t                    received = 0;
+    int64_t                   last_ns  = 0;
+    socket_wrapper::Histogram rtt;
+};
+
+// Time Exceeded, Destination Unreachable.
+const int ICMP_TIME_EXCEEDED = 11;
+const int ICMP_UNREACHABLE   = 3;
+
+// The echo request quoted by an ICMP error: the original IPv4 header and
+// the first 8 bytes of its payload, nullptr for anything else.
+const icmphdr* FindQuotedRequest(const char* buf, ssize_t len, uint16_t id, in_addr_t& destination)
+{
+    const auto* ip = reinterpret_cast<const ip_hdr*>(buf);
+    if (static_cast<size_t>(len) < sizeof(ip_hdr) ||
+        static_cast<size_t>(len) < IpHeaderLength(ip) + sizeof(icmphdr) + sizeof(ip_hdr))
+        return nullptr;
+
+    const auto* icmp = reinterpret_cast<const icmphdr*>(buf + IpHeaderLength(ip));
+    if (icmp->type != ICMP_TIME_EXCEEDED && icmp->type != ICMP_UNREACHABLE) return nullptr;
+
+    const char* quoted    = reinterpret_cast<const char*>(icmp) + sizeof(icmphdr);
+    const auto* inner     = reinterpret_cast<const ip_hdr*>(quoted);
+    const char* inner_end = quoted + IpHeaderLength(inner) + sizeof(icmphdr);
+    if (inner->ip_protocol != IPPROTO_ICMP || inner_end > buf + len) return nullptr;
+
+    const auto* request = reinterpret_cast<const icmphdr*>(quoted + IpHeaderLength(inner));
+    if (request->type != ICMP_ECHO || request->un.echo.id != id) return nullptr;
+
+    destination = inner->ip_destaddr;
+    return request;
+}
+
+class Trace
+{
+public:
+    Trace(socket_wrapper::Socket& sock,
+          const sockaddr_in&      target,
+          std::vector<TraceHop>&  hops,
+          const TraceOptions&     opts,
+          socket_wrapper::Logger& logger)
+        : sock_(sock)
+        , target_(target)
+        , hops_(hops)
+        , opts_(opts)
+        , logger_(logger)
+        , id_(htons(getpid()))
+        , probes_(65536)
+        , reached_(opts.max_hops)
+        , redraw_(isatty(STDOUT_FILENO))
+    {
+    }
+
+    void run()
+    {
+        if (loop_.add(sock_, socket_wrapper::EventLoop::readable, [this](uint32_t) { receive(); }) != 0)
+        {
+            throw std::runtime_error("Event loop registration failed!");
+        }
+
+        send_timer_ = loop_.add_timer(0ms, [this] { send_round(); }, opts_.interval);
+
+        loop_.run();
+    }
+
+    // Safe from a signal handler.
+    void stop() { loop_.stop(); }
+
+    // Hops up to the destination, or all of them until it answered.
+    size_t path_length() const { return reached_; }
+
+    void print(std::ostream& out) const
+    {
+        out << std::right << std::setw(4) << "" << std::left << std::setw(18) << "host" << std::right
+            << std::setw(7) << "loss%" << std::setw(6) << "snt" << std::setw(9) << "last" << std::setw(9) << "avg"
+            << std::setw(9) << "best" << std::setw(9) << "wrst" << std::setw(9) << "stdev" << '\n';
+
+        auto ms = [](double ns) { return ns / 1e6; };
+
+        for (size_t h = 0; h < reached_; ++h)
+        {
+            const TraceHop& hop = hops_[h];
+
+            out << std::right << std::setw(3) << h + 1 << ". " << std::left << std::setw(18)
+                << (hop.addresses.empty() ? "???" : inet_ntoa(in_addr{ hop.addresses[0] })) << std::right
+                << std::fixed << std::setprecision(1) << std::setw(6)
+                << (hop.sent ? (hop.sent - hop.received) * 100.0 / hop.sent : 0.0) << '%' << std::setw(6)
+                << hop.sent;
+
+            if (hop.received)
+            {
+                out << std::setprecision(3) << std::setw(9) << ms(hop.last_ns) << std::setw(9)
+                    << ms(hop.rtt.mean()) << std::setw(9) << ms(hop.rtt.min()) << std::setw(9)
+                    << ms(hop.rtt.max()) << std::setw(9) << ms(hop.rtt.stddev());
+            }
+            out << '\n';
+
+            for (size_t a = 1; a < hop.addresses.size(); ++a)
+            {
+                out << std::setw(6) << "" << inet_ntoa(in_addr{ hop.addresses[a] }) << '\n';
+            }
+        }
+    }
+
+private:
+    struct Probe
+    {
+        size_t     ttl         = 0;
+        bool       outstanding = false;
+        ProbeTimes sent;
+    };
+
+    void send_round()
+    {
+        if (opts_.count != 0 && round_ == opts_.count)
+        {
+            loop_.cancel_timer(send_timer_);
+            return;
+        }
+
+        ++round_;
+
+        // Once the destination answered, TTLs beyond it are not probed.
+        std::vector<uint16_t> sequences;
+
+        for (size_t ttl = 1; ttl <= reached_; ++ttl)
+        {
+            const uint16_t sequence = next_sequence_++;
+            const icmphdr  header   = CreateEchoRequest(id_, htons(sequence));
+
+            control_.clear();
+            control_.add<socket_wrapper::control::TimeToLive>(static_cast<int>(ttl));
+
+            if (SendEchoRequest(sock_, header, target_, control_.view()) < 0)
+            {
+                if (errno == EAGAIN || errno == EWOULDBLOCK || errno == ENOBUFS) break;
+                logger_.warning("sendmsg (ttl {}): {}", ttl, std::strerror(errno));
+                continue;
+            }
+
+            Probe& probe       = probes_[sequence];
+            probe.ttl          = ttl;
+            probe.outstanding  = true;
+            probe.sent         = ProbeTimes();
+            probe.sent.user_ns = RealtimeNs();
+
+            ++hops_[ttl - 1].sent;
+            ++outstanding_;
+            sequences.push_back(sequence);
+        }
+
+        read_tx_timestamps();
+
+        loop_.add_timer(opts_.timeout, [this, sequences = std::move(sequences)] { expire(sequences); });
+    }
+
+    void read_tx_timestamps()
+    {
+        ReadTxTimestamps(sock_, id_, [this](in_addr_t, uint16_t sequence, const auto& ts) {
+            if (probes_[sequence].outstanding) SetTxTimes(probes_[sequence].sent, ts);
+        });
+    }
+
+    void receive()
+    {
+        char                            buffer[MAX_PACKET_SIZE];
+        sockaddr_in                     from;
+        socklen_t                       from_len = sizeof(from);
+        socket_wrapper::PacketTimestamp rx;
+        ssize_t                         len;
+
+        // TX stamps are queued before the replies can arrive.
+        read_tx_timestamps();
+
+        while ((len = socket_wrapper::recv_timestamped(sock_,
+                                                       buffer,
+                                                       sizeof(buffer),
+                                                       0,
+                                                       reinterpret_cast<sockaddr*>(&from),
+                                                       &from_len,
+                                                       rx)) >= 0)
+        {
+            from_len = sizeof(from);
+
+            const icmphdr* icmp        = FindEchoReply(buffer, len, id_);
+            in_addr_t      destination = from.sin_addr.s_addr;
+            const bool     reply       = icmp != nullptr;
+
+            // A reply comes from the target itself, an error quotes the
+            // request that was sent to it.
+            if (!reply) icmp = FindQuotedRequest(buffer, len, id_, destination);
+            if (icmp == nullptr || destination != target_.sin_addr.s_addr) continue;
+
+            Probe& probe = probes_[ntohs(icmp->un.echo.sequence)];
+            // Duplicates and answers after the timeout are ignored.
+            if (!probe.outstanding) continue;
+
+            probe.outstanding = false;
+            --outstanding_;
+
+            StampSource   source;
+            const int64_t rtt_ns = RoundTripNs(probe.sent, rx, source);
+            TraceHop&     hop    = hops_[probe.ttl - 1];
+
+            ++hop.received;
+            hop.last_ns = rtt_ns;
+            hop.rtt.record(static_cast<uint64_t>(std::max<int64_t>(rtt_ns, 0)));
+
+            if (std::find(hop.addresses.begin(), hop.addresses.end(), from.sin_addr.s_addr) == hop.addresses.end())
+            {
+                hop.addresses.push_back(from.sin_addr.s_addr);
+            }
+
+            // The destination itself, or a final hop refusing it.
+            if ((reply || icmp_type(buffer) == ICMP_UNREACHABLE) && probe.ttl < reached_) reached_ = probe.ttl;
+
+            logger_.debug("ttl {}: {} {}, {} us ({})",
+                          probe.ttl,
+                          reply ? "reply from" : "error from",
+                          inet_ntoa(from.sin_addr),
+                          std::round(rtt_ns) / 1000,
+                          stamp_source_names[static_cast<size_t>(source)]);
+        }
+
+        if (errno != EAGAIN && errno != EWOULDBLOCK)
+        {
+            logger_.error("recvfrom: {}", std::strerror(errno));
+        }
+
+        finish_if_done();
+    }
+
+    static int icmp_type(const char* buf)
+    {
+        const auto* ip = reinterpret_cast<const ip_hdr*>(buf);
+
+        return reinterpret_cast<const icmphdr*>(buf + IpHeaderLength(ip))->type;
+    }
+
+    void expire(const std::vector<uint16_t>& sequences)
+    {
+        for (const uint16_t sequence : sequences)
+        {
+            Probe& probe = probes_[sequence];
+            if (!probe.outstanding) continue;
+
+            probe.outstanding = false;
+            --outstanding_;
+            logger_.debug("ttl {}: timed out", probe.ttl);
+        }
+
+        if (redraw_)
+        {
+            // Home and clear, then the table as of this round.
+            std::cout << "\033[H\033[2J";
+            print(std::cout);
+            std::cout << std::flush;
+        }
+
+        finish_if_done();
+    }
+
+    void finish_if_done()
+    {
+        if (opts_.count != 0 && round_ == opts_.count && outstanding_ == 0) loop_.stop();
+    }
+
+private:
+    socket_wrapper::Socket&   sock_;
+    const sockaddr_in&        target_;
+    std::vector<TraceHop>&    hops_;
+    const TraceOptions&       opts_;
+    socket_wrapper::Logger&   logger_;
+    const uint16_t            id_;
+    socket_wrapper::EventLoop loop_;
+    // By sequence number, which wraps after 65536 probes.
+    std::vector<Probe>        probes_;
+    size_t                    reached_;
+    const bool                redraw_;
+
+    socket_wrapper::ControlBuffer<socket_wrapper::control_space<socket_wrapper::control::TimeToLive>> control_;
+
+    socket_wrapper::EventLoop::TimerId send_timer_    = 0;
+    size_t                             round_         = 0;
+    uint16_t                           next_sequence_ = 0;
+    size_t                             outstanding_   = 0;
+};
+
+static Trace* running_trace = nullptr;
+
+static void trace_stop_handler(int)
+{
+    if (running_trace) running_trace->stop();
+}
+
+int trace_main(int argc, const char* argv[])
+{
+    TraceOptions opts;
+    bool         valid = true;
+
+    for (int i = 2; i < argc && valid; ++i)
+    {
+        const std::string name      = argv[i];
+        const bool        has_value = i + 1 < argc;
+
+        try
+        {
+            if ("--count" == name && has_value)
+                opts.count = std::stoul(argv[++i]);
+            else if ("--max-hops" == name && has_value)
+                opts.max_hops = std::stoul(argv[++i]);
+            else if ("--interval" == name && has_value)
+                opts.interval = milliseconds(std::stoul(argv[++i]));
+            else if ("--timeout" == name && has_value)
+                opts.timeout = milliseconds(std::stoul(argv[++i]));
+            else if ("--interface" == name && has_value)
+                opts.interface = argv[++i];
+            else if ("--verbose" == name)
+                opts.verbose = true;
+            else if ("--profile" == name && has_value)
+                valid = socket_wrapper::parse_socket_profile(argv[++i], opts.profile);
+            else if (name.rfind("--", 0) == 0 || !opts.host.empty())
+                valid = false;
+            else
+                opts.host = name;
+        }
+        catch (const std::exception&)
+        {
+            valid = false;
+        }
+    }
+
+    if (!valid || opts.host.empty() || opts.max_hops == 0 || opts.max_hops > 255 || opts.interval == 0ms)
+    {
+        std::cout << "Usage: " << argv[0]
+                  << " --trace [--count <rounds>] [--max-hops <n>] [--interval <ms>] [--timeout <ms>]\n"
+                     "    [--interface <nic>] [--verbose] [--profile none|low-latency|high-throughput] <host-name>\n";
+        return EXIT_FAILURE;
+    }
+
+    socket_wrapper::SocketWrapper sock_wrap;
+    socket_wrapper::Logger        logger(STDERR_FILENO);
+    socket_wrapper::Resolver      resolver;
+    const auto                    resolved = resolver.resolve(opts.host, AF_INET).get();
+
+    if (opts.verbose) logger.set_level(socket_wrapper::LogLevel::debug);
+
+    if (resolved.error != 0 || resolved.addresses.empty())
+    {
+        logger.error("{}: {}", opts.host, gai_strerror(resolved.error));
         return EXIT_FAILURE;
     }
 
-    sockaddr_in addr = 
-    { .sin_family = static_cast<short unsigned>(dest_addr->h_addrtype),
-      // Automatic port number.
-      .sin_port = htons(0) };
+    sockaddr_in addr = *reinterpret_cast<const sockaddr_in*>(&resolved.addresses.front());
+    addr.sin_port    = 0;
+
+    socket_wrapper::Socket sock(AF_INET, SOCK_RAW, IPPROTO_ICMP);
+
+    if (!sock || sock.set_nonblocking() != 0)
+    {
+        logger.error("socket: {}", sock_wrap.get_last_error_string());
+        return EXIT_FAILURE;
+    }
 
-    addr.sin_addr.s_addr =
-        *reinterpret_cast<const in_addr_t*>(dest_addr->h_addr);
+    apply_profile(sock, opts.profile, logger);
+
+    if (!opts.interface.empty() &&
+        socket_wrapper::enable_hardware_timestamps(sock, opts.interface.c_str()) != 0)
+    {
+        logger.warning("No hardware timestamps on {}: {}", opts.interface, std::strerror(errno));
+    }
+    if (socket_wrapper::enable_timestamping(sock,
+                                            socket_wrapper::timestamp_rx | socket_wrapper::timestamp_tx |
+                                                socket_wrapper::timestamp_hardware) < 0)
+    {
+        logger.warning("No kernel timestamps, RTTs are measured in user space");
+    }
+
+    logger.info("Tracing \"{}\" [{}], {} hops max", opts.host, inet_ntoa(addr.sin_addr), opts.max_hops);
+
+    std::vector<TraceHop> hops(opts.max_hops);
+    Trace                 trace(sock, addr, hops, opts, logger);
+
+    running_trace = &trace;
+    std::signal(SIGINT, trace_stop_handler);
+    std::signal(SIGTERM, trace_stop_handler);
+
+    trace.run();
+
+    running_trace = nullptr;
+
+    // The live table, if any, is replaced by the final one.
+    if (isatty(STDOUT_FILENO)) std::cout << "\033[H\033[2J";
+    trace.print(std::cout);
+
+    const TraceHop& last = hops[trace.path_length() - 1];
+    const bool      reached =
+        std::find(last.addresses.begin(), last.addresses.end(), addr.sin_addr.s_addr) != last.addresses.end();
+
+    return reached ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+int main(int argc, const char* argv[])
+{
+    if (argc > 1 && std::string("--flood") == argv[1])
+    {
+        return flood_main(argc, argv);
+    }
+    if (argc > 1 && std::string("--trace") == argv[1])
+    {
+        return trace_main(argc, argv);
+    }
+    if (argc > 1 && std::string(argv[1]).rfind("--", 0) == 0)
+    {
+        return sweep_main(argc, argv);
+    }
+
+    socket_wrapper::SocketProfile profile = socket_wrapper::SocketProfile::none;
+
+    if (!(argc == 3 ||
+          (argc == 5 && std::string("--profile") == argv[3] && socket_wrapper::parse_socket_profile(argv[4], profile))))
+    {
+        std::cout << "Usage: " << argv[0]
+                  << " <number of pings> <host-name> [--profile none|low-latency|high-throughput]\n"
+                  << "       " << argv[0] << " --count <n> [sweep options] <host-name>...\n"
+                  << "       " << argv[0] << " --flood [flood options] <host-name>\n"
+                  << "       " << argv[0] << " --trace [trace options] <host-name>\n";
+        return EXIT_FAILURE;
+    }
+
+    socket_wrapper::SocketWrapper sock_wrap;
+    socket_wrapper::Logger        logger;
+    socket_wrapper::Resolver      resolver;
+    std::string                   hostname  = { argv[2] };
+    const auto                    dest_addr = resolver.resolve(hostname, AF_INET).get();
+
+    if (dest_addr.error != 0 || dest_addr.addresses.empty())
+    {
+        logger.error("DEST_ADDR: {}", gai_strerror(dest_addr.error));
+
+        return EXIT_FAILURE;
+    }
+
+    socket_wrapper::Socket sock(AF_INET, SOCK_RAW, IPPROTO_ICMP);
+
+    if (!sock)
+    {
+        logger.error("socket: {}", sock_wrap.get_last_error_string());
+        return EXIT_FAILURE;
+    }
+
+    sockaddr_in addr = *reinterpret_cast<const sockaddr_in*>(&dest_addr.addresses.front());
+    // Automatic port number.
+    addr.sin_port = htons(0);
 
     sockaddr_in recv_addr;
 
-    std::cout << "Pinging \"" << dest_addr->h_name << "\" ["
-              << inet_ntoa(addr.sin_addr) << "]" << std::endl;
+    logger.info("Pinging \"{}\" [{}]", dest_addr.name, inet_ntoa(addr.sin_addr));
 
-    int ttl = 255;
-    if (setsockopt(sock,
-                   IPPROTO_IP,
-                   IP_TTL,
-                   reinterpret_cast<const char*>(&ttl),
-                   sizeof(ttl)) != 0)
+    const int ttl = 255;
+    if (socket_wrapper::set_option<socket_wrapper::option::TimeToLive>(sock, ttl) != 0)
     {
         throw std::runtime_error("TTL setting failed!");
     }
 
-    auto tv = duration_cast<milliseconds>(recv_timeout).count();
-    if (setsockopt(sock,
-                   SOL_SOCKET,
-                   SO_RCVTIMEO,
-                   reinterpret_cast<const char*>(&tv),
-                   sizeof(tv)) != 0)
+    if (socket_wrapper::set_option<socket_wrapper::option::ReceiveTimeout>(sock, recv_timeout) != 0)
     {
         throw std::runtime_error("Recv timeout setting failed!");
     }
 
-    std::cout << "TTL = " << ttl << std::endl;
-    std::cout << "Recv timeout seconds = " << tv << " ms\n\n";
+    apply_profile(sock, profile, logger);
 
-    int      pings      = 1;
-    uint16_t sequence_n = 0;
+    if (socket_wrapper::enable_timestamping(sock,
+                                            socket_wrapper::timestamp_rx | socket_wrapper::timestamp_tx |
+                                                socket_wrapper::timestamp_hardware) < 0)
+    {
+        logger.warning("No kernel timestamps, RTTs are measured in user space");
+    }
+
+    logger.info("TTL = {}", ttl);
+    logger.info("Recv timeout = {} ms", duration_cast<milliseconds>(recv_timeout).count());
+
+    const int      pings = std::stoi(argv[1]);
+    const uint16_t id    = htons(getpid());
+    RttStats       stats;
+    int64_t        previous_rtt_ns = -1;
 
-    char* icmp_data = reinterpret_cast<char*>(
-        HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, MAX_PACKET_SIZE));
-    char* recvbuf = reinterpret_cast<char*>(
-        HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, MAX_PACKET_SIZE));
+    std::vector<char> recv_buffer(MAX_PACKET_SIZE, 0);
 
-    memset(icmp_data, 0, MAX_PACKET_SIZE);
+    char* recvbuf = recv_buffer.data();
 
-    while (pings != std::stoi(argv[1]))
+    for (int ping = 1; ping <= pings; ++ping)
     {
-        sequence_n++;
-        CreatePacket(icmp_data, ping_packet_size, sequence_n);
+        const uint16_t sequence_n = static_cast<uint16_t>(ping);
 
-        icmphdr* hdr = (icmphdr*)icmp_data;
+        if (ping > 1) std::this_thread::sleep_for(ping_sleep_rate);
 
-        std::cout << "Sending packet " << ntohs(hdr->un.echo.sequence) << " to "
-                  << dest_addr->h_name
-                  << " request with id = " << ntohs(hdr->un.echo.id)
-                  << std::endl;
+        const icmphdr request = CreateEchoRequest(id, htons(sequence_n));
 
-        if (sendto(sock,
-                   icmp_data,
-                   sizeof(icmp_data),
-                   0,
-                   reinterpret_cast<const struct sockaddr*>(&addr),
-                   sizeof(addr)) < sizeof(icmp_data))
+        logger.info("Sending packet {} to {} request with id = {}", sequence_n, dest_addr.name, ntohs(id));
+
+        ProbeTimes sent;
+        sent.user_ns = RealtimeNs();
+
+        if (SendEchoRequest(sock, request, addr) < static_cast<ssize_t>(ping_packet_size))
         {
-            std::cerr << "Packet was not sent!\n";
+            logger.error("Packet was not sent!");
             continue;
         }
 
-        socklen_t addr_len   = sizeof(sockaddr);
-        recv_addr.sin_family = AF_INET;
-        recv_addr.sin_addr   = addr.sin_addr;
+        auto read_sent_time = [&] {
+            ReadTxTimestamps(sock, id, [&](in_addr_t, uint16_t sequence, const auto& ts) {
+                if (sequence == sequence_n) SetTxTimes(sent, ts);
+            });
+        };
+        read_sent_time();
 
-        auto start_time = std::chrono::steady_clock::now();
+        const auto deadline = steady_clock::now() + recv_timeout;
+        bool       replied  = false;
 
-        if (recvfrom(sock,
-                     recvbuf,
-                     sizeof(recvbuf),
-                     0,
-                     reinterpret_cast<sockaddr*>(&recv_addr),
-                     &addr_len) < sizeof(recvbuf))
+        // Our own request and unrelated ICMP traffic arrive here too.
+        while (!replied && steady_clock::now() < deadline)
         {
-            std::cerr << "Packet was not received!\n";
-            continue;
+            socket_wrapper::PacketTimestamp rx;
+            socklen_t                       addr_len = sizeof(recv_addr);
+
+            ssize_t len = socket_wrapper::recv_timestamped(sock,
+                                                           recvbuf,
+                                                           MAX_PACKET_SIZE,
+                                                           0,
+                                                           reinterpret_cast<sockaddr*>(&recv_addr),
+                                                           &addr_len,
+                                                           rx);
+            if (len < 0) break;
+
+            const icmphdr* reply = FindEchoReply(recvbuf, len, id);
+            if (reply == nullptr || ntohs(reply->un.echo.sequence) != sequence_n ||
+                recv_addr.sin_addr.s_addr != addr.sin_addr.s_addr)
+                continue;
+
+            if (sent.software_ns == 0) read_sent_time();
+
+            StampSource   source;
+            const int64_t rtt_ns = RoundTripNs(sent, rx, source);
+
+            stats.record(rtt_ns, previous_rtt_ns, source);
+            previous_rtt_ns = rtt_ns;
+            replied         = true;
+
+            logger.info("Reply from {}: ICMP sequence = {}, {} bytes, time = {} us ({})",
+                        inet_ntoa(recv_addr.sin_addr),
+                        sequence_n,
+                        len,
+                        std::round(rtt_ns) / 1000,
+                        stamp_source_names[static_cast<size_t>(source)]);
         }
 
-        DecodePacket(recvbuf, start_time, &recv_addr);
-        ++pings;
+        if (!replied) logger.error("Packet {} was not received!", sequence_n);
     }
 
-    HeapFree(GetProcessHeap(), 0, recvbuf);
-    HeapFree(GetProcessHeap(), 0, icmp_data);
+    const size_t received = stats.histogram.count();
+    logger.info("{} packets transmitted, {} received, {}% packet loss",
+                pings,
+                received,
+                (pings - received) * 100 / std::max(pings, 1));
+    stats.report(logger);
 
-    return EXIT_SUCCESS;
-}
\ No newline at end of file
+    return received > 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
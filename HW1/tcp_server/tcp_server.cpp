@@ -0,0 +1,605 @@
+#include <cerrno>
+#include <csignal>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+
+#include <socket_wrapper/event_loop.h>
+#include <socket_wrapper/io_uring.h>
+#include <socket_wrapper/logger.h>
+#include <socket_wrapper/socket_headers.h>
+#include <socket_wrapper/socket_options.h>
+#include <socket_wrapper/socket_wrapper.h>
+#include <socket_wrapper/tcp.h>
+
+enum class Backend
+{
+    epoll,
+    uring, // echo only
+};
+
+enum class FileMethod
+{
+    sendfile,
+    splice,
+};
+
+struct Options
+{
+    int        port    = 0;
+    bool       nodelay = true;
+    // Every client gets this file instead of an echo, empty for echo.
+    std::string file;
+    FileMethod  file_method = FileMethod::sendfile;
+    Backend     backend     = Backend::epoll;
+
+    socket_wrapper::SocketProfile profile = socket_wrapper::SocketProfile::none;
+
+    socket_wrapper::LogLevel log_level = socket_wrapper::LogLevel::info;
+};
+
+// Echo output queued for a client before the server stops reading from it.
+constexpr size_t max_pending = 4 << 20;
+
+struct Client
+{
+    socket_wrapper::TcpConnection conn;
+    std::string                   name;
+    off_t                         file_offset = 0;
+    bool                          file_done   = false;
+};
+
+struct Totals
+{
+    uint64_t connections = 0;
+    uint64_t bytes_in    = 0;
+    uint64_t bytes_out   = 0;
+};
+
+static socket_wrapper::EventLoop* running_loop = nullptr;
+
+static void stop_handler(int)
+{
+    if (running_loop) running_loop->stop();
+}
+
+static void usage(const char* program)
+{
+    std::cout << "Usage: " << program << " <port> [--nodelay on|off] [--file <path>] [--method sendfile|splice]\n"
+              << "    [--backend epoll|uring] [--profile none|low-latency|high-throughput]\n"
+              << "    [--log-level debug|info|warning|error|off]" << std::endl;
+}
+
+static bool parse_options(int argc, char const* argv[], Options& opts)
+{
+    if (argc < 2 || argc % 2 != 0) return false;
+
+    opts.port = std::stoi(argv[1]);
+
+    for (int i = 2; i + 1 < argc; i += 2)
+    {
+        const std::string name  = argv[i];
+        const std::string value = argv[i + 1];
+
+        if ("--nodelay" == name && ("on" == value || "off" == value))
+            opts.nodelay = "on" == value;
+        else if ("--file" == name)
+            opts.file = value;
+        else if ("--method" == name && "sendfile" == value)
+            opts.file_method = FileMethod::sendfile;
+        else if ("--method" == name && "splice" == value)
+            opts.file_method = FileMethod::splice;
+        else if ("--backend" == name && "epoll" == value)
+            opts.backend = Backend::epoll;
+        else if ("--backend" == name && "uring" == value)
+            opts.backend = Backend::uring;
+        else if ("--profile" == name)
+        {
+            if (!socket_wrapper::parse_socket_profile(value, opts.profile)) return false;
+        }
+        else if ("--log-level" == name)
+        {
+            if (!socket_wrapper::parse_log_level(value, opts.log_level)) return false;
+        }
+        else
+            return false;
+    }
+
+    // The io_uring path has no file transmission.
+    return opts.backend == Backend::epoll || opts.file.empty();
+}
+
+static std::string peer_name(const sockaddr* peer, socklen_t peer_len)
+{
+    char host[INET6_ADDRSTRLEN] = "?";
+    char port[8]                = "?";
+
+    getnameinfo(peer, peer_len, host, sizeof(host), port, sizeof(port), NI_NUMERICHOST | NI_NUMERICSERV);
+
+    return std::string(host) + ":" + port;
+}
+
+// Echo on io_uring: a multishot accept on the listener, a multishot recv per
+// connection into the shared provided buffers, and one send in flight per
+// connection straight from the buffers received, in order. A buffer goes back
+// to the kernel once all of it was sent.
+static bool serve_uring(const socket_wrapper::TcpListener& listener,
+                        const Options&                     opts,
+                        socket_wrapper::EventLoop&         loop,
+                        socket_wrapper::Logger&            logger,
+                        Totals&                            totals)
+{
+    using socket_wrapper::BufferRing;
+
+    struct Received
+    {
+        uint16_t id;
+        size_t   length;
+    };
+
+    struct UringClient
+    {
+        socket_wrapper::TcpConnection conn;
+        std::string                   name;
+        std::deque<Received>          received;
+        size_t                        sent      = 0; // of received.front()
+        bool                          receiving = false;
+        bool                          sending   = false;
+        bool                          eof       = false;
+        bool                          closing   = false;
+    };
+
+    socket_wrapper::SocketWrapper sock_wrap;
+    socket_wrapper::IoUring       ring(1024);
+
+    if (!ring.opened())
+    {
+        logger.error("io_uring_setup: {}", sock_wrap.get_last_error_string());
+        return false;
+    }
+
+    const uint16_t group = 0;
+    BufferRing     buffers(ring, group, 512, 16 * 1024);
+
+    if (!buffers.opened())
+    {
+        logger.error("Provided buffers: {}", sock_wrap.get_last_error_string());
+        return false;
+    }
+
+    // user_data: the operation in the upper half, the descriptor below.
+    const uint64_t accept_op = 1ull << 32;
+    const uint64_t recv_op   = 2ull << 32;
+    const uint64_t send_op   = 3ull << 32;
+
+    std::unordered_map<SocketDescriptorType, std::unique_ptr<UringClient>> clients;
+    // Connections whose receive stopped for lack of buffers.
+    std::vector<SocketDescriptorType> starved;
+
+    auto get_sqe = [&] {
+        io_uring_sqe* sqe = ring.get_sqe();
+        // Full: hand the queued entries to the kernel to make room.
+        while (!sqe && ring.submit() >= 0) sqe = ring.get_sqe();
+        return sqe;
+    };
+
+    auto arm_accept = [&] {
+        io_uring_sqe* sqe = get_sqe();
+        if (!sqe) return false;
+
+        socket_wrapper::prep_accept_multishot(sqe, listener);
+        sqe->user_data = accept_op;
+        return true;
+    };
+
+    auto arm_recv = [&](UringClient& client) {
+        io_uring_sqe* sqe = get_sqe();
+        if (!sqe) return;
+
+        const SocketDescriptorType fd = client.conn;
+
+        socket_wrapper::prep_recv_multishot(sqe, fd, group);
+        sqe->user_data   = recv_op | static_cast<uint32_t>(fd);
+        client.receiving = true;
+    };
+
+    auto send_next = [&](UringClient& client) {
+        io_uring_sqe* sqe = get_sqe();
+        if (!sqe) return;
+
+        const SocketDescriptorType fd   = client.conn;
+        const auto&                next = client.received.front();
+
+        socket_wrapper::prep_send(sqe, fd, buffers.data(next.id) + client.sent, next.length - client.sent);
+        sqe->user_data = send_op | static_cast<uint32_t>(fd);
+        client.sending = true;
+    };
+
+    // Shutting the socket down ends the pending operations; the client goes
+    // once none is left.
+    auto close_client = [&](UringClient& client) {
+        const SocketDescriptorType fd = client.conn;
+
+        if (!client.closing)
+        {
+            client.closing = true;
+            shutdown(fd, SHUT_RDWR);
+        }
+        if (client.receiving || client.sending) return;
+
+        for (const auto& r : client.received) buffers.recycle(r.id);
+        logger.debug("Client {} disconnected", client.name);
+        clients.erase(fd);
+    };
+
+    auto on_accept = [&](const io_uring_cqe& cqe) {
+        if (!(cqe.flags & IORING_CQE_F_MORE) && !loop.stopped()) arm_accept();
+
+        if (cqe.res < 0)
+        {
+            logger.error("accept: {}", std::strerror(-cqe.res));
+            return;
+        }
+
+        auto  client = std::make_unique<UringClient>();
+        auto& c      = *client;
+        c.conn       = socket_wrapper::TcpConnection(cqe.res);
+
+        sockaddr_storage peer;
+        socklen_t        peer_len = sizeof(peer);
+        if (getpeername(c.conn, reinterpret_cast<sockaddr*>(&peer), &peer_len) == 0)
+        {
+            c.name = peer_name(reinterpret_cast<const sockaddr*>(&peer), peer_len);
+        }
+        if (opts.nodelay) c.conn.set_nodelay(true);
+
+        ++totals.connections;
+        logger.debug("Client {} connected", c.name);
+
+        clients.emplace(cqe.res, std::move(client));
+        arm_recv(c);
+    };
+
+    auto on_recv = [&](UringClient& client, const io_uring_cqe& cqe) {
+        if (!(cqe.flags & IORING_CQE_F_MORE)) client.receiving = false;
+
+        if (cqe.res > 0)
+        {
+            totals.bytes_in += cqe.res;
+            client.received.push_back({ BufferRing::buffer_id(cqe), static_cast<size_t>(cqe.res) });
+            if (!client.sending && !client.closing) send_next(client);
+        }
+        else if (cqe.res == 0)
+        {
+            client.eof = true;
+        }
+        else if (cqe.res == -ENOBUFS)
+        {
+            // Armed again once buffers came back.
+            starved.push_back(client.conn);
+        }
+        else if (!client.closing)
+        {
+            logger.warning("recv from {}: {}", client.name, std::strerror(-cqe.res));
+            close_client(client);
+            return;
+        }
+
+        // Everything received was sent: the peer sees EOF in turn.
+        if ((client.eof || client.closing) && !client.sending) close_client(client);
+    };
+
+    auto on_send = [&](UringClient& client, const io_uring_cqe& cqe) {
+        client.sending = false;
+
+        if (cqe.res < 0)
+        {
+            if (!client.closing) logger.warning("send to {}: {}", client.name, std::strerror(-cqe.res));
+            close_client(client);
+            return;
+        }
+
+        totals.bytes_out += cqe.res;
+        client.sent += cqe.res;
+
+        // A short send goes on from where it stopped.
+        if (client.sent == client.received.front().length)
+        {
+            buffers.recycle(client.received.front().id);
+            client.received.pop_front();
+            client.sent = 0;
+        }
+
+        if (client.closing)
+            close_client(client);
+        else if (!client.received.empty())
+            send_next(client);
+        else if (client.eof)
+            close_client(client);
+    };
+
+    auto on_completion = [&](const io_uring_cqe& cqe) {
+        if (cqe.user_data == BufferRing::user_data)
+        {
+            logger.error("IORING_OP_PROVIDE_BUFFERS: {}", std::strerror(-cqe.res));
+            return;
+        }
+
+        const uint64_t op = cqe.user_data & ~0xffffffffull;
+        if (op == accept_op)
+        {
+            on_accept(cqe);
+            return;
+        }
+
+        const auto it = clients.find(static_cast<SocketDescriptorType>(cqe.user_data & 0xffffffff));
+        if (it == clients.end()) return;
+
+        if (op == recv_op)
+            on_recv(*it->second, cqe);
+        else
+            on_send(*it->second, cqe);
+    };
+
+    if (!arm_accept()) return false;
+
+    while (!loop.stopped())
+    {
+        if (ring.submit(1, std::chrono::milliseconds(100)) < 0 && errno != EBUSY)
+        {
+            logger.error("io_uring_enter: {}", sock_wrap.get_last_error_string());
+            return false;
+        }
+
+        ring.for_each_completion(on_completion);
+        buffers.commit();
+
+        for (const auto fd : starved)
+        {
+            const auto it = clients.find(fd);
+            if (it != clients.end() && !it->second->receiving && !it->second->closing) arm_recv(*it->second);
+        }
+        starved.clear();
+    }
+
+    return true;
+}
+
+int main(int argc, char const* argv[])
+{
+    Options opts;
+
+    if (!parse_options(argc, argv, opts))
+    {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    socket_wrapper::SocketWrapper sock_wrap;
+    socket_wrapper::Logger        logger;
+    socket_wrapper::EventLoop     loop;
+    Totals                        totals;
+
+    logger.set_level(opts.log_level);
+
+    int   file_fd   = -1;
+    off_t file_size = 0;
+
+    if (!opts.file.empty())
+    {
+        struct stat st;
+
+        file_fd = open(opts.file.c_str(), O_RDONLY | O_CLOEXEC);
+        if (file_fd < 0 || fstat(file_fd, &st) != 0)
+        {
+            logger.error("{}: {}", opts.file, sock_wrap.get_last_error_string());
+            return EXIT_FAILURE;
+        }
+        file_size = st.st_size;
+    }
+
+    logger.info("Starting TCP {} server on the port {}{}...",
+                file_fd < 0 ? "echo" : "file",
+                opts.port,
+                opts.backend == Backend::uring ? " with io_uring" : "");
+
+    sockaddr_in addr = {
+        .sin_family = PF_INET,
+        .sin_port   = htons(opts.port),
+    };
+
+    addr.sin_addr.s_addr = INADDR_ANY;
+
+    socket_wrapper::TcpListener listener(reinterpret_cast<const sockaddr*>(&addr), sizeof(addr));
+
+    if (!listener.listening())
+    {
+        logger.error("listen: {}", sock_wrap.get_last_error_string());
+        return EXIT_FAILURE;
+    }
+
+    // Accepted connections inherit the options of the listener.
+    socket_wrapper::apply_socket_profile(listener, opts.profile, [&](const char* option, int error) {
+        logger.warning("{} ({} profile): {}",
+                       option,
+                       socket_wrapper::socket_profile_name(opts.profile),
+                       std::strerror(error));
+    });
+
+    running_loop = &loop;
+    std::signal(SIGINT, stop_handler);
+    std::signal(SIGTERM, stop_handler);
+    std::signal(SIGPIPE, SIG_IGN);
+
+    if (opts.backend == Backend::uring)
+    {
+        logger.info("Running TCP server...");
+
+        const bool served = serve_uring(listener, opts, loop, logger, totals);
+
+        logger.info("{} connections, {} bytes received, {} bytes sent",
+                    totals.connections,
+                    totals.bytes_in,
+                    totals.bytes_out);
+
+        return served ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    std::unordered_map<SocketDescriptorType, std::unique_ptr<Client>> clients;
+
+    auto close_client = [&](Client& client) {
+        const SocketDescriptorType fd = client.conn;
+
+        logger.debug("Client {} disconnected", client.name);
+        loop.remove(fd);
+        // Destroys `client` and closes the socket.
+        clients.erase(fd);
+    };
+
+    // Sends the next part of the file, false on a hard error.
+    auto send_file = [&](Client& client) {
+        while (!client.file_done)
+        {
+            const size_t  left = file_size - client.file_offset;
+            const ssize_t sent = opts.file_method == FileMethod::splice
+                                     ? client.conn.splice_file(file_fd, client.file_offset, left)
+                                     : client.conn.send_file(file_fd, client.file_offset, left);
+            if (sent < 0) return errno == EAGAIN || errno == EWOULDBLOCK;
+
+            totals.bytes_out += sent;
+            if (client.file_offset >= file_size)
+            {
+                // The peer sees EOF after the last byte.
+                client.file_done = true;
+                shutdown(client.conn, SHUT_WR);
+            }
+            else if (sent == 0)
+            {
+                return true;
+            }
+        }
+
+        return true;
+    };
+
+    auto on_client = [&](Client& client, uint32_t events) {
+        if (events & socket_wrapper::EventLoop::error)
+        {
+            // EPOLLHUP alone is a regular close by the peer.
+            const int error = client.conn.connect_error();
+            if (error != 0) logger.warning("Client {}: {}", client.name, std::strerror(error));
+            close_client(client);
+            return;
+        }
+
+        // Backpressure: past the high-water mark a client's data is left in
+        // the kernel, where it closes the TCP window. The writable edge that
+        // drains the output reads it, so `readable` is not required.
+        if (client.conn.pending() >= max_pending && client.conn.flush() < 0)
+        {
+            logger.warning("send to {}: {}", client.name, sock_wrap.get_last_error_string());
+            close_client(client);
+            return;
+        }
+
+        if (client.conn.pending() < max_pending)
+        {
+            const ssize_t received = client.conn.receive();
+            if (received < 0)
+            {
+                logger.warning("recv from {}: {}", client.name, sock_wrap.get_last_error_string());
+                close_client(client);
+                return;
+            }
+            totals.bytes_in += received;
+
+            const auto input = client.conn.input();
+            if (file_fd < 0)
+            {
+                // Echo: queued if the socket does not take it all.
+                if (client.conn.write(input) != 0)
+                {
+                    logger.warning("send to {}: {}", client.name, sock_wrap.get_last_error_string());
+                    close_client(client);
+                    return;
+                }
+                totals.bytes_out += input.size();
+            }
+            client.conn.consume(input.size());
+        }
+
+        if (client.conn.flush() < 0 || (file_fd >= 0 && !send_file(client)))
+        {
+            logger.warning("send to {}: {}", client.name, sock_wrap.get_last_error_string());
+            close_client(client);
+            return;
+        }
+
+        if (client.conn.eof() && client.conn.pending() == 0) close_client(client);
+    };
+
+    auto on_accept = [&](uint32_t) {
+        for (;;)
+        {
+            sockaddr_storage peer;
+            socklen_t        peer_len = sizeof(peer);
+            auto             conn     = listener.accept(&peer, &peer_len);
+
+            if (!conn)
+            {
+                if (errno != EAGAIN && errno != EWOULDBLOCK)
+                {
+                    logger.error("accept4: {}", sock_wrap.get_last_error_string());
+                }
+                break;
+            }
+
+            if (opts.nodelay) conn.set_nodelay(true);
+
+            auto client = std::make_unique<Client>(
+                Client{ std::move(conn), peer_name(reinterpret_cast<const sockaddr*>(&peer), peer_len) });
+            auto&                      c  = *client;
+            const SocketDescriptorType fd = c.conn;
+
+            ++totals.connections;
+            logger.debug("Client {} connected", c.name);
+
+            clients.emplace(fd, std::move(client));
+            if (loop.add(fd,
+                         socket_wrapper::EventLoop::readable | socket_wrapper::EventLoop::writable,
+                         [&on_client, &c](uint32_t events) { on_client(c, events); }) != 0)
+            {
+                logger.error("Event loop registration failed: {}", sock_wrap.get_last_error_string());
+                clients.erase(fd);
+            }
+        }
+    };
+
+    if (loop.add(listener, socket_wrapper::EventLoop::readable, on_accept) != 0)
+    {
+        logger.error("Event loop registration failed: {}", sock_wrap.get_last_error_string());
+        return EXIT_FAILURE;
+    }
+
+    logger.info("Running TCP server...");
+
+    loop.run();
+
+    logger.info("{} connections, {} bytes received, {} bytes sent",
+                totals.connections,
+                totals.bytes_in,
+                totals.bytes_out);
+
+    if (file_fd >= 0) close(file_fd);
+
+    return EXIT_SUCCESS;
+}
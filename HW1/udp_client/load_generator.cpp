@@ -0,0 +1,338 @@
+#include "load_generator.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <poll.h>
+
+#include <socket_wrapper/datagram_batch.h>
+#include <socket_wrapper/histogram.h>
+#include <socket_wrapper/socket_class.h>
+
+using Clock = std::chrono::steady_clock;
+
+namespace
+{
+
+const uint32_t load_magic = 0x4c4f4144; // "LOAD"
+
+#pragma pack(push, 1)
+// Leads every payload, the echo server sends it back untouched.
+struct LoadHeader
+{
+    uint32_t magic;
+    uint32_t thread;
+    uint64_t sequence;
+    int64_t  intended_ns; // scheduled send time
+    int64_t  sent_ns;     // actual send time
+};
+#pragma pack(pop)
+
+struct WorkerResult
+{
+    uint64_t sent        = 0;
+    uint64_t received    = 0;
+    uint64_t duplicates  = 0;
+    uint64_t send_errors = 0;
+    // From the intended send time (corrected) and from the actual one.
+    socket_wrapper::Histogram response;
+    socket_wrapper::Histogram service;
+};
+
+
+int64_t to_ns(Clock::time_point t)
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(t.time_since_epoch()).count();
+}
+
+
+void run_worker(size_t                  index,
+                const sockaddr_in&      server,
+                const LoadOptions&      opts,
+                Clock::time_point       start,
+                Clock::time_point       end,
+                socket_wrapper::Logger& logger,
+                WorkerResult&           result)
+{
+    // Sockets are spread over the threads, at least one each.
+    const size_t socket_count =
+        std::max<size_t>(opts.sockets / opts.threads + (index < opts.sockets % opts.threads), 1);
+
+    std::vector<socket_wrapper::Socket> sockets;
+    std::vector<pollfd>                 pollfds;
+
+    for (size_t i = 0; i < socket_count; ++i)
+    {
+        socket_wrapper::Socket sock(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+
+        // Connected: the kernel filters out foreign datagrams.
+        if (!sock || connect(sock, reinterpret_cast<const sockaddr*>(&server), sizeof(server)) != 0 ||
+            sock.set_nonblocking() != 0)
+        {
+            logger.error("Load socket setup failed: {}", std::strerror(errno));
+            return;
+        }
+        socket_wrapper::set_option<socket_wrapper::option::ReceiveBuffer>(sock, 4 << 20);
+        // Failures were reported for the first socket already.
+        socket_wrapper::apply_socket_profile(sock, opts.profile, [&](const char* option, int error) {
+            if (index == 0 && i == 0)
+            {
+                logger.warning("{} ({} profile): {}",
+                               option,
+                               socket_wrapper::socket_profile_name(opts.profile),
+                               std::strerror(error));
+            }
+        });
+
+        pollfds.push_back(pollfd{ sock, POLLIN, 0 });
+        sockets.push_back(std::move(sock));
+    }
+
+    const size_t                  burst = 64;
+    socket_wrapper::DatagramBatch tx(burst, opts.payload_size);
+    socket_wrapper::DatagramBatch rx(burst, std::max<size_t>(opts.payload_size, 2048));
+
+    for (size_t i = 0; i < burst; ++i)
+    {
+        std::memset(tx.data(i), 'x', opts.payload_size);
+        tx.set_length(i, opts.payload_size);
+        tx.set_address(i, reinterpret_cast<const sockaddr*>(&server), sizeof(server));
+    }
+
+    const double                     thread_rate = opts.rate / opts.threads;
+    std::mt19937_64                  random(index + 1);
+    std::exponential_distribution<> gap(thread_rate);
+    auto next_gap = [&] {
+        return std::chrono::duration<double>(opts.poisson ? gap(random) : 1 / thread_rate);
+    };
+
+    // Threads start staggered, so constant rate streams do not send in lockstep.
+    auto next_send = start + std::chrono::duration_cast<Clock::duration>(next_gap() * (index + 1.0) /
+                                                                          opts.threads);
+    std::vector<uint8_t> replied;
+    size_t               next_socket = 0;
+
+    auto receive_all = [&] {
+        bool any = false;
+
+        for (auto& sock : sockets)
+        {
+            int n;
+            while ((n = rx.receive(sock)) > 0)
+            {
+                const int64_t now = to_ns(Clock::now());
+                any               = true;
+
+                // A GRO slot (high-throughput profile) holds several replies.
+                for (int i = 0; i < n; ++i)
+                {
+                    for (size_t k = 0; k < rx.segment_count(i); ++k)
+                    {
+                        const auto reply = rx.segment(i, k);
+
+                        LoadHeader header;
+                        if (reply.size() < sizeof(header)) continue;
+
+                        std::memcpy(&header, reply.data(), sizeof(header));
+                        if (header.magic != load_magic || header.thread != index ||
+                            header.sequence >= replied.size())
+                            continue;
+
+                        if (replied[header.sequence])
+                        {
+                            ++result.duplicates;
+                            continue;
+                        }
+
+                        replied[header.sequence] = 1;
+                        ++result.received;
+                        result.response.record(std::max<int64_t>(now - header.intended_ns, 0));
+                        result.service.record(std::max<int64_t>(now - header.sent_ns, 0));
+                    }
+                }
+            }
+        }
+
+        return any;
+    };
+
+    auto wait = [&](Clock::duration timeout) {
+        const auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                            std::max(timeout, Clock::duration::zero()))
+                            .count();
+        timespec ts = { static_cast<time_t>(ns / 1000000000), static_cast<long>(ns % 1000000000) };
+
+        ppoll(pollfds.data(), pollfds.size(), &ts, nullptr);
+    };
+
+    while (next_send < end)
+    {
+        const auto now = Clock::now();
+        size_t     due = 0;
+
+        // A sender that fell behind catches up with one sendmmsg().
+        while (next_send <= now && next_send < end && due < burst)
+        {
+            LoadHeader header = { load_magic,
+                                  static_cast<uint32_t>(index),
+                                  replied.size(),
+                                  to_ns(next_send),
+                                  to_ns(now) };
+
+            std::memcpy(tx.data(due++), &header, sizeof(header));
+            replied.push_back(0);
+            next_send += std::chrono::duration_cast<Clock::duration>(next_gap());
+        }
+
+        if (due > 0)
+        {
+            int sent = tx.send(sockets[next_socket], due);
+            next_socket = (next_socket + 1) % sockets.size();
+
+            // sendmmsg() stops at the first datagram it refuses: the rest
+            // never left, their sequence numbers go to the next ones.
+            const size_t accepted = static_cast<size_t>(std::max(sent, 0));
+
+            result.sent += accepted;
+            result.send_errors += due - accepted;
+            replied.resize(replied.size() - (due - accepted));
+        }
+
+        if (!receive_all() && due == 0) wait(next_send - Clock::now());
+    }
+
+    const auto deadline = Clock::now() + opts.timeout;
+
+    while (result.received < result.sent && Clock::now() < deadline)
+    {
+        if (!receive_all()) wait(std::min<Clock::duration>(deadline - Clock::now(), std::chrono::milliseconds(10)));
+    }
+}
+
+
+void print_percentiles(const char* title, const socket_wrapper::Histogram& h)
+{
+    auto us = [](uint64_t ns) { return ns / 1000.0; };
+
+    std::cout << title << std::fixed << std::setprecision(1) << "p50 " << us(h.percentile(50))
+              << ", p90 " << us(h.percentile(90)) << ", p99 " << us(h.percentile(99))
+              << ", p99.9 " << us(h.percentile(99.9)) << ", p99.99 " << us(h.percentile(99.99))
+              << ", max " << us(h.max()) << " us\n";
+}
+
+}
+
+
+bool parse_load_options(int argc, char const* argv[], int first, LoadOptions& opts)
+{
+    for (int i = first; i < argc; ++i)
+    {
+        const std::string name      = argv[i];
+        const bool        has_value = i + 1 < argc;
+
+        try
+        {
+            if ("--load" == name)
+                continue;
+            else if ("--poisson" == name)
+                opts.poisson = true;
+            else if ("--rate" == name && has_value)
+                opts.rate = std::stod(argv[++i]);
+            else if ("--duration" == name && has_value)
+                opts.duration = std::stod(argv[++i]);
+            else if ("--size" == name && has_value)
+                opts.payload_size = std::stoul(argv[++i]);
+            else if ("--sockets" == name && has_value)
+                opts.sockets = std::stoul(argv[++i]);
+            else if ("--threads" == name && has_value)
+                opts.threads = std::stoul(argv[++i]);
+            else if ("--timeout" == name && has_value)
+                opts.timeout = std::chrono::milliseconds(std::stoul(argv[++i]));
+            else if ("--profile" == name && has_value)
+            {
+                if (!socket_wrapper::parse_socket_profile(argv[++i], opts.profile)) return false;
+            }
+            else
+                return false;
+        }
+        catch (const std::exception&)
+        {
+            return false;
+        }
+    }
+
+    return opts.rate > 0 && opts.duration > 0 && opts.threads > 0 && opts.sockets > 0 &&
+           opts.payload_size >= sizeof(LoadHeader) && opts.payload_size <= 65507;
+}
+
+
+int run_load(const sockaddr_in& server, const LoadOptions& opts, socket_wrapper::Logger& logger)
+{
+    std::cout << "Target " << opts.rate << " datagrams/s (" << (opts.poisson ? "Poisson" : "constant")
+              << ") for " << opts.duration << " s, " << opts.payload_size << " B payload, "
+              << std::max(opts.sockets, opts.threads) << " socket(s) on " << opts.threads
+              << " thread(s)" << std::endl;
+
+    // Workers set up their sockets before the schedule starts.
+    const auto start = Clock::now() + std::chrono::milliseconds(100);
+    const auto end   = start + std::chrono::duration_cast<Clock::duration>(
+                                 std::chrono::duration<double>(opts.duration));
+
+    std::vector<WorkerResult> results(opts.threads);
+    std::vector<std::thread>  workers;
+
+    for (size_t i = 0; i < opts.threads; ++i)
+    {
+        workers.emplace_back(run_worker,
+                             i,
+                             std::cref(server),
+                             std::cref(opts),
+                             start,
+                             end,
+                             std::ref(logger),
+                             std::ref(results[i]));
+    }
+    for (auto& worker : workers) worker.join();
+
+    WorkerResult total;
+    for (const auto& r : results)
+    {
+        total.sent += r.sent;
+        total.received += r.received;
+        total.duplicates += r.duplicates;
+        total.send_errors += r.send_errors;
+        total.response.merge(r.response);
+        total.service.merge(r.service);
+    }
+
+    const uint64_t lost = total.sent - total.received;
+
+    std::cout << std::fixed << std::setprecision(0) << "Sent " << total.sent << " ("
+              << total.sent / opts.duration << "/s), received " << total.received << " ("
+              << total.received / opts.duration << "/s, " << std::setprecision(2)
+              << total.received * opts.payload_size * 8 / opts.duration / 1e6 << " Mbit/s)\n"
+              << "Lost " << lost << " (" << std::setprecision(3)
+              << (total.sent ? 100.0 * lost / total.sent : 0) << "%), duplicates "
+              << total.duplicates << '\n';
+
+    // Refused by the kernel, so neither sent nor lost.
+    if (total.send_errors > 0) std::cout << "Send errors " << total.send_errors << '\n';
+
+    if (total.received > 0)
+    {
+        print_percentiles("Latency from intended send (CO corrected): ", total.response);
+        print_percentiles("Service time from actual send:             ", total.service);
+    }
+
+    return total.received > 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
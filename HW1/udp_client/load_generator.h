@@ -0,0 +1,34 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+
+#include <socket_wrapper/logger.h>
+#include <socket_wrapper/socket_headers.h>
+#include <socket_wrapper/socket_options.h>
+
+
+// Open-loop load: datagrams leave on a schedule fixed in advance (constant
+// rate or Poisson arrivals), whatever the replies do. Latency is measured
+// from the intended send time, so a stalled sender or server shows up in
+// the percentiles instead of silently slowing the load down (coordinated
+// omission).
+struct LoadOptions
+{
+    double                    rate         = 10000; // datagrams per second, all threads together
+    bool                      poisson      = false;
+    double                    duration     = 5; // seconds
+    size_t                    payload_size = 64;
+    size_t                    sockets      = 1;
+    size_t                    threads      = 1;
+    std::chrono::milliseconds timeout{ 1000 }; // wait for replies after the last send
+
+    socket_wrapper::SocketProfile profile = socket_wrapper::SocketProfile::none;
+};
+
+// Parses the options from argv[first] on, false on an unknown one.
+bool parse_load_options(int argc, char const* argv[], int first, LoadOptions& opts);
+
+// Runs the load against `server`, prints the report to stdout and returns
+// EXIT_SUCCESS if any reply arrived.
+int run_load(const sockaddr_in& server, const LoadOptions& opts, socket_wrapper::Logger& logger);
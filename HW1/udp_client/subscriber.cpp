@@ -0,0 +1,219 @@
+#include "subscriber.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <csignal>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <string_view>
+
+#include <socket_wrapper/datagram_batch.h>
+#include <socket_wrapper/event_loop.h>
+#include <socket_wrapper/packet_buffer.h>
+#include <socket_wrapper/socket_class.h>
+#include <socket_wrapper/socket_options.h>
+
+namespace
+{
+
+socket_wrapper::EventLoop* running_loop = nullptr;
+
+
+void stop_handler(int)
+{
+    if (running_loop) running_loop->stop();
+}
+
+
+// A multicast group a topic is published to.
+struct Group
+{
+    std::string            topic;
+    sockaddr_in            address;
+    socket_wrapper::Socket sock;
+};
+
+
+// Bound to the group's address and port, so only its datagrams arrive;
+// SO_REUSEADDR lets every subscriber on the host bind it.
+bool join_group(Group& group, socket_wrapper::Logger& logger)
+{
+    const ip_mreqn membership = { .imr_multiaddr = group.address.sin_addr,
+                                  .imr_address   = { htonl(INADDR_ANY) },
+                                  .imr_ifindex   = 0 };
+
+    if (!group.sock || socket_wrapper::set_option<socket_wrapper::option::ReuseAddress>(group.sock, true) != 0 ||
+        bind(group.sock, reinterpret_cast<const sockaddr*>(&group.address), sizeof(group.address)) != 0 ||
+        socket_wrapper::set_option<socket_wrapper::option::AddMembership>(group.sock, membership) != 0 ||
+        group.sock.set_nonblocking() != 0)
+    {
+        logger.error("Joining the group of {} failed: {}", group.topic, std::strerror(errno));
+        return false;
+    }
+
+    return true;
+}
+
+}
+
+
+bool parse_subscribe_options(int argc, char const* argv[], int first, SubscribeOptions& opts)
+{
+    for (int i = first; i < argc; ++i)
+    {
+        const std::string name      = argv[i];
+        const bool        has_value = i + 1 < argc;
+
+        try
+        {
+            if ("--subscribe" == name && has_value)
+            {
+                // Comma separated.
+                const std::string topics = argv[++i];
+
+                for (size_t start = 0; start <= topics.size();)
+                {
+                    const size_t end = std::min(topics.find(',', start), topics.size());
+                    if (end > start) opts.topics.push_back(topics.substr(start, end - start));
+                    start = end + 1;
+                }
+            }
+            else if ("--count" == name && has_value)
+                opts.count = std::stoul(argv[++i]);
+            else if ("--renew" == name && has_value)
+                opts.renew = std::chrono::seconds(std::stoul(argv[++i]));
+            else
+                return false;
+        }
+        catch (const std::exception&)
+        {
+            return false;
+        }
+    }
+
+    return !opts.topics.empty() && opts.renew.count() > 0;
+}
+
+
+int run_subscriber(const sockaddr_in& server, const SubscribeOptions& opts, socket_wrapper::Logger& logger)
+{
+    socket_wrapper::EventLoop     loop;
+    socket_wrapper::Socket        sock(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    socket_wrapper::DatagramBatch batch(32, socket_wrapper::max_datagram_size);
+
+    // Connected: only the server's datagrams arrive, publishes included.
+    if (!sock || connect(sock, reinterpret_cast<const sockaddr*>(&server), sizeof(server)) != 0 ||
+        sock.set_nonblocking() != 0)
+    {
+        logger.error("socket: {}", std::strerror(errno));
+        return EXIT_FAILURE;
+    }
+
+    // Publishes come in bursts.
+    socket_wrapper::set_option<socket_wrapper::option::ReceiveBuffer>(sock, 4 << 20);
+
+    std::vector<std::unique_ptr<Group>> groups;
+    size_t                              received = 0;
+
+    auto send_all = [&](const char* command) {
+        for (const auto& topic : opts.topics)
+        {
+            const std::string request = std::string(command) + " " + topic;
+            if (send(sock, request.data(), request.size(), 0) < 0)
+            {
+                logger.warning("{}: {}", request, std::strerror(errno));
+            }
+        }
+    };
+
+    auto print = [&](std::string_view datagram) {
+        std::cout << datagram << "\n";
+        if (opts.count > 0 && ++received >= opts.count) loop.stop();
+    };
+
+    // "SUBSCRIBED <topic> [<group>:<port>]": join the group once.
+    auto on_subscribed = [&](std::string_view reply) {
+        const auto space = reply.find(' ');
+        if (space == std::string_view::npos) return;
+
+        const auto  topic = reply.substr(0, space);
+        const auto  where = std::string(reply.substr(space + 1));
+        const auto  colon = where.rfind(':');
+        sockaddr_in group = { .sin_family = AF_INET };
+
+        if (colon == std::string::npos || inet_pton(AF_INET, where.substr(0, colon).c_str(), &group.sin_addr) != 1)
+        {
+            logger.warning("Unexpected reply \"SUBSCRIBED {}\"", reply);
+            return;
+        }
+        group.sin_port = htons(std::stoi(where.substr(colon + 1)));
+
+        for (const auto& joined : groups)
+        {
+            if (joined->topic == topic) return;
+        }
+
+        auto  joined = std::make_unique<Group>(Group{ std::string(topic), group, { AF_INET, SOCK_DGRAM, IPPROTO_UDP } });
+        auto& member = *joined;
+
+        if (!join_group(member, logger)) return;
+
+        loop.add(member.sock, socket_wrapper::EventLoop::readable, [&, &member = member](uint32_t) {
+            for (int n; (n = batch.receive(member.sock)) > 0;)
+            {
+                for (int i = 0; i < n; ++i) print(batch.view(i));
+            }
+        });
+        logger.info("Receiving {} from the group {}", member.topic, where);
+        groups.push_back(std::move(joined));
+    };
+
+    loop.add(sock, socket_wrapper::EventLoop::readable, [&](uint32_t) {
+        for (;;)
+        {
+            const int n = batch.receive(sock);
+            if (n < 0)
+            {
+                // The server is not up yet: the next renewal retries.
+                if (errno == ECONNREFUSED || errno == EINTR) continue;
+                break;
+            }
+
+            for (int i = 0; i < n; ++i)
+            {
+                const auto datagram = batch.view(i);
+
+                if (datagram.starts_with("SUBSCRIBED "))
+                {
+                    const auto topic = datagram.substr(11);
+                    if (topic.find(' ') != std::string_view::npos) on_subscribed(topic);
+                }
+                else if (datagram.starts_with("REJECTED"))
+                    logger.warning("The server rejected the subscription: {}", datagram);
+                else if (!datagram.starts_with("UNSUBSCRIBED "))
+                    print(datagram);
+            }
+        }
+    });
+
+    // Subscriptions are soft state on the server.
+    loop.add_timer(opts.renew, [&] { send_all("SUB"); }, opts.renew);
+
+    running_loop = &loop;
+    std::signal(SIGINT, stop_handler);
+    std::signal(SIGTERM, stop_handler);
+
+    send_all("SUB");
+    loop.run();
+
+    running_loop = nullptr;
+
+    // Leaving groups is up to the kernel when the sockets close.
+    send_all("UNSUB");
+
+    logger.info("{} datagrams received", received);
+
+    return EXIT_SUCCESS;
+}
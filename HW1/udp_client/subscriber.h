@@ -0,0 +1,27 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <string>
+#include <vector>
+
+#include <socket_wrapper/logger.h>
+#include <socket_wrapper/socket_headers.h>
+
+
+// Subscriber of a udp-server in --mode pubsub: subscribes to its topics,
+// renews the subscriptions before the server expires them and prints every
+// published datagram. When the server answers with a multicast group the
+// subscriber joins it and reads the topic from there instead.
+struct SubscribeOptions
+{
+    std::vector<std::string> topics;
+    size_t                   count = 0; // datagrams to receive, 0 until interrupted
+    std::chrono::seconds     renew{ 10 };
+};
+
+// Parses the options from argv[first] on, false on an unknown one.
+bool parse_subscribe_options(int argc, char const* argv[], int first, SubscribeOptions& opts);
+
+// Returns EXIT_SUCCESS once `count` datagrams arrived or on SIGINT.
+int run_subscriber(const sockaddr_in& server, const SubscribeOptions& opts, socket_wrapper::Logger& logger);
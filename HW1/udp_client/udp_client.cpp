@@ -1,95 +1,323 @@
+#include <algorithm>
+#include <chrono>
 #include <cstdlib>
+#include <cstring>
+#include <deque>
 #include <iomanip>
 #include <iostream>
 #include <string>
 
-#include <socket_wrapper/socket_class.h>
+#include <socket_wrapper/event_loop.h>
+#include <socket_wrapper/logger.h>
+#include <socket_wrapper/request_client.h>
+#include <socket_wrapper/shm_transport.h>
 #include <socket_wrapper/socket_headers.h>
+#include <socket_wrapper/socket_options.h>
 #include <socket_wrapper/socket_wrapper.h>
 
+#include "load_generator.h"
+#include "subscriber.h"
 
-int main(int argc, char const* argv[])
+
+namespace
+{
+
+struct RequestOptions
+{
+    socket_wrapper::RequestClient::Options request;
+    size_t                                 pipeline = 0; // 0: interactive
+    socket_wrapper::SocketProfile          profile  = socket_wrapper::SocketProfile::none;
+    // Through the shared memory of a udp-server on this host.
+    bool                                   shm      = false;
+};
+
+
+bool parse_request_options(int argc, char const* argv[], int first, RequestOptions& opts)
+{
+    opts.request.retries = 2;
+
+    for (int i = first; i < argc; ++i)
+    {
+        const std::string name      = argv[i];
+        const bool        has_value = i + 1 < argc;
+
+        try
+        {
+            if ("--pipeline" == name && has_value)
+                opts.pipeline = std::stoul(argv[++i]);
+            else if ("--timeout" == name && has_value)
+                opts.request.timeout = std::chrono::milliseconds(std::stoul(argv[++i]));
+            else if ("--retries" == name && has_value)
+                opts.request.retries = std::stoul(argv[++i]);
+            else if ("--profile" == name && has_value)
+            {
+                if (!socket_wrapper::parse_socket_profile(argv[++i], opts.profile)) return false;
+            }
+            else if ("--transport" == name && has_value)
+            {
+                const std::string transport = argv[++i];
+                if (transport != "udp" && transport != "shm") return false;
+                opts.shm = "shm" == transport;
+            }
+            else
+                return false;
+        }
+        catch (const std::exception&)
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+
+void print_reply(int error, const std::string& reply)
+{
+    if (error == 0)
+        std::cout << reply << std::endl;
+    else
+        std::cout << "<no reply: " << std::strerror(error) << ">" << std::endl;
+}
+
+
+// One line per request, prompt and reply in turn.
+void run_interactive(socket_wrapper::EventLoop&     loop,
+                     socket_wrapper::RequestClient& client,
+                     const RequestOptions&          opts,
+                     socket_wrapper::Logger&        logger)
+{
+    std::string line;
+
+    for (;;)
+    {
+        std::cout << "$> ";
+        if (!std::getline(std::cin, line)) break;
+
+        bool done = false;
+
+        client.request(
+            line,
+            [&](socket_wrapper::RequestClient::RequestId, int error, std::string_view reply) {
+                logger.debug("Received {} bytes from the server", reply.size());
+                print_reply(error, std::string(reply));
+                done = true;
+            },
+            opts.request);
+
+        while (!done) loop.run_once(std::chrono::milliseconds(-1));
+
+        if (":exit" == line) break;
+
+        std::cout << std::endl;
+    }
+}
+
+
+// Every stdin line is a request with up to `opts.pipeline` of them in
+// flight; replies are printed in the input order.
+void run_pipelined(socket_wrapper::EventLoop&     loop,
+                   socket_wrapper::RequestClient& client,
+                   const RequestOptions&          opts)
 {
-    const size_t BUFSIZE = 256;
+    struct Slot
+    {
+        bool        done  = false;
+        int         error = 0;
+        std::string reply;
+    };
+
+    std::deque<Slot> slots;
+    size_t           first_id = 0; // id of slots.front()
+    std::string      line;
+    bool             input    = true;
+    const auto       start    = std::chrono::steady_clock::now();
 
-    if (argc != 3)
+    auto flush = [&] {
+        while (!slots.empty() && slots.front().done)
+        {
+            print_reply(slots.front().error, slots.front().reply);
+            slots.pop_front();
+            ++first_id;
+        }
+    };
+
+    while (input || !slots.empty())
     {
-        std::cout << "Usage: " << argv[0] << " <ip> <port>\n";
+        // Keep the pipeline full, the client queues nothing itself.
+        while (input && client.in_flight() < opts.pipeline)
+        {
+            if (!std::getline(std::cin, line))
+            {
+                input = false;
+                break;
+            }
+
+            slots.emplace_back();
+            client.request(
+                line,
+                [&](socket_wrapper::RequestClient::RequestId id, int error, std::string_view reply) {
+                    Slot& slot = slots[id - first_id];
+                    slot.done  = true;
+                    slot.error = error;
+                    slot.reply.assign(reply);
+                },
+                opts.request);
+        }
+
+        if (!slots.empty()) loop.run_once(std::chrono::milliseconds(-1));
+        flush();
+    }
+
+    const auto& stats   = client.stats();
+    const auto  seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    std::cerr << stats.completed << " replies, " << stats.timed_out << " timed out, " << stats.retransmitted
+              << " retransmitted, " << stats.duplicates << " duplicates in " << std::fixed
+              << std::setprecision(3) << seconds << " s (" << std::setprecision(0)
+              << stats.completed / seconds << " requests/s)" << std::endl;
+}
+
+
+
+// The same session through a udp-server started with --transport shm. The
+// queues neither lose nor reorder datagrams, so replies are simply read in
+// the order of the requests, and the timeout only catches a stuck server.
+int run_shm(int port, const RequestOptions& opts, socket_wrapper::Logger& logger)
+{
+    const std::string         name = "/udp-server-" + std::to_string(port);
+    socket_wrapper::ShmClient client(name);
+
+    if (!client.opened())
+    {
+        logger.error("Shared memory {}: {}", name, std::strerror(errno));
         return EXIT_FAILURE;
     }
 
-    socket_wrapper::SocketWrapper sock_wrap;
-    const int                     port = std::stoi(argv[2]);
+    client.set_receive_timeout(std::chrono::duration_cast<std::chrono::microseconds>(opts.request.timeout));
 
-    // creating socket
-    socket_wrapper::Socket sock(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    logger.info("Running shared memory client {}...", client.id());
+    logger.flush();
 
-    std::cout << "Starting UDP client on the port " << port << "...\n";
+    const bool   interactive = opts.pipeline == 0;
+    const size_t depth       = std::max<size_t>(opts.pipeline, 1);
+    std::string  line;
+    std::string  reply(client.max_datagram_size(), '\0');
+    size_t       in_flight   = 0;
+    bool         input       = true;
 
-    if (!sock)
+    for (;;)
     {
-        std::cerr << sock_wrap.get_last_error_string() << std::endl;
+        while (input && in_flight < depth)
+        {
+            if (interactive) std::cout << "$> ";
+            if (!std::getline(std::cin, line))
+            {
+                input = false;
+                break;
+            }
+
+            if (client.send(line.data(), line.size()) < 0)
+                print_reply(errno, {});
+            else
+                ++in_flight;
+        }
+
+        if (in_flight == 0) break;
+
+        const ssize_t received = client.recv(reply.data(), reply.size());
+        --in_flight;
+
+        print_reply(received < 0 ? errno : 0, received < 0 ? std::string() : reply.substr(0, received));
+        // Timed out or the server is gone: later replies would not match.
+        if (received < 0) break;
+
+        if (interactive)
+        {
+            if (":exit" == line) break;
+            std::cout << std::endl;
+        }
+    }
+
+    return EXIT_SUCCESS;
+}
+
+}
+
+
+int main(int argc, char const* argv[])
+{
+    // Options after the address select the load generator (--load), the
+    // subscriber (--subscribe) or tune the request mode.
+    LoadOptions      load_options;
+    SubscribeOptions subscribe_options;
+    RequestOptions   request_options;
+    const bool       load      = argc > 3 && std::string("--load") == argv[3];
+    const bool       subscribe = argc > 3 && std::string("--subscribe") == argv[3];
+
+    if (argc < 3 || (load && !parse_load_options(argc, argv, 3, load_options)) ||
+        (subscribe && !parse_subscribe_options(argc, argv, 3, subscribe_options)) ||
+        (!load && !subscribe && !parse_request_options(argc, argv, 3, request_options)))
+    {
+        std::cout << "Usage: " << argv[0] << " <ip> <port> [--pipeline <depth>] [--timeout <ms>] [--retries <n>]\n"
+                  << "           [--profile none|low-latency|high-throughput] [--transport udp|shm]\n"
+                  << "       " << argv[0]
+                  << " <ip> <port> --load [--rate <pps>] [--poisson] [--duration <s>] [--size <bytes>]\n"
+                  << "           [--sockets <n>] [--threads <n>] [--timeout <ms>]"
+                  << " [--profile none|low-latency|high-throughput]\n"
+                  << "       " << argv[0] << " <ip> <port> --subscribe <topic>[,<topic>...] [--count <n>] [--renew <s>]\n";
         return EXIT_FAILURE;
     }
 
-    /*
-        two message arrays are needed
-        to correctly process commands
-        (":exit" command in this case)
-
-        it is not useful in this example,
-        but if we imagine that the server
-        sends an answer different from the client's message,
-        then the single array will be overwritten
-        and the command won't be processed correctly
-    */
-    char message_sent[BUFSIZE]     = "";
-    char message_received[BUFSIZE] = "";
-    bool exit                      = false;
+    socket_wrapper::SocketWrapper sock_wrap;
+    // Diagnostics go to stderr, stdout is the interactive session.
+    socket_wrapper::Logger        logger(STDERR_FILENO);
+    const int                     port = std::stoi(argv[2]);
 
     // setting up server address info
     struct sockaddr_in server_address = {
         .sin_family = AF_INET,
         .sin_port   = htons(port),
     };
-    server_address.sin_addr.S_un.S_addr = inet_addr(argv[1]);
-    socklen_t server_address_len        = sizeof(sockaddr_in);
-    ssize_t   recv_len                  = 0;
+    server_address.sin_addr.s_addr = inet_addr(argv[1]);
 
-    std::cout << "Running UDP client...\n\n";
+    if (load) return run_load(server_address, load_options, logger);
+    if (subscribe) return run_subscriber(server_address, subscribe_options, logger);
+    if (request_options.shm) return run_shm(port, request_options, logger);
 
-    while (!exit)
-    {
-        std::cout << "$> ";
-        std::cin.getline(message_sent, BUFSIZE);
-
-        sendto(sock,
-               message_sent,
-               strlen(message_sent),
-               0,
-               reinterpret_cast<const sockaddr*>(&server_address),
-               server_address_len);
-
-        recv_len = recvfrom(sock,
-                            message_received,
-                            sizeof(message_received) - 1,
-                            0,
-                            reinterpret_cast<sockaddr*>(&server_address),
-                            &server_address_len);
-
-        if (recv_len > 0)
-        {
-            std::cout << message_received << std::endl;
-        }
+    logger.info("Starting UDP client on the port {}...", port);
 
-        if (message_sent[0] == ':')
-        {
-            std::string command = message_sent;
-            if (command == ":exit")
-                exit = true;
-        }
+    // Interactive lines go out as they are typed, the server reads "exit" and
+    // the pub/sub commands from the first byte on.
+    const bool                    pipelined = request_options.pipeline > 0;
+    socket_wrapper::EventLoop     loop;
+    socket_wrapper::RequestClient client(loop,
+                                         reinterpret_cast<const sockaddr*>(&server_address),
+                                         sizeof(server_address),
+                                         request_options.pipeline,
+                                         pipelined ? socket_wrapper::RequestClient::Framing::header
+                                                   : socket_wrapper::RequestClient::Framing::none);
 
-        std::cout << std::endl;
+    if (!client.opened())
+    {
+        logger.error("socket: {}", sock_wrap.get_last_error_string());
+        return EXIT_FAILURE;
     }
+
+    socket_wrapper::apply_socket_profile(client.socket(), request_options.profile, [&](const char* option, int error) {
+        logger.warning("{} ({} profile): {}",
+                       option,
+                       socket_wrapper::socket_profile_name(request_options.profile),
+                       std::strerror(error));
+    });
+
+    logger.info("Running UDP client...");
+    logger.flush();
+
+    if (pipelined)
+        run_pipelined(loop, client, request_options);
+    else
+        run_interactive(loop, client, request_options, logger);
+
     return EXIT_SUCCESS;
-}
\ No newline at end of file
+}
@@ -1,42 +1,965 @@
 #include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <csignal>
+#include <cstdint>
 #include <cstdlib>
+#include <cstring>
+#include <functional>
 #include <iomanip>
 #include <iostream>
+#include <memory>
+#include <optional>
 #include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
 
+#include <socket_wrapper/datagram_batch.h>
+#include <socket_wrapper/event_loop.h>
+#include <socket_wrapper/io_uring.h>
+#include <socket_wrapper/logger.h>
+#include <socket_wrapper/metrics.h>
+#include <socket_wrapper/packet_buffer.h>
+#include <socket_wrapper/resolver.h>
+#include <socket_wrapper/session_table.h>
+#include <socket_wrapper/sharding.h>
+#include <socket_wrapper/shm_transport.h>
 #include <socket_wrapper/socket_class.h>
 #include <socket_wrapper/socket_headers.h>
+#include <socket_wrapper/socket_options.h>
 #include <socket_wrapper/socket_wrapper.h>
+#include <socket_wrapper/spin_poll.h>
+#include <socket_wrapper/topic_fanout.h>
 
 // Trim from end (in place).
 static inline std::string& rtrim(std::string& s)
 {
-    s.erase(std::find_if(s.rbegin(), s.rend(), [](int c) { return !std::isspace(c); }).base());
+    s.erase(std::find_if(s.rbegin(), s.rend(), [](int c) { return !std::isspace(c); }).base(),
+            s.end());
     return s;
 }
 
+// Datagrams received and replied to per syscall pair.
+const size_t default_batch_depth = 32;
+
+enum class Steering
+{
+    none, // kernel hash of the 4-tuple
+    cpu,  // SO_INCOMING_CPU
+    bpf,  // reuseport CBPF program indexing by the receiving CPU
+};
+
+enum class Transport
+{
+    udp,
+    shm, // same-host clients through shared memory (udp-client --transport shm)
+};
+
+enum class Mode
+{
+    echo,
+    // Clients subscribe to topics ("SUB <topic>", "UNSUB <topic>") and every
+    // "PUB <topic> <payload>" goes out to the topic's subscribers as
+    // "<topic> <payload>". Anything else is echoed.
+    pubsub,
+};
+
+enum class Backend
+{
+    blocking, // recvfrom()/sendto(), a datagram per syscall
+    epoll,    // event loop with recvmmsg()/sendmmsg() batches
+    uring,    // io_uring: multishot recvmsg into a provided buffer ring
+};
+
+struct Options
+{
+    int       port        = 0;
+    size_t    batch_depth = default_batch_depth;
+    // Buffers in every shard's pool, 0 means two per batch slot.
+    size_t    pool_size   = 0;
+    size_t    threads     = 1;
+    Steering  steering    = Steering::none;
+    Backend   backend     = Backend::epoll;
+    Transport transport   = Transport::udp;
+    Mode      mode        = Mode::echo;
+    // UDP GRO on receive and GSO on send, where the kernel supports them
+    // (epoll backend only).
+    bool      offload     = true;
+
+    socket_wrapper::SocketProfile profile = socket_wrapper::SocketProfile::none;
+
+    // Non-blocking receives retried this long before the thread blocks
+    // (blocking and epoll backends), 0 to block right away.
+    std::chrono::microseconds spin{ 0 };
+
+    // Clients tracked per shard, 0 keeps no per-client state.
+    size_t               sessions     = 65536;
+    std::chrono::seconds idle_timeout{ 30 };
+    // Datagrams per second every client may send, 0 for no limit. Over the
+    // limit datagrams are dropped unanswered. The burst defaults to 100 ms
+    // worth of the rate.
+    double rate_limit = 0;
+    double burst      = 0;
+
+    // Publish to IP multicast groups instead of every subscriber: topic i
+    // goes to this group + i. Subscriptions expire after the idle timeout.
+    std::optional<sockaddr_in> multicast;
+    int                        multicast_ttl = 1;
+
+    // Every datagram is logged at the debug level.
+    socket_wrapper::LogLevel log_level  = socket_wrapper::LogLevel::debug;
+    uint32_t                 log_sample = 1;
+
+    // Prometheus endpoint, "host:port" or "unix:/path", empty for none.
+    std::string metrics_address;
+};
+
+// Handles of one shard's metrics, labelled with the shard index. The
+// registry keeps the cells of every thread apart, so shards never share
+// cache lines.
+struct ShardMetrics
+{
+    using Metrics = socket_wrapper::Metrics;
+
+    ShardMetrics(Metrics& metrics, size_t shard)
+    {
+        const std::string labels = "shard=\"" + std::to_string(shard) + "\"";
+
+        datagrams   = metrics.counter("udp_server_datagrams_total", "Datagrams received.", labels);
+        bytes       = metrics.counter("udp_server_bytes_total", "Payload bytes received.", labels);
+        batches     = metrics.counter("udp_server_batches_total", "recvmmsg() calls that returned datagrams.", labels);
+        coalesced   = metrics.counter("udp_server_coalesced_total", "GRO receives holding several datagrams.", labels);
+        truncated   = metrics.counter("udp_server_truncated_total", "Datagrams cut to the buffer size.", labels);
+        send_errors = metrics.counter("udp_server_send_errors_total", "Replies that could not be sent.", labels);
+        spin_hits   = metrics.counter("udp_server_spin_hits_total", "Spins that found a datagram.", labels);
+        sleeps      = metrics.counter("udp_server_sleeps_total", "Spins that ran out, the thread blocked.", labels);
+        rate_limited =
+            metrics.counter("udp_server_rate_limited_total", "Datagrams dropped over their client's limit.", labels);
+        published = metrics.counter("udp_server_published_total", "Datagrams published to a topic.", labels);
+        fanout    = metrics.counter("udp_server_fanout_total", "Datagrams sent to subscribers or groups.", labels);
+        fanout_errors =
+            metrics.counter("udp_server_fanout_errors_total", "Datagrams to subscribers that could not be sent.", labels);
+        sessions      = metrics.gauge("udp_server_sessions", "Clients with a session.", labels);
+        subscriptions = metrics.gauge("udp_server_subscriptions", "Subscriptions to topics.", labels);
+        socket_drops =
+            metrics.gauge("udp_server_socket_drops", "Receive queue overflows reported by SO_RXQ_OVFL.", labels);
+        // 1 us .. 0.5 s
+        batch_latency = metrics.histogram("udp_server_batch_processing_seconds",
+                                          "Time from recvmmsg() returning to the replies being sent.",
+                                          labels,
+                                          socket_wrapper::exponential_buckets(1000, 2, 20),
+                                          1e-9);
+    }
+
+    Metrics::Counter   datagrams;
+    Metrics::Counter   bytes;
+    Metrics::Counter   batches;
+    Metrics::Counter   coalesced;
+    Metrics::Counter   truncated;
+    Metrics::Counter   send_errors;
+    Metrics::Counter   spin_hits;
+    Metrics::Counter   sleeps;
+    Metrics::Counter   rate_limited;
+    Metrics::Counter   published;
+    Metrics::Counter   fanout;
+    Metrics::Counter   fanout_errors;
+    Metrics::Gauge     sessions;
+    Metrics::Gauge     subscriptions;
+    Metrics::Gauge     socket_drops;
+    Metrics::Histogram batch_latency;
+};
+
+struct Shard
+{
+    Shard(unsigned cpu, const Options& opts, socket_wrapper::Metrics& metrics, size_t index)
+        : sock(AF_INET, SOCK_DGRAM, IPPROTO_UDP)
+        , pool(socket_wrapper::max_datagram_size, opts.pool_size)
+        , cpu(cpu)
+        , metrics(metrics)
+        , m(metrics, index)
+    {
+        if (opts.sessions > 0)
+        {
+            sessions = std::make_unique<socket_wrapper::SessionTable>(opts.sessions,
+                                                                      opts.rate_limit,
+                                                                      opts.burst,
+                                                                      opts.idle_timeout);
+        }
+        if (opts.mode == Mode::pubsub)
+        {
+            fanout = std::make_unique<socket_wrapper::TopicFanout>(socket_wrapper::TopicFanout::Options{
+                .ttl = opts.idle_timeout, .multicast = opts.multicast });
+        }
+    }
+
+    socket_wrapper::Socket     sock;
+    socket_wrapper::EventLoop  loop;
+    socket_wrapper::Resolver   resolver;
+    socket_wrapper::BufferPool pool;
+    unsigned                   cpu;
+    bool                       gso = false;
+    socket_wrapper::Metrics&   metrics;
+    ShardMetrics               m;
+
+    // Per-client counters and rate limits, none with --sessions 0.
+    std::unique_ptr<socket_wrapper::SessionTable> sessions;
+    // With --transport shm, used instead of the socket.
+    std::unique_ptr<socket_wrapper::ShmServer> shm;
+    // Topics and subscribers with --mode pubsub.
+    std::unique_ptr<socket_wrapper::TopicFanout> fanout;
+};
+
+static std::vector<std::unique_ptr<Shard>> shards;
+
+static void stop_all()
+{
+    for (auto& shard : shards) shard->loop.stop();
+}
+
+static void stop_handler(int)
+{
+    stop_all();
+}
+
+static void usage(const char* program)
+{
+    std::cout << "Usage: " << program << " <port> [--batch <depth>] [--pool <buffers>]"
+              << " [--threads <n>] [--steer none|cpu|bpf] [--offload on|off]\n"
+              << "    [--backend blocking|epoll|uring] [--profile none|low-latency|high-throughput] [--spin <us>]\n"
+              << "    [--transport udp|shm] [--mode echo|pubsub] [--multicast <group>:<port>] [--multicast-ttl <n>]\n"
+              << "    [--sessions <n>] [--idle-timeout <s>] [--rate-limit <pps>] [--burst <n>]\n"
+              << "    [--log-level debug|info|warning|error|off] [--log-sample <n>]"
+              << " [--metrics <host:port|unix:path>]" << std::endl;
+}
+
+static bool parse_options(int argc, char const* argv[], Options& opts)
+{
+    if (argc < 2 || argc % 2 != 0) return false;
+
+    opts.port = std::stoi(argv[1]);
+
+    for (int i = 2; i + 1 < argc; i += 2)
+    {
+        const std::string name  = argv[i];
+        const std::string value = argv[i + 1];
+
+        if ("--batch" == name)
+            opts.batch_depth = std::stoul(value);
+        else if ("--pool" == name)
+            opts.pool_size = std::stoul(value);
+        else if ("--threads" == name)
+            opts.threads = std::stoul(value);
+        else if ("--steer" == name && "none" == value)
+            opts.steering = Steering::none;
+        else if ("--steer" == name && "cpu" == value)
+            opts.steering = Steering::cpu;
+        else if ("--steer" == name && "bpf" == value)
+            opts.steering = Steering::bpf;
+        else if ("--backend" == name && "blocking" == value)
+            opts.backend = Backend::blocking;
+        else if ("--backend" == name && "epoll" == value)
+            opts.backend = Backend::epoll;
+        else if ("--backend" == name && "uring" == value)
+            opts.backend = Backend::uring;
+        else if ("--transport" == name && "udp" == value)
+            opts.transport = Transport::udp;
+        else if ("--transport" == name && "shm" == value)
+            opts.transport = Transport::shm;
+        else if ("--mode" == name && "echo" == value)
+            opts.mode = Mode::echo;
+        else if ("--mode" == name && "pubsub" == value)
+            opts.mode = Mode::pubsub;
+        else if ("--multicast" == name)
+        {
+            const auto  colon = value.rfind(':');
+            sockaddr_in group = { .sin_family = AF_INET };
+
+            if (colon == std::string::npos ||
+                inet_pton(AF_INET, value.substr(0, colon).c_str(), &group.sin_addr) != 1 ||
+                !IN_MULTICAST(ntohl(group.sin_addr.s_addr)))
+            {
+                return false;
+            }
+            group.sin_port = htons(std::stoi(value.substr(colon + 1)));
+            opts.multicast = group;
+        }
+        else if ("--multicast-ttl" == name)
+            opts.multicast_ttl = std::stoi(value);
+        else if ("--offload" == name && ("on" == value || "off" == value))
+            opts.offload = "on" == value;
+        else if ("--profile" == name)
+        {
+            if (!socket_wrapper::parse_socket_profile(value, opts.profile)) return false;
+        }
+        else if ("--spin" == name)
+            opts.spin = std::chrono::microseconds(std::stoul(value));
+        else if ("--sessions" == name)
+            opts.sessions = std::stoul(value);
+        else if ("--idle-timeout" == name)
+            opts.idle_timeout = std::chrono::seconds(std::stoul(value));
+        else if ("--rate-limit" == name)
+            opts.rate_limit = std::stod(value);
+        else if ("--burst" == name)
+            opts.burst = std::stod(value);
+        else if ("--log-level" == name)
+        {
+            if (!socket_wrapper::parse_log_level(value, opts.log_level)) return false;
+        }
+        else if ("--log-sample" == name)
+            opts.log_sample = std::stoul(value);
+        else if ("--metrics" == name)
+            opts.metrics_address = value;
+        else
+            return false;
+    }
+
+    if (opts.pool_size == 0) opts.pool_size = 2 * opts.batch_depth;
+    // Publishers' datagrams are routed one by one.
+    if (opts.mode == Mode::pubsub) opts.offload = false;
+    if (opts.burst == 0) opts.burst = std::max(1.0, opts.rate_limit / 10);
+
+    return opts.batch_depth > 0 && opts.threads > 0 && opts.log_sample > 0 &&
+           opts.pool_size >= opts.batch_depth && opts.rate_limit >= 0 && opts.burst >= 1 &&
+           (opts.rate_limit == 0 || opts.sessions > 0) && (opts.transport == Transport::udp || opts.threads == 1) &&
+           // Subscribers and publishers must meet in one shard's table.
+           (opts.mode == Mode::echo ||
+            (opts.threads == 1 && opts.backend == Backend::epoll && opts.transport == Transport::udp)) &&
+           (!opts.multicast || opts.mode == Mode::pubsub) && opts.multicast_ttl >= 0 && opts.multicast_ttl <= 255;
+}
+
+static bool would_block()
+{
+    return errno == EAGAIN || errno == EWOULDBLOCK;
+}
+
+// Accounts the datagrams to their client. False: the client is over its
+// limit, drop them before any other work.
+static bool admit(Shard&                                shard,
+                  const sockaddr*                       address,
+                  socklen_t                             address_len,
+                  size_t                                bytes,
+                  size_t                                datagrams,
+                  std::chrono::steady_clock::time_point now)
+{
+    if (!shard.sessions) return true;
+
+    const bool admitted = shard.sessions->admit(address, address_len, bytes, now, datagrams);
+
+    if (!admitted) shard.metrics.add(shard.m.rate_limited, datagrams);
+    shard.metrics.set(shard.m.sessions, shard.sessions->size());
+
+    return admitted;
+}
+
+// "SUB", "UNSUB" and "PUB" datagrams of --mode pubsub. False: not a
+// command, echo it. A publish goes out from the receive buffer it arrived
+// in, without the "PUB " in front.
+static bool route_pubsub(Shard&                                shard,
+                         socket_wrapper::Logger&               logger,
+                         const sockaddr*                       address,
+                         socklen_t                             address_len,
+                         std::string_view                      datagram,
+                         std::chrono::steady_clock::time_point now)
+{
+    auto& fanout  = *shard.fanout;
+    auto& metrics = shard.metrics;
+
+    const auto space   = datagram.find(' ');
+    const auto command = datagram.substr(0, space);
+
+    if (space == std::string_view::npos || (command != "SUB" && command != "UNSUB" && command != "PUB")) return false;
+
+    if ("PUB" == command)
+    {
+        const auto message = datagram.substr(space + 1);
+        const auto topic   = message.substr(0, message.find(' '));
+
+        const uint64_t errors = fanout.stats().send_errors;
+
+        metrics.add(shard.m.published);
+        metrics.add(shard.m.fanout, fanout.publish(shard.sock, topic, message));
+        metrics.add(shard.m.fanout_errors, fanout.stats().send_errors - errors);
+        return true;
+    }
+
+    // The topic runs to the end, less a line break of a terminal client.
+    auto topic = datagram.substr(space + 1);
+    while (!topic.empty() && std::isspace(static_cast<unsigned char>(topic.back()))) topic.remove_suffix(1);
+
+    std::string reply;
+
+    if (topic.empty() || topic.find(' ') != std::string_view::npos)
+    {
+        reply = "REJECTED";
+    }
+    else if ("UNSUB" == command)
+    {
+        fanout.unsubscribe(topic, address, address_len);
+        reply = "UNSUBSCRIBED ";
+        reply.append(topic);
+    }
+    else if (const auto id = fanout.subscribe(topic, address, address_len, now);
+             id == socket_wrapper::TopicFanout::no_topic)
+    {
+        reply = "REJECTED ";
+        reply.append(topic);
+    }
+    else
+    {
+        reply = "SUBSCRIBED ";
+        reply.append(topic);
+
+        // Members join the group themselves.
+        if (fanout.multicast())
+        {
+            const sockaddr_in group = fanout.group(id);
+            char              group_buf[INET_ADDRSTRLEN];
+
+            inet_ntop(AF_INET, &group.sin_addr, group_buf, sizeof(group_buf));
+            reply += " " + std::string(group_buf) + ":" + std::to_string(ntohs(group.sin_port));
+        }
+    }
+
+    metrics.set(shard.m.subscriptions, fanout.subscriptions());
+
+    if (sendto(shard.sock, reply.data(), reply.size(), 0, address, address_len) < 0)
+    {
+        metrics.add(shard.m.send_errors);
+        logger.debug("Reply to a {} failed: {}", command, std::strerror(errno));
+    }
+
+    return true;
+}
+
+// recvfrom()/sendto() on the shard's socket, in the shape of ShmServer.
+struct UdpChannel
+{
+    ssize_t recv_from(char* data, size_t len, sockaddr* from, socklen_t* from_len, int flags)
+    {
+        return recvfrom(sock, data, len, flags, from, from_len);
+    }
+
+    ssize_t send_to(const char* data, size_t len, const sockaddr* to, socklen_t to_len, int flags)
+    {
+        return sendto(sock, data, len, flags, to, to_len);
+    }
+
+    const socket_wrapper::Socket& sock;
+};
+
+// Receives one datagram per recv_from() and echoes it with send_to(). The
+// channel's receive timeout must let the thread notice stop().
+template <typename Channel, typename OnDatagram>
+static void serve_blocking(Shard&                  shard,
+                           const Options&          opts,
+                           socket_wrapper::Logger& logger,
+                           Channel&                channel,
+                           OnDatagram&&            on_datagram)
+{
+    socket_wrapper::SocketWrapper sock_wrap;
+    auto&                         loop    = shard.loop;
+    auto&                         metrics = shard.metrics;
+    const auto&                   m       = shard.m;
+
+    auto                          buffer = shard.pool.acquire();
+    socket_wrapper::SpinThenBlock spinner(opts.spin);
+
+    while (!loop.stopped())
+    {
+        sockaddr_storage client_address;
+        socklen_t        client_address_len;
+        ssize_t          received;
+
+        // MSG_TRUNC: the real length, even if the buffer was too small.
+        auto receive = [&](int flags) {
+            client_address_len = sizeof(client_address);
+            received           = channel.recv_from(buffer.data(),
+                                                   buffer.capacity(),
+                                                   reinterpret_cast<sockaddr*>(&client_address),
+                                                   &client_address_len,
+                                                   MSG_TRUNC | flags);
+            return received >= 0 || !would_block();
+        };
+
+        if (spinner.spin([&] { return receive(MSG_DONTWAIT); }))
+            metrics.add(m.spin_hits);
+        else
+        {
+            if (spinner.enabled()) metrics.add(m.sleeps);
+            receive(0);
+        }
+
+        if (received < 0)
+        {
+            if (!would_block() && errno != EINTR)
+            {
+                logger.error("recvfrom: {}", sock_wrap.get_last_error_string());
+            }
+            continue;
+        }
+
+        const auto received_at = std::chrono::steady_clock::now();
+        const auto length      = std::min<size_t>(received, buffer.capacity());
+        const auto address     = reinterpret_cast<const sockaddr*>(&client_address);
+
+        metrics.add(m.batches);
+        if (!admit(shard, address, client_address_len, length, 1, received_at)) continue;
+
+        if (length < static_cast<size_t>(received))
+        {
+            metrics.add(m.truncated);
+            logger.warning("Datagram truncated to {} bytes", length);
+        }
+
+        on_datagram(address, client_address_len, std::string_view(buffer.data(), length));
+
+        if (channel.send_to(buffer.data(), length, address, client_address_len, 0) < 0) metrics.add(m.send_errors);
+        metrics.observe(m.batch_latency,
+                        std::chrono::duration_cast<std::chrono::nanoseconds>(
+                            std::chrono::steady_clock::now() - received_at)
+                            .count());
+    }
+}
+
+// Batched recvmmsg()/sendmmsg() from an edge-triggered event loop.
+template <typename OnDatagram>
+static void serve_epoll(Shard& shard, const Options& opts, socket_wrapper::Logger& logger, OnDatagram&& on_datagram)
+{
+    socket_wrapper::SocketWrapper sock_wrap;
+    auto&                         sock    = shard.sock;
+    auto&                         loop    = shard.loop;
+    auto&                         metrics = shard.metrics;
+    const auto&                   m       = shard.m;
+
+    // 64 KiB pooled buffers: a datagram is received, logged and echoed from
+    // the same buffer.
+    socket_wrapper::DatagramBatch batch(opts.batch_depth, shard.pool);
+    batch.set_gso(shard.gso);
+
+    socket_wrapper::SpinThenBlock spinner(opts.spin);
+
+    // Batches per wakeup: under a steady flood (or while spinning) the
+    // handler returns now and then, so timers and posted jobs get their turn.
+    constexpr int max_batches = 64;
+
+    std::function<void(uint32_t)> on_readable;
+
+    on_readable = [&](uint32_t)
+    {
+        // Edge-triggered: drain everything queued, or leave the rest to a
+        // posted continuation since no new edge may come for it.
+        for (int batches = 0; !loop.stopped(); ++batches)
+        {
+            if (batches == max_batches)
+            {
+                loop.post([&] { on_readable(0); });
+                break;
+            }
+
+            // Read up to batch_depth datagrams with one syscall.
+            int received = batch.receive(sock);
+
+            // Drained: wait for the next datagram here rather than in
+            // epoll_wait(), for as long as the spin budget allows.
+            if (received < 0 && would_block() && spinner.enabled())
+            {
+                const bool hit = spinner.spin([&] {
+                    received = batch.receive(sock);
+                    return received >= 0 || !would_block();
+                });
+                metrics.add(hit ? m.spin_hits : m.sleeps);
+            }
+
+            if (received < 0)
+            {
+                if (!would_block())
+                {
+                    logger.error("recvmmsg: {}", sock_wrap.get_last_error_string());
+                }
+                break;
+            }
+
+            const auto received_at = std::chrono::steady_clock::now();
+
+            metrics.add(m.batches);
+            metrics.set(m.socket_drops, batch.socket_drops());
+
+            // The slots to answer are gathered in front.
+            size_t answered = 0;
+
+            for (int i = 0; i < received; ++i)
+            {
+                if (!admit(shard,
+                           batch.address(i),
+                           batch.address_length(i),
+                           batch.length(i),
+                           batch.segment_count(i),
+                           received_at))
+                {
+                    continue;
+                }
+
+                if (batch.truncated(i))
+                {
+                    metrics.add(m.truncated);
+                    logger.warning("Datagram truncated to {} bytes", batch.length(i));
+                }
+                if (batch.segment_size(i) != 0) metrics.add(m.coalesced);
+
+                // A GRO slot holds several datagrams of the same client.
+                for (size_t k = 0; k < batch.segment_count(i); ++k)
+                {
+                    on_datagram(batch.address(i), batch.address_length(i), batch.segment(i, k));
+                }
+
+                // Commands are answered by the fan-out, GRO is off for it.
+                if (shard.fanout &&
+                    route_pubsub(
+                        shard, logger, batch.address(i), batch.address_length(i), batch.view(i), received_at))
+                {
+                    continue;
+                }
+
+                batch.swap(answered++, i);
+            }
+
+            // Send same content back to the clients ("echo") with one syscall,
+            // coalesced slots go out as one GSO send each.
+            // A full send buffer drops the replies, as the network would.
+            int sent = answered > 0 ? batch.send(sock, answered) : 0;
+            metrics.add(m.send_errors, answered - std::max(sent, 0));
+            metrics.observe(m.batch_latency,
+                            std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                std::chrono::steady_clock::now() - received_at)
+                                .count());
+
+            // A short batch means the queue is empty, the next datagram
+            // will raise a new edge. Spinning goes on until the budget runs out.
+            if (!spinner.enabled() && static_cast<size_t>(received) < batch.depth()) break;
+        }
+    };
+
+    if (loop.add(sock, socket_wrapper::EventLoop::readable, on_readable) != 0)
+    {
+        logger.error("Event loop registration failed: {}", sock_wrap.get_last_error_string());
+        stop_all();
+        return;
+    }
+
+    loop.run();
+}
+
+// One multishot recvmsg keeps receiving into a provided buffer ring, every
+// datagram is echoed with a sendmsg from the buffer it arrived in, and the
+// buffer goes back to the ring when the send completes. Each io_uring_enter()
+// submits the replies of the previous completions and reaps the next ones.
+template <typename OnDatagram>
+static void serve_uring(Shard& shard, const Options& opts, socket_wrapper::Logger& logger, OnDatagram&& on_datagram)
+{
+    using socket_wrapper::BufferRing;
+
+    socket_wrapper::SocketWrapper sock_wrap;
+    auto&                         loop    = shard.loop;
+    auto&                         metrics = shard.metrics;
+    const auto&                   m       = shard.m;
+
+    // A reply for every buffer plus the receive fit in one submission.
+    socket_wrapper::IoUring ring(2 * opts.pool_size);
+    if (!ring.opened())
+    {
+        logger.error("io_uring_setup: {}", sock_wrap.get_last_error_string());
+        stop_all();
+        return;
+    }
+
+    // The socket is fixed file 0.
+    const int fd = shard.sock;
+    if (ring.register_files(&fd, 1) != 0)
+    {
+        logger.error("IORING_REGISTER_FILES: {}", sock_wrap.get_last_error_string());
+        stop_all();
+        return;
+    }
+
+    const uint16_t group = 0;
+    BufferRing     buffers(ring, group, opts.pool_size, socket_wrapper::max_datagram_size);
+    if (!buffers.opened())
+    {
+        logger.error("Provided buffers: {}", sock_wrap.get_last_error_string());
+        stop_all();
+        return;
+    }
+
+    // Reserves room for the client address at the head of every buffer.
+    msghdr receive_msg      = {};
+    receive_msg.msg_namelen = sizeof(sockaddr_storage);
+
+    struct Reply
+    {
+        msghdr msg;
+        iovec  iov;
+    };
+    // Indexed by buffer id: a buffer holds one datagram until its reply is sent.
+    std::vector<Reply> replies(buffers.count());
+
+    // user_data: the operation in the upper half, the buffer id below.
+    const uint64_t receive_op = 1ull << 32;
+    const uint64_t send_op    = 2ull << 32;
+
+    bool   armed     = false;
+    size_t in_flight = 0;
+
+    std::chrono::steady_clock::time_point received_at;
+
+    auto get_sqe = [&]
+    {
+        io_uring_sqe* sqe = ring.get_sqe();
+        // Full: hand the queued entries to the kernel to make room.
+        while (!sqe && ring.submit() >= 0) sqe = ring.get_sqe();
+        return sqe;
+    };
+
+    auto arm = [&]
+    {
+        io_uring_sqe* sqe = get_sqe();
+        if (!sqe) return;
+
+        socket_wrapper::prep_recvmsg_multishot(sqe, 0, &receive_msg, group);
+        sqe->flags |= IOSQE_FIXED_FILE;
+        sqe->user_data = receive_op;
+        armed          = true;
+    };
+
+    auto on_completion = [&](const io_uring_cqe& cqe)
+    {
+        if (cqe.user_data == BufferRing::user_data)
+        {
+            logger.error("IORING_OP_PROVIDE_BUFFERS: {}", std::strerror(-cqe.res));
+            return;
+        }
+
+        if ((cqe.user_data & send_op) != 0)
+        {
+            if (cqe.res < 0) metrics.add(m.send_errors);
+            buffers.recycle(static_cast<uint16_t>(cqe.user_data));
+            --in_flight;
+            return;
+        }
+
+        // Without F_MORE the request is gone and must be armed again.
+        if (!(cqe.flags & IORING_CQE_F_MORE)) armed = false;
+
+        if (cqe.res < 0)
+        {
+            // ENOBUFS: every buffer waits for its reply to go out.
+            if (cqe.res != -ENOBUFS) logger.error("recvmsg: {}", std::strerror(-cqe.res));
+            return;
+        }
+
+        const uint16_t             id = BufferRing::buffer_id(cqe);
+        socket_wrapper::RecvmsgOut out;
+
+        if (!socket_wrapper::parse_recvmsg_out(buffers.data(id), cqe.res, receive_msg, out))
+        {
+            buffers.recycle(id);
+            return;
+        }
+
+        if (!admit(shard, out.name, out.name_length, out.payload.size(), 1, received_at))
+        {
+            buffers.recycle(id);
+            return;
+        }
+
+        if (out.truncated)
+        {
+            metrics.add(m.truncated);
+            logger.warning("Datagram truncated to {} bytes", out.payload.size());
+        }
+
+        on_datagram(out.name, out.name_length, out.payload);
+
+        auto& reply = replies[id];
+
+        reply.iov             = { const_cast<char*>(out.payload.data()), out.payload.size() };
+        reply.msg             = {};
+        reply.msg.msg_name    = const_cast<sockaddr*>(out.name);
+        reply.msg.msg_namelen = out.name_length;
+        reply.msg.msg_iov     = &reply.iov;
+        reply.msg.msg_iovlen  = 1;
+
+        io_uring_sqe* sqe = get_sqe();
+        if (!sqe)
+        {
+            metrics.add(m.send_errors);
+            buffers.recycle(id);
+            return;
+        }
+
+        socket_wrapper::prep_sendmsg(sqe, 0, &reply.msg);
+        sqe->flags |= IOSQE_FIXED_FILE;
+        sqe->user_data = send_op | id;
+        ++in_flight;
+    };
+
+    arm();
+
+    while (!loop.stopped())
+    {
+        if (ring.submit(1, std::chrono::milliseconds(100)) < 0 && errno != EBUSY)
+        {
+            logger.error("io_uring_enter: {}", sock_wrap.get_last_error_string());
+            stop_all();
+            break;
+        }
+
+        received_at              = std::chrono::steady_clock::now();
+        const unsigned completed = ring.for_each_completion(on_completion);
+
+        buffers.commit();
+        if (!armed && in_flight < buffers.count()) arm();
+
+        if (completed > 0)
+        {
+            metrics.add(m.batches);
+            metrics.observe(m.batch_latency,
+                            std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                std::chrono::steady_clock::now() - received_at)
+                                .count());
+        }
+    }
+}
+
+static void serve(Shard& shard, const Options& opts, socket_wrapper::Logger& logger)
+{
+    socket_wrapper::SocketWrapper sock_wrap;
+    auto&                         metrics = shard.metrics;
+    const auto&                   m       = shard.m;
+
+    // A spinning thread must not share its CPU.
+    if ((shards.size() > 1 || opts.spin.count() > 0) && socket_wrapper::pin_current_thread(shard.cpu) != 0)
+    {
+        logger.warning("Pinning to CPU {} failed: {}", shard.cpu, sock_wrap.get_last_error_string());
+    }
+
+    // string to store command
+    std::string command_string;
+
+    char client_address_buf[INET_ADDRSTRLEN];
+    char client_name_buf[NI_MAXHOST];
+
+    // What every backend does with a received datagram, besides echoing it.
+    auto on_datagram = [&](const sockaddr* address, socklen_t address_len, std::string_view buffer)
+    {
+        const auto& client_address = *reinterpret_cast<const sockaddr_in*>(address);
+        size_t      recv_len       = buffer.size();
+
+        metrics.add(m.datagrams);
+        metrics.add(m.bytes, recv_len);
+
+        if (logger.enabled(socket_wrapper::LogLevel::debug) && address->sa_family != AF_INET)
+        {
+            uint32_t id = 0;
+            socket_wrapper::ShmServer::client_id(address, address_len, id);
+
+            logger.debug("Local client {} sent datagram [length = {}]: '{}'", id, recv_len, buffer);
+        }
+        else if (logger.enabled(socket_wrapper::LogLevel::debug))
+        {
+            // Cached host name, the numeric address until it resolves.
+            shard.resolver.reverse(address, address_len, client_name_buf, sizeof(client_name_buf));
+
+            logger.debug("Client {} with address {}:{} sent datagram [length = {}]: '{}'",
+                         client_name_buf,
+                         inet_ntop(AF_INET,
+                                   &client_address.sin_addr,
+                                   client_address_buf,
+                                   sizeof(client_address_buf) / sizeof(client_address_buf[0])),
+                         ntohs(client_address.sin_port),
+                         recv_len,
+                         buffer);
+        }
+
+        if (recv_len == 4)
+        {
+            command_string.assign(buffer.data(), buffer.size());
+            rtrim(command_string);
+            if ("exit" == command_string)
+                stop_all();
+        }
+    };
+
+    // Subscriptions not renewed for the idle timeout expire.
+    if (shard.fanout)
+    {
+        shard.loop.add_timer(
+            std::chrono::seconds(1),
+            [&] {
+                shard.fanout->expire(std::chrono::steady_clock::now());
+                metrics.set(m.subscriptions, shard.fanout->subscriptions());
+            },
+            std::chrono::seconds(1));
+    }
+
+    if (shard.shm)
+    {
+        shard.shm->set_receive_timeout(std::chrono::milliseconds(100));
+        serve_blocking(shard, opts, logger, *shard.shm, on_datagram);
+        return;
+    }
+
+    switch (opts.backend)
+    {
+        case Backend::blocking:
+        {
+            UdpChannel channel{ shard.sock };
+            // Lets the thread notice stop().
+            if (socket_wrapper::set_option<socket_wrapper::option::ReceiveTimeout>(shard.sock,
+                                                                                std::chrono::milliseconds(100)) != 0)
+            {
+                logger.warning("SO_RCVTIMEO: {}", sock_wrap.get_last_error_string());
+            }
+            serve_blocking(shard, opts, logger, channel, on_datagram);
+            break;
+        }
+        case Backend::epoll:
+            serve_epoll(shard, opts, logger, on_datagram);
+            break;
+        case Backend::uring:
+            serve_uring(shard, opts, logger, on_datagram);
+            break;
+    }
+}
+
 int main(int argc, char const* argv[])
 {
+    Options opts;
 
-    if (argc != 2)
+    if (!parse_options(argc, argv, opts))
     {
-        std::cout << "Usage: " << argv[0] << " <port>" << std::endl;
+        usage(argv[0]);
         return EXIT_FAILURE;
     }
 
     socket_wrapper::SocketWrapper sock_wrap;
-    const int                     port{ std::stoi(argv[1]) };
-
-    socket_wrapper::Socket sock = { AF_INET, SOCK_DGRAM, IPPROTO_UDP };
+    socket_wrapper::Logger        logger;
+    socket_wrapper::Metrics       metrics;
+    const int                     port = opts.port;
+    const auto                    cpus = socket_wrapper::allowed_cpus();
 
-    std::cout << "Starting echo server on the port " << port << "...\n";
+    logger.set_level(opts.log_level);
+    logger.set_sampling(socket_wrapper::LogLevel::debug, opts.log_sample);
 
-    if (!sock)
+    // Steering maps a CPU to one shard: a shard sharing its CPU gets nothing.
+    if (opts.steering == Steering::bpf && opts.threads > std::max<size_t>(cpus.size(), 1))
     {
-        std::cerr << sock_wrap.get_last_error_string() << std::endl;
+        logger.error("--steer bpf needs a CPU per shard, {} allowed for {} shards", cpus.size(), opts.threads);
         return EXIT_FAILURE;
     }
 
+    logger.info("Starting echo server on the port {} with {} shard(s)...", port, opts.threads);
+
     sockaddr_in addr = {
         .sin_family = PF_INET,
         .sin_port   = htons(port),
@@ -44,80 +967,201 @@ int main(int argc, char const* argv[])
 
     addr.sin_addr.s_addr = INADDR_ANY;
 
-    if (bind(sock, reinterpret_cast<const sockaddr*>(&addr), sizeof(addr)) != 0)
+    // Sockets join the reuseport group in bind() order: shard i is socket i.
+    for (size_t i = 0; i < opts.threads; ++i)
     {
-        std::cerr << sock_wrap.get_last_error_string() << std::endl;
-        // Socket will be closed in the Socket destructor.
-        return EXIT_FAILURE;
-    }
+        auto  shard = std::make_unique<Shard>(cpus.empty() ? 0 : cpus[i % cpus.size()], opts, metrics, i);
+        auto& sock  = shard->sock;
 
-    char buffer[256];
+        if (opts.transport == Transport::shm)
+        {
+            const std::string name = "/udp-server-" + std::to_string(port);
 
-    // string to store command
-    std::string command_string;
+            shard->shm = std::make_unique<socket_wrapper::ShmServer>(name);
+            if (!shard->shm->opened())
+            {
+                logger.error("Shared memory {}: {}", name, sock_wrap.get_last_error_string());
+                return EXIT_FAILURE;
+            }
+            logger.info("Serving same-host clients through {}", name);
 
-    bool exit = false;
+            shards.push_back(std::move(shard));
+            continue;
+        }
 
-    // socket address used to store client address
-    struct sockaddr_in client_address     = { 0 };
-    socklen_t          client_address_len = sizeof(sockaddr_in);
-    ssize_t            recv_len           = 0;
+        if (!sock)
+        {
+            logger.error("socket: {}", sock_wrap.get_last_error_string());
+            return EXIT_FAILURE;
+        }
 
-    std::cout << "Running echo server...\n" << std::endl;
-    char client_address_buf[INET_ADDRSTRLEN];
-    char client_name_buf[NI_MAXHOST];
+        if (opts.threads > 1 && socket_wrapper::enable_reuseport(sock) != 0)
+        {
+            logger.error("SO_REUSEPORT: {}", sock_wrap.get_last_error_string());
+            return EXIT_FAILURE;
+        }
 
-    while (!exit)
-    {
-        // Read content into buffer from an incoming client.
-        recv_len = recvfrom(sock,
-                            buffer,
-                            sizeof(buffer) - 1,
-                            0,
-                            reinterpret_cast<sockaddr*>(&client_address),
-                            &client_address_len);
-
-        // getting hostname from address
-        getnameinfo(reinterpret_cast<sockaddr*>(&client_address),
-                    client_address_len,
-                    client_name_buf,
-                    sizeof(client_name_buf),
-                    nullptr,
-                    0,
-                    NI_NAMEREQD);
-
-        if (recv_len > 0)
-        {
-            buffer[recv_len] = '\0';
-            std::cout << "Client " << client_name_buf << " with address "
-                      << inet_ntop(AF_INET,
-                                   &client_address.sin_addr,
-                                   client_address_buf,
-                                   sizeof(client_address_buf) / sizeof(client_address_buf[0]))
-                      << ":" << ntohs(client_address.sin_port)
-                      << " sent datagram "
-                      << "[length = " << recv_len << "]:\n'''\n"
-                      << buffer << "\n'''" << std::endl;
+        if (opts.steering == Steering::cpu &&
+            socket_wrapper::set_incoming_cpu(sock, shard->cpu) != 0)
+        {
+            logger.warning("SO_INCOMING_CPU: {}", sock_wrap.get_last_error_string());
+        }
 
-            if (recv_len == 4)
+        socket_wrapper::apply_socket_profile(sock, opts.profile, [&](const char* option, int error) {
+            logger.warning("{} ({} profile): {}",
+                           option,
+                           socket_wrapper::socket_profile_name(opts.profile),
+                           std::strerror(error));
+        });
+
+        // The other backends echo one datagram per buffer, and without offload
+        // (pub/sub routes every datagram on its own) the profile's GRO must
+        // not merge them either.
+        if (opts.backend != Backend::epoll || !opts.offload)
+        {
+            socket_wrapper::set_option<socket_wrapper::option::UdpGro>(sock, false);
+        }
+        else if (opts.offload)
+        {
+            if (socket_wrapper::enable_udp_gro(sock) != 0)
+            {
+                logger.warning("UDP_GRO unavailable: {}", sock_wrap.get_last_error_string());
+            }
+            shard->gso = socket_wrapper::probe_udp_gso(sock) == 0;
+            if (!shard->gso)
             {
-                command_string = buffer;
-                rtrim(command_string);
-                if ("exit" == command_string)
-                    exit = true;
+                logger.warning("UDP_SEGMENT unavailable: {}", sock_wrap.get_last_error_string());
             }
+        }
+
+        if (socket_wrapper::enable_rx_drop_counter(sock) != 0)
+        {
+            logger.warning("SO_RXQ_OVFL: {}", sock_wrap.get_last_error_string());
+        }
+
+        // A publish queues a datagram per subscriber at once.
+        if (opts.mode == Mode::pubsub &&
+            socket_wrapper::set_option<socket_wrapper::option::SendBuffer>(sock, 16 << 20) != 0)
+        {
+            logger.warning("SO_SNDBUF: {}", sock_wrap.get_last_error_string());
+        }
+
+        if (opts.multicast &&
+            socket_wrapper::set_option<socket_wrapper::option::MulticastTimeToLive>(sock, opts.multicast_ttl) != 0)
+        {
+            logger.warning("IP_MULTICAST_TTL: {}", sock_wrap.get_last_error_string());
+        }
 
-            // Send same content back to the client ("echo").
-            sendto(sock,
-                   buffer,
-                   recv_len,
-                   0,
-                   reinterpret_cast<const sockaddr*>(&client_address),
-                   client_address_len);
+        if (bind(sock, reinterpret_cast<const sockaddr*>(&addr), sizeof(addr)) != 0)
+        {
+            logger.error("bind: {}", sock_wrap.get_last_error_string());
+            // Socket will be closed in the Socket destructor.
+            return EXIT_FAILURE;
         }
 
-        std::cout << std::endl;
+        if (opts.backend != Backend::blocking && sock.set_nonblocking() != 0)
+        {
+            logger.error("FIONBIO: {}", sock_wrap.get_last_error_string());
+            return EXIT_FAILURE;
+        }
+
+        shards.push_back(std::move(shard));
+    }
+
+    std::vector<unsigned> shard_cpus;
+    for (const auto& shard : shards) shard_cpus.push_back(shard->cpu);
+
+    if (opts.steering == Steering::bpf && opts.threads > 1 &&
+        socket_wrapper::attach_reuseport_cpu_steering(shards.front()->sock, shard_cpus) != 0)
+    {
+        logger.warning("SO_ATTACH_REUSEPORT_CBPF: {}", sock_wrap.get_last_error_string());
+    }
+
+    metrics.gauge("udp_server_proc_drops",
+                  "Drops of the sockets bound to the port, from /proc/net/udp.",
+                  "port=\"" + std::to_string(port) + "\"",
+                  [port] { return static_cast<double>(socket_wrapper::proc_udp_drops(port)); });
+    metrics.gauge("udp_server_log_dropped", "Log records dropped because a ring was full.", "", [&logger] {
+        return static_cast<double>(logger.dropped());
+    });
+
+    std::unique_ptr<socket_wrapper::MetricsExporter> exporter;
+    if (!opts.metrics_address.empty())
+    {
+        exporter = std::make_unique<socket_wrapper::MetricsExporter>(metrics, opts.metrics_address);
+        if (exporter->listening())
+            logger.info("Serving metrics on {}", opts.metrics_address);
+        else
+            logger.warning("Metrics endpoint {}: {}", opts.metrics_address, sock_wrap.get_last_error_string());
+    }
+
+    std::signal(SIGINT, stop_handler);
+    std::signal(SIGTERM, stop_handler);
+
+    logger.info("Running echo server...");
+
+    // Shard 0 runs on the main thread.
+    std::vector<std::thread> workers;
+    for (size_t i = 1; i < shards.size(); ++i)
+    {
+        workers.emplace_back(serve, std::ref(*shards[i]), std::cref(opts), std::ref(logger));
+    }
+    serve(*shards.front(), opts, logger);
+
+    for (auto& worker : workers) worker.join();
+
+    for (size_t i = 0; i < shards.size(); ++i)
+    {
+        const auto& m    = shards[i]->m;
+        const auto  pool = shards[i]->pool.stats();
+        logger.info("Shard {} (cpu {}): {} datagrams, {} bytes, {} batches, {} coalesced, "
+                    "{} truncated, {} send errors",
+                    i,
+                    shards[i]->cpu,
+                    metrics.value(m.datagrams),
+                    metrics.value(m.bytes),
+                    metrics.value(m.batches),
+                    metrics.value(m.coalesced),
+                    metrics.value(m.truncated),
+                    metrics.value(m.send_errors));
+        if (opts.spin.count() > 0)
+        {
+            logger.info("Shard {} spin: {} hits, {} sleeps",
+                        i,
+                        metrics.value(m.spin_hits),
+                        metrics.value(m.sleeps));
+        }
+        if (const auto& sessions = shards[i]->sessions)
+        {
+            const auto& stats = sessions->stats();
+            logger.info("Shard {} sessions: {} active, {} created, {} expired, {} evicted, {} rate limited",
+                        i,
+                        sessions->size(),
+                        stats.created,
+                        stats.expired,
+                        stats.evicted,
+                        stats.dropped);
+        }
+        if (const auto& fanout = shards[i]->fanout)
+        {
+            const auto& stats = fanout->stats();
+            logger.info("Shard {} topics: {}, {} subscriptions, {} published, {} sent, {} send errors, {} expired",
+                        i,
+                        fanout->topic_count(),
+                        fanout->subscriptions(),
+                        stats.published,
+                        stats.delivered,
+                        stats.send_errors,
+                        stats.expired);
+        }
+        logger.info("Shard {} pool: {} x {} B buffers, high water {}, exhausted {} times",
+                    i,
+                    pool.capacity,
+                    pool.buffer_size,
+                    pool.high_water,
+                    pool.exhausted);
     }
+    logger.info("Logger dropped {} records", logger.dropped());
 
     return EXIT_SUCCESS;
 }
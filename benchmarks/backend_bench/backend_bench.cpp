@@ -0,0 +1,422 @@
+// Loopback UDP echo on the three I/O backends of udp-server: a blocking
+// recvfrom()/sendto() loop, recvmmsg()/sendmmsg() batches from an epoll
+// loop, and io_uring with a multishot recvmsg into provided buffers.
+// Throughput with a window of datagrams in flight, then round-trip latency
+// with one at a time.
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <poll.h>
+
+#include <socket_wrapper/datagram_batch.h>
+#include <socket_wrapper/event_loop.h>
+#include <socket_wrapper/histogram.h>
+#include <socket_wrapper/io_uring.h>
+#include <socket_wrapper/socket_class.h>
+#include <socket_wrapper/socket_headers.h>
+#include <socket_wrapper/socket_wrapper.h>
+
+using namespace std::chrono_literals;
+
+struct Options
+{
+    double seconds      = 2;
+    size_t batch        = 32;
+    size_t payload_size = 64;
+    size_t window       = 256;
+    size_t pings        = 20000;
+};
+
+enum class Backend
+{
+    blocking,
+    epoll,
+    uring,
+};
+
+struct Result
+{
+    double                    pps;
+    socket_wrapper::Histogram rtt; // ns
+};
+
+
+static socket_wrapper::Socket make_server_socket(sockaddr_in& addr, Backend backend)
+{
+    socket_wrapper::Socket sock = { AF_INET, SOCK_DGRAM, IPPROTO_UDP };
+
+    addr                 = { .sin_family = AF_INET, .sin_port = 0 };
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    socklen_t len = sizeof(addr);
+    if (!sock || bind(sock, reinterpret_cast<const sockaddr*>(&addr), len) != 0 ||
+        getsockname(sock, reinterpret_cast<sockaddr*>(&addr), &len) != 0)
+    {
+        throw std::runtime_error("Server socket setup failed!");
+    }
+
+    if (backend == Backend::blocking)
+    {
+        // Lets the server thread notice the stop flag.
+        timeval tv = { .tv_sec = 0, .tv_usec = 100000 };
+        setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    }
+    else if (sock.set_nonblocking() != 0)
+    {
+        throw std::runtime_error("Server socket setup failed!");
+    }
+
+    return sock;
+}
+
+
+static void serve_blocking(const socket_wrapper::Socket& sock, const std::atomic<bool>& stop)
+{
+    char        buffer[65536];
+    sockaddr_in client_address;
+
+    while (!stop)
+    {
+        socklen_t     client_address_len = sizeof(client_address);
+        const ssize_t recv_len           = recvfrom(sock,
+                                          buffer,
+                                          sizeof(buffer),
+                                          0,
+                                          reinterpret_cast<sockaddr*>(&client_address),
+                                          &client_address_len);
+        if (recv_len < 0) continue;
+
+        sendto(sock,
+               buffer,
+               recv_len,
+               0,
+               reinterpret_cast<const sockaddr*>(&client_address),
+               client_address_len);
+    }
+}
+
+
+static void serve_epoll(const socket_wrapper::Socket& sock, size_t depth, socket_wrapper::EventLoop& loop)
+{
+    socket_wrapper::DatagramBatch batch(depth, socket_wrapper::max_datagram_size);
+
+    loop.add(sock, socket_wrapper::EventLoop::readable, [&](uint32_t) {
+        int received;
+        while ((received = batch.receive(sock)) > 0)
+        {
+            batch.send(sock, received);
+            if (static_cast<size_t>(received) < batch.depth()) break;
+        }
+    });
+
+    loop.run();
+}
+
+
+static void serve_uring(const socket_wrapper::Socket& sock, size_t buffers_count, const std::atomic<bool>& stop)
+{
+    using socket_wrapper::BufferRing;
+
+    socket_wrapper::IoUring ring(2 * buffers_count);
+    const int               fd = sock;
+
+    if (!ring.opened() || ring.register_files(&fd, 1) != 0)
+    {
+        throw std::runtime_error("io_uring setup failed!");
+    }
+
+    BufferRing buffers(ring, 0, buffers_count, 2048);
+    if (!buffers.opened()) throw std::runtime_error("Provided buffers setup failed!");
+
+    msghdr receive_msg      = {};
+    receive_msg.msg_namelen = sizeof(sockaddr_storage);
+
+    struct Reply
+    {
+        msghdr msg;
+        iovec  iov;
+    };
+    std::vector<Reply> replies(buffers.count());
+
+    const uint64_t send_op   = 1ull << 32;
+    bool           armed     = false;
+    size_t         in_flight = 0;
+
+    auto get_sqe = [&] {
+        io_uring_sqe* sqe = ring.get_sqe();
+        while (!sqe && ring.submit() >= 0) sqe = ring.get_sqe();
+        return sqe;
+    };
+
+    auto arm = [&] {
+        io_uring_sqe* sqe = get_sqe();
+        socket_wrapper::prep_recvmsg_multishot(sqe, 0, &receive_msg, buffers.group());
+        sqe->flags |= IOSQE_FIXED_FILE;
+        armed = true;
+    };
+
+    auto on_completion = [&](const io_uring_cqe& cqe) {
+        if (cqe.user_data == BufferRing::user_data) return;
+
+        if (cqe.user_data & send_op)
+        {
+            buffers.recycle(static_cast<uint16_t>(cqe.user_data));
+            --in_flight;
+            return;
+        }
+
+        if (!(cqe.flags & IORING_CQE_F_MORE)) armed = false;
+        if (cqe.res < 0) return;
+
+        const uint16_t             id = BufferRing::buffer_id(cqe);
+        socket_wrapper::RecvmsgOut out;
+
+        if (!socket_wrapper::parse_recvmsg_out(buffers.data(id), cqe.res, receive_msg, out))
+        {
+            buffers.recycle(id);
+            return;
+        }
+
+        auto& reply = replies[id];
+
+        reply.iov             = { const_cast<char*>(out.payload.data()), out.payload.size() };
+        reply.msg             = {};
+        reply.msg.msg_name    = const_cast<sockaddr*>(out.name);
+        reply.msg.msg_namelen = out.name_length;
+        reply.msg.msg_iov     = &reply.iov;
+        reply.msg.msg_iovlen  = 1;
+
+        io_uring_sqe* sqe = get_sqe();
+        socket_wrapper::prep_sendmsg(sqe, 0, &reply.msg);
+        sqe->flags |= IOSQE_FIXED_FILE;
+        sqe->user_data = send_op | id;
+        ++in_flight;
+    };
+
+    arm();
+
+    while (!stop)
+    {
+        ring.submit(1, 100ms);
+        ring.for_each_completion(on_completion);
+        buffers.commit();
+        if (!armed && in_flight < buffers.count()) arm();
+    }
+}
+
+
+static socket_wrapper::Socket make_client_socket(const sockaddr_in& server)
+{
+    socket_wrapper::Socket sock = { AF_INET, SOCK_DGRAM, IPPROTO_UDP };
+
+    if (!sock || connect(sock, reinterpret_cast<const sockaddr*>(&server), sizeof(server)) != 0)
+    {
+        throw std::runtime_error("Client socket setup failed!");
+    }
+
+    return sock;
+}
+
+
+// Keeps `window` datagrams in flight and counts echoed replies.
+static double run_throughput(const sockaddr_in& server, const Options& opts)
+{
+    socket_wrapper::Socket sock = make_client_socket(server);
+
+    if (sock.set_nonblocking() != 0) throw std::runtime_error("Client socket setup failed!");
+
+    const size_t                  burst = 64;
+    socket_wrapper::DatagramBatch tx(burst, opts.payload_size);
+    socket_wrapper::DatagramBatch rx(burst, socket_wrapper::max_datagram_size);
+
+    for (size_t i = 0; i < burst; ++i)
+    {
+        std::memset(tx.data(i), 'a', opts.payload_size);
+        tx.set_length(i, opts.payload_size);
+    }
+
+    using Clock        = std::chrono::steady_clock;
+    const auto start   = Clock::now();
+    const auto finish  = start + std::chrono::duration<double>(opts.seconds);
+    auto       last_rx = start;
+
+    size_t in_flight = 0;
+    size_t received  = 0;
+
+    for (auto now = start; now < finish; now = Clock::now())
+    {
+        if (in_flight < opts.window)
+        {
+            int sent = tx.send(sock, std::min(burst, opts.window - in_flight));
+            if (sent > 0) in_flight += sent;
+        }
+
+        pollfd pfd = { .fd = sock, .events = POLLIN };
+        poll(&pfd, 1, 1);
+
+        int n;
+        while ((n = rx.receive(sock)) > 0)
+        {
+            received += n;
+            in_flight -= std::min<size_t>(in_flight, n);
+            last_rx = now;
+        }
+
+        // Replies lost to a full socket buffer never come back.
+        if (now - last_rx > 10ms)
+        {
+            in_flight = 0;
+            last_rx   = now;
+        }
+    }
+
+    return received / std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+
+// One datagram in flight: the round trip through the server's backend.
+static socket_wrapper::Histogram run_latency(const sockaddr_in& server, const Options& opts)
+{
+    socket_wrapper::Socket    sock = make_client_socket(server);
+    socket_wrapper::Histogram rtt;
+    std::vector<char>         payload(opts.payload_size, 'a');
+    char                      reply[65536];
+
+    timeval tv = { .tv_sec = 0, .tv_usec = 100000 };
+    setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+
+    for (size_t i = 0; i < opts.pings; ++i)
+    {
+        const auto sent_at = std::chrono::steady_clock::now();
+
+        if (send(sock, payload.data(), payload.size(), 0) < 0) continue;
+        // A lost reply times out and is not counted.
+        if (recv(sock, reply, sizeof(reply), 0) < 0) continue;
+
+        rtt.record(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - sent_at)
+                       .count());
+    }
+
+    return rtt;
+}
+
+
+static Result measure(const Options& opts, Backend backend)
+{
+    sockaddr_in               server;
+    socket_wrapper::Socket    sock = make_server_socket(server, backend);
+    socket_wrapper::EventLoop loop;
+    std::atomic<bool>         stop{ false };
+    std::exception_ptr        error;
+
+    std::thread worker([&] {
+        try
+        {
+            if (backend == Backend::blocking)
+                serve_blocking(sock, stop);
+            else if (backend == Backend::epoll)
+                serve_epoll(sock, opts.batch, loop);
+            else
+                serve_uring(sock, 2 * opts.window, stop);
+        }
+        catch (...)
+        {
+            error = std::current_exception();
+        }
+    });
+
+    Result result;
+    result.pps = run_throughput(server, opts);
+    // A server that failed to start would let every ping time out.
+    if (result.pps > 0) result.rtt = run_latency(server, opts);
+
+    stop = true;
+    loop.stop();
+    worker.join();
+
+    if (error) std::rethrow_exception(error);
+    if (result.pps == 0) throw std::runtime_error("No replies!");
+
+    return result;
+}
+
+
+int main(int argc, const char* argv[])
+{
+    Options opts;
+    bool    valid = argc % 2 == 1;
+
+    for (int i = 1; valid && i + 1 < argc; i += 2)
+    {
+        const std::string name = argv[i];
+
+        if ("--seconds" == name)
+            opts.seconds = std::stod(argv[i + 1]);
+        else if ("--batch" == name)
+            opts.batch = std::stoul(argv[i + 1]);
+        else if ("--size" == name)
+            opts.payload_size = std::stoul(argv[i + 1]);
+        else if ("--window" == name)
+            opts.window = std::stoul(argv[i + 1]);
+        else if ("--pings" == name)
+            opts.pings = std::stoul(argv[i + 1]);
+        else
+            valid = false;
+    }
+
+    if (!valid || opts.batch == 0 || opts.payload_size == 0 || opts.payload_size > 2000 || opts.window == 0)
+    {
+        std::cout << "Usage: " << argv[0]
+                  << " [--seconds S] [--batch N] [--size BYTES (<= 2000)] [--window N] [--pings N]\n";
+        return EXIT_FAILURE;
+    }
+
+    socket_wrapper::SocketWrapper sock_wrap;
+
+    std::cout << "UDP echo over loopback, " << opts.payload_size << " B payload, " << opts.window
+              << " datagrams in flight, then " << opts.pings << " round trips\n\n";
+    std::cout << std::left << std::setw(24) << "backend" << std::right << std::setw(10) << "pps"
+              << std::setw(8) << "" << std::setw(10) << "p50 us" << std::setw(10) << "p99 us" << std::setw(10)
+              << "p99.9 us" << "\n";
+
+    const std::pair<const char*, Backend> backends[] = {
+        { "blocking", Backend::blocking },
+        { "epoll + recvmmsg", Backend::epoll },
+        { "io_uring multishot", Backend::uring },
+    };
+
+    double base = 0;
+
+    for (const auto& [name, backend] : backends)
+    {
+        Result r;
+
+        try
+        {
+            r = measure(opts, backend);
+        }
+        catch (const std::exception& e)
+        {
+            std::cout << std::left << std::setw(24) << name << e.what() << "\n";
+            continue;
+        }
+
+        if (base == 0) base = r.pps;
+
+        std::cout << std::left << std::setw(24) << name << std::right << std::fixed << std::setprecision(0)
+                  << std::setw(10) << r.pps << std::setprecision(2) << std::setw(6) << r.pps / base << "x"
+                  << std::setprecision(1) << std::setw(11) << r.rtt.percentile(50) / 1e3 << std::setw(10)
+                  << r.rtt.percentile(99) / 1e3 << std::setw(10) << r.rtt.percentile(99.9) / 1e3 << "\n";
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,159 @@
+// Publish cost per subscriber over loopback: a sendto() per subscriber
+// against TopicFanout's prebuilt sendmmsg() batches from one payload buffer.
+// Every subscriber is a socket of its own; nobody reads them, so once their
+// queues are full the kernel drops the datagrams after the send is paid for.
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <sys/resource.h>
+
+#include <socket_wrapper/socket_class.h>
+#include <socket_wrapper/socket_headers.h>
+#include <socket_wrapper/socket_options.h>
+#include <socket_wrapper/socket_wrapper.h>
+#include <socket_wrapper/topic_fanout.h>
+
+struct Options
+{
+    std::vector<size_t> subscribers  = { 16, 256, 4096 };
+    size_t              publishes    = 200;
+    size_t              payload_size = 64;
+    size_t              batch        = 1024;
+};
+
+
+struct Subscribers
+{
+    explicit Subscribers(size_t count)
+    {
+        for (size_t i = 0; i < count; ++i)
+        {
+            socket_wrapper::Socket sock(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+            sockaddr_in            addr = { .sin_family = AF_INET, .sin_port = 0 };
+            socklen_t              len  = sizeof(addr);
+
+            addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+            if (!sock || bind(sock, reinterpret_cast<const sockaddr*>(&addr), len) != 0 ||
+                getsockname(sock, reinterpret_cast<sockaddr*>(&addr), &len) != 0)
+            {
+                throw std::runtime_error("Subscriber socket setup failed!");
+            }
+
+            sockets.push_back(std::move(sock));
+            addresses.push_back(addr);
+        }
+    }
+
+    std::vector<socket_wrapper::Socket> sockets;
+    std::vector<sockaddr_in>            addresses;
+};
+
+
+template <typename Publish>
+static double ns_per_subscriber(const Options& opts, size_t subscribers, Publish&& publish)
+{
+    using Clock = std::chrono::steady_clock;
+
+    publish(); // warm up
+
+    const auto start = Clock::now();
+    for (size_t i = 0; i < opts.publishes; ++i) publish();
+    const auto elapsed = std::chrono::duration<double, std::nano>(Clock::now() - start).count();
+
+    return elapsed / (opts.publishes * subscribers);
+}
+
+
+int main(int argc, const char* argv[])
+{
+    Options opts;
+    bool    valid = argc % 2 == 1;
+
+    for (int i = 1; valid && i + 1 < argc; i += 2)
+    {
+        const std::string name = argv[i];
+
+        if ("--subscribers" == name)
+            opts.subscribers = { std::stoul(argv[i + 1]) };
+        else if ("--publishes" == name)
+            opts.publishes = std::stoul(argv[i + 1]);
+        else if ("--size" == name)
+            opts.payload_size = std::stoul(argv[i + 1]);
+        else if ("--batch" == name)
+            opts.batch = std::stoul(argv[i + 1]);
+        else
+            valid = false;
+    }
+
+    if (!valid || opts.publishes == 0 || opts.payload_size > 65507 || opts.batch == 0 || opts.subscribers[0] == 0)
+    {
+        std::cout << "Usage: " << argv[0]
+                  << " [--subscribers N] [--publishes N] [--size BYTES] [--batch N (<= 1024)]\n";
+        return EXIT_FAILURE;
+    }
+
+    // A socket per subscriber.
+    rlimit files;
+    if (getrlimit(RLIMIT_NOFILE, &files) == 0)
+    {
+        files.rlim_cur = files.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &files);
+    }
+
+    socket_wrapper::SocketWrapper sock_wrap;
+    socket_wrapper::Socket        publisher(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    const std::vector<char>       payload(opts.payload_size, 'a');
+
+    // A whole publish fits the send buffer.
+    socket_wrapper::set_option<socket_wrapper::option::SendBuffer>(publisher, 16 << 20);
+
+    std::cout << "Publish of " << opts.payload_size << " B to every subscriber, " << opts.publishes
+              << " times, ns per subscriber\n\n";
+    std::cout << std::right << std::setw(12) << "subscribers" << std::setw(14) << "sendto()" << std::setw(14)
+              << "sendmmsg()" << "\n";
+
+    for (const size_t count : opts.subscribers)
+    {
+        try
+        {
+            Subscribers subscribers(count);
+
+            const double single = ns_per_subscriber(opts, count, [&] {
+                for (const auto& addr : subscribers.addresses)
+                {
+                    sendto(publisher,
+                           payload.data(),
+                           payload.size(),
+                           0,
+                           reinterpret_cast<const sockaddr*>(&addr),
+                           sizeof(addr));
+                }
+            });
+
+            socket_wrapper::TopicFanout fanout({ .max_subscribers = count, .batch = opts.batch, .ttl = {} });
+            const auto                  now = std::chrono::steady_clock::now();
+
+            for (const auto& addr : subscribers.addresses)
+            {
+                fanout.subscribe("bench", reinterpret_cast<const sockaddr*>(&addr), sizeof(addr), now);
+            }
+
+            const double batched = ns_per_subscriber(opts, count, [&] { fanout.publish(publisher, "bench", payload); });
+
+            std::cout << std::setw(12) << count << std::fixed << std::setprecision(0) << std::setw(14) << single
+                      << std::setw(14) << batched << "\n";
+        }
+        catch (const std::exception& e)
+        {
+            std::cout << std::setw(12) << count << "  " << e.what() << "\n";
+        }
+    }
+
+    return EXIT_SUCCESS;
+}
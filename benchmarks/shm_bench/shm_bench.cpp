@@ -0,0 +1,312 @@
+// Same-host datagram echo over UDP loopback, a Unix domain datagram socket
+// pair and the shared memory transport. Throughput with a window of
+// datagrams in flight, then round-trip latency with one at a time. Every
+// link is used with blocking calls from a client and an echo thread.
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <unistd.h>
+
+#include <socket_wrapper/histogram.h>
+#include <socket_wrapper/shm_transport.h>
+#include <socket_wrapper/socket_class.h>
+#include <socket_wrapper/socket_headers.h>
+#include <socket_wrapper/socket_options.h>
+#include <socket_wrapper/socket_wrapper.h>
+
+using namespace std::chrono_literals;
+
+struct Options
+{
+    double seconds      = 2;
+    size_t payload_size = 64;
+    size_t window       = 128;
+    size_t pings        = 20000;
+};
+
+struct Result
+{
+    double                    pps;
+    socket_wrapper::Histogram rtt; // ns
+};
+
+
+// Blocking receives give up after this, so the echo thread sees the stop
+// flag and a lost datagram does not hang the client.
+static const auto receive_timeout = 100ms;
+
+
+static void set_receive_timeout(const socket_wrapper::Socket& sock)
+{
+    if (socket_wrapper::set_option<socket_wrapper::option::ReceiveTimeout>(sock, receive_timeout) != 0)
+    {
+        throw std::runtime_error("SO_RCVTIMEO failed!");
+    }
+}
+
+
+struct UdpLink
+{
+    UdpLink()
+        : server(AF_INET, SOCK_DGRAM, IPPROTO_UDP)
+        , client(AF_INET, SOCK_DGRAM, IPPROTO_UDP)
+    {
+        sockaddr_in addr     = { .sin_family = AF_INET, .sin_port = 0 };
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+        socklen_t len = sizeof(addr);
+        if (!server || !client || bind(server, reinterpret_cast<const sockaddr*>(&addr), len) != 0 ||
+            getsockname(server, reinterpret_cast<sockaddr*>(&addr), &len) != 0 ||
+            connect(client, reinterpret_cast<const sockaddr*>(&addr), len) != 0)
+        {
+            throw std::runtime_error("UDP socket setup failed!");
+        }
+
+        set_receive_timeout(server);
+        set_receive_timeout(client);
+    }
+
+    void echo_once(char* buffer, size_t capacity)
+    {
+        sockaddr_storage from;
+        socklen_t        from_len = sizeof(from);
+        const ssize_t    len      = recvfrom(server, buffer, capacity, 0, reinterpret_cast<sockaddr*>(&from), &from_len);
+
+        if (len >= 0) sendto(server, buffer, len, 0, reinterpret_cast<const sockaddr*>(&from), from_len);
+    }
+
+    ssize_t send(const char* data, size_t len) { return ::send(client, data, len, 0); }
+    ssize_t recv(char* data, size_t len) { return ::recv(client, data, len, 0); }
+
+    socket_wrapper::Socket server;
+    socket_wrapper::Socket client;
+};
+
+
+struct UnixLink
+{
+    UnixLink()
+        : server(make_pair())
+        , client(pair_[1])
+    {
+        set_receive_timeout(server);
+        set_receive_timeout(client);
+    }
+
+    void echo_once(char* buffer, size_t capacity)
+    {
+        const ssize_t len = ::recv(server, buffer, capacity, 0);
+
+        if (len >= 0) ::send(server, buffer, len, 0);
+    }
+
+    ssize_t send(const char* data, size_t len) { return ::send(client, data, len, 0); }
+    ssize_t recv(char* data, size_t len) { return ::recv(client, data, len, 0); }
+
+    int make_pair()
+    {
+        if (socketpair(AF_UNIX, SOCK_DGRAM, 0, pair_) != 0) throw std::runtime_error("socketpair() failed!");
+        return pair_[0];
+    }
+
+    int                    pair_[2];
+    socket_wrapper::Socket server;
+    socket_wrapper::Socket client;
+};
+
+
+struct ShmLink
+{
+    ShmLink()
+        : name("/shm-bench-" + std::to_string(getpid()))
+        , server(name)
+        , client(name)
+    {
+        if (!server.opened() || !client.opened()) throw std::runtime_error("Shared memory setup failed!");
+
+        server.set_receive_timeout(receive_timeout);
+        client.set_receive_timeout(receive_timeout);
+    }
+
+    void echo_once(char* buffer, size_t capacity)
+    {
+        sockaddr_storage from;
+        socklen_t        from_len = sizeof(from);
+        const ssize_t    len      = server.recv_from(buffer, capacity, reinterpret_cast<sockaddr*>(&from), &from_len);
+
+        if (len >= 0) server.send_to(buffer, len, reinterpret_cast<const sockaddr*>(&from), from_len);
+    }
+
+    ssize_t send(const char* data, size_t len) { return client.send(data, len); }
+    ssize_t recv(char* data, size_t len) { return client.recv(data, len); }
+
+    std::string               name;
+    socket_wrapper::ShmServer server;
+    socket_wrapper::ShmClient client;
+};
+
+
+// Keeps `window` datagrams in flight and counts echoed replies.
+template <typename Link>
+static double run_throughput(Link& link, const Options& opts)
+{
+    std::vector<char> payload(opts.payload_size, 'a');
+    char              reply[65536];
+
+    using Clock       = std::chrono::steady_clock;
+    const auto start  = Clock::now();
+    const auto finish = start + std::chrono::duration<double>(opts.seconds);
+
+    size_t in_flight = 0;
+    size_t received  = 0;
+
+    while (Clock::now() < finish)
+    {
+        while (in_flight < opts.window && link.send(payload.data(), payload.size()) >= 0) ++in_flight;
+
+        if (link.recv(reply, sizeof(reply)) >= 0)
+        {
+            ++received;
+            --in_flight;
+        }
+        else
+        {
+            // Timed out: the rest of the window was lost.
+            in_flight = 0;
+        }
+    }
+
+    // Replies still on the way are left to the echo thread.
+    return received / std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+
+// One datagram in flight.
+template <typename Link>
+static socket_wrapper::Histogram run_latency(Link& link, const Options& opts)
+{
+    socket_wrapper::Histogram rtt;
+    std::vector<char>         payload(opts.payload_size, 'a');
+    char                      reply[65536];
+
+    // Drains what the throughput run left over.
+    while (link.recv(reply, sizeof(reply)) >= 0) {}
+
+    for (size_t i = 0; i < opts.pings; ++i)
+    {
+        const auto sent_at = std::chrono::steady_clock::now();
+
+        if (link.send(payload.data(), payload.size()) < 0) continue;
+        // A lost reply times out and is not counted.
+        if (link.recv(reply, sizeof(reply)) < 0) continue;
+
+        rtt.record(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - sent_at)
+                       .count());
+    }
+
+    return rtt;
+}
+
+
+template <typename Link>
+static Result measure(const Options& opts)
+{
+    Link              link;
+    std::atomic<bool> stop{ false };
+
+    std::thread worker([&] {
+        std::vector<char> buffer(65536);
+        while (!stop) link.echo_once(buffer.data(), buffer.size());
+    });
+
+    Result result;
+    result.pps = run_throughput(link, opts);
+    if (result.pps > 0) result.rtt = run_latency(link, opts);
+
+    stop = true;
+    worker.join();
+
+    if (result.pps == 0) throw std::runtime_error("No replies!");
+
+    return result;
+}
+
+
+int main(int argc, const char* argv[])
+{
+    Options opts;
+    bool    valid = argc % 2 == 1;
+
+    for (int i = 1; valid && i + 1 < argc; i += 2)
+    {
+        const std::string name = argv[i];
+
+        if ("--seconds" == name)
+            opts.seconds = std::stod(argv[i + 1]);
+        else if ("--size" == name)
+            opts.payload_size = std::stoul(argv[i + 1]);
+        else if ("--window" == name)
+            opts.window = std::stoul(argv[i + 1]);
+        else if ("--pings" == name)
+            opts.pings = std::stoul(argv[i + 1]);
+        else
+            valid = false;
+    }
+
+    // The shared memory slots hold 2048 bytes.
+    if (!valid || opts.payload_size == 0 || opts.payload_size > 2000 || opts.window == 0)
+    {
+        std::cout << "Usage: " << argv[0] << " [--seconds S] [--size BYTES (<= 2000)] [--window N] [--pings N]\n";
+        return EXIT_FAILURE;
+    }
+
+    socket_wrapper::SocketWrapper sock_wrap;
+
+    std::cout << "Same-host echo, " << opts.payload_size << " B payload, " << opts.window
+              << " datagrams in flight, then " << opts.pings << " round trips\n\n";
+    std::cout << std::left << std::setw(24) << "transport" << std::right << std::setw(10) << "pps"
+              << std::setw(8) << "" << std::setw(10) << "p50 us" << std::setw(10) << "p99 us" << std::setw(10)
+              << "p99.9 us" << "\n";
+
+    const std::pair<const char*, Result (*)(const Options&)> transports[] = {
+        { "UDP loopback", measure<UdpLink> },
+        { "Unix datagram pair", measure<UnixLink> },
+        { "shared memory", measure<ShmLink> },
+    };
+
+    double base = 0;
+
+    for (const auto& [name, run] : transports)
+    {
+        Result r;
+
+        try
+        {
+            r = run(opts);
+        }
+        catch (const std::exception& e)
+        {
+            std::cout << std::left << std::setw(24) << name << e.what() << "\n";
+            continue;
+        }
+
+        if (base == 0) base = r.pps;
+
+        std::cout << std::left << std::setw(24) << name << std::right << std::fixed << std::setprecision(0)
+                  << std::setw(10) << r.pps << std::setprecision(2) << std::setw(6) << r.pps / base << "x"
+                  << std::setprecision(1) << std::setw(11) << r.rtt.percentile(50) / 1e3 << std::setw(10)
+                  << r.rtt.percentile(99) / 1e3 << std::setw(10) << r.rtt.percentile(99.9) / 1e3 << "\n";
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,299 @@
+// Loopback TCP throughput of the transmit paths: send() from a user buffer,
+// MSG_ZEROCOPY, sendfile() and splice() from a file in the page cache.
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <poll.h>
+#include <stdlib.h>
+
+#include <socket_wrapper/socket_headers.h>
+#include <socket_wrapper/socket_wrapper.h>
+#include <socket_wrapper/tcp.h>
+
+using Clock = std::chrono::steady_clock;
+
+struct Options
+{
+    double seconds   = 2;
+    size_t chunk     = 256 * 1024;
+    // Size of the file sendfile() and splice() read from.
+    size_t file_size = 64 * 1024 * 1024;
+    // Buffers MSG_ZEROCOPY rotates through while the kernel holds them.
+    size_t buffers   = 16;
+};
+
+enum class Mode
+{
+    copy,
+    zerocopy,
+    sendfile,
+    splice,
+};
+
+struct Result
+{
+    double   gbps;
+    uint64_t zerocopy_sent;
+    uint64_t zerocopy_copied;
+};
+
+
+static void wait_for(const socket_wrapper::TcpConnection& conn, short events)
+{
+    pollfd pfd = { conn, events, 0 };
+    poll(&pfd, 1, 100);
+}
+
+
+// Reads and discards until EOF, returns the byte count and the time from the
+// first to the last byte.
+static void receive_all(socket_wrapper::TcpConnection& conn, uint64_t& bytes, double& seconds)
+{
+    std::vector<char> buffer(1 << 20);
+    Clock::time_point first;
+
+    bytes = 0;
+    for (;;)
+    {
+        const ssize_t n = recv(conn, buffer.data(), buffer.size(), 0);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) break;
+
+        if (bytes == 0) first = Clock::now();
+        bytes += n;
+    }
+
+    seconds = std::chrono::duration<double>(Clock::now() - first).count();
+}
+
+
+static bool send_chunk(socket_wrapper::TcpConnection& conn,
+                       const Options&                 opts,
+                       Mode                           mode,
+                       std::vector<std::vector<char>>& buffers,
+                       std::vector<uint32_t>&          released_after,
+                       size_t&                         next_buffer,
+                       int                             file_fd,
+                       off_t&                          offset)
+{
+    if (mode == Mode::copy)
+    {
+        if (conn.write({ buffers[0].data(), buffers[0].size() }) != 0) return false;
+        while (conn.flush() == 1) wait_for(conn, POLLOUT);
+        return true;
+    }
+
+    if (mode == Mode::zerocopy)
+    {
+        const size_t b = next_buffer;
+        next_buffer    = (next_buffer + 1) % buffers.size();
+
+        // The kernel may still read this buffer.
+        while (conn.zerocopy_completed() < released_after[b])
+        {
+            wait_for(conn, 0); // POLLERR is always reported
+            if (conn.read_zerocopy_completions() < 0) return false;
+        }
+
+        size_t sent = 0;
+        while (sent < buffers[b].size())
+        {
+            const ssize_t n = conn.write_zerocopy(buffers[b].data() + sent, buffers[b].size() - sent);
+            if (n >= 0)
+            {
+                sent += n;
+                continue;
+            }
+            // ENOBUFS: the notification budget (optmem) is used up.
+            if (errno != EAGAIN && errno != EWOULDBLOCK && errno != ENOBUFS) return false;
+
+            conn.read_zerocopy_completions();
+            wait_for(conn, POLLOUT);
+        }
+        released_after[b] = conn.zerocopy_sent();
+        return true;
+    }
+
+    size_t left = opts.chunk;
+    while (left > 0)
+    {
+        if (static_cast<size_t>(offset) >= opts.file_size) offset = 0;
+
+        const size_t  count = std::min(left, opts.file_size - offset);
+        const ssize_t n     = mode == Mode::sendfile ? conn.send_file(file_fd, offset, count)
+                                                     : conn.splice_file(file_fd, offset, count);
+        if (n < 0)
+        {
+            if (errno != EAGAIN && errno != EWOULDBLOCK) return false;
+            wait_for(conn, POLLOUT);
+            continue;
+        }
+        // splice() may report bytes the pipe held from the last call.
+        left -= std::min<size_t>(left, n);
+        if (n == 0) wait_for(conn, POLLOUT);
+    }
+
+    return true;
+}
+
+
+static Result measure(const Options& opts, Mode mode, int file_fd)
+{
+    sockaddr_in addr = { .sin_family = AF_INET, .sin_port = 0 };
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    socket_wrapper::TcpListener listener(reinterpret_cast<const sockaddr*>(&addr), sizeof(addr));
+    socklen_t                   len = sizeof(addr);
+
+    if (!listener.listening() || getsockname(listener, reinterpret_cast<sockaddr*>(&addr), &len) != 0)
+    {
+        throw std::runtime_error("Listener setup failed!");
+    }
+
+    socket_wrapper::TcpConnection sender(reinterpret_cast<const sockaddr*>(&addr), sizeof(addr));
+    wait_for(sender, POLLOUT);
+    if (!sender || sender.connect_error() != 0) throw std::runtime_error("Connect failed!");
+
+    socket_wrapper::TcpConnection receiver = listener.accept();
+    while (!receiver)
+    {
+        pollfd pfd = { listener, POLLIN, 0 };
+        poll(&pfd, 1, 100);
+        receiver = listener.accept();
+    }
+    // The reader blocks, the sender polls.
+    receiver.set_nonblocking(false);
+
+    uint64_t    bytes   = 0;
+    double      seconds = 0;
+    std::thread reader([&] { receive_all(receiver, bytes, seconds); });
+
+    std::vector<std::vector<char>> buffers(mode == Mode::zerocopy ? opts.buffers : 1,
+                                           std::vector<char>(opts.chunk, 'x'));
+    std::vector<uint32_t>          released_after(buffers.size(), 0);
+    size_t                         next_buffer = 0;
+    off_t                          offset      = 0;
+    Result                         result      = {};
+
+    if (mode == Mode::zerocopy && sender.enable_zerocopy() != 0)
+    {
+        std::cerr << "SO_ZEROCOPY: " << std::strerror(errno) << std::endl;
+    }
+
+    const auto end = Clock::now() + std::chrono::duration_cast<Clock::duration>(
+                                        std::chrono::duration<double>(opts.seconds));
+
+    while (Clock::now() < end)
+    {
+        if (!send_chunk(sender, opts, mode, buffers, released_after, next_buffer, file_fd, offset))
+        {
+            std::cerr << "send: " << std::strerror(errno) << std::endl;
+            break;
+        }
+    }
+
+    // Every buffer must be released before it is freed.
+    while (mode == Mode::zerocopy && sender.zerocopy_completed() < sender.zerocopy_sent())
+    {
+        wait_for(sender, 0);
+        if (sender.read_zerocopy_completions() < 0) break;
+    }
+
+    shutdown(sender, SHUT_WR);
+    reader.join();
+
+    result.gbps            = seconds > 0 ? bytes * 8 / seconds / 1e9 : 0;
+    result.zerocopy_sent   = sender.zerocopy_sent();
+    result.zerocopy_copied = sender.zerocopy_copied();
+
+    return result;
+}
+
+
+static int make_file(size_t size)
+{
+    char path[] = "/tmp/tcp-bench-XXXXXX";
+    int  fd     = mkstemp(path);
+
+    if (fd < 0) throw std::runtime_error("mkstemp failed!");
+    unlink(path);
+
+    // Written once, later reads come from the page cache.
+    std::vector<char> block(1 << 20, 'f');
+    for (size_t written = 0; written < size; written += block.size())
+    {
+        if (::write(fd, block.data(), std::min(block.size(), size - written)) < 0)
+        {
+            throw std::runtime_error("Test file write failed!");
+        }
+    }
+
+    return fd;
+}
+
+
+int main(int argc, const char* argv[])
+{
+    Options opts;
+    bool    valid = argc % 2 == 1;
+
+    for (int i = 1; valid && i + 1 < argc; i += 2)
+    {
+        const std::string name = argv[i];
+
+        if ("--seconds" == name)
+            opts.seconds = std::stod(argv[i + 1]);
+        else if ("--chunk" == name)
+            opts.chunk = std::stoul(argv[i + 1]);
+        else if ("--file-size" == name)
+            opts.file_size = std::stoul(argv[i + 1]);
+        else if ("--buffers" == name)
+            opts.buffers = std::stoul(argv[i + 1]);
+        else
+            valid = false;
+    }
+
+    if (!valid || opts.chunk == 0 || opts.file_size == 0 || opts.buffers == 0)
+    {
+        std::cout << "Usage: " << argv[0] << " [--seconds S] [--chunk BYTES] [--file-size BYTES] [--buffers N]\n";
+        return EXIT_FAILURE;
+    }
+
+    socket_wrapper::SocketWrapper sock_wrap;
+    const int                     file_fd = make_file(opts.file_size);
+
+    std::cout << "TCP over loopback, " << opts.chunk << " B per send call\n\n";
+
+    auto print = [](const char* name, const Result& r, const Result& base) {
+        std::cout << std::left << std::setw(20) << name << std::right << std::fixed
+                  << std::setprecision(2) << std::setw(8) << r.gbps << " Gbit/s "
+                  << std::setw(6) << r.gbps / base.gbps << "x";
+        if (r.zerocopy_sent > 0)
+        {
+            std::cout << "  (" << r.zerocopy_copied << " of " << r.zerocopy_sent
+                      << " sends fell back to copying)";
+        }
+        std::cout << '\n';
+    };
+
+    const Result copy = measure(opts, Mode::copy, file_fd);
+
+    print("send():", copy, copy);
+    print("MSG_ZEROCOPY:", measure(opts, Mode::zerocopy, file_fd), copy);
+    print("sendfile():", measure(opts, Mode::sendfile, file_fd), copy);
+    print("splice():", measure(opts, Mode::splice, file_fd), copy);
+
+    close(file_fd);
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,323 @@
+// Loopback UDP echo throughput: the single recvfrom()/sendto() loop against
+// the recvmmsg()/sendmmsg() batch path, with and without UDP GSO/GRO, and
+// the same single loop written as a coroutine.
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <thread>
+
+#include <poll.h>
+
+#include <socket_wrapper/coroutine.h>
+#include <socket_wrapper/datagram_batch.h>
+#include <socket_wrapper/socket_class.h>
+#include <socket_wrapper/socket_headers.h>
+#include <socket_wrapper/socket_wrapper.h>
+
+using namespace std::chrono_literals;
+
+struct Options
+{
+    double seconds      = 2;
+    size_t batch        = 32;
+    size_t payload_size = 64;
+    size_t window       = 256;
+    // Datagrams per GSO send in the offload run, 0 skips it.
+    size_t gso_segments = 16;
+};
+
+enum class Mode
+{
+    single,
+    batched,
+    offload,
+    coroutine,
+};
+
+struct Result
+{
+    double pps;
+    double gbps;
+};
+
+
+static socket_wrapper::Socket make_server_socket(sockaddr_in& addr)
+{
+    socket_wrapper::Socket sock = { AF_INET, SOCK_DGRAM, IPPROTO_UDP };
+
+    addr                 = { .sin_family = AF_INET, .sin_port = 0 };
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    socklen_t len = sizeof(addr);
+    if (!sock || bind(sock, reinterpret_cast<const sockaddr*>(&addr), len) != 0 ||
+        getsockname(sock, reinterpret_cast<sockaddr*>(&addr), &len) != 0)
+    {
+        throw std::runtime_error("Server socket setup failed!");
+    }
+
+    // Lets the server threads notice the stop flag.
+    timeval tv = { .tv_sec = 0, .tv_usec = 100000 };
+    setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+
+    return sock;
+}
+
+
+static void serve_single(const socket_wrapper::Socket& sock, const std::atomic<bool>& stop)
+{
+    char        buffer[65536];
+    sockaddr_in client_address;
+
+    while (!stop)
+    {
+        socklen_t client_address_len = sizeof(client_address);
+        ssize_t   recv_len           = recvfrom(sock,
+                                  buffer,
+                                  sizeof(buffer),
+                                  0,
+                                  reinterpret_cast<sockaddr*>(&client_address),
+                                  &client_address_len);
+        if (recv_len <= 0) continue;
+
+        sendto(sock,
+               buffer,
+               recv_len,
+               0,
+               reinterpret_cast<const sockaddr*>(&client_address),
+               client_address_len);
+    }
+}
+
+
+static void serve_batched(const socket_wrapper::Socket& sock,
+                          size_t                        depth,
+                          bool                          offload,
+                          const std::atomic<bool>&      stop)
+{
+    socket_wrapper::DatagramBatch batch(depth, socket_wrapper::max_datagram_size);
+
+    if (offload)
+    {
+        socket_wrapper::enable_udp_gro(sock);
+        batch.set_gso(socket_wrapper::probe_udp_gso(sock) == 0);
+    }
+
+    while (!stop)
+    {
+        // Blocks for the first datagram only.
+        int received = batch.receive(sock, MSG_WAITFORONE);
+        if (received <= 0) continue;
+
+        batch.send(sock, received);
+    }
+}
+
+
+// Frame allocations of the coroutine server thread.
+static socket_wrapper::FramePool::Stats coroutine_frames;
+
+static socket_wrapper::Task<void> serve_coroutine(socket_wrapper::Socket&& server_sock, const std::atomic<bool>& stop)
+{
+    socket_wrapper::AsyncSocket sock(std::move(server_sock));
+    char                        buffer[65536];
+    sockaddr_storage            client_address;
+
+    while (!stop)
+    {
+        socklen_t     client_address_len = sizeof(client_address);
+        const ssize_t recv_len           = co_await sock.recv_from(buffer,
+                                                         sizeof(buffer),
+                                                         reinterpret_cast<sockaddr*>(&client_address),
+                                                         &client_address_len);
+        if (recv_len <= 0) continue;
+
+        co_await sock.send_to(buffer,
+                              recv_len,
+                              reinterpret_cast<const sockaddr*>(&client_address),
+                              client_address_len);
+    }
+
+    coroutine_frames = socket_wrapper::FramePool::stats();
+}
+
+
+// Keeps `window` datagrams in flight and counts echoed replies.
+static Result run_client(const sockaddr_in& server, const Options& opts, bool offload)
+{
+    socket_wrapper::Socket sock = { AF_INET, SOCK_DGRAM, IPPROTO_UDP };
+
+    if (!sock ||
+        connect(sock, reinterpret_cast<const sockaddr*>(&server), sizeof(server)) != 0 ||
+        sock.set_nonblocking() != 0)
+    {
+        throw std::runtime_error("Client socket setup failed!");
+    }
+
+    // Every tx slot carries `segments` datagrams of payload_size bytes.
+    const size_t                  segments = offload ? opts.gso_segments : 1;
+    const size_t                  burst    = std::max<size_t>(64 / segments, 1);
+    socket_wrapper::DatagramBatch tx(burst, opts.payload_size * segments);
+    socket_wrapper::DatagramBatch rx(burst, socket_wrapper::max_datagram_size);
+
+    if (offload)
+    {
+        socket_wrapper::enable_udp_gro(sock);
+        tx.set_gso(socket_wrapper::probe_udp_gso(sock) == 0);
+    }
+
+    for (size_t i = 0; i < burst; ++i)
+    {
+        std::memset(tx.data(i), 'a', opts.payload_size * segments);
+        tx.set_length(i, opts.payload_size * segments);
+        tx.set_segment_size(i, segments > 1 ? opts.payload_size : 0);
+    }
+
+    using Clock        = std::chrono::steady_clock;
+    const auto start   = Clock::now();
+    const auto finish  = start + std::chrono::duration<double>(opts.seconds);
+    auto       last_rx = start;
+
+    size_t in_flight = 0;
+    size_t received  = 0;
+    size_t bytes     = 0;
+
+    for (auto now = start; now < finish; now = Clock::now())
+    {
+        if (in_flight < opts.window)
+        {
+            int sent = tx.send(sock, std::min(burst, (opts.window - in_flight + segments - 1) / segments));
+            if (sent > 0) in_flight += sent * segments;
+        }
+
+        pollfd pfd = { .fd = sock, .events = POLLIN };
+        poll(&pfd, 1, 1);
+
+        int n;
+        while ((n = rx.receive(sock)) > 0)
+        {
+            for (int i = 0; i < n; ++i)
+            {
+                const size_t datagrams = rx.segment_count(i);
+                received += datagrams;
+                bytes += rx.length(i);
+                in_flight -= std::min(in_flight, datagrams);
+            }
+            last_rx = now;
+        }
+
+        // Replies lost to a full socket buffer never come back.
+        if (now - last_rx > 10ms)
+        {
+            in_flight = 0;
+            last_rx   = now;
+        }
+    }
+
+    const double elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+
+    return { received / elapsed, bytes * 8 / elapsed / 1e9 };
+}
+
+
+static Result measure(const Options& opts, Mode mode)
+{
+    sockaddr_in            server;
+    socket_wrapper::Socket sock = make_server_socket(server);
+    std::atomic<bool>      stop{ false };
+
+    std::thread worker([&] {
+        if (mode == Mode::single)
+            serve_single(sock, stop);
+        else if (mode == Mode::coroutine)
+        {
+            socket_wrapper::EventLoop loop;
+            socket_wrapper::run(loop, serve_coroutine(std::move(sock), stop));
+        }
+        else
+            serve_batched(sock, opts.batch, mode == Mode::offload, stop);
+    });
+
+    Result result = run_client(server, opts, mode == Mode::offload);
+
+    stop = true;
+    if (mode == Mode::coroutine)
+    {
+        // Wakes the coroutine waiting in recv_from().
+        socket_wrapper::Socket wakeup = { AF_INET, SOCK_DGRAM, IPPROTO_UDP };
+        sendto(wakeup, "", 0, 0, reinterpret_cast<const sockaddr*>(&server), sizeof(server));
+    }
+    worker.join();
+
+    return result;
+}
+
+
+int main(int argc, const char* argv[])
+{
+    Options opts;
+    bool    valid = argc % 2 == 1;
+
+    for (int i = 1; valid && i + 1 < argc; i += 2)
+    {
+        const std::string name = argv[i];
+
+        if ("--seconds" == name)
+            opts.seconds = std::stod(argv[i + 1]);
+        else if ("--batch" == name)
+            opts.batch = std::stoul(argv[i + 1]);
+        else if ("--size" == name)
+            opts.payload_size = std::stoul(argv[i + 1]);
+        else if ("--window" == name)
+            opts.window = std::stoul(argv[i + 1]);
+        else if ("--gso" == name)
+            opts.gso_segments = std::stoul(argv[i + 1]);
+        else
+            valid = false;
+    }
+
+    if (!valid || opts.batch == 0 || opts.payload_size == 0 ||
+        opts.payload_size * std::max<size_t>(opts.gso_segments, 1) > 65507)
+    {
+        std::cout << "Usage: " << argv[0]
+                  << " [--seconds S] [--batch N] [--size BYTES] [--window N] [--gso SEGMENTS]\n";
+        return EXIT_FAILURE;
+    }
+
+    socket_wrapper::SocketWrapper sock_wrap;
+
+    std::cout << "UDP echo over loopback, " << opts.payload_size << " B payload, "
+              << opts.window << " datagrams in flight\n\n";
+
+    auto print = [](const char* name, const Result& r, const Result& base) {
+        std::cout << std::left << std::setw(28) << name << std::right << std::fixed
+                  << std::setprecision(0) << std::setw(10) << r.pps << " pps "
+                  << std::setprecision(2) << std::setw(8) << r.gbps << " Gbit/s "
+                  << std::setw(6) << r.pps / base.pps << "x\n";
+    };
+
+    const Result single  = measure(opts, Mode::single);
+    const Result batched = measure(opts, Mode::batched);
+
+    print("recvfrom/sendto:", single, single);
+    print(("recvmmsg/sendmmsg (" + std::to_string(opts.batch) + "):").c_str(), batched, single);
+
+    const Result coroutine = measure(opts, Mode::coroutine);
+    print("coroutine recv/send:", coroutine, single);
+    std::cout << "    " << coroutine_frames.allocations << " coroutine frames, "
+              << coroutine_frames.heap_allocations << " from the heap\n";
+
+    if (opts.gso_segments > 1)
+    {
+        const Result offload = measure(opts, Mode::offload);
+        print(("+ GSO/GRO (" + std::to_string(opts.gso_segments) + " segments):").c_str(),
+              offload,
+              single);
+    }
+
+    return EXIT_SUCCESS;
+}
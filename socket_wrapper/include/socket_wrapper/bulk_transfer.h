@@ -0,0 +1,347 @@
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <span>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "congestion_control.h"
+#include "datagram_batch.h"
+#include "event_loop.h"
+#include "loss_shim.h"
+#include "socket_class.h"
+#include "socket_headers.h"
+
+
+namespace socket_wrapper
+{
+
+// Reliable one-way transfer of a block of memory over UDP, without TCP's
+// head-of-line blocking: the data is cut into fixed-size chunks that may
+// arrive in any order and are written straight to their place.
+//
+// Every DATA datagram gets a new packet number, a retransmitted chunk too,
+// so acknowledgements are never ambiguous (as in QUIC). The receiver
+// acknowledges each batch it reads with the ranges of packet numbers it got
+// (selective acknowledgement). The sender takes RTT samples from them,
+// declares a packet lost once three later ones or 9/8 RTT worth of later
+// ones were acknowledged, and retransmits its chunk. Both thresholds widen
+// whenever a packet declared lost turns up after all. How much is in flight
+// and how fast it is paced is up to a pluggable CongestionController.
+//
+// Wire format, big endian. Every datagram starts with
+//     u16 magic, u8 type, u8 flags, u32 session
+// DATA continues with
+//     u64 packet number, u64 total size, u32 chunk, u32 chunk size, payload
+// ACK with
+//     u64 largest packet number, u32 ack delay (us), u16 ranges, u16 0,
+//     then per range u64 first, u64 last; those that took packets since
+//     the previous ACK first, then the newest
+// and the flag `complete` once the receiver has everything.
+
+// A whole file mapped into memory.
+class MappedFile
+{
+public:
+    MappedFile() = default;
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+public:
+    // Both return false with errno set. An empty file maps to no memory.
+    bool open(const std::string& path);
+    // Creates or truncates the file and sizes it to `size` bytes, writable.
+    bool create(const std::string& path, size_t size);
+
+    char*  data() const { return data_; }
+    size_t size() const { return size_; }
+
+    // msync(): returns 0, or -1 with errno set.
+    int sync();
+    // Unmaps and closes the file.
+    void close();
+
+private:
+    int    fd_   = -1;
+    char*  data_ = nullptr;
+    size_t size_ = 0;
+};
+
+
+class BulkSender
+{
+public:
+    using Clock    = EventLoop::Clock;
+    // 0 once the receiver has all data, ETIMEDOUT when it stopped answering,
+    // or the errno of a failed send. Called once, on the loop thread.
+    using Callback = std::function<void(int error)>;
+
+    struct Options
+    {
+        size_t    chunk_size   = 1400; // payload bytes per datagram
+        size_t    batch        = 64;   // datagrams per sendmmsg()
+        unsigned  max_timeouts = 8;    // retransmission timeouts in a row before giving up
+        LossShim* shim         = nullptr;
+    };
+
+    struct Stats
+    {
+        uint64_t packets                = 0; // DATA datagrams sent
+        uint64_t retransmitted          = 0;
+        uint64_t spurious_retransmitted = 0; // ... of chunks whose earlier copy arrived
+        uint64_t lost                   = 0; // packets declared lost
+        uint64_t spurious               = 0; // ... and acknowledged after all
+        uint64_t timeouts               = 0;
+        uint64_t acks                   = 0;
+    };
+
+    static constexpr size_t header_size = 32;
+
+public:
+    // `data` must stay valid until the transfer is done. Nothing is sent
+    // before start().
+    BulkSender(EventLoop&                            loop,
+               const sockaddr*                       receiver,
+               socklen_t                             receiver_len,
+               std::span<const char>                 data,
+               std::unique_ptr<CongestionController> congestion,
+               Callback                              done,
+               Options                               options);
+    ~BulkSender();
+
+    BulkSender(const BulkSender&) = delete;
+    BulkSender& operator=(const BulkSender&) = delete;
+
+public:
+    // False if the socket could not be set up (errno is set).
+    bool          opened() const { return opened_; }
+    const Socket& socket() const { return sock_; }
+
+    void start();
+
+public:
+    bool                        finished() const { return finished_; }
+    uint64_t                    size() const { return data_.size(); }
+    uint64_t                    acked_bytes() const { return acked_bytes_; }
+    size_t                      in_flight() const { return in_flight_; }
+    const Stats&                stats() const { return stats_; }
+    const RttEstimator&         rtt() const { return rtt_; }
+    const CongestionController& congestion() const { return *congestion_; }
+
+private:
+    enum class PacketState : uint8_t
+    {
+        in_flight,
+        acked,
+        lost,
+    };
+
+    struct SentPacket
+    {
+        uint32_t          chunk;
+        uint32_t          bytes;
+        PacketState       state;
+        bool              app_limited;
+        Clock::time_point sent_time;
+        // Delivery rate estimation: the connection's state at send time.
+        uint64_t          delivered;
+        Clock::time_point delivered_time;
+        Clock::time_point first_sent_time;
+    };
+
+    // Marks a chunk waiting in the retransmission queue.
+    static constexpr uint64_t queued = UINT64_MAX;
+    // Reordering tolerated at most, in packets (Linux: tcp_max_reordering).
+    static constexpr unsigned max_packet_threshold = 300;
+    // Steps of min RTT / 4 the time threshold widens by at most.
+    static constexpr unsigned max_reorder_steps = 16;
+
+private:
+    size_t            chunk_bytes(uint32_t chunk) const;
+    bool              next_chunk(uint32_t& chunk) const;
+    void              pump();
+    void              queue_packet(uint32_t chunk, Clock::time_point now);
+    // Sends the queued batch, false while the socket is full or on error.
+    bool              flush();
+    void              on_readable();
+    // Handles the ACKs queued on the socket, false if there were none.
+    bool              receive_acks();
+    void              on_ack(const char* data, size_t len);
+    // True if the packet had been declared lost.
+    bool              acknowledge(SentPacket& packet, uint64_t number, size_t& acked_bytes);
+    void              detect_lost(Clock::time_point now);
+    void              declare_lost(SentPacket& packet, uint64_t number);
+    void              drop_resolved(Clock::time_point now);
+    Clock::time_point rto_deadline() const;
+    void              arm_alarm();
+    void              on_alarm();
+    void              arm_pacer(double rate, size_t bytes);
+    void              finish(int error);
+
+private:
+    EventLoop&                            loop_;
+    Socket                                sock_;
+    const std::span<const char>           data_;
+    std::unique_ptr<CongestionController> congestion_;
+    Callback                              done_;
+    const Options                         options_;
+    bool                                  opened_;
+    bool                                  finished_;
+    uint32_t                              session_;
+    uint32_t                              chunk_count_;
+
+    // Per chunk: acknowledged, and the packet number of its last transmission.
+    std::vector<uint8_t>  chunk_acked_;
+    std::vector<uint64_t> chunk_packet_;
+    std::deque<uint32_t>  retransmit_;
+    uint32_t              next_chunk_;
+    uint32_t              acked_chunks_;
+    uint64_t              acked_bytes_;
+
+    // Packets from first_packet_ on, until they are acknowledged or lost a while.
+    std::deque<SentPacket> packets_;
+    uint64_t               first_packet_;
+    uint64_t               next_packet_;
+    uint64_t               largest_acked_;
+    bool                   has_acked_;
+    // Both grow with every spurious loss: the packet threshold to the
+    // reordering seen, the time threshold by a step of min RTT / 4.
+    unsigned               packet_threshold_;
+    unsigned               reorder_steps_;
+    size_t                 in_flight_;
+
+    RttEstimator       rtt_;
+    Clock::time_point  loss_time_; // when the next packet may be declared lost
+    Clock::time_point  last_progress_;
+    unsigned           timeouts_in_row_;
+    EventLoop::TimerId alarm_;
+    Clock::time_point  alarm_deadline_;
+
+    double             pacing_credit_;
+    Clock::time_point  pacing_stamp_;
+    EventLoop::TimerId pacer_;
+
+    uint64_t          delivered_;
+    Clock::time_point delivered_time_;
+    Clock::time_point first_sent_time_;
+    uint64_t          app_limited_until_; // 0: not short of data
+
+    // Outgoing batch: a header and a payload iovec per datagram.
+    std::vector<mmsghdr>                       msgs_;
+    std::vector<iovec>                         iovecs_;
+    std::vector<std::array<char, header_size>> headers_;
+    size_t                                     batch_count_;
+    size_t                                     batch_sent_;
+    bool                                       waiting_writable_;
+
+    DatagramBatch rx_;
+    Stats         stats_;
+};
+
+
+class BulkReceiver
+{
+public:
+    using Clock    = EventLoop::Clock;
+    // Storage for a transfer of `size` bytes, or false to refuse it.
+    using Storage  = std::function<bool(uint64_t size, std::span<char>& storage)>;
+    // Called once all data is stored.
+    using Callback = std::function<void()>;
+
+    struct Options
+    {
+        size_t    max_ranges = 32; // per acknowledgement
+        size_t    batch      = 64; // datagrams per recvmmsg()
+        LossShim* shim       = nullptr;
+    };
+
+    struct Stats
+    {
+        uint64_t packets    = 0; // DATA datagrams
+        uint64_t duplicates = 0; // chunks received before
+        uint64_t foreign    = 0; // other sessions and malformed datagrams
+        uint64_t acks       = 0;
+    };
+
+public:
+    // Receives one transfer on a UDP socket bound to `local`.
+    BulkReceiver(EventLoop&      loop,
+                 const sockaddr* local,
+                 socklen_t       local_len,
+                 Storage         storage,
+                 Callback        complete,
+                 Options         options);
+    ~BulkReceiver();
+
+    BulkReceiver(const BulkReceiver&) = delete;
+    BulkReceiver& operator=(const BulkReceiver&) = delete;
+
+public:
+    // False if the socket could not be set up (errno is set).
+    bool          opened() const { return opened_; }
+    const Socket& socket() const { return sock_; }
+
+public:
+    bool              started() const { return session_ != 0; }
+    bool              complete() const { return started() && received_chunks_ == chunk_count_; }
+    uint64_t          size() const { return size_; }
+    uint64_t          received_bytes() const { return received_bytes_; }
+    // The last DATA datagram, to tell when the sender has gone quiet.
+    Clock::time_point last_packet_time() const { return last_packet_time_; }
+    const Stats&      stats() const { return stats_; }
+
+private:
+    void on_readable();
+    // True if `datagram`, received in `slot`, was DATA of this transfer.
+    bool on_data(size_t slot, std::string_view datagram, bool truncated, Clock::time_point now);
+    bool start(uint32_t session, uint64_t size, uint32_t chunk_size, size_t slot);
+    void add_range(uint64_t number);
+    void send_ack(Clock::time_point now);
+
+private:
+    // Ranges remembered, an acknowledgement carries Options::max_ranges.
+    static constexpr size_t max_kept_ranges = 4096;
+
+private:
+    EventLoop&    loop_;
+    Socket        sock_;
+    Storage       storage_callback_;
+    Callback      complete_;
+    const Options options_;
+    bool          opened_;
+
+    uint32_t         session_;
+    uint64_t         size_;
+    uint32_t         chunk_size_;
+    uint32_t         chunk_count_;
+    std::span<char>  storage_;
+    sockaddr_storage peer_;
+    socklen_t        peer_len_;
+
+    std::vector<uint8_t> chunk_received_;
+    uint32_t             received_chunks_;
+    uint64_t             received_bytes_;
+
+    // Received packet numbers as [first, last], newest first.
+    std::vector<std::pair<uint64_t, uint64_t>> ranges_;
+    std::vector<uint64_t>                      unacked_numbers_; // received since the last acknowledgement
+    std::vector<size_t>                        ack_ranges_;      // indexes into ranges_, sent in order
+    Clock::time_point                          largest_time_;
+    Clock::time_point                          last_packet_time_;
+    std::vector<char>                          ack_;
+
+    DatagramBatch rx_;
+    Stats         stats_;
+};
+
+} // socket_wrapper
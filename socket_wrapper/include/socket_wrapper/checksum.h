@@ -0,0 +1,61 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+
+namespace socket_wrapper
+{
+
+// Internet checksum (RFC 1071). The ones' complement sum does not depend on
+// the byte order, so all values are 16-bit words exactly as they are stored
+// in the packet, and results can be stored back with a plain assignment.
+
+enum class ChecksumKernel
+{
+    portable,
+    sse2,
+    avx2,
+};
+
+// The fastest kernel the CPU supports, detected once.
+ChecksumKernel checksum_kernel();
+bool           checksum_kernel_supported(ChecksumKernel kernel);
+const char*    checksum_kernel_name(ChecksumKernel kernel);
+
+// Ones' complement sum of `data` folded to 16 bits, not complemented.
+// Sums of consecutive chunks may be combined with checksum_add() as long as
+// every chunk but the last has an even length.
+uint16_t checksum_sum(const void* data, size_t len);
+uint16_t checksum_sum(const void* data, size_t len, ChecksumKernel kernel);
+uint16_t checksum_add(uint16_t sum, uint16_t other);
+
+// Checksum ready to be stored into a header with a zeroed checksum field.
+inline uint16_t internet_checksum(const void* data, size_t len)
+{
+    return static_cast<uint16_t>(~checksum_sum(data, len));
+}
+
+// Incremental update (RFC 1624, eqn. 3) after a 16-bit word of the covered
+// data changed from `old_word` to `new_word`: HC' = ~(~HC + ~m + m').
+inline uint16_t checksum_update(uint16_t checksum, uint16_t old_word, uint16_t new_word)
+{
+    uint32_t sum = static_cast<uint16_t>(~checksum) + static_cast<uint16_t>(~old_word) + new_word;
+
+    sum = (sum & 0xffff) + (sum >> 16);
+    sum = (sum & 0xffff) + (sum >> 16);
+
+    return static_cast<uint16_t>(~sum);
+}
+
+// The same for a 32-bit field (e.g. an address), as two 16-bit words.
+inline uint16_t checksum_update(uint16_t checksum, uint32_t old_value, uint32_t new_value)
+{
+    checksum = checksum_update(checksum, static_cast<uint16_t>(old_value), static_cast<uint16_t>(new_value));
+
+    return checksum_update(checksum,
+                           static_cast<uint16_t>(old_value >> 16),
+                           static_cast<uint16_t>(new_value >> 16));
+}
+
+} // socket_wrapper
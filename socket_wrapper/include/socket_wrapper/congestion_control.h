@@ -0,0 +1,195 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string_view>
+
+
+namespace socket_wrapper
+{
+
+// Round-trip time estimate of RFC 6298: smoothed RTT, its variation and the
+// retransmission timeout derived from them, plus the minimum seen.
+class RttEstimator
+{
+public:
+    using Clock = std::chrono::steady_clock;
+
+public:
+    explicit RttEstimator(Clock::duration initial_rto = std::chrono::seconds(1),
+                          Clock::duration min_rto     = std::chrono::milliseconds(10));
+
+public:
+    // `ack_delay` is the time the receiver held the acknowledgement, it is
+    // subtracted unless that would go below the minimum RTT.
+    void sample(Clock::duration rtt, Clock::duration ack_delay = Clock::duration::zero());
+
+    bool            has_sample() const { return has_sample_; }
+    Clock::duration latest() const { return latest_; }
+    Clock::duration smoothed() const { return smoothed_; }
+    Clock::duration variation() const { return variation_; }
+    Clock::duration min() const { return min_; }
+    Clock::duration rto() const;
+
+private:
+    const Clock::duration initial_rto_;
+    const Clock::duration min_rto_;
+    bool                  has_sample_;
+    Clock::duration       latest_;
+    Clock::duration       smoothed_;
+    Clock::duration       variation_;
+    Clock::duration       min_;
+};
+
+
+// Sender side congestion control, driven by the transfer: it reports every
+// acknowledgement, loss and timeout, and asks how many bytes may be in
+// flight and how fast to pace them. Byte counts are datagram sizes.
+class CongestionController
+{
+public:
+    using Clock = std::chrono::steady_clock;
+
+    // One acknowledgement, with the delivery rate sample of the newest packet
+    // it acknowledged (draft-cheng-iccrg-delivery-rate-estimation).
+    struct Ack
+    {
+        Clock::time_point now;
+        Clock::time_point sent_time;       // of the newest packet acknowledged
+        size_t            acked_bytes;     // newly acknowledged by this ack
+        size_t            in_flight;       // after it
+        uint64_t          delivered;       // bytes delivered in total
+        uint64_t          prior_delivered; // `delivered` when that packet was sent
+        double            delivery_rate;   // bytes per second, 0 without a sample
+        bool              app_limited;     // the sample was taken while short of data
+        Clock::duration   rtt;             // latest sample, zero if none
+        Clock::duration   smoothed_rtt;
+        Clock::duration   min_rtt;
+    };
+
+public:
+    virtual ~CongestionController() = default;
+
+    virtual const char* name() const = 0;
+
+    virtual void on_ack(const Ack& ack) = 0;
+    // Packets were declared lost, the newest of them sent at `sent_time`.
+    virtual void on_loss(Clock::time_point now, Clock::time_point sent_time, size_t lost_bytes, size_t in_flight) = 0;
+    // Nothing was acknowledged for a whole retransmission timeout.
+    virtual void on_timeout(Clock::time_point now) = 0;
+
+    // Bytes allowed in flight.
+    virtual size_t window() const = 0;
+    // Bytes per second to pace at, 0 for no pacing.
+    virtual double pacing_rate() const = 0;
+};
+
+
+// RFC 6582/9002 style loss-based control: slow start, additive increase,
+// halving once per round trip with losses, back to two packets on a timeout.
+// Paced at twice the window per RTT in slow start and 1.25 times after.
+class NewReno : public CongestionController
+{
+public:
+    explicit NewReno(size_t mss);
+
+public:
+    const char* name() const override { return "newreno"; }
+
+    void on_ack(const Ack& ack) override;
+    void on_loss(Clock::time_point now, Clock::time_point sent_time, size_t lost_bytes, size_t in_flight) override;
+    void on_timeout(Clock::time_point now) override;
+
+    size_t window() const override { return window_; }
+    double pacing_rate() const override;
+
+    size_t slow_start_threshold() const { return threshold_; }
+
+private:
+    const size_t      mss_;
+    size_t            window_;
+    size_t            threshold_;
+    size_t            acked_in_round_; // additive increase credit
+    Clock::time_point recovery_start_;
+    Clock::duration   smoothed_rtt_;
+};
+
+
+// Model-based control after BBR v1: the bottleneck bandwidth is the maximum
+// delivery rate of the last ten round trips, the propagation delay the
+// minimum RTT of the last ten seconds. It paces at a gain times the
+// bandwidth (2.89 while starting up, cycling 1.25/0.75/1 while probing) and
+// allows twice the bandwidth-delay product in flight. Losses do not shrink
+// the window.
+class Bbr : public CongestionController
+{
+public:
+    enum class State
+    {
+        startup,
+        drain,
+        probe_bandwidth,
+        probe_rtt,
+    };
+
+public:
+    explicit Bbr(size_t mss);
+
+public:
+    const char* name() const override { return "bbr"; }
+
+    void on_ack(const Ack& ack) override;
+    void on_loss(Clock::time_point now, Clock::time_point sent_time, size_t lost_bytes, size_t in_flight) override;
+    void on_timeout(Clock::time_point now) override;
+
+    size_t window() const override;
+    double pacing_rate() const override;
+
+    State  state() const { return state_; }
+    double bottleneck_bandwidth() const; // bytes per second
+    size_t bdp() const;
+
+private:
+    static constexpr size_t bandwidth_rounds = 10;
+
+    void update_round(const Ack& ack);
+    void update_bandwidth(const Ack& ack);
+    void update_min_rtt(const Ack& ack);
+    void update_state(const Ack& ack);
+    void enter_probe_bandwidth(Clock::time_point now);
+
+private:
+    const size_t mss_;
+    State        state_;
+    double       pacing_gain_;
+    double       window_gain_;
+
+    // Windowed maximum: the best sample of each of the last rounds.
+    double   bandwidth_[bandwidth_rounds];
+    uint64_t round_;
+    uint64_t next_round_delivered_;
+    bool     round_start_;
+
+    Clock::duration   min_rtt_;
+    Clock::time_point min_rtt_stamp_;
+    bool              min_rtt_expired_;
+    Clock::duration   smoothed_rtt_;
+
+    // Startup ends when three rounds grew the bandwidth by less than 25%.
+    double full_bandwidth_;
+    size_t full_bandwidth_rounds_;
+    bool   full_bandwidth_reached_;
+
+    size_t            cycle_index_;
+    Clock::time_point cycle_stamp_;
+    Clock::time_point probe_rtt_done_;
+    bool              timed_out_;
+};
+
+
+// "newreno" or "bbr", nullptr for anything else.
+std::unique_ptr<CongestionController> make_congestion_controller(std::string_view name, size_t mss);
+
+} // socket_wrapper
@@ -0,0 +1,320 @@
+#pragma once
+
+#include <coroutine>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <optional>
+#include <string>
+#include <utility>
+
+#include "event_loop.h"
+#include "packet_buffer.h"
+#include "resolver.h"
+#include "socket_class.h"
+#include "socket_headers.h"
+
+
+namespace socket_wrapper
+{
+
+// Coroutine frames are carved from per-thread free lists in 64-byte size
+// classes, so after warm-up an awaited operation does not touch the heap.
+// Frames above max_pooled_size go to operator new.
+class FramePool
+{
+public:
+    static constexpr size_t max_pooled_size = 4096;
+
+    struct Stats
+    {
+        uint64_t allocations      = 0;
+        uint64_t heap_allocations = 0; // pool misses
+    };
+
+public:
+    static void* allocate(size_t size);
+    static void  deallocate(void* frame, size_t size);
+    // Of the calling thread.
+    static Stats stats();
+};
+
+
+template <typename T>
+class Task;
+
+namespace detail
+{
+
+struct PromiseBase
+{
+    struct FinalAwaiter
+    {
+        bool await_ready() const noexcept { return false; }
+
+        template <typename Promise>
+        std::coroutine_handle<> await_suspend(std::coroutine_handle<Promise> handle) noexcept
+        {
+            auto& promise = handle.promise();
+
+            if (promise.detached)
+            {
+                // Nobody could observe it, as with std::thread.
+                if (promise.exception) std::terminate();
+                handle.destroy();
+                return std::noop_coroutine();
+            }
+
+            // Finished inside Task::await_suspend(): it lets the caller go
+            // on, so a loop of synchronous completions keeps a flat stack
+            // even where the compiler emits no tail call (-O0).
+            if (promise.started_inline)
+            {
+                promise.finished_inline = true;
+                return std::noop_coroutine();
+            }
+
+            return promise.continuation;
+        }
+
+        void await_resume() const noexcept {}
+    };
+
+    static void* operator new(size_t size) { return FramePool::allocate(size); }
+    static void  operator delete(void* frame, size_t size) { FramePool::deallocate(frame, size); }
+
+    std::suspend_always initial_suspend() const noexcept { return {}; }
+    FinalAwaiter        final_suspend() const noexcept { return {}; }
+    void                unhandled_exception() { exception = std::current_exception(); }
+
+    std::coroutine_handle<> continuation;
+    std::exception_ptr      exception;
+    bool                    detached        = false;
+    bool                    started_inline  = false;
+    bool                    finished_inline = false;
+};
+
+
+template <typename T>
+struct Promise : PromiseBase
+{
+    Task<T> get_return_object();
+    void    return_value(T value) { result.emplace(std::move(value)); }
+
+    T take()
+    {
+        if (exception) std::rethrow_exception(exception);
+        return std::move(*result);
+    }
+
+    std::optional<T> result;
+};
+
+
+template <>
+struct Promise<void> : PromiseBase
+{
+    Task<void> get_return_object();
+    void       return_void() const {}
+
+    void take()
+    {
+        if (exception) std::rethrow_exception(exception);
+    }
+};
+
+} // detail
+
+
+// Lazily started coroutine: runs when awaited (or spawned) and resumes the
+// awaiting coroutine when it finishes.
+template <typename T = void>
+class [[nodiscard]] Task
+{
+public:
+    using promise_type = detail::Promise<T>;
+    using Handle       = std::coroutine_handle<promise_type>;
+
+public:
+    explicit Task(Handle handle) : handle_(handle) {}
+    Task(Task&& t) noexcept : handle_(std::exchange(t.handle_, {})) {}
+
+    Task& operator=(Task&& t) noexcept
+    {
+        if (&t == this) return *this;
+
+        if (handle_) handle_.destroy();
+        handle_ = std::exchange(t.handle_, {});
+
+        return *this;
+    }
+
+    ~Task()
+    {
+        if (handle_) handle_.destroy();
+    }
+
+public:
+    bool await_ready() const noexcept { return !handle_ || handle_.done(); }
+
+    bool await_suspend(std::coroutine_handle<> caller) noexcept
+    {
+        auto& promise = handle_.promise();
+
+        promise.continuation   = caller;
+        promise.started_inline = true;
+        handle_.resume();
+        promise.started_inline = false;
+
+        // Done already: the caller continues without suspending.
+        return !promise.finished_inline;
+    }
+
+    T await_resume() { return handle_.promise().take(); }
+
+public:
+    Handle release() { return std::exchange(handle_, {}); }
+
+private:
+    Handle handle_;
+};
+
+
+namespace detail
+{
+
+template <typename T>
+Task<T> Promise<T>::get_return_object()
+{
+    return Task<T>(std::coroutine_handle<Promise<T>>::from_promise(*this));
+}
+
+
+inline Task<void> Promise<void>::get_return_object()
+{
+    return Task<void>(std::coroutine_handle<Promise<void>>::from_promise(*this));
+}
+
+} // detail
+
+
+// Starts `task` right away and lets it run on its own, its frame is freed
+// when it finishes. An exception escaping it terminates the program.
+void spawn(Task<void> task);
+
+// The loop run() drives on the calling thread.
+EventLoop& current_loop();
+
+// Runs `loop` on the calling thread until `main` finishes, rethrows what
+// escaped `main`. Coroutines spawned meanwhile keep their frames alive until
+// the loop runs again.
+void run(EventLoop& loop, Task<void> main);
+
+// One loop per allowed CPU (or `threads` of them), each on a thread pinned to
+// its CPU, running make_main(cpu, index) until it finishes. Combine with
+// SO_REUSEPORT so every loop owns a socket.
+void run_per_core(std::function<Task<void>(unsigned cpu, size_t index)> make_main, size_t threads = 0);
+
+
+// co_await sleep_for(10ms): resumes from a timer of the current loop.
+class SleepAwaiter
+{
+public:
+    explicit SleepAwaiter(EventLoop::Clock::duration delay) : delay_(delay) {}
+
+    bool await_ready() const noexcept { return delay_ <= EventLoop::Clock::duration::zero(); }
+    void await_suspend(std::coroutine_handle<> handle)
+    {
+        current_loop().add_timer(delay_, [handle] { handle.resume(); });
+    }
+    void await_resume() const noexcept {}
+
+private:
+    EventLoop::Clock::duration delay_;
+};
+
+inline SleepAwaiter sleep_for(EventLoop::Clock::duration delay)
+{
+    return SleepAwaiter(delay);
+}
+
+
+// co_await resolve("example.com"): a forward lookup on a worker thread of a
+// process-wide Resolver, the coroutine resumes on its own loop.
+class ResolveAwaiter
+{
+public:
+    ResolveAwaiter(std::string host, int family) : host_(std::move(host)), family_(family) {}
+
+    bool         await_ready() const noexcept { return false; }
+    void         await_suspend(std::coroutine_handle<> handle);
+    ResolvedHost await_resume() { return std::move(result_); }
+
+private:
+    std::string  host_;
+    int          family_;
+    ResolvedHost result_;
+};
+
+inline ResolveAwaiter resolve(std::string host, int family = AF_UNSPEC)
+{
+    return ResolveAwaiter(std::move(host), family);
+}
+
+
+// A non-blocking socket registered with the current loop. Operations try
+// the syscall first and suspend only on EAGAIN; one reader and one writer
+// may wait at a time. Results are those of the syscalls (-1 and errno).
+class AsyncSocket
+{
+public:
+    explicit AsyncSocket(Socket&& sock);
+    ~AsyncSocket();
+
+    AsyncSocket(const AsyncSocket&) = delete;
+    AsyncSocket& operator=(const AsyncSocket&) = delete;
+
+public:
+    // False if the socket is invalid or could not be registered.
+    bool          opened() const { return registered_; }
+    const Socket& socket() const { return sock_; }
+
+public:
+    Task<ssize_t> recv_from(char* data, size_t len, sockaddr* from, socklen_t* from_len, int flags = 0);
+    // Fills `buffer` (size and truncation flag) from one datagram.
+    Task<ssize_t> recv_from(PacketBuffer& buffer, sockaddr_storage* from = nullptr, socklen_t* from_len = nullptr);
+    Task<ssize_t> send_to(const char* data, size_t len, const sockaddr* to, socklen_t to_len, int flags = 0);
+    Task<ssize_t> recv(char* data, size_t len, int flags = 0);
+    Task<ssize_t> send(const char* data, size_t len, int flags = 0);
+
+public:
+    class ReadyAwaiter
+    {
+    public:
+        ReadyAwaiter(std::coroutine_handle<>& waiter) : waiter_(waiter) {}
+
+        bool await_ready() const noexcept { return false; }
+        void await_suspend(std::coroutine_handle<> handle) noexcept { waiter_ = handle; }
+        void await_resume() const noexcept {}
+
+    private:
+        std::coroutine_handle<>& waiter_;
+    };
+
+    // Suspends until the next readiness edge.
+    ReadyAwaiter readable() { return ReadyAwaiter(reader_); }
+    ReadyAwaiter writable() { return ReadyAwaiter(writer_); }
+
+private:
+    void on_events(uint32_t events);
+
+private:
+    Socket                  sock_;
+    EventLoop&              loop_;
+    bool                    registered_;
+    std::coroutine_handle<> reader_;
+    std::coroutine_handle<> writer_;
+};
+
+} // socket_wrapper
@@ -0,0 +1,114 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string_view>
+#include <vector>
+
+#include "packet_buffer.h"
+#include "socket_headers.h"
+
+
+namespace socket_wrapper
+{
+
+// UDP segmentation offloads (Linux 4.18+ for GSO, 5.0+ for GRO).
+// Both return 0 on success and -1 with errno set if the kernel lacks support.
+
+// Lets the kernel coalesce consecutive datagrams of a flow into one receive.
+int enable_udp_gro(SocketDescriptorType sock);
+// Checks that sendmsg() accepts UDP_SEGMENT on this socket.
+int probe_udp_gso(SocketDescriptorType sock);
+// Makes every receive report the socket's receive queue drops (SO_RXQ_OVFL),
+// see DatagramBatch::socket_drops().
+int enable_rx_drop_counter(SocketDescriptorType sock);
+
+// Fixed set of datagram slots moved with one recvmmsg()/sendmmsg() call.
+// Every slot keeps the peer address it was received from, so an echo reply
+// is just send() of the received slots.
+//
+// With GRO enabled on the socket a slot may hold several equally sized
+// datagrams (the last one may be shorter), see segment_size(). A slot with a
+// segment size is sent as one UDP_SEGMENT (GSO) message, or split into
+// separate datagrams if GSO is off or the kernel rejects it.
+class DatagramBatch
+{
+public:
+    // Slots use buffers of an internal pool.
+    DatagramBatch(size_t depth, size_t datagram_size);
+    // Slots use buffers of `pool`, which must outlive the batch.
+    DatagramBatch(size_t depth, BufferPool& pool);
+
+    DatagramBatch(const DatagramBatch&) = delete;
+    DatagramBatch& operator=(const DatagramBatch&) = delete;
+
+public:
+    // Receives up to depth() datagrams, returns their number or -1 (errno set).
+    int receive(SocketDescriptorType sock, int flags = MSG_DONTWAIT);
+    // Sends the first `count` slots, returns the number sent or -1 if none was.
+    int send(SocketDescriptorType sock, size_t count, int flags = 0);
+
+public:
+    size_t depth() const { return msgs_.size(); }
+    size_t datagram_size() const { return pool_->buffer_size(); }
+    // Number of slots filled by the last receive().
+    size_t size() const { return size_; }
+    // Datagrams the kernel dropped on this socket because its receive queue
+    // was full, as of the last receive() (see enable_rx_drop_counter()).
+    uint32_t socket_drops() const { return socket_drops_; }
+
+    char*            data(size_t i) { return slots_[i].data(); }
+    size_t           length(size_t i) const { return slots_[i].size(); }
+    std::string_view view(size_t i) const { return slots_[i].view(); }
+    void             set_length(size_t i, size_t length) { slots_[i].set_size(length); }
+    // The datagram was longer than datagram_size() and got cut (MSG_TRUNC).
+    bool truncated(size_t i) const { return slots_[i].truncated(); }
+
+    // 0 for a single datagram, otherwise the size of the coalesced segments.
+    uint16_t         segment_size(size_t i) const { return segment_sizes_[i]; }
+    void             set_segment_size(size_t i, uint16_t size) { segment_sizes_[i] = size; }
+    size_t           segment_count(size_t i) const;
+    std::string_view segment(size_t i, size_t k) const;
+
+    // Send segmented slots with one GSO message each (see probe_udp_gso()).
+    void set_gso(bool enabled) { gso_ = enabled; }
+    bool gso() const { return gso_; }
+
+    // Moves the buffer of slot `i` out (no copy), the slot gets a fresh one
+    // from the pool on the next receive().
+    PacketBuffer take(size_t i) { return std::move(slots_[i]); }
+
+    const sockaddr* address(size_t i) const;
+    socklen_t       address_length(size_t i) const;
+    void            set_address(size_t i, const sockaddr* addr, socklen_t len);
+
+    // Exchanges two slots with their addresses and segment sizes, e.g. to
+    // gather the datagrams to answer in front for send().
+    void swap(size_t i, size_t j);
+
+private:
+    void init();
+    // Gives every slot a buffer, returns the number of leading usable slots.
+    size_t refill();
+    bool   needs_split(size_t i) const;
+    void   prepare_send(size_t i);
+    // Sends slot `i` as separate datagrams, one per segment.
+    int send_split(SocketDescriptorType sock, size_t i, int flags);
+
+private:
+    std::unique_ptr<BufferPool> own_pool_;
+    BufferPool*                 pool_;
+    size_t                      size_;
+    bool                        gso_;
+    uint32_t                    socket_drops_;
+
+    std::vector<PacketBuffer>     slots_;
+    std::vector<sockaddr_storage> addresses_;
+    std::vector<iovec>            iovecs_;
+    std::vector<mmsghdr>          msgs_;
+    std::vector<uint16_t>         segment_sizes_;
+    std::unique_ptr<char[]>       control_;
+};
+
+} // socket_wrapper
@@ -0,0 +1,108 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <unordered_map>
+#include <vector>
+
+#include "socket_headers.h"
+
+struct epoll_event;
+
+namespace socket_wrapper
+{
+
+// Single-threaded edge-triggered reactor (Linux epoll).
+// Handlers are invoked once per readiness edge, so a readable handler must
+// drain the socket until the call returns EAGAIN/EWOULDBLOCK.
+class EventLoop
+{
+public:
+    enum Events : uint32_t
+    {
+        readable = 1 << 0,
+        writable = 1 << 1,
+        error    = 1 << 2,
+    };
+
+    using Clock         = std::chrono::steady_clock;
+    using IoHandler     = std::function<void(uint32_t events)>;
+    using TimerCallback = std::function<void()>;
+    using TimerId       = uint64_t;
+
+public:
+    EventLoop();
+    ~EventLoop();
+
+    EventLoop(const EventLoop&) = delete;
+    EventLoop& operator=(const EventLoop&) = delete;
+
+public:
+    // Registers a descriptor, it must already be in the non-blocking mode.
+    int add(SocketDescriptorType fd, uint32_t events, IoHandler handler);
+    int modify(SocketDescriptorType fd, uint32_t events);
+    int remove(SocketDescriptorType fd);
+
+    TimerId add_timer(Clock::duration delay,
+                      TimerCallback   callback,
+                      Clock::duration period = Clock::duration::zero());
+    void    cancel_timer(TimerId id);
+
+public:
+    // Runs until stop() is called.
+    void run();
+    // Waits for events at most `timeout` (forever, if negative), dispatches
+    // ready handlers and expired timers, returns the number of handled events.
+    int run_once(std::chrono::milliseconds timeout);
+    // Thread-safe: may be called from other threads and signal handlers.
+    void stop();
+    // Thread-safe: runs `job` on the loop thread during the next iteration.
+    void post(std::function<void()> job);
+    bool stopped() const { return stopped_; }
+
+private:
+    struct Handler
+    {
+        IoHandler callback;
+    };
+
+    struct Timer
+    {
+        Clock::time_point deadline;
+        Clock::duration   period;
+        TimerId           id;
+
+        bool operator>(const Timer& t) const { return deadline > t.deadline; }
+    };
+
+private:
+    int  wait_timeout(std::chrono::milliseconds timeout) const;
+    void run_timers();
+    void run_posted();
+
+private:
+    const size_t max_events_ = 256;
+
+    int               epoll_fd_;
+    int               wakeup_fd_;
+    std::atomic<bool> stopped_;
+
+    std::unique_ptr<epoll_event[]> events_;
+
+    std::unordered_map<SocketDescriptorType, std::shared_ptr<Handler>> handlers_;
+
+    TimerId next_timer_id_;
+    std::priority_queue<Timer, std::vector<Timer>, std::greater<Timer>>
+                                               timers_;
+    std::unordered_map<TimerId, TimerCallback> timer_callbacks_;
+
+    std::mutex                         posted_mutex_;
+    std::vector<std::function<void()>> posted_;
+};
+
+} // socket_wrapper
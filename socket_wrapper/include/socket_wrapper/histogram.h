@@ -0,0 +1,48 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+
+namespace socket_wrapper
+{
+
+// HDR-style log-linear histogram of non-negative integer values (e.g. ns).
+// Every power of two range is split into 2^precision_bits sub-buckets, so a
+// reported value is within 1 / 2^precision_bits of the recorded one, and
+// record() is a few shifts and an increment over the full 64-bit range.
+class Histogram
+{
+public:
+    explicit Histogram(unsigned precision_bits = 7);
+
+public:
+    void record(uint64_t value, uint64_t count = 1);
+    void merge(const Histogram& h);
+    void reset();
+
+public:
+    uint64_t count() const { return count_; }
+    uint64_t min() const { return count_ ? min_ : 0; }
+    uint64_t max() const { return max_; }
+    double   mean() const;
+    double   stddev() const;
+    // Smallest value that at least `percent` % of the records do not exceed.
+    uint64_t percentile(double percent) const;
+
+private:
+    size_t   index(uint64_t value) const;
+    uint64_t highest_value(size_t index) const;
+
+private:
+    unsigned              precision_bits_;
+    std::vector<uint64_t> buckets_;
+    uint64_t              count_;
+    uint64_t              min_;
+    uint64_t              max_;
+    double                sum_;
+    double                sum_squares_;
+};
+
+} // socket_wrapper
@@ -0,0 +1,217 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string_view>
+
+#include <linux/io_uring.h>
+
+#include "socket_headers.h"
+
+
+namespace socket_wrapper
+{
+
+// Minimal io_uring on the raw syscalls, so no liburing is needed: one
+// submission and one completion ring, mapped at construction. Entries are
+// queued with get_sqe() and go to the kernel in one io_uring_enter() per
+// submit(), however many there are. Not thread-safe.
+class IoUring
+{
+public:
+    explicit IoUring(unsigned entries = 256, unsigned flags = 0);
+    ~IoUring();
+
+    IoUring(const IoUring&) = delete;
+    IoUring& operator=(const IoUring&) = delete;
+
+public:
+    // False if io_uring_setup() failed (errno is set): an old kernel, or
+    // io_uring disabled by the kernel.io_uring_disabled sysctl.
+    bool opened() const { return fd_ >= 0; }
+    int  fd() const { return fd_; }
+
+    // A zeroed submission entry, nullptr when the ring is full (submit first).
+    io_uring_sqe* get_sqe();
+    // Submits the queued entries and waits for `wait_nr` completions, at most
+    // `timeout` (forever if negative). Returns the number submitted, or -1
+    // with errno set; a timeout is not an error.
+    int submit(unsigned wait_nr = 0, std::chrono::nanoseconds timeout = std::chrono::nanoseconds(-1));
+
+    // Calls handler(const io_uring_cqe&) for every ready completion, returns
+    // how many there were. The handler may queue new entries.
+    template <typename Handler>
+    unsigned for_each_completion(Handler&& handler)
+    {
+        unsigned       head  = *cq_head_;
+        const unsigned tail  = __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE);
+        unsigned       count = 0;
+
+        for (; head != tail; ++head, ++count)
+        {
+            handler(cqes_[head & cq_mask_]);
+        }
+
+        __atomic_store_n(cq_head_, head, __ATOMIC_RELEASE);
+
+        return count;
+    }
+
+    // Registered files are addressed by index with IOSQE_FIXED_FILE, which
+    // saves the file table lookup and reference counting per operation.
+    int register_files(const int* fds, unsigned count);
+
+private:
+    void unmap();
+
+private:
+    int     fd_;
+    void*   sq_ring_;
+    size_t  sq_ring_size_;
+    void*   cq_ring_;
+    size_t  cq_ring_size_;
+    void*   sqes_mapping_;
+    size_t  sqes_size_;
+
+    unsigned*      sq_head_;
+    unsigned*      sq_tail_;
+    unsigned       sq_mask_;
+    unsigned       sq_entries_;
+    unsigned*      sq_array_;
+    io_uring_sqe*  sqes_;
+    unsigned       sqe_tail_; // entries handed out, ahead of *sq_tail_
+    unsigned*      cq_head_;
+    unsigned*      cq_tail_;
+    unsigned       cq_mask_;
+    io_uring_cqe*  cqes_;
+};
+
+
+// Provided buffers: the kernel picks a free buffer of the group itself
+// when data arrives (IOSQE_BUFFER_SELECT), so a multishot receive needs no
+// buffer per outstanding request. The buffer id comes back in the upper 16
+// bits of cqe.flags.
+//
+// Buffers go back through a ring shared with the kernel (5.19+). Where that
+// is missing or does not work they are handed over with
+// IORING_OP_PROVIDE_BUFFERS entries instead, queued by recycle() and sent by
+// the next submit(); those complete silently unless they fail, with
+// cqe.user_data == BufferRing::user_data.
+class BufferRing
+{
+public:
+    static constexpr uint64_t user_data = UINT64_MAX;
+
+public:
+    // `count` is rounded up to a power of two.
+    BufferRing(IoUring& ring, uint16_t group, unsigned count, size_t buffer_size);
+    ~BufferRing();
+
+    BufferRing(const BufferRing&) = delete;
+    BufferRing& operator=(const BufferRing&) = delete;
+
+public:
+    bool     opened() const { return opened_; }
+    // Whether the buffers go back through a mapped ring.
+    bool     mapped() const { return entries_ != nullptr; }
+    uint16_t group() const { return group_; }
+    unsigned count() const { return mask_ + 1; }
+    size_t   buffer_size() const { return buffer_size_; }
+    char*    data(uint16_t id) { return buffers_.get() + id * buffer_size_; }
+
+    // Hands buffer `id` back to the kernel, visible after commit().
+    void recycle(uint16_t id);
+    void commit();
+
+    static uint16_t buffer_id(const io_uring_cqe& cqe) { return cqe.flags >> IORING_CQE_BUFFER_SHIFT; }
+
+private:
+    io_uring_sqe* provide_sqe();
+
+    static io_uring_buf_ring* map_buffer_ring(int ring_fd, uint16_t group, unsigned entries, size_t size);
+    static bool               buffer_rings_work();
+
+private:
+    IoUring&                 ring_;
+    const uint16_t           group_;
+    unsigned                 mask_;
+    const size_t             buffer_size_;
+    io_uring_buf_ring*       entries_;
+    size_t                   entries_size_;
+    std::unique_ptr<char[]>  buffers_;
+    uint16_t                 tail_;
+    bool                     opened_;
+};
+
+
+// Submission helpers in the manner of liburing's io_uring_prep_*().
+// Add IOSQE_FIXED_FILE to sqe->flags when `fd` is a registered file index.
+
+// One request, one completion per datagram (IORING_CQE_F_MORE while it
+// stays armed) into buffers of `group`; `msg` gives the name and control
+// space to reserve in every buffer and must outlive the request.
+inline void prep_recvmsg_multishot(io_uring_sqe* sqe, int fd, msghdr* msg, uint16_t group)
+{
+    sqe->opcode    = IORING_OP_RECVMSG;
+    sqe->fd        = fd;
+    sqe->addr      = reinterpret_cast<uint64_t>(msg);
+    sqe->len       = 1;
+    sqe->ioprio    = IORING_RECV_MULTISHOT;
+    sqe->flags     = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = group;
+}
+
+inline void prep_sendmsg(io_uring_sqe* sqe, int fd, const msghdr* msg, int flags = 0)
+{
+    sqe->opcode    = IORING_OP_SENDMSG;
+    sqe->fd        = fd;
+    sqe->addr      = reinterpret_cast<uint64_t>(msg);
+    sqe->len       = 1;
+    sqe->msg_flags = flags;
+}
+
+// Stream counterpart of prep_recvmsg_multishot(); res 0 is the end of stream.
+inline void prep_recv_multishot(io_uring_sqe* sqe, int fd, uint16_t group)
+{
+    sqe->opcode    = IORING_OP_RECV;
+    sqe->fd        = fd;
+    sqe->ioprio    = IORING_RECV_MULTISHOT;
+    sqe->flags     = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = group;
+}
+
+inline void prep_send(io_uring_sqe* sqe, int fd, const void* data, size_t len, int flags = MSG_NOSIGNAL)
+{
+    sqe->opcode    = IORING_OP_SEND;
+    sqe->fd        = fd;
+    sqe->addr      = reinterpret_cast<uint64_t>(data);
+    sqe->len       = static_cast<uint32_t>(len);
+    sqe->msg_flags = flags;
+}
+
+// One completion per accepted connection, cqe.res is the new descriptor.
+inline void prep_accept_multishot(io_uring_sqe* sqe, int fd)
+{
+    sqe->opcode       = IORING_OP_ACCEPT;
+    sqe->fd           = fd;
+    sqe->ioprio       = IORING_ACCEPT_MULTISHOT;
+    sqe->accept_flags = SOCK_NONBLOCK | SOCK_CLOEXEC;
+}
+
+
+// A buffer filled by a multishot recvmsg: io_uring_recvmsg_out, the name
+// and control areas sized by the request's msghdr, then the payload.
+struct RecvmsgOut
+{
+    const sockaddr*  name;
+    socklen_t        name_length;
+    std::string_view payload;
+    bool             truncated;
+};
+
+// False if the buffer is too short to hold the layout.
+bool parse_recvmsg_out(const char* buffer, size_t length, const msghdr& msg, RecvmsgOut& out);
+
+} // socket_wrapper
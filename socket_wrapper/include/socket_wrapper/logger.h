@@ -0,0 +1,202 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+
+namespace socket_wrapper
+{
+
+enum class LogLevel : uint8_t
+{
+    debug,
+    info,
+    warning,
+    error,
+    off,
+};
+
+// Returns false if `name` is not a level name ("debug", "info", ...).
+bool parse_log_level(const std::string& name, LogLevel& level);
+
+// Fixed-size binary log entry. Producers only copy the arguments in, the
+// background thread substitutes them for the "{}" placeholders of `format`,
+// which must be a string literal (or otherwise outlive the logger).
+struct LogRecord
+{
+    static constexpr size_t max_args = 8;
+
+    enum ArgType : uint8_t
+    {
+        signed_value,
+        unsigned_value,
+        double_value,
+        text_value, // offset << 16 | length in text[]
+    };
+
+    uint64_t    timestamp_ns;
+    const char* format;
+    LogLevel    level;
+    uint8_t     args_count;
+    uint16_t    text_used;
+    ArgType     types[max_args];
+    uint64_t    args[max_args];
+    char        text[256 - 24 - max_args * 9];
+};
+
+static_assert(sizeof(LogRecord) == 256, "LogRecord must stay a fixed 256 bytes");
+
+// Asynchronous logger: every producer thread owns a lock-free SPSC ring of
+// LogRecords, a background thread formats them and writes them out in
+// batches. A full ring never blocks the producer, the record is dropped
+// and counted instead.
+class Logger
+{
+public:
+    explicit Logger(int fd = 1, size_t ring_capacity = 4096);
+    ~Logger();
+
+    Logger(const Logger&) = delete;
+    Logger& operator=(const Logger&) = delete;
+
+public:
+    void     set_level(LogLevel level) { level_ = level; }
+    LogLevel level() const { return level_; }
+    // Keep only every n-th record of `level` (per thread), 1 keeps all.
+    void set_sampling(LogLevel level, uint32_t every_n);
+
+    bool enabled(LogLevel level) const { return level >= level_; }
+
+    template <typename... Args>
+    void log(LogLevel level, const char* format, const Args&... args)
+    {
+        static_assert(sizeof...(Args) <= LogRecord::max_args, "Too many log arguments");
+
+        if (!enabled(level)) return;
+
+        Ring*      ring   = nullptr;
+        LogRecord* record = begin_record(level, format, ring);
+        if (record == nullptr) return;
+
+        int dummy[] = { 0, (append(*record, args), 0)... };
+        (void)dummy;
+
+        commit_record(*ring);
+    }
+
+    template <typename... Args>
+    void debug(const char* format, const Args&... args)
+    {
+        log(LogLevel::debug, format, args...);
+    }
+
+    template <typename... Args>
+    void info(const char* format, const Args&... args)
+    {
+        log(LogLevel::info, format, args...);
+    }
+
+    template <typename... Args>
+    void warning(const char* format, const Args&... args)
+    {
+        log(LogLevel::warning, format, args...);
+    }
+
+    template <typename... Args>
+    void error(const char* format, const Args&... args)
+    {
+        log(LogLevel::error, format, args...);
+    }
+
+public:
+    // Records dropped because a ring was full.
+    uint64_t dropped() const;
+    // Blocks until everything logged so far is written.
+    void flush();
+
+private:
+    struct Ring;
+
+private:
+    LogRecord* begin_record(LogLevel level, const char* format, Ring*& ring);
+    void       commit_record(Ring& ring);
+    Ring&      thread_ring();
+
+    void run();
+    bool drain(std::string& out);
+    void format_record(const LogRecord& record, std::string& out) const;
+
+    static void append(LogRecord& record, std::string_view value);
+    static void append(LogRecord& record, const std::string& value)
+    {
+        append(record, std::string_view(value));
+    }
+    static void append(LogRecord& record, const char* value)
+    {
+        append(record, std::string_view(value ? value : "(null)"));
+    }
+    static void append(LogRecord& record, char* value)
+    {
+        append(record, static_cast<const char*>(value));
+    }
+    template <size_t N>
+    static void append(LogRecord& record, const char (&value)[N])
+    {
+        append(record, std::string_view(value, strnlen(value, N)));
+    }
+
+    template <typename T>
+    static void append(LogRecord& record, const T& value)
+    {
+        static_assert(std::is_arithmetic<T>::value || std::is_enum<T>::value,
+                      "Unsupported log argument type");
+
+        auto& arg  = record.args[record.args_count];
+        auto& type = record.types[record.args_count++];
+
+        if constexpr (std::is_floating_point<T>::value)
+        {
+            double d = value;
+            std::memcpy(&arg, &d, sizeof(arg));
+            type = LogRecord::double_value;
+        }
+        else if constexpr (std::is_signed<T>::value)
+        {
+            arg  = static_cast<uint64_t>(static_cast<int64_t>(value));
+            type = LogRecord::signed_value;
+        }
+        else
+        {
+            arg  = static_cast<uint64_t>(value);
+            type = LogRecord::unsigned_value;
+        }
+    }
+
+private:
+    const int      fd_;
+    const size_t   ring_capacity_;
+    const uint64_t id_;
+
+    std::atomic<LogLevel> level_;
+    std::atomic<uint32_t> sampling_[4];
+
+    mutable std::mutex                 rings_mutex_;
+    std::vector<std::shared_ptr<Ring>> rings_;
+
+    std::atomic<bool>     stopping_;
+    std::atomic<uint64_t> flush_requests_;
+    std::atomic<uint64_t> flushed_;
+    uint64_t              reported_drops_;
+    std::thread           writer_;
+};
+
+} // socket_wrapper
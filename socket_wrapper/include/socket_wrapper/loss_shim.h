@@ -0,0 +1,89 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <random>
+#include <string>
+
+#include "event_loop.h"
+#include "socket_headers.h"
+
+
+namespace socket_wrapper
+{
+
+// Emulates a bad path on the sending side of a socket, so protocols can be
+// tested over loopback: every datagram is dropped with some probability,
+// delayed, jittered, or held back long enough for later ones to overtake it.
+// Held datagrams are copied and sent from an EventLoop timer, in order of
+// their release time.
+class LossShim
+{
+public:
+    using Clock = EventLoop::Clock;
+
+    struct Options
+    {
+        double          loss          = 0; // probability a datagram is dropped
+        Clock::duration delay         = Clock::duration::zero();
+        Clock::duration jitter        = Clock::duration::zero(); // uniform on top of the delay
+        double          reorder       = 0; // probability a datagram is held back...
+        Clock::duration reorder_delay = std::chrono::milliseconds(2); // ...this much longer
+
+        bool enabled() const { return loss > 0 || delay.count() > 0 || jitter.count() > 0 || reorder > 0; }
+    };
+
+    struct Stats
+    {
+        uint64_t passed    = 0; // sent right away
+        uint64_t dropped   = 0;
+        uint64_t delayed   = 0;
+        uint64_t reordered = 0;
+    };
+
+public:
+    LossShim(EventLoop& loop, const Options& options, uint64_t seed = std::random_device()());
+    // Datagrams still held back are dropped.
+    ~LossShim();
+
+    LossShim(const LossShim&) = delete;
+    LossShim& operator=(const LossShim&) = delete;
+
+public:
+    // sendmsg() through the shim, with its result for a datagram sent right
+    // away. Dropped and held datagrams count as sent; errors of a delayed
+    // send are lost like the datagram.
+    ssize_t send(SocketDescriptorType sock, const msghdr& msg, int flags = 0);
+
+    const Options& options() const { return options_; }
+    const Stats&   stats() const { return stats_; }
+
+private:
+    struct Held
+    {
+        SocketDescriptorType sock;
+        sockaddr_storage     address;
+        socklen_t            address_length;
+        int                  flags;
+        std::string          data;
+    };
+
+private:
+    void schedule();
+    void release();
+
+private:
+    EventLoop&      loop_;
+    const Options   options_;
+    std::mt19937_64 random_;
+    Stats           stats_;
+
+    // Equal release times keep the order they were sent in.
+    std::multimap<Clock::time_point, Held> held_;
+    EventLoop::TimerId                     timer_;
+    Clock::time_point                      timer_deadline_;
+};
+
+} // socket_wrapper
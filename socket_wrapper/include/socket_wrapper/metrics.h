@@ -0,0 +1,174 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "socket_headers.h"
+
+
+namespace socket_wrapper
+{
+
+// Counters, gauges and histograms with per-thread storage. Every thread
+// writes only its own cache-line aligned block with relaxed atomics, so the
+// packet path takes no lock (except once, when a thread first touches the
+// registry); readers sum the blocks of all threads on demand.
+class Metrics
+{
+public:
+    struct Counter
+    {
+        uint32_t offset;
+    };
+
+    struct Gauge
+    {
+        uint32_t index;
+    };
+
+    struct Histogram
+    {
+        uint32_t        offset;
+        const uint64_t* bounds;
+        uint32_t        bounds_count;
+    };
+
+public:
+    // `capacity`: 64-bit cells per thread, a histogram takes bounds + 2.
+    explicit Metrics(size_t capacity = 1024);
+
+    Metrics(const Metrics&) = delete;
+    Metrics& operator=(const Metrics&) = delete;
+
+public:
+    // Registration, `labels` in the exposition form: shard="0",port="53".
+    // Throws std::length_error when the capacity is exhausted.
+    Counter   counter(const std::string& name, const std::string& help, const std::string& labels = "");
+    Gauge     gauge(const std::string& name, const std::string& help, const std::string& labels = "");
+    // A gauge read by calling `read` at export time.
+    void      gauge(const std::string&      name,
+                    const std::string&      help,
+                    const std::string&      labels,
+                    std::function<double()> read);
+    // Values are recorded as integers (e.g. ns) and exported multiplied by
+    // `scale` (e.g. 1e-9 for seconds); `bounds` are upper bucket bounds.
+    Histogram histogram(const std::string&    name,
+                        const std::string&    help,
+                        const std::string&    labels,
+                        std::vector<uint64_t> bounds,
+                        double                scale = 1);
+
+public:
+    void add(Counter counter, uint64_t n = 1)
+    {
+        auto& cell = thread_cell(counter.offset);
+        cell.store(cell.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+    }
+
+    void set(Gauge gauge, int64_t value)
+    {
+        gauges_[gauge.index].store(value, std::memory_order_relaxed);
+    }
+
+    void observe(Histogram histogram, uint64_t value);
+
+public:
+    // Sums over all threads.
+    uint64_t value(Counter counter) const;
+    int64_t  value(Gauge gauge) const;
+    // Prometheus text exposition format, version 0.0.4.
+    std::string prometheus() const;
+
+private:
+    enum class Type
+    {
+        counter,
+        gauge,
+        histogram,
+    };
+
+    struct Descriptor
+    {
+        Type                    type;
+        std::string             name;
+        std::string             help;
+        std::string             labels;
+        uint32_t                offset;
+        std::vector<uint64_t>   bounds;
+        double                  scale;
+        std::function<double()> read;
+    };
+
+    // Eight cells per cache line.
+    struct alignas(64) Line
+    {
+        std::atomic<uint64_t> cells[8]{};
+    };
+
+    using Block = std::vector<Line>;
+
+private:
+    std::atomic<uint64_t>& thread_cell(uint32_t offset)
+    {
+        Block& block = thread_block();
+        return block[offset / 8].cells[offset % 8];
+    }
+
+    Block&   thread_block();
+    uint32_t allocate(size_t cells);
+    uint64_t sum(uint32_t offset) const;
+
+private:
+    const size_t   capacity_;
+    const uint64_t id_;
+
+    mutable std::mutex                       mutex_;
+    std::vector<std::unique_ptr<Descriptor>> descriptors_;
+    std::vector<std::shared_ptr<Block>>      blocks_;
+    uint32_t                                 next_offset_;
+    uint32_t                                 next_gauge_;
+    std::unique_ptr<std::atomic<int64_t>[]>  gauges_;
+};
+
+// Upper bounds start, start * factor, ... (count of them).
+std::vector<uint64_t> exponential_buckets(uint64_t start, double factor, size_t count);
+
+// Sum of the "drops" column of /proc/net/udp and /proc/net/udp6 over the
+// sockets bound to `port`.
+uint64_t proc_udp_drops(uint16_t port);
+
+// Serves Metrics::prometheus() over HTTP on a background thread. `address`
+// is "host:port" for TCP or "unix:/path" for a Unix socket.
+class MetricsExporter
+{
+public:
+    MetricsExporter(const Metrics& metrics, const std::string& address);
+    ~MetricsExporter();
+
+    MetricsExporter(const MetricsExporter&) = delete;
+    MetricsExporter& operator=(const MetricsExporter&) = delete;
+
+public:
+    // False if the listening socket could not be set up (errno is set).
+    bool listening() const { return listener_ != INVALID_SOCKET; }
+
+private:
+    void run();
+    void respond(SocketDescriptorType client);
+
+private:
+    const Metrics&       metrics_;
+    std::string          unix_path_;
+    SocketDescriptorType listener_;
+    std::atomic<bool>    stopping_;
+    std::thread          thread_;
+};
+
+} // socket_wrapper
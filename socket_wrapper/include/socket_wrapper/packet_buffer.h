@@ -0,0 +1,104 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string_view>
+#include <vector>
+
+
+namespace socket_wrapper
+{
+
+// Largest UDP datagram plus headroom: 64 KiB.
+constexpr size_t max_datagram_size = 65536;
+
+class BufferPool;
+
+// Move-only handle to one buffer of a BufferPool, returned to the pool on
+// destruction. Carries the received length and the truncation flag, so the
+// same buffer can travel from receive to reply to logging untouched.
+class PacketBuffer
+{
+public:
+    PacketBuffer() = default;
+    PacketBuffer(PacketBuffer&& b) noexcept;
+    PacketBuffer& operator=(PacketBuffer&& b) noexcept;
+    ~PacketBuffer();
+
+    PacketBuffer(const PacketBuffer&) = delete;
+    PacketBuffer& operator=(const PacketBuffer&) = delete;
+
+public:
+    explicit operator bool() const { return data_ != nullptr; }
+
+    char*            data() { return data_; }
+    const char*      data() const { return data_; }
+    size_t           capacity() const { return capacity_; }
+    size_t           size() const { return size_; }
+    std::string_view view() const { return { data_, size_ }; }
+
+    void set_size(size_t size) { size_ = size < capacity_ ? size : capacity_; }
+    // The datagram did not fit and was cut to capacity() (MSG_TRUNC).
+    bool truncated() const { return truncated_; }
+    void set_truncated(bool truncated) { truncated_ = truncated; }
+
+    void reset();
+
+private:
+    friend class BufferPool;
+
+    PacketBuffer(BufferPool* pool, uint32_t index, char* data, size_t capacity);
+
+private:
+    BufferPool* pool_      = nullptr;
+    uint32_t    index_     = 0;
+    char*       data_      = nullptr;
+    size_t      capacity_  = 0;
+    size_t      size_      = 0;
+    bool        truncated_ = false;
+};
+
+struct BufferPoolStats
+{
+    size_t   buffer_size;
+    size_t   capacity;   // buffers in the arena
+    size_t   in_use;
+    size_t   high_water; // most buffers ever in use at once
+    uint64_t exhausted;  // acquire() calls that found the pool empty
+};
+
+// Fixed arena of equally sized buffers with a LIFO free list, so the most
+// recently released (cache-warm) buffer is reused first. No allocation after
+// construction. Not thread-safe: give every I/O thread its own pool.
+class BufferPool
+{
+public:
+    BufferPool(size_t buffer_size, size_t count);
+
+    BufferPool(const BufferPool&) = delete;
+    BufferPool& operator=(const BufferPool&) = delete;
+
+public:
+    // Returns an empty handle when all buffers are in use.
+    PacketBuffer acquire();
+
+    size_t          buffer_size() const { return buffer_size_; }
+    BufferPoolStats stats() const;
+
+private:
+    friend class PacketBuffer;
+
+    void release(uint32_t index);
+
+private:
+    const size_t buffer_size_;
+    const size_t count_;
+
+    std::unique_ptr<char[]> arena_;
+    std::vector<uint32_t>   free_;
+    size_t                  high_water_;
+    uint64_t                exhausted_;
+};
+
+} // socket_wrapper
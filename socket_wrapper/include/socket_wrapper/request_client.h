@@ -0,0 +1,132 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+#include "datagram_batch.h"
+#include "event_loop.h"
+#include "socket_class.h"
+#include "socket_headers.h"
+
+
+namespace socket_wrapper
+{
+
+// Pipelined request/response over UDP on an EventLoop. Every request goes
+// out with an 8-byte header (session tag and request id, network order) in
+// front of the payload, and the server must return the header unchanged (an
+// echo server does). Up to `depth` requests are in flight at once, the rest
+// wait in a queue; replies are matched by id, so they may arrive in any order,
+// and a second reply to a finished request is counted and dropped.
+//
+// Servers that read the datagram as text (udp-server's "exit" and pub/sub
+// commands) take Framing::none instead: the payload goes out as it is, one
+// request at a time, and whatever arrives while it is in flight is its reply.
+// A reply that comes after its request timed out is then taken for the next
+// one's.
+class RequestClient
+{
+public:
+    using Clock     = EventLoop::Clock;
+    using RequestId = uint32_t;
+    // `error` is 0 with the reply payload (header stripped), ETIMEDOUT when
+    // all attempts timed out (or the errno of the last failed send), or
+    // ECANCELED. Called on the loop thread.
+    using Callback  = std::function<void(RequestId id, int error, std::string_view reply)>;
+
+    struct Options
+    {
+        Clock::duration timeout = std::chrono::seconds(1); // per attempt
+        unsigned        retries = 0;                       // resends after a timeout
+    };
+
+    struct Stats
+    {
+        uint64_t sent          = 0; // datagrams, retransmissions included
+        uint64_t retransmitted = 0;
+        uint64_t completed     = 0;
+        uint64_t timed_out     = 0;
+        uint64_t duplicates    = 0; // replies to requests already finished
+        uint64_t unmatched     = 0; // foreign or malformed datagrams
+    };
+
+    enum class Framing
+    {
+        header,
+        none,
+    };
+
+    static constexpr size_t header_size = 8;
+
+public:
+    // `depth` is 1 without framing.
+    RequestClient(EventLoop&      loop,
+                  const sockaddr* server,
+                  socklen_t       server_len,
+                  size_t          depth   = 64,
+                  Framing         framing = Framing::header);
+    // Drops outstanding requests without calling their callbacks.
+    ~RequestClient();
+
+    RequestClient(const RequestClient&) = delete;
+    RequestClient& operator=(const RequestClient&) = delete;
+
+public:
+    // False if the socket could not be set up (errno is set).
+    bool          opened() const { return opened_; }
+    const Socket& socket() const { return sock_; }
+
+    // Sends `payload` now, or as soon as the pipeline has room.
+    RequestId request(std::string_view payload, Callback callback, Options options);
+    RequestId request(std::string_view payload, Callback callback)
+    {
+        return request(payload, std::move(callback), Options());
+    }
+    // Finishes a queued or in-flight request with ECANCELED.
+    bool      cancel(RequestId id);
+
+public:
+    size_t       in_flight() const { return in_flight_.size(); }
+    size_t       queued() const { return queued_.size(); }
+    const Stats& stats() const { return stats_; }
+
+private:
+    struct Request
+    {
+        std::string       datagram;
+        Callback          callback;
+        Options           options;
+        unsigned          attempts   = 0;
+        int               last_error = 0;
+        EventLoop::TimerId timer     = 0;
+    };
+
+private:
+    void transmit(RequestId id, Request& request);
+    void on_readable();
+    void on_timeout(RequestId id);
+    void finish(Request request, RequestId id, int error, std::string_view reply);
+    void start_queued();
+
+private:
+    EventLoop&    loop_;
+    Socket        sock_;
+    const Framing framing_;
+    const size_t  depth_;
+    bool          opened_;
+    uint32_t      session_;
+    RequestId     next_id_;
+
+    std::unordered_map<RequestId, Request> in_flight_;
+    std::deque<std::pair<RequestId, Request>> queued_;
+    DatagramBatch                          rx_;
+    Stats                                  stats_;
+};
+
+} // socket_wrapper
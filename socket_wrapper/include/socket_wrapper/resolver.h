@@ -0,0 +1,117 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "socket_headers.h"
+
+
+namespace socket_wrapper
+{
+
+struct ResolvedHost
+{
+    std::string                   name;      // canonical name, if known
+    std::vector<sockaddr_storage> addresses;
+    int                           error = 0; // getaddrinfo() error code
+};
+
+// DNS lookups on background threads with a TTL cache for both directions.
+// Failed lookups are cached too (for negative_ttl), so an unresolvable peer
+// costs one query per TTL instead of one per packet.
+class Resolver
+{
+public:
+    using Clock = std::chrono::steady_clock;
+
+    explicit Resolver(Clock::duration ttl          = std::chrono::minutes(5),
+                      Clock::duration negative_ttl = std::chrono::seconds(30),
+                      size_t          workers      = 1,
+                      size_t          max_entries  = 65536);
+    ~Resolver();
+
+    Resolver(const Resolver&) = delete;
+    Resolver& operator=(const Resolver&) = delete;
+
+public:
+    // Never blocks on DNS: writes the cached host name of `addr` to `host` and
+    // returns true, or writes the numeric address, schedules a lookup if none
+    // is cached yet and returns false.
+    bool reverse(const sockaddr* addr, socklen_t addr_len, char* host, size_t host_len);
+
+    // Forward lookup (getaddrinfo) on a worker thread.
+    std::future<ResolvedHost> resolve(const std::string& host, int family = AF_UNSPEC);
+    // Same, `done` is called on a worker thread (or right away on a cache hit).
+    void                      resolve(const std::string& host, int family, std::function<void(ResolvedHost)> done);
+
+public:
+    size_t cache_size() const;
+
+private:
+    struct AddressKey
+    {
+        uint16_t family;
+        uint8_t  bytes[16];
+
+        bool operator==(const AddressKey& k) const;
+    };
+
+    struct AddressKeyHash
+    {
+        size_t operator()(const AddressKey& k) const;
+    };
+
+    enum class State
+    {
+        pending,
+        resolved,
+        failed,
+    };
+
+    struct ReverseEntry
+    {
+        State             state;
+        std::string       name;
+        Clock::time_point expires;
+    };
+
+    struct ForwardEntry
+    {
+        ResolvedHost      host;
+        Clock::time_point expires;
+    };
+
+private:
+    static bool make_key(const sockaddr* addr, AddressKey& key);
+
+    void post(std::function<void()> job);
+    void work();
+    // Drops expired entries when the cache is full, mutex_ must be held.
+    bool reserve_entry(Clock::time_point now);
+
+private:
+    const Clock::duration ttl_;
+    const Clock::duration negative_ttl_;
+    const size_t          max_entries_;
+
+    mutable std::mutex                                           mutex_;
+    std::unordered_map<AddressKey, ReverseEntry, AddressKeyHash> reverse_cache_;
+    std::unordered_map<std::string, ForwardEntry>                forward_cache_;
+    Clock::time_point                                            last_sweep_;
+
+    std::condition_variable            jobs_ready_;
+    std::deque<std::function<void()>> jobs_;
+    bool                               stopping_;
+    std::vector<std::thread>           workers_;
+};
+
+} // socket_wrapper
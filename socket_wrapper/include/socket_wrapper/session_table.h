@@ -0,0 +1,144 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "socket_headers.h"
+
+
+namespace socket_wrapper
+{
+
+// Per-client state of a datagram server, keyed by the client address and
+// port, with a token bucket for every client.
+//
+// Sessions live in a slab allocated at construction and are found through a
+// separate open-addressing index of (hash, slot) pairs, 8 bytes each, so a
+// lookup probes one or two cache lines and never allocates. The hash is
+// seeded per table, so colliding addresses cannot be worked out in advance.
+//
+// Idle sessions are expired by a timer wheel that covers twice the idle
+// timeout. A session is put in the wheel when it is created and moved only
+// when its slot comes up, so a datagram of a known client costs no wheel
+// work. When the slab is full the session closest to expiring makes room.
+// Not thread-safe, use a table per shard.
+class SessionTable
+{
+public:
+    using Clock = std::chrono::steady_clock;
+
+    // Address bytes (IPv4 in the first four), port and family.
+    struct Key
+    {
+        uint8_t  address[16];
+        uint16_t port;
+        uint16_t family;
+
+        bool operator==(const Key&) const = default;
+    };
+
+    struct Session
+    {
+        Key      key;
+        uint32_t hash;
+
+        Clock::time_point last_seen;
+        double            tokens;
+
+        uint64_t datagrams; // admitted
+        uint64_t bytes;     // admitted
+        uint64_t dropped;
+
+        // Wheel slot and list, or the free list while unused.
+        uint32_t wheel;
+        uint32_t prev;
+        uint32_t next;
+    };
+
+    struct Stats
+    {
+        uint64_t created  = 0;
+        uint64_t expired  = 0; // idle for the timeout
+        uint64_t evicted  = 0; // to make room for a new client
+        uint64_t admitted = 0;
+        uint64_t dropped  = 0; // over the limit
+    };
+
+public:
+    // At most `capacity` clients, each allowed `rate` datagrams per second
+    // with bursts of `burst`. A rate of 0 keeps the counters only.
+    SessionTable(size_t capacity, double rate, double burst, Clock::duration idle_timeout);
+
+    SessionTable(const SessionTable&) = delete;
+    SessionTable& operator=(const SessionTable&) = delete;
+
+public:
+    // Accounts `datagrams` datagrams of `bytes` bytes from `address`, which
+    // take as many tokens. False means the client is over its limit and the
+    // datagrams should be dropped. A GRO batch is admitted whole while the
+    // bucket holds a token and may leave it in debt. Addresses other than
+    // IPv4 and IPv6 are always admitted. Also expires idle sessions.
+    bool admit(const sockaddr* address, socklen_t length, size_t bytes, Clock::time_point now, size_t datagrams = 1);
+    // Advances the wheel, returns the number of sessions it expired.
+    size_t expire(Clock::time_point now);
+
+    // nullptr if the client has no session.
+    const Session* find(const sockaddr* address, socklen_t length) const;
+
+public:
+    size_t          size() const { return size_; }
+    size_t          capacity() const { return sessions_.size(); }
+    double          rate() const { return rate_; }
+    double          burst() const { return burst_; }
+    Clock::duration idle_timeout() const { return idle_timeout_; }
+    const Stats&    stats() const { return stats_; }
+
+private:
+    // An index slot: the session's hash and its slab index + 1, 0 if empty.
+    struct Slot
+    {
+        uint32_t hash;
+        uint32_t entry;
+    };
+
+    static constexpr uint32_t none        = UINT32_MAX;
+    static constexpr size_t   wheel_slots = 256;
+
+private:
+    static bool make_key(const sockaddr* address, socklen_t length, Key& key);
+
+    uint32_t hash(const Key& key) const;
+    // Index slot of the key, or of the empty slot ending its probe sequence.
+    size_t   probe(const Key& key, uint32_t h) const;
+    uint32_t create(const Key& key, uint32_t h, size_t slot, Clock::time_point now);
+    void     destroy(uint32_t entry);
+    void     erase_slot(size_t slot);
+
+    int64_t tick_of(Clock::time_point time) const;
+    void    link(uint32_t entry, int64_t tick);
+    void    unlink(uint32_t entry);
+    // The session due soonest, none if the table is empty.
+    uint32_t oldest() const;
+
+private:
+    const double          rate_;
+    const double          burst_;
+    const Clock::duration idle_timeout_;
+    const Clock::duration tick_;
+    const uint64_t        seed_;
+
+    std::vector<Session>  sessions_;
+    std::vector<Slot>     index_;
+    size_t                index_mask_;
+    size_t                size_;
+    uint32_t              free_;
+
+    std::vector<uint32_t> wheel_;
+    int64_t               current_tick_;
+
+    Stats stats_;
+};
+
+} // socket_wrapper
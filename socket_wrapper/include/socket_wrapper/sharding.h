@@ -0,0 +1,28 @@
+#pragma once
+
+#include <vector>
+
+#include "socket_headers.h"
+
+
+namespace socket_wrapper
+{
+
+// Helpers for running one SO_REUSEPORT socket per worker thread (Linux).
+// All functions return 0 on success and -1 with errno set otherwise.
+
+// CPUs the process is allowed to run on, in ascending order.
+std::vector<unsigned> allowed_cpus();
+int                   pin_current_thread(unsigned cpu);
+
+int enable_reuseport(SocketDescriptorType sock);
+// Prefer this socket of a reuseport group for packets processed on `cpu`.
+int set_incoming_cpu(SocketDescriptorType sock, unsigned cpu);
+// Attaches a classic BPF program to the reuseport group of `sock` which picks
+// the socket i with shard_cpus[i] == receiving CPU, the first one if several
+// match. Sockets join the group in bind() order, so socket i should be served
+// by a thread pinned to shard_cpus[i]. Packets received on any other CPU go
+// to the socket (CPU % group size).
+int attach_reuseport_cpu_steering(SocketDescriptorType sock, const std::vector<unsigned>& shard_cpus);
+
+} // socket_wrapper
@@ -0,0 +1,131 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include "socket_headers.h"
+
+
+namespace socket_wrapper
+{
+
+// Datagrams between processes of one host through a shared memory object
+// (shm_open()) instead of the network stack. The server creates it with one
+// request queue that all clients send to and a reply queue per client.
+// Queues are bounded lock-free rings of fixed-size slots with a sequence
+// number per slot: producers claim a slot with one CAS, the consumer needs
+// no atomic read-modify-write at all. A waiting side sleeps on a futex in
+// the mapping, which a producer only wakes when somebody actually sleeps.
+//
+// Datagrams are neither lost nor reordered: a client blocks while the
+// request queue is full, the server never blocks on a slow client and gets
+// EAGAIN from its full reply queue instead.
+
+namespace detail
+{
+
+// An mmap()ed shared memory object, unlinked on destruction by its creator.
+class ShmMapping
+{
+public:
+    ShmMapping() = default;
+    ~ShmMapping();
+
+    ShmMapping(const ShmMapping&) = delete;
+    ShmMapping& operator=(const ShmMapping&) = delete;
+
+public:
+    // Both return false with errno set.
+    bool create(const std::string& name, size_t size);
+    bool open(const std::string& name);
+
+    char*  data() const { return data_; }
+    size_t size() const { return size_; }
+
+private:
+    std::string name_;
+    char*       data_  = nullptr;
+    size_t      size_  = 0;
+    bool        owner_ = false;
+};
+
+} // detail
+
+
+class ShmServer
+{
+public:
+    // Creates the object `name` ("/name"), replacing one whose server is
+    // gone; fails with EADDRINUSE while that server runs. It holds a request
+    // queue of `slots` datagrams of up to `slot_size` bytes, and room for
+    // `max_clients` clients with `reply_slots` replies queued each.
+    explicit ShmServer(const std::string& name,
+                       size_t             slots       = 1024,
+                       size_t             slot_size   = 2048,
+                       size_t             max_clients = 64,
+                       size_t             reply_slots = 256);
+    // Tells the clients that the server is gone.
+    ~ShmServer();
+
+    ShmServer(const ShmServer&) = delete;
+    ShmServer& operator=(const ShmServer&) = delete;
+
+public:
+    // False if the object could not be created (errno is set).
+    bool   opened() const { return opened_; }
+    size_t max_datagram_size() const;
+
+    // As recvfrom()/sendto() on a UDP socket: -1 with errno set on failure,
+    // MSG_DONTWAIT and MSG_TRUNC are honoured. The client address is
+    // AF_UNIX with an abstract name holding the client id, see client_id().
+    ssize_t recv_from(char* data, size_t len, sockaddr* from, socklen_t* from_len, int flags = 0);
+    ssize_t send_to(const char* data, size_t len, const sockaddr* to, socklen_t to_len, int flags = 0);
+
+    // How long a blocking recv_from() waits before failing with EAGAIN, as
+    // SO_RCVTIMEO. 0 waits forever.
+    void set_receive_timeout(std::chrono::microseconds timeout) { receive_timeout_ = timeout; }
+
+    static bool client_id(const sockaddr* address, socklen_t len, uint32_t& id);
+
+private:
+    detail::ShmMapping        mapping_;
+    bool                      opened_;
+    std::chrono::microseconds receive_timeout_;
+};
+
+
+class ShmClient
+{
+public:
+    // Attaches to the object of a running ShmServer and takes a free client
+    // id, or the id of a client process that is gone.
+    explicit ShmClient(const std::string& name);
+    // Gives the client id back.
+    ~ShmClient();
+
+    ShmClient(const ShmClient&) = delete;
+    ShmClient& operator=(const ShmClient&) = delete;
+
+public:
+    // False if there is no server or no free client id (errno is set).
+    bool     opened() const { return opened_; }
+    uint32_t id() const { return id_; }
+    size_t   max_datagram_size() const;
+
+    // As send()/recv() on a connected UDP socket. Both fail with
+    // ECONNREFUSED once the server process is gone.
+    ssize_t send(const char* data, size_t len, int flags = 0);
+    ssize_t recv(char* data, size_t len, int flags = 0);
+
+    void set_receive_timeout(std::chrono::microseconds timeout) { receive_timeout_ = timeout; }
+
+private:
+    detail::ShmMapping        mapping_;
+    bool                      opened_;
+    uint32_t                  id_;
+    std::chrono::microseconds receive_timeout_;
+};
+
+} // socket_wrapper
@@ -27,6 +27,8 @@ public:
 
 public:
     int close();
+    // Switches the descriptor to (non-)blocking mode, returns 0 on success.
+    int set_nonblocking(bool enabled = true);
 
 protected:
     void open(int domain, int type, int protocol);
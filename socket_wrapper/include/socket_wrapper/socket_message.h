@@ -0,0 +1,262 @@
+#pragma once
+
+#include <algorithm>
+#include <concepts>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <ctime>
+#include <iterator>
+#include <optional>
+#include <span>
+#include <type_traits>
+
+#include <linux/errqueue.h>
+#include <netinet/in.h>
+#include <netinet/udp.h>
+#include <sys/uio.h>
+
+#include "socket_headers.h"
+
+
+namespace socket_wrapper
+{
+
+// An ancillary (control) message type as a type: its level, its cmsg_type
+// and the C++ value it carries, in the manner of SocketOption.
+template <int Level, int Type, typename T>
+struct ControlType
+{
+    static constexpr int level = Level;
+    static constexpr int type  = Type;
+
+    using value_type = T;
+};
+
+template <typename Control>
+concept ControlMessageType = requires {
+    { Control::level } -> std::convertible_to<int>;
+    { Control::type } -> std::convertible_to<int>;
+    requires std::is_trivially_copyable_v<typename Control::value_type>;
+};
+
+
+namespace control
+{
+
+// Received with option::ReceivePacketInfo: the local address the datagram
+// was sent to and the interface it came in on. Sent, it picks the source.
+using PacketInfo  = ControlType<IPPROTO_IP, IP_PKTINFO, in_pktinfo>;
+using PacketInfo6 = ControlType<IPPROTO_IPV6, IPV6_PKTINFO, in6_pktinfo>;
+// Received with option::ReceiveTimeToLive, sent to override IP_TTL.
+using TimeToLive  = ControlType<IPPROTO_IP, IP_TTL, int>;
+using HopLimit    = ControlType<IPPROTO_IPV6, IPV6_HOPLIMIT, int>;
+// Received with option::ReceiveTypeOfService (one byte), sent to override IP_TOS.
+using TypeOfService = ControlType<IPPROTO_IP, IP_TOS, uint8_t>;
+using TrafficClass  = ControlType<IPPROTO_IPV6, IPV6_TCLASS, int>;
+// See timestamping.h.
+using TimestampNs  = ControlType<SOL_SOCKET, SO_TIMESTAMPNS, timespec>;
+using Timestamping = ControlType<SOL_SOCKET, SO_TIMESTAMPING, scm_timestamping>;
+// Receive queue drops so far, with enable_rx_drop_counter().
+using ReceiveQueueDrops = ControlType<SOL_SOCKET, SO_RXQ_OVFL, uint32_t>;
+// GSO segment size to send with, GRO segment size received.
+using UdpSegment = ControlType<SOL_UDP, UDP_SEGMENT, uint16_t>;
+using UdpGro     = ControlType<SOL_UDP, UDP_GRO, int>;
+
+} // control
+
+
+// One received control message.
+class ControlMessage
+{
+public:
+    explicit ControlMessage(const cmsghdr* cmsg) : cmsg_(cmsg) {}
+
+public:
+    int                  level() const { return cmsg_->cmsg_level; }
+    int                  type() const { return cmsg_->cmsg_type; }
+    const unsigned char* data() const { return CMSG_DATA(cmsg_); }
+    size_t               size() const { return cmsg_->cmsg_len - CMSG_LEN(0); }
+
+    template <ControlMessageType Control>
+    bool is() const
+    {
+        return level() == Control::level && type() == Control::type;
+    }
+
+    // The value if this is a `Control` message, nullopt otherwise. A payload
+    // shorter than the type is zero-extended (IP_TOS comes as one byte on
+    // receive but may be an int elsewhere).
+    template <ControlMessageType Control>
+    std::optional<typename Control::value_type> get() const
+    {
+        if (!is<Control>()) return std::nullopt;
+
+        typename Control::value_type value{};
+        std::memcpy(&value, data(), std::min(size(), sizeof(value)));
+
+        return value;
+    }
+
+private:
+    const cmsghdr* cmsg_;
+};
+
+
+// The control messages of a received message, as a forward range:
+//
+//     for (const auto& cmsg : message.control)
+//         if (auto ttl = cmsg.get<control::TimeToLive>()) ...
+//
+// Views the control buffer passed to receive_message(), valid as long as
+// that is not reused.
+class ControlMessages
+{
+public:
+    class iterator
+    {
+    public:
+        using iterator_category = std::forward_iterator_tag;
+        using value_type        = ControlMessage;
+        using difference_type   = std::ptrdiff_t;
+        using pointer           = const ControlMessage*;
+        using reference         = ControlMessage;
+
+        iterator() = default;
+        iterator(const msghdr* msg, cmsghdr* cmsg) : msg_(msg), cmsg_(cmsg) {}
+
+        ControlMessage operator*() const { return ControlMessage(cmsg_); }
+
+        iterator& operator++()
+        {
+            cmsg_ = CMSG_NXTHDR(const_cast<msghdr*>(msg_), cmsg_);
+            return *this;
+        }
+
+        iterator operator++(int)
+        {
+            iterator previous = *this;
+            ++*this;
+            return previous;
+        }
+
+        bool operator==(const iterator& other) const { return cmsg_ == other.cmsg_; }
+
+    private:
+        const msghdr* msg_  = nullptr;
+        cmsghdr*      cmsg_ = nullptr;
+    };
+
+public:
+    ControlMessages() = default;
+    ControlMessages(const void* control, size_t len)
+    {
+        msg_.msg_control    = const_cast<void*>(control);
+        msg_.msg_controllen = len;
+    }
+    // Those of `msg`, as filled by recvmsg().
+    explicit ControlMessages(const msghdr& msg) : ControlMessages(msg.msg_control, msg.msg_controllen) {}
+
+public:
+    iterator begin() const { return iterator(&msg_, msg_.msg_controllen ? CMSG_FIRSTHDR(&msg_) : nullptr); }
+    iterator end() const { return iterator(&msg_, nullptr); }
+    bool     empty() const { return begin() == end(); }
+
+    // The first `Control` message, nullopt if there is none.
+    template <ControlMessageType Control>
+    std::optional<typename Control::value_type> find() const
+    {
+        for (const ControlMessage cmsg : *this)
+        {
+            if (auto value = cmsg.get<Control>()) return value;
+        }
+
+        return std::nullopt;
+    }
+
+private:
+    msghdr msg_ = {};
+};
+
+
+// Bytes of control buffer the given message types take.
+template <ControlMessageType... Controls>
+constexpr size_t control_space = (CMSG_SPACE(sizeof(typename Controls::value_type)) + ... + 0);
+
+// Outgoing control messages, built in place:
+//
+//     ControlBuffer<control_space<control::TimeToLive>> control;
+//     control.add<control::TimeToLive>(1);
+//     send_message(sock, buffers, to, to_len, control.view());
+template <size_t Capacity>
+class ControlBuffer
+{
+public:
+    // False if the message does not fit.
+    template <ControlMessageType Control>
+    bool add(const typename Control::value_type& value)
+    {
+        constexpr size_t space = CMSG_SPACE(sizeof(value));
+
+        if (size_ + space > Capacity) return false;
+
+        // Zeroed padding, the kernel checks nothing but the lengths.
+        std::memset(data_ + size_, 0, space);
+
+        auto* cmsg       = reinterpret_cast<cmsghdr*>(data_ + size_);
+        cmsg->cmsg_level = Control::level;
+        cmsg->cmsg_type  = Control::type;
+        cmsg->cmsg_len   = CMSG_LEN(sizeof(value));
+        std::memcpy(CMSG_DATA(cmsg), &value, sizeof(value));
+
+        size_ += space;
+        return true;
+    }
+
+    void clear() { size_ = 0; }
+
+    std::span<const char> view() const { return { data_, size_ }; }
+
+private:
+    alignas(cmsghdr) char data_[Capacity];
+    size_t size_ = 0;
+};
+
+
+// What receive_message() got besides the payload.
+struct ReceivedMessage
+{
+    size_t          length         = 0; // payload bytes received
+    socklen_t       address_length = 0;
+    int             flags          = 0; // msg_flags: MSG_TRUNC, MSG_CTRUNC, MSG_ERRQUEUE
+    ControlMessages control;
+
+    // The datagram did not fit the buffers (or the control messages theirs).
+    bool truncated() const { return flags & MSG_TRUNC; }
+    bool control_truncated() const { return flags & MSG_CTRUNC; }
+};
+
+
+// sendmsg() of `buffers` in that order, gathered by the kernel: a header, a
+// static payload and user data go out as one datagram without being copied
+// together first. `to` may be nullptr on a connected socket. Returns the
+// bytes sent or -1 with errno set, as sendmsg().
+ssize_t send_message(SocketDescriptorType   sock,
+                     std::span<const iovec> buffers,
+                     const sockaddr*        to      = nullptr,
+                     socklen_t              to_len  = 0,
+                     std::span<const char>  control = {},
+                     int                    flags   = 0);
+
+// recvmsg() scattering the datagram over `buffers`, the sender's address
+// into `from` (up to `from_len` bytes) and control messages into `control`.
+// Returns the bytes received or -1 with errno set, as recvmsg().
+ssize_t receive_message(SocketDescriptorType   sock,
+                        std::span<const iovec> buffers,
+                        ReceivedMessage&       message,
+                        sockaddr*              from     = nullptr,
+                        socklen_t              from_len = 0,
+                        std::span<char>        control  = {},
+                        int                    flags    = 0);
+
+} // socket_wrapper
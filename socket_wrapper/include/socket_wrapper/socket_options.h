@@ -0,0 +1,158 @@
+#pragma once
+
+#include <chrono>
+#include <concepts>
+#include <functional>
+#include <string>
+#include <type_traits>
+
+#include <netinet/in.h>
+#include <netinet/ip.h>
+#include <netinet/tcp.h>
+#include <netinet/udp.h>
+#include <sys/time.h>
+
+#include "socket_headers.h"
+
+
+namespace socket_wrapper
+{
+
+// A socket option as a type: its level, its name, the C++ value it takes and
+// the representation setsockopt() expects. Passing the wrong value type (an
+// integer as a timeout, say) does not compile.
+template <int Level, int Name, typename T, typename Native = T>
+struct SocketOption
+{
+    static constexpr int level = Level;
+    static constexpr int name  = Name;
+
+    using value_type  = T;
+    using native_type = Native;
+
+    static Native to_native(const T& value) { return static_cast<Native>(value); }
+    static T      from_native(const Native& value) { return static_cast<T>(value); }
+};
+
+// On/off options, an int for the kernel.
+template <int Level, int Name>
+using FlagOption = SocketOption<Level, Name, bool, int>;
+
+// SO_RCVTIMEO and SO_SNDTIMEO take a timeval, 0 means no timeout.
+template <int Name>
+struct TimeoutOption : SocketOption<SOL_SOCKET, Name, std::chrono::microseconds, timeval>
+{
+    static timeval to_native(std::chrono::microseconds value)
+    {
+        return { .tv_sec  = static_cast<time_t>(value.count() / 1000000),
+                 .tv_usec = static_cast<suseconds_t>(value.count() % 1000000) };
+    }
+
+    static std::chrono::microseconds from_native(const timeval& value)
+    {
+        return std::chrono::seconds(value.tv_sec) + std::chrono::microseconds(value.tv_usec);
+    }
+};
+
+template <typename Option>
+concept SocketOptionType = requires(const typename Option::value_type& value,
+                                    const typename Option::native_type& native) {
+    { Option::level } -> std::convertible_to<int>;
+    { Option::name } -> std::convertible_to<int>;
+    { Option::to_native(value) } -> std::same_as<typename Option::native_type>;
+    { Option::from_native(native) } -> std::same_as<typename Option::value_type>;
+};
+
+
+namespace option
+{
+
+using Type          = SocketOption<SOL_SOCKET, SO_TYPE, int>;   // read only
+using Domain        = SocketOption<SOL_SOCKET, SO_DOMAIN, int>; // read only
+using ReuseAddress  = FlagOption<SOL_SOCKET, SO_REUSEADDR>;
+using ReusePort     = FlagOption<SOL_SOCKET, SO_REUSEPORT>;
+using Priority      = SocketOption<SOL_SOCKET, SO_PRIORITY, int>;
+using IncomingCpu   = SocketOption<SOL_SOCKET, SO_INCOMING_CPU, int>;
+// The kernel doubles the value and caps it at net.core.[rw]mem_max.
+using ReceiveBuffer = SocketOption<SOL_SOCKET, SO_RCVBUF, int>;
+using SendBuffer    = SocketOption<SOL_SOCKET, SO_SNDBUF, int>;
+// Same without the sysctl cap, needs CAP_NET_ADMIN.
+using ReceiveBufferForce = SocketOption<SOL_SOCKET, SO_RCVBUFFORCE, int>;
+using SendBufferForce    = SocketOption<SOL_SOCKET, SO_SNDBUFFORCE, int>;
+using ReceiveTimeout     = TimeoutOption<SO_RCVTIMEO>;
+using SendTimeout        = TimeoutOption<SO_SNDTIMEO>;
+// Microseconds a blocking receive or poll spins on the device queue before
+// sleeping; raising it above net.core.busy_read needs CAP_NET_ADMIN.
+using BusyPoll       = SocketOption<SOL_SOCKET, SO_BUSY_POLL, int>;
+// Busy polling keeps device interrupts deferred instead of racing them (5.11+).
+using PreferBusyPoll = FlagOption<SOL_SOCKET, SO_PREFER_BUSY_POLL>;
+using BusyPollBudget = SocketOption<SOL_SOCKET, SO_BUSY_POLL_BUDGET, int>;
+
+using TimeToLive    = SocketOption<IPPROTO_IP, IP_TTL, int>;
+using TypeOfService = SocketOption<IPPROTO_IP, IP_TOS, int>;
+using TrafficClass  = SocketOption<IPPROTO_IPV6, IPV6_TCLASS, int>;
+// Deliver the matching control message with every datagram received, see
+// socket_message.h.
+using ReceivePacketInfo    = FlagOption<IPPROTO_IP, IP_PKTINFO>;
+using ReceiveTimeToLive    = FlagOption<IPPROTO_IP, IP_RECVTTL>;
+using ReceiveTypeOfService = FlagOption<IPPROTO_IP, IP_RECVTOS>;
+// Multicast: hops a datagram sent to a group may take, and whether members
+// on this host get a copy.
+using MulticastTimeToLive = SocketOption<IPPROTO_IP, IP_MULTICAST_TTL, int>;
+using MulticastLoop       = FlagOption<IPPROTO_IP, IP_MULTICAST_LOOP>;
+// Joins or leaves a group on an interface, set only.
+using AddMembership  = SocketOption<IPPROTO_IP, IP_ADD_MEMBERSHIP, ip_mreqn>;
+using DropMembership = SocketOption<IPPROTO_IP, IP_DROP_MEMBERSHIP, ip_mreqn>;
+
+using TcpNoDelay = FlagOption<IPPROTO_TCP, TCP_NODELAY>;
+using TcpCork    = FlagOption<IPPROTO_TCP, TCP_CORK>;
+using UdpGro     = FlagOption<SOL_UDP, UDP_GRO>;
+
+} // option
+
+
+// Both return 0 on success and -1 with errno set otherwise.
+template <SocketOptionType Option>
+int set_option(SocketDescriptorType sock, const std::type_identity_t<typename Option::value_type>& value)
+{
+    const typename Option::native_type native = Option::to_native(value);
+
+    return setsockopt(sock, Option::level, Option::name, reinterpret_cast<const char*>(&native), sizeof(native));
+}
+
+template <SocketOptionType Option>
+int get_option(SocketDescriptorType sock, typename Option::value_type& value)
+{
+    typename Option::native_type native = {};
+    socklen_t                    len    = sizeof(native);
+
+    if (getsockopt(sock, Option::level, Option::name, reinterpret_cast<char*>(&native), &len) != 0) return -1;
+
+    value = Option::from_native(native);
+    return 0;
+}
+
+
+// Named sets of options for a role, applied after socket() and before use.
+enum class SocketProfile
+{
+    none,
+    // Busy polling, small buffers against queueing delay, a low-delay DSCP
+    // and TCP_NODELAY on streams.
+    low_latency,
+    // Large buffers past the sysctl caps where permitted, GRO on UDP.
+    high_throughput,
+};
+
+// Accepts "none", "low-latency" and "high-throughput".
+bool        parse_socket_profile(const std::string& name, SocketProfile& profile);
+const char* socket_profile_name(SocketProfile profile);
+
+// Applies what the socket and the privileges allow: every option that could
+// not be set is reported to `on_failure` (option name, errno) and the rest is
+// still applied. Returns 0 if everything was set, -1 otherwise.
+int apply_socket_profile(SocketDescriptorType                               sock,
+                         SocketProfile                                      profile,
+                         const std::function<void(const char*, int error)>& on_failure = nullptr);
+
+} // socket_wrapper
@@ -0,0 +1,75 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+
+
+namespace socket_wrapper
+{
+
+// Lets the sibling hyper-thread run while spinning.
+inline void cpu_relax()
+{
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__)
+    asm volatile("yield");
+#endif
+}
+
+
+// Spin-then-block waiting. Before a thread goes to sleep in the kernel
+// (blocking receive, epoll_wait()), it retries a non-blocking operation for
+// up to `budget`. A request that arrives meanwhile is picked up without a
+// wakeup and a context switch. When the traffic goes quiet the budget runs
+// out and the thread blocks as before. Spinning burns the CPU it runs on, so
+// pin the thread.
+class SpinThenBlock
+{
+public:
+    using Clock = std::chrono::steady_clock;
+
+    struct Stats
+    {
+        uint64_t spin_hits = 0; // spins that found work
+        uint64_t sleeps    = 0; // spins that ran out, the caller blocked
+    };
+
+public:
+    explicit SpinThenBlock(Clock::duration budget) : budget_(budget) {}
+
+public:
+    bool            enabled() const { return budget_ > Clock::duration::zero(); }
+    Clock::duration budget() const { return budget_; }
+    const Stats&    stats() const { return stats_; }
+
+    // Calls try_once() until it returns true (a hit, returns true) or the
+    // budget runs out (returns false: block now). Disabled, it returns false
+    // without calling try_once() or counting a sleep.
+    template <typename TryOnce>
+    bool spin(TryOnce&& try_once)
+    {
+        if (!enabled()) return false;
+
+        const auto deadline = Clock::now() + budget_;
+
+        do
+        {
+            if (try_once())
+            {
+                ++stats_.spin_hits;
+                return true;
+            }
+            cpu_relax();
+        } while (Clock::now() < deadline);
+
+        ++stats_.sleeps;
+        return false;
+    }
+
+private:
+    Clock::duration budget_;
+    Stats           stats_;
+};
+
+} // socket_wrapper
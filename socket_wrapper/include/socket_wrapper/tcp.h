@@ -0,0 +1,125 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string_view>
+#include <vector>
+
+#include <sys/types.h>
+
+#include "socket_class.h"
+#include "socket_headers.h"
+
+
+namespace socket_wrapper
+{
+
+// Non-blocking TCP stream with its own read and write buffers, made for an
+// edge-triggered EventLoop: receive() and flush() go on until the kernel
+// returns EAGAIN. Linux only.
+class TcpConnection : public Socket
+{
+public:
+    // Takes over an accepted (non-blocking) descriptor.
+    explicit TcpConnection(SocketDescriptorType fd = INVALID_SOCKET);
+    // Starts a non-blocking connect(); the connection is established when
+    // the socket turns writable and connect_error() is 0.
+    TcpConnection(const sockaddr* addr, socklen_t addr_len);
+
+    TcpConnection(TcpConnection&&) = default;
+    TcpConnection& operator=(TcpConnection&&) = default;
+
+public:
+    int set_nodelay(bool enabled);
+    // While corked, partial segments wait (up to 200 ms) until uncorked.
+    int set_cork(bool enabled);
+    // SO_ERROR: the result of a non-blocking connect().
+    int connect_error() const;
+
+public:
+    // Appends everything readable to input(). Returns the bytes read, or -1
+    // with errno set; eof() turns true once the peer shut its side down.
+    ssize_t          receive();
+    std::string_view input() const { return { input_.get() + input_start_, input_end_ - input_start_ }; }
+    void             consume(size_t n);
+    bool             eof() const { return eof_; }
+
+    // Sends `data` after the pending output, queueing what the socket does
+    // not take. Returns -1 (errno set) on a hard error.
+    int    write(std::string_view data);
+    // Sends queued output: 0 when all went out, 1 when some is left (wait
+    // for writable), -1 on error.
+    int    flush();
+    size_t pending() const { return output_.size() - output_start_; }
+
+public:
+    // Zero-copy file transmission; both need an empty output queue (flush()
+    // first). They return the bytes sent, or -1 with errno set (EAGAIN when
+    // the socket buffer is full).
+    ssize_t send_file(int fd, off_t& offset, size_t count);
+    // Same through splice() and a private pipe, pages move file -> pipe ->
+    // socket without being copied to user space. Data the socket did not take
+    // stays in the pipe (`offset` is past it) and goes first on the next
+    // call, whose result includes it.
+    ssize_t splice_file(int fd, off_t& offset, size_t count);
+
+public:
+    // MSG_ZEROCOPY: the kernel sends straight from user pages and reports on
+    // the error queue when it no longer needs them. Every successful
+    // write_zerocopy() call gets the next sequence number, starting at 0; the
+    // buffer of call n may be reused once zerocopy_completed() > n.
+    int      enable_zerocopy();
+    ssize_t  write_zerocopy(const void* data, size_t len);
+    // Reads completion notifications (the socket reports them as an error
+    // event), returns how many were read or -1.
+    int      read_zerocopy_completions();
+    uint32_t zerocopy_sent() const { return zerocopy_sent_; }
+    uint32_t zerocopy_completed() const { return zerocopy_completed_; }
+    // Sends the kernel completed by copying after all (e.g. over loopback).
+    uint64_t zerocopy_copied() const { return zerocopy_copied_; }
+
+private:
+    // Makes room for `n` bytes after input_end_, moving or growing the buffer.
+    void    reserve_input(size_t n);
+    ssize_t drain_pipe();
+
+private:
+    // Raw storage: recv() writes into the spare capacity, never zero-filled.
+    std::unique_ptr<char[]> input_;
+    size_t                  input_start_    = 0;
+    size_t                  input_end_      = 0;
+    size_t                  input_capacity_ = 0;
+
+    std::vector<char> output_;
+    size_t            output_start_ = 0;
+    bool              eof_          = false;
+
+    Socket pipe_read_{ INVALID_SOCKET };
+    Socket pipe_write_{ INVALID_SOCKET };
+    size_t pipe_bytes_ = 0;
+
+    uint32_t zerocopy_sent_      = 0;
+    uint32_t zerocopy_completed_ = 0;
+    uint64_t zerocopy_copied_    = 0;
+};
+
+
+// Non-blocking listening socket.
+class TcpListener : public Socket
+{
+public:
+    TcpListener(const sockaddr* addr, socklen_t addr_len, int backlog = SOMAXCONN, bool reuseport = false);
+
+public:
+    // False if socket(), bind() or listen() failed (errno is set).
+    bool listening() const { return listening_; }
+    // accept4() with SOCK_NONBLOCK; an unopened connection with errno
+    // EAGAIN means the backlog is drained.
+    TcpConnection accept(sockaddr_storage* peer = nullptr, socklen_t* peer_len = nullptr);
+
+private:
+    bool listening_ = false;
+};
+
+} // socket_wrapper
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <cstdint>
+#include <ctime>
+
+#include "socket_headers.h"
+
+
+namespace socket_wrapper
+{
+
+// Kernel packet timestamps (Linux SO_TIMESTAMPING, SO_TIMESTAMPNS fallback).
+// Software stamps are taken by the network stack, hardware ones by the NIC
+// if it supports them and enable_hardware_timestamps() was called for it.
+
+enum TimestampFlags : uint32_t
+{
+    timestamp_rx       = 1 << 0,
+    timestamp_tx       = 1 << 1,
+    timestamp_hardware = 1 << 2,
+};
+
+struct PacketTimestamp
+{
+    timespec software = {};
+    timespec hardware = {};
+
+    bool has_software() const { return software.tv_sec != 0 || software.tv_nsec != 0; }
+    bool has_hardware() const { return hardware.tv_sec != 0 || hardware.tv_nsec != 0; }
+    bool empty() const { return !has_software() && !has_hardware(); }
+    // Hardware stamp if present, software otherwise, 0 if there is none.
+    int64_t     ns() const;
+    const char* source() const;
+};
+
+// Turns on reporting of the requested stamps. Returns the flags actually
+// enabled (only timestamp_rx when just SO_TIMESTAMPNS is available) or -1.
+int enable_timestamping(SocketDescriptorType sock, uint32_t flags);
+// Asks the NIC `interface` to stamp all packets (SIOCSHWTSTAMP, needs
+// CAP_NET_ADMIN), returns 0 on success and -1 with errno set otherwise.
+int enable_hardware_timestamps(SocketDescriptorType sock, const char* interface);
+
+// Fills `ts` from the control messages of a received `msg`, false if the
+// message carries no timestamp.
+bool read_timestamp(const msghdr& msg, PacketTimestamp& ts);
+
+// recvfrom() that also returns the receive timestamp (empty if disabled).
+ssize_t recv_timestamped(SocketDescriptorType sock,
+                         void*                buffer,
+                         size_t               len,
+                         int                  flags,
+                         sockaddr*            from,
+                         socklen_t*           from_len,
+                         PacketTimestamp&     ts);
+
+// Reads one transmit timestamp from the error queue without blocking.
+// The stamped packet is copied to `buffer` as the kernel looped it back
+// (with the link layer header for raw sockets, so it is easiest located from
+// the end). Returns the copied length or -1 (EAGAIN when the queue is empty).
+ssize_t read_tx_timestamp(SocketDescriptorType sock,
+                          void*                buffer,
+                          size_t               len,
+                          PacketTimestamp&     ts);
+
+} // socket_wrapper
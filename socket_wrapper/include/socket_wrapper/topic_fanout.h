@@ -0,0 +1,163 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include <netinet/in.h>
+#include <sys/uio.h>
+
+#include "socket_headers.h"
+
+
+namespace socket_wrapper
+{
+
+// Topics and their subscribers for a publish/subscribe datagram server.
+//
+// Every topic keeps its subscribers in one contiguous array, removed ones
+// are swapped with the last. Next to it lies an array of mmsghdr, one per
+// subscriber, naming its address and sharing a single iovec: a publish
+// points that iovec at the payload and hands the arrays to sendmmsg() in
+// batches of up to UIO_MAXIOV, with no copy and no per-subscriber work in
+// user space. The headers are rebuilt only after the list changed.
+//
+// With a multicast group the topics map to groups instead: topic i is sent
+// once to the group address + i, and subscribers join it themselves.
+// Subscriptions are soft state and expire unless renewed. A topic left
+// without subscribers (in multicast mode: not renewed for the TTL) is
+// dropped and its id reused, so stale names do not use up max_topics.
+// Not thread-safe.
+class TopicFanout
+{
+public:
+    using Clock   = std::chrono::steady_clock;
+    using TopicId = uint32_t;
+
+    static constexpr TopicId no_topic = UINT32_MAX;
+
+    struct Options
+    {
+        size_t          max_topics      = 4096;
+        size_t          max_subscribers = 65536; // per topic
+        size_t          batch           = UIO_MAXIOV; // datagrams per sendmmsg()
+        Clock::duration ttl             = std::chrono::seconds(30); // 0: subscriptions never expire
+        // Group of topic 0 and the port every group is sent to.
+        std::optional<sockaddr_in> multicast;
+    };
+
+    struct Stats
+    {
+        uint64_t subscribed   = 0; // new subscriptions, renewals not counted
+        uint64_t unsubscribed = 0;
+        uint64_t expired      = 0;
+        uint64_t rejected     = 0; // over a limit, or not an IP address
+        uint64_t published    = 0;
+        uint64_t delivered    = 0; // datagrams accepted by the kernel
+        uint64_t send_errors  = 0; // datagrams it refused
+    };
+
+public:
+    explicit TopicFanout(const Options& options);
+
+    TopicFanout(const TopicFanout&) = delete;
+    TopicFanout& operator=(const TopicFanout&) = delete;
+
+public:
+    // Adds or renews the subscription of `address` to `topic`, creating the
+    // topic. Returns the topic, or no_topic if a limit was hit. In multicast
+    // mode only the topic is created.
+    TopicId subscribe(std::string_view topic, const sockaddr* address, socklen_t length, Clock::time_point now);
+    // False if there was no such subscription.
+    bool    unsubscribe(std::string_view topic, const sockaddr* address, socklen_t length);
+    // Sends `payload` from `sock` to every subscriber of `topic`, or to its
+    // group. A full send buffer drops the rest, as the network would.
+    // Returns the datagrams sent.
+    size_t  publish(SocketDescriptorType sock, std::string_view topic, std::span<const char> payload);
+    // Drops subscriptions not renewed for the TTL, returns how many.
+    size_t  expire(Clock::time_point now);
+
+public:
+    // no_topic if nobody is subscribed to it.
+    TopicId      find(std::string_view topic) const;
+    size_t       subscribers(TopicId topic) const { return topics_[topic].endpoints.size(); }
+    size_t       subscriptions() const { return subscriptions_; }
+    size_t       topic_count() const { return names_.size(); }
+    bool         multicast() const { return options_.multicast.has_value(); }
+    // The group `topic` is sent to, multicast mode only.
+    sockaddr_in  group(TopicId topic) const;
+    const Stats& stats() const { return stats_; }
+
+private:
+    union Endpoint
+    {
+        sockaddr     any;
+        sockaddr_in  in;
+        sockaddr_in6 in6;
+    };
+
+    // Address bytes (IPv4 in the first four), port and family.
+    struct Key
+    {
+        uint8_t  address[16];
+        uint16_t port;
+        uint16_t family;
+
+        bool operator==(const Key&) const = default;
+    };
+
+    struct KeyHash
+    {
+        size_t operator()(const Key& key) const;
+    };
+
+    // Heterogeneous lookup: a topic is found by string_view without a copy.
+    struct NameHash
+    {
+        using is_transparent = void;
+
+        size_t operator()(std::string_view name) const { return std::hash<std::string_view>()(name); }
+    };
+
+    struct Topic
+    {
+        std::string                                name;
+        std::vector<Endpoint>                      endpoints;
+        std::vector<Clock::time_point>             renewed;   // per endpoint
+        std::unordered_map<Key, uint32_t, KeyHash> positions; // in endpoints
+        std::vector<mmsghdr>                       messages;  // per endpoint, unless stale
+        bool                                       stale = true;
+        Clock::time_point                          used;      // last subscribe, multicast mode
+    };
+
+private:
+    static bool make_key(const sockaddr* address, socklen_t length, Key& key, Endpoint& endpoint);
+
+    void   remove(TopicId id, uint32_t position);
+    // Forgets the name and frees the id for the next new topic.
+    void   release(TopicId id);
+    void   rebuild(Topic& topic);
+    size_t send(SocketDescriptorType sock, mmsghdr* messages, size_t count);
+
+private:
+    const Options options_;
+
+    std::vector<Topic>                                                  topics_;
+    std::vector<TopicId>                                                free_ids_;
+    std::unordered_map<std::string, TopicId, NameHash, std::equal_to<>> names_;
+    size_t                                                              subscriptions_;
+
+    // The payload every message of a publish points at.
+    iovec payload_;
+
+    Stats stats_;
+};
+
+} // socket_wrapper
@@ -0,0 +1,1056 @@
+#include <socket_wrapper/bulk_transfer.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <random>
+
+#include <endian.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <socket_wrapper/packet_buffer.h>
+
+
+namespace socket_wrapper
+{
+
+namespace
+{
+
+constexpr uint16_t magic         = 0x4254; // "BT"
+constexpr uint8_t  type_data     = 1;
+constexpr uint8_t  type_ack      = 2;
+constexpr uint8_t  flag_complete = 1;
+
+constexpr size_t common_size     = 8;
+constexpr size_t ack_header_size = 24;
+constexpr size_t range_size      = 16;
+
+
+void store16(char* p, uint16_t v)
+{
+    v = htobe16(v);
+    std::memcpy(p, &v, sizeof(v));
+}
+
+
+void store32(char* p, uint32_t v)
+{
+    v = htobe32(v);
+    std::memcpy(p, &v, sizeof(v));
+}
+
+
+void store64(char* p, uint64_t v)
+{
+    v = htobe64(v);
+    std::memcpy(p, &v, sizeof(v));
+}
+
+
+uint16_t load16(const char* p)
+{
+    uint16_t v;
+    std::memcpy(&v, p, sizeof(v));
+    return be16toh(v);
+}
+
+
+uint32_t load32(const char* p)
+{
+    uint32_t v;
+    std::memcpy(&v, p, sizeof(v));
+    return be32toh(v);
+}
+
+
+uint64_t load64(const char* p)
+{
+    uint64_t v;
+    std::memcpy(&v, p, sizeof(v));
+    return be64toh(v);
+}
+
+
+void write_common(char* p, uint8_t type, uint8_t flags, uint32_t session)
+{
+    store16(p, magic);
+    p[2] = static_cast<char>(type);
+    p[3] = static_cast<char>(flags);
+    store32(p + 4, session);
+}
+
+
+// False for anything but a datagram of this protocol.
+bool read_common(const char* p, size_t len, uint8_t& type, uint8_t& flags, uint32_t& session)
+{
+    if (len < common_size || load16(p) != magic) return false;
+
+    type    = static_cast<uint8_t>(p[2]);
+    flags   = static_cast<uint8_t>(p[3]);
+    session = load32(p + 4);
+
+    return true;
+}
+
+
+double seconds(EventLoop::Clock::duration d)
+{
+    return std::chrono::duration<double>(d).count();
+}
+
+
+uint32_t chunk_count_of(uint64_t size, uint64_t chunk_size)
+{
+    // An empty transfer still sends one empty chunk.
+    return static_cast<uint32_t>(std::max<uint64_t>((size + chunk_size - 1) / chunk_size, 1));
+}
+
+}
+
+
+MappedFile::~MappedFile()
+{
+    close();
+}
+
+
+bool MappedFile::open(const std::string& path)
+{
+    close();
+
+    fd_ = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+
+    struct stat st;
+    if (fd_ < 0 || fstat(fd_, &st) != 0) return close(), false;
+
+    size_ = static_cast<size_t>(st.st_size);
+    if (size_ == 0) return true;
+
+    void* data = mmap(nullptr, size_, PROT_READ, MAP_SHARED, fd_, 0);
+    if (data == MAP_FAILED) return close(), false;
+
+    data_ = static_cast<char*>(data);
+    madvise(data_, size_, MADV_SEQUENTIAL);
+
+    return true;
+}
+
+
+bool MappedFile::create(const std::string& path, size_t size)
+{
+    close();
+
+    fd_ = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd_ < 0 || ftruncate(fd_, static_cast<off_t>(size)) != 0) return close(), false;
+
+    size_ = size;
+    if (size_ == 0) return true;
+
+    void* data = mmap(nullptr, size_, PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0);
+    if (data == MAP_FAILED) return close(), false;
+
+    data_ = static_cast<char*>(data);
+
+    return true;
+}
+
+
+int MappedFile::sync()
+{
+    return data_ ? msync(data_, size_, MS_SYNC) : 0;
+}
+
+
+void MappedFile::close()
+{
+    const int error = errno;
+
+    if (data_) munmap(data_, size_);
+    if (fd_ >= 0) ::close(fd_);
+
+    fd_   = -1;
+    data_ = nullptr;
+    size_ = 0;
+    // The caller reports the error that made it give up.
+    errno = error;
+}
+
+
+BulkSender::BulkSender(EventLoop&                            loop,
+                       const sockaddr*                       receiver,
+                       socklen_t                             receiver_len,
+                       std::span<const char>                 data,
+                       std::unique_ptr<CongestionController> congestion,
+                       Callback                              done,
+                       Options                               options)
+    : loop_(loop)
+    , sock_(receiver->sa_family, SOCK_DGRAM, IPPROTO_UDP)
+    , data_(data)
+    , congestion_(std::move(congestion))
+    , done_(std::move(done))
+    , options_(options)
+    , opened_(false)
+    , finished_(false)
+    , session_(std::max<uint32_t>(std::random_device()(), 1))
+    , chunk_count_(chunk_count_of(data.size(), options.chunk_size))
+    , chunk_acked_(chunk_count_, 0)
+    , chunk_packet_(chunk_count_, queued)
+    , next_chunk_(0)
+    , acked_chunks_(0)
+    , acked_bytes_(0)
+    , first_packet_(0)
+    , next_packet_(0)
+    , largest_acked_(0)
+    , has_acked_(false)
+    , packet_threshold_(3)
+    , reorder_steps_(0)
+    , in_flight_(0)
+    , timeouts_in_row_(0)
+    , alarm_(0)
+    , pacing_credit_(0)
+    , pacer_(0)
+    , delivered_(0)
+    , app_limited_until_(0)
+    , msgs_(std::max<size_t>(options.batch, 1))
+    , iovecs_(2 * msgs_.size())
+    , headers_(msgs_.size())
+    , batch_count_(0)
+    , batch_sent_(0)
+    , waiting_writable_(false)
+    , rx_(16, max_datagram_size)
+{
+    for (size_t i = 0; i < msgs_.size(); ++i)
+    {
+        msgs_[i].msg_hdr            = {};
+        msgs_[i].msg_hdr.msg_iov    = &iovecs_[2 * i];
+        msgs_[i].msg_hdr.msg_iovlen = 2;
+        iovecs_[2 * i]              = { headers_[i].data(), header_size };
+    }
+
+    // Connected: the kernel drops datagrams of other peers and reports
+    // ICMP errors to this socket.
+    if (!sock_ || connect(sock_, receiver, receiver_len) != 0 || sock_.set_nonblocking() != 0) return;
+
+    opened_ = loop_.add(sock_, EventLoop::readable, [this](uint32_t events) {
+        if (events & EventLoop::writable) pump();
+        if (events & (EventLoop::readable | EventLoop::error)) on_readable();
+    }) == 0;
+}
+
+
+BulkSender::~BulkSender()
+{
+    if (alarm_ != 0) loop_.cancel_timer(alarm_);
+    if (pacer_ != 0) loop_.cancel_timer(pacer_);
+    if (opened_) loop_.remove(sock_);
+}
+
+
+void BulkSender::start()
+{
+    last_progress_ = Clock::now();
+    pacing_stamp_  = last_progress_;
+
+    pump();
+}
+
+
+size_t BulkSender::chunk_bytes(uint32_t chunk) const
+{
+    const uint64_t offset = static_cast<uint64_t>(chunk) * options_.chunk_size;
+
+    return std::min<uint64_t>(options_.chunk_size, data_.size() - offset);
+}
+
+
+bool BulkSender::next_chunk(uint32_t& chunk) const
+{
+    if (!retransmit_.empty())
+    {
+        chunk = retransmit_.front();
+        return true;
+    }
+    if (next_chunk_ < chunk_count_)
+    {
+        chunk = next_chunk_;
+        return true;
+    }
+
+    return false;
+}
+
+
+void BulkSender::pump()
+{
+    if (finished_ || !flush()) return;
+
+    const auto   now  = Clock::now();
+    const double rate = congestion_->pacing_rate();
+
+    if (rate > 0)
+    {
+        // Credit for a couple of milliseconds at most, the loop's timers are
+        // no finer than that.
+        const double burst = std::max(rate * 0.002, 4.0 * (options_.chunk_size + header_size));
+        pacing_credit_     = std::min(pacing_credit_ + rate * seconds(now - pacing_stamp_), burst);
+    }
+    pacing_stamp_ = now;
+
+    while (true)
+    {
+        // Chunks acknowledged since they were queued need no retransmission.
+        while (!retransmit_.empty() && chunk_acked_[retransmit_.front()]) retransmit_.pop_front();
+
+        uint32_t chunk;
+        if (!next_chunk(chunk))
+        {
+            // Rate samples taken before this is delivered do not show what the
+            // path could carry.
+            if (in_flight_ > 0) app_limited_until_ = delivered_ + in_flight_;
+            break;
+        }
+
+        const size_t bytes = chunk_bytes(chunk) + header_size;
+
+        if (in_flight_ > 0 && in_flight_ + bytes > congestion_->window()) break;
+        if (rate > 0 && pacing_credit_ < bytes)
+        {
+            arm_pacer(rate, bytes);
+            break;
+        }
+
+        if (!retransmit_.empty())
+        {
+            retransmit_.pop_front();
+            ++stats_.retransmitted;
+        }
+        else
+        {
+            ++next_chunk_;
+        }
+
+        queue_packet(chunk, now);
+        if (rate > 0) pacing_credit_ -= bytes;
+
+        if (batch_count_ == msgs_.size() && !flush()) break;
+    }
+
+    flush();
+    arm_alarm();
+}
+
+
+void BulkSender::queue_packet(uint32_t chunk, Clock::time_point now)
+{
+    if (in_flight_ == 0)
+    {
+        // After an idle period rate samples start over, and so does the
+        // retransmission timeout.
+        first_sent_time_ = now;
+        delivered_time_  = now;
+        last_progress_   = now;
+    }
+
+    const uint64_t number  = next_packet_++;
+    const size_t   payload = chunk_bytes(chunk);
+    char*          header  = headers_[batch_count_].data();
+
+    write_common(header, type_data, 0, session_);
+    store64(header + 8, number);
+    store64(header + 16, data_.size());
+    store32(header + 24, chunk);
+    store32(header + 28, static_cast<uint32_t>(options_.chunk_size));
+
+    const uint64_t offset         = static_cast<uint64_t>(chunk) * options_.chunk_size;
+    iovecs_[2 * batch_count_ + 1] = { const_cast<char*>(data_.data()) + offset, payload };
+    ++batch_count_;
+
+    const uint32_t bytes = static_cast<uint32_t>(payload + header_size);
+
+    packets_.push_back(SentPacket{ chunk,
+                                   bytes,
+                                   PacketState::in_flight,
+                                   app_limited_until_ != 0,
+                                   now,
+                                   delivered_,
+                                   delivered_time_,
+                                   first_sent_time_ });
+    chunk_packet_[chunk] = number;
+    in_flight_ += bytes;
+    ++stats_.packets;
+}
+
+
+bool BulkSender::flush()
+{
+    while (batch_sent_ < batch_count_)
+    {
+        if (options_.shim)
+        {
+            // What the shim fails to send is lost on the way, like its drops.
+            options_.shim->send(sock_, msgs_[batch_sent_].msg_hdr);
+            ++batch_sent_;
+            continue;
+        }
+
+        const int sent = sendmmsg(sock_, &msgs_[batch_sent_], batch_count_ - batch_sent_, 0);
+        if (sent < 0)
+        {
+            // An ICMP error of an earlier datagram is reported once: the
+            // receiver may not be up yet, the timeout takes care of it.
+            if (errno == EINTR || errno == ECONNREFUSED) continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+            {
+                if (!waiting_writable_)
+                {
+                    waiting_writable_ = loop_.modify(sock_, EventLoop::readable | EventLoop::writable) == 0;
+                }
+                return false;
+            }
+
+            finish(errno);
+            return false;
+        }
+
+        batch_sent_ += sent;
+    }
+
+    batch_count_ = 0;
+    batch_sent_  = 0;
+
+    if (waiting_writable_)
+    {
+        loop_.modify(sock_, EventLoop::readable);
+        waiting_writable_ = false;
+    }
+
+    return true;
+}
+
+
+void BulkSender::on_readable()
+{
+    receive_acks();
+    if (!finished_) pump();
+}
+
+
+bool BulkSender::receive_acks()
+{
+    bool any = false;
+
+    for (;;)
+    {
+        const int received = rx_.receive(sock_);
+        if (received < 0)
+        {
+            if (errno == ECONNREFUSED || errno == EINTR) continue;
+            break;
+        }
+        any = true;
+
+        // With GRO (high-throughput profile) a slot holds several ACKs.
+        for (int i = 0; i < received && !finished_; ++i)
+        {
+            for (size_t k = 0; k < rx_.segment_count(i) && !finished_; ++k)
+            {
+                const auto ack = rx_.segment(i, k);
+                on_ack(ack.data(), ack.size());
+            }
+        }
+        if (finished_) break;
+    }
+
+    return any;
+}
+
+
+void BulkSender::on_ack(const char* data, size_t len)
+{
+    uint8_t  type;
+    uint8_t  flags;
+    uint32_t session;
+
+    if (!read_common(data, len, type, flags, session) || type != type_ack || session != session_) return;
+    if (len < ack_header_size) return;
+
+    const uint64_t largest   = load64(data + 8);
+    const auto     ack_delay = std::chrono::microseconds(load32(data + 16));
+    const size_t   ranges    = load16(data + 20);
+
+    if (len < ack_header_size + ranges * range_size) return;
+
+    ++stats_.acks;
+
+    const auto  now           = Clock::now();
+    size_t      acked_bytes   = 0;
+    SentPacket* newest        = nullptr;
+    uint64_t    newest_number = 0;
+    bool        spurious      = false;
+    uint64_t    reordering    = 0; // packets, of the spurious losses
+
+    for (size_t r = 0; r < ranges && next_packet_ > first_packet_; ++r)
+    {
+        const char* range = data + ack_header_size + r * range_size;
+        uint64_t    first = load64(range);
+        uint64_t    last  = load64(range + 8);
+
+        // Packets before first_packet_ were resolved already.
+        if (first > last || last < first_packet_ || first >= next_packet_) continue;
+
+        first = std::max(first, first_packet_);
+        last  = std::min(last, next_packet_ - 1);
+
+        for (uint64_t number = first; number <= last; ++number)
+        {
+            SentPacket& packet = packets_[number - first_packet_];
+            if (packet.state == PacketState::acked) continue;
+
+            if (acknowledge(packet, number, acked_bytes))
+            {
+                spurious   = true;
+                reordering = std::max(reordering, largest - std::min(largest, number));
+            }
+
+            if (newest == nullptr || number > newest_number)
+            {
+                newest        = &packet;
+                newest_number = number;
+            }
+        }
+    }
+
+    if (newest != nullptr)
+    {
+        // Only the largest packet number gives an RTT sample, the receiver
+        // reports its delay for that one.
+        const bool sampled = newest_number == largest;
+        if (sampled) rtt_.sample(now - newest->sent_time, ack_delay);
+
+        delivered_time_ = now;
+
+        // Delivery rate: bytes delivered since the packet was sent, over the
+        // longer of its send and ack intervals.
+        const auto send_elapsed = newest->sent_time - newest->first_sent_time;
+        const auto ack_elapsed  = now - newest->delivered_time;
+        const auto interval     = std::max(send_elapsed, ack_elapsed);
+        const double rate =
+            interval > Clock::duration::zero() ? (delivered_ - newest->delivered) / seconds(interval) : 0;
+
+        first_sent_time_ = newest->sent_time;
+        if (app_limited_until_ != 0 && delivered_ > app_limited_until_) app_limited_until_ = 0;
+
+        if (!has_acked_ || newest_number > largest_acked_)
+        {
+            largest_acked_ = newest_number;
+            has_acked_     = true;
+        }
+
+        if (acked_bytes > 0)
+        {
+            timeouts_in_row_ = 0;
+            last_progress_   = now;
+        }
+
+        congestion_->on_ack(CongestionController::Ack{ now,
+                                                       newest->sent_time,
+                                                       acked_bytes,
+                                                       in_flight_,
+                                                       delivered_,
+                                                       newest->delivered,
+                                                       rate,
+                                                       newest->app_limited,
+                                                       sampled ? rtt_.latest() : Clock::duration::zero(),
+                                                       rtt_.smoothed(),
+                                                       rtt_.min() });
+    }
+
+    // Reordering, not loss: wait for more packets and longer before
+    // declaring one lost (RACK's reordering window, RFC 8985 section 6.2).
+    if (spurious)
+    {
+        packet_threshold_ = static_cast<unsigned>(
+            std::min<uint64_t>(std::max<uint64_t>(packet_threshold_ + 1, reordering + 1), max_packet_threshold));
+        reorder_steps_ = std::min(reorder_steps_ + 1, max_reorder_steps);
+    }
+
+    detect_lost(now);
+    drop_resolved(now);
+
+    if ((flags & flag_complete) || acked_chunks_ == chunk_count_) finish(0);
+}
+
+
+bool BulkSender::acknowledge(SentPacket& packet, uint64_t number, size_t& acked_bytes)
+{
+    // Declared lost too early, its chunk may have been sent again.
+    const bool spurious = packet.state == PacketState::lost;
+
+    if (spurious)
+    {
+        ++stats_.spurious;
+
+        const uint64_t latest = chunk_packet_[packet.chunk];
+        if (latest != queued && latest != number) ++stats_.spurious_retransmitted;
+    }
+    else
+    {
+        in_flight_ -= packet.bytes;
+        acked_bytes += packet.bytes;
+    }
+
+    packet.state = PacketState::acked;
+    delivered_ += packet.bytes;
+
+    if (!chunk_acked_[packet.chunk])
+    {
+        chunk_acked_[packet.chunk] = 1;
+        ++acked_chunks_;
+        acked_bytes_ += chunk_bytes(packet.chunk);
+    }
+
+    return spurious;
+}
+
+
+// RFC 9002 section 6.1: a packet is lost once a packet packet_threshold_
+// numbers later, or one sent 9/8 RTT plus the reordering window after it,
+// was acknowledged. The window is capped at the smoothed RTT, as in RACK.
+void BulkSender::detect_lost(Clock::time_point now)
+{
+    loss_time_ = Clock::time_point();
+
+    if (!has_acked_) return;
+
+    const Clock::duration reorder_window = std::min(rtt_.min() / 4 * reorder_steps_, rtt_.smoothed());
+    const Clock::duration loss_delay     = std::max<Clock::duration>(
+        std::max(rtt_.smoothed(), rtt_.latest()) * 9 / 8 + reorder_window, std::chrono::milliseconds(1));
+
+    size_t            lost_bytes = 0;
+    Clock::time_point newest_lost;
+
+    for (uint64_t number = first_packet_; number < largest_acked_; ++number)
+    {
+        SentPacket& packet = packets_[number - first_packet_];
+        if (packet.state != PacketState::in_flight) continue;
+
+        const Clock::time_point deadline = packet.sent_time + loss_delay;
+
+        if (largest_acked_ - number >= packet_threshold_ || deadline <= now)
+        {
+            lost_bytes += packet.bytes;
+            newest_lost = std::max(newest_lost, packet.sent_time);
+            declare_lost(packet, number);
+        }
+        else if (loss_time_ == Clock::time_point() || deadline < loss_time_)
+        {
+            loss_time_ = deadline;
+        }
+    }
+
+    if (lost_bytes > 0) congestion_->on_loss(now, newest_lost, lost_bytes, in_flight_);
+}
+
+
+void BulkSender::declare_lost(SentPacket& packet, uint64_t number)
+{
+    packet.state = PacketState::lost;
+    in_flight_ -= packet.bytes;
+    ++stats_.lost;
+
+    // Only the latest transmission of a chunk brings it back.
+    if (!chunk_acked_[packet.chunk] && chunk_packet_[packet.chunk] == number)
+    {
+        chunk_packet_[packet.chunk] = queued;
+        retransmit_.push_back(packet.chunk);
+    }
+}
+
+
+void BulkSender::drop_resolved(Clock::time_point now)
+{
+    // Lost packets are kept a few RTTs, and at least a timeout, longer to see
+    // whether they arrive after all.
+    const Clock::duration keep_lost = std::max(3 * std::max(rtt_.smoothed(), rtt_.latest()), rtt_.rto());
+
+    while (!packets_.empty())
+    {
+        const SentPacket& packet = packets_.front();
+
+        if (packet.state == PacketState::in_flight) break;
+        if (packet.state == PacketState::lost && now - packet.sent_time < keep_lost) break;
+
+        packets_.pop_front();
+        ++first_packet_;
+    }
+}
+
+
+// Doubles with every timeout in a row.
+BulkSender::Clock::time_point BulkSender::rto_deadline() const
+{
+    return last_progress_ + rtt_.rto() * (1u << std::min(timeouts_in_row_, 10u));
+}
+
+
+void BulkSender::arm_alarm()
+{
+    Clock::time_point deadline;
+
+    if (loss_time_ != Clock::time_point())
+        deadline = loss_time_;
+    else if (in_flight_ > 0)
+        deadline = rto_deadline();
+    else
+        return;
+
+    // An earlier alarm stays, it re-arms itself when it finds nothing to do.
+    if (alarm_ != 0)
+    {
+        if (alarm_deadline_ <= deadline) return;
+        loop_.cancel_timer(alarm_);
+    }
+
+    alarm_deadline_ = deadline;
+    alarm_          = loop_.add_timer(std::max(deadline - Clock::now(), Clock::duration::zero()), [this] {
+        alarm_ = 0;
+        on_alarm();
+    });
+}
+
+
+void BulkSender::on_alarm()
+{
+    const auto now = Clock::now();
+
+    if (loss_time_ != Clock::time_point() && loss_time_ <= now)
+    {
+        detect_lost(now);
+        drop_resolved(now);
+        pump();
+        return;
+    }
+
+    if (in_flight_ == 0 || loss_time_ != Clock::time_point() || now < rto_deadline())
+    {
+        arm_alarm();
+        return;
+    }
+
+    // A long send burst can delay the readable event past the deadline: the
+    // ACKs already queued come first.
+    if (receive_acks())
+    {
+        if (!finished_) pump();
+        return;
+    }
+
+    // Nothing acknowledged for a whole timeout: everything in flight is lost.
+    ++stats_.timeouts;
+    if (++timeouts_in_row_ > options_.max_timeouts)
+    {
+        finish(ETIMEDOUT);
+        return;
+    }
+
+    congestion_->on_timeout(now);
+
+    for (size_t i = 0; i < packets_.size(); ++i)
+    {
+        if (packets_[i].state == PacketState::in_flight) declare_lost(packets_[i], first_packet_ + i);
+    }
+    drop_resolved(now);
+
+    pump();
+}
+
+
+void BulkSender::arm_pacer(double rate, size_t bytes)
+{
+    if (pacer_ != 0) return;
+
+    const auto wait = std::chrono::duration<double>((bytes - pacing_credit_) / rate);
+
+    pacer_ = loop_.add_timer(std::chrono::duration_cast<Clock::duration>(wait), [this] {
+        pacer_ = 0;
+        pump();
+    });
+}
+
+
+void BulkSender::finish(int error)
+{
+    if (finished_) return;
+
+    finished_ = true;
+
+    if (alarm_ != 0) loop_.cancel_timer(alarm_);
+    if (pacer_ != 0) loop_.cancel_timer(pacer_);
+    alarm_ = 0;
+    pacer_ = 0;
+
+    if (done_) done_(error);
+}
+
+
+BulkReceiver::BulkReceiver(EventLoop&      loop,
+                           const sockaddr* local,
+                           socklen_t       local_len,
+                           Storage         storage,
+                           Callback        complete,
+                           Options         options)
+    : loop_(loop)
+    , sock_(local->sa_family, SOCK_DGRAM, IPPROTO_UDP)
+    , storage_callback_(std::move(storage))
+    , complete_(std::move(complete))
+    , options_(options)
+    , opened_(false)
+    , session_(0)
+    , size_(0)
+    , chunk_size_(0)
+    , chunk_count_(0)
+    , peer_len_(0)
+    , received_chunks_(0)
+    , received_bytes_(0)
+    , ack_(ack_header_size + std::max<size_t>(options.max_ranges, 1) * range_size)
+    , rx_(std::max<size_t>(options.batch, 1), max_datagram_size)
+{
+    if (!sock_ || bind(sock_, local, local_len) != 0 || sock_.set_nonblocking() != 0) return;
+
+    opened_ = loop_.add(sock_, EventLoop::readable, [this](uint32_t) { on_readable(); }) == 0;
+}
+
+
+BulkReceiver::~BulkReceiver()
+{
+    if (opened_) loop_.remove(sock_);
+}
+
+
+void BulkReceiver::on_readable()
+{
+    for (;;)
+    {
+        const int received = rx_.receive(sock_);
+        if (received < 0)
+        {
+            if (errno == ECONNREFUSED || errno == EINTR) continue;
+            break;
+        }
+
+        const auto now  = Clock::now();
+        bool       data = false;
+
+        // With GRO (high-throughput profile) a slot holds several chunks.
+        for (int i = 0; i < received; ++i)
+        {
+            const size_t segments = rx_.segment_count(i);
+
+            for (size_t k = 0; k < segments; ++k)
+            {
+                data |= on_data(i, rx_.segment(i, k), rx_.truncated(i) && k + 1 == segments, now);
+            }
+        }
+
+        // One acknowledgement per batch read.
+        if (data) send_ack(now);
+    }
+}
+
+
+bool BulkReceiver::on_data(size_t slot, std::string_view datagram, bool truncated, Clock::time_point now)
+{
+    const char*  data = datagram.data();
+    const size_t len  = datagram.size();
+    uint8_t      type;
+    uint8_t      flags;
+    uint32_t     session;
+
+    if (!read_common(data, len, type, flags, session) || type != type_data || len < BulkSender::header_size ||
+        truncated)
+    {
+        ++stats_.foreign;
+        return false;
+    }
+
+    const uint64_t number     = load64(data + 8);
+    const uint64_t size       = load64(data + 16);
+    const uint32_t chunk      = load32(data + 24);
+    const uint32_t chunk_size = load32(data + 28);
+
+    if (!started() && !start(session, size, chunk_size, slot))
+    {
+        ++stats_.foreign;
+        return false;
+    }
+
+    if (session != session_ || size != size_ || chunk_size != chunk_size_ || chunk >= chunk_count_)
+    {
+        ++stats_.foreign;
+        return false;
+    }
+
+    const uint64_t offset   = static_cast<uint64_t>(chunk) * chunk_size_;
+    const size_t   expected = std::min<uint64_t>(chunk_size_, size_ - offset);
+
+    if (len - BulkSender::header_size != expected)
+    {
+        ++stats_.foreign;
+        return false;
+    }
+
+    ++stats_.packets;
+    last_packet_time_ = now;
+
+    if (ranges_.empty() || number > ranges_.front().second) largest_time_ = now;
+    add_range(number);
+    unacked_numbers_.push_back(number);
+
+    if (chunk_received_[chunk])
+    {
+        ++stats_.duplicates;
+        return true;
+    }
+
+    std::memcpy(storage_.data() + offset, data + BulkSender::header_size, expected);
+    chunk_received_[chunk] = 1;
+    ++received_chunks_;
+    received_bytes_ += expected;
+
+    if (complete() && complete_) complete_();
+
+    return true;
+}
+
+
+bool BulkReceiver::start(uint32_t session, uint64_t size, uint32_t chunk_size, size_t slot)
+{
+    if (session == 0 || chunk_size == 0) return false;
+    if ((size + chunk_size - 1) / chunk_size > UINT32_MAX) return false;
+
+    std::span<char> storage;
+    if (!storage_callback_ || !storage_callback_(size, storage) || storage.size() < size) return false;
+
+    session_     = session;
+    size_        = size;
+    chunk_size_  = chunk_size;
+    chunk_count_ = chunk_count_of(size, chunk_size);
+    storage_     = storage;
+    peer_len_    = rx_.address_length(slot);
+    std::memcpy(&peer_, rx_.address(slot), peer_len_);
+
+    chunk_received_.assign(chunk_count_, 0);
+
+    return true;
+}
+
+
+void BulkReceiver::add_range(uint64_t number)
+{
+    for (size_t i = 0; i < ranges_.size(); ++i)
+    {
+        auto& range = ranges_[i];
+
+        if (number > range.second + 1)
+        {
+            ranges_.insert(ranges_.begin() + i, { number, number });
+            break;
+        }
+        if (number == range.second + 1)
+        {
+            // The newer range starts above number + 1, nothing to merge.
+            range.second = number;
+            return;
+        }
+        if (number >= range.first) return;
+        if (number + 1 == range.first)
+        {
+            range.first = number;
+            if (i + 1 < ranges_.size() && ranges_[i + 1].second + 1 == number)
+            {
+                range.first = ranges_[i + 1].first;
+                ranges_.erase(ranges_.begin() + i + 1);
+            }
+            return;
+        }
+
+        if (i + 1 == ranges_.size())
+        {
+            ranges_.push_back({ number, number });
+            break;
+        }
+    }
+
+    if (ranges_.empty()) ranges_.push_back({ number, number });
+
+    // The oldest ranges go first, the sender has long seen them.
+    if (ranges_.size() > max_kept_ranges) ranges_.resize(max_kept_ranges);
+}
+
+
+void BulkReceiver::send_ack(Clock::time_point now)
+{
+    const size_t capacity = (ack_.size() - ack_header_size) / range_size;
+
+    auto choose = [&](size_t index) {
+        if (ack_ranges_.size() < capacity &&
+            std::find(ack_ranges_.begin(), ack_ranges_.end(), index) == ack_ranges_.end())
+        {
+            ack_ranges_.push_back(index);
+        }
+    };
+
+    // The ranges that took packets since the last acknowledgement go first,
+    // as in SACK (RFC 2018 section 4): a late packet filling an old hole is
+    // reported even when many newer ranges exist. The newest fill the rest.
+    ack_ranges_.clear();
+    choose(0);
+
+    for (const uint64_t number : unacked_numbers_)
+    {
+        const auto range = std::partition_point(
+            ranges_.begin(), ranges_.end(), [number](const auto& r) { return r.first > number; });
+
+        if (range != ranges_.end() && range->second >= number) choose(range - ranges_.begin());
+    }
+    for (size_t i = 0; i < ranges_.size() && ack_ranges_.size() < capacity; ++i) choose(i);
+
+    unacked_numbers_.clear();
+
+    const size_t count = ack_ranges_.size();
+    const auto   delay = std::chrono::duration_cast<std::chrono::microseconds>(now - largest_time_);
+    char*        ack   = ack_.data();
+
+    write_common(ack, type_ack, complete() ? flag_complete : 0, session_);
+    store64(ack + 8, ranges_.front().second);
+    store32(ack + 16, static_cast<uint32_t>(std::min<int64_t>(delay.count(), UINT32_MAX)));
+    store16(ack + 20, static_cast<uint16_t>(count));
+    store16(ack + 22, 0);
+
+    for (size_t r = 0; r < count; ++r)
+    {
+        store64(ack + ack_header_size + r * range_size, ranges_[ack_ranges_[r]].first);
+        store64(ack + ack_header_size + r * range_size + 8, ranges_[ack_ranges_[r]].second);
+    }
+
+    iovec  iov = { ack, ack_header_size + count * range_size };
+    msghdr msg = {};
+
+    msg.msg_name    = &peer_;
+    msg.msg_namelen = peer_len_;
+    msg.msg_iov     = &iov;
+    msg.msg_iovlen  = 1;
+
+    if (options_.shim)
+        options_.shim->send(sock_, msg);
+    else
+        sendmsg(sock_, &msg, MSG_DONTWAIT);
+
+    ++stats_.acks;
+}
+
+} // socket_wrapper
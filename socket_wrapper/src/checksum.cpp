@@ -0,0 +1,215 @@
+#include <socket_wrapper/checksum.h>
+
+#include <cstring>
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define SOCKET_WRAPPER_X86_KERNELS 1
+#include <immintrin.h>
+#endif
+
+
+namespace socket_wrapper
+{
+
+namespace
+{
+
+uint16_t fold(uint64_t sum)
+{
+    sum = (sum & 0xffffffff) + (sum >> 32);
+    sum = (sum & 0xffffffff) + (sum >> 32);
+    sum = (sum & 0xffff) + (sum >> 16);
+    sum = (sum & 0xffff) + (sum >> 16);
+    sum = (sum & 0xffff) + (sum >> 16);
+
+    return static_cast<uint16_t>(sum);
+}
+
+
+// Adding 32-bit words into a 64-bit accumulator defers the end-around carry
+// until fold(), 2^32 words before it could overflow.
+uint64_t sum_portable(const uint8_t* p, size_t len, uint64_t sum)
+{
+    for (; len >= 16; p += 16, len -= 16)
+    {
+        uint32_t w[4];
+        std::memcpy(w, p, sizeof(w));
+        sum += static_cast<uint64_t>(w[0]) + w[1] + w[2] + w[3];
+    }
+    for (; len >= 4; p += 4, len -= 4)
+    {
+        uint32_t w;
+        std::memcpy(&w, p, sizeof(w));
+        sum += w;
+    }
+    if (len >= 2)
+    {
+        uint16_t w;
+        std::memcpy(&w, p, sizeof(w));
+        sum += w;
+        p += 2;
+        len -= 2;
+    }
+    if (len == 1)
+    {
+        // The odd byte is padded with a zero byte (RFC 1071).
+        uint16_t w = 0;
+        std::memcpy(&w, p, 1);
+        sum += w;
+    }
+
+    return sum;
+}
+
+
+#ifdef SOCKET_WRAPPER_X86_KERNELS
+
+// The vector kernels widen 32-bit words to 64-bit lanes, so the same
+// deferred carry argument holds per lane.
+__attribute__((target("sse2"))) uint64_t sum_sse2(const uint8_t* p, size_t len, uint64_t sum)
+{
+    if (len < 32) return sum_portable(p, len, sum);
+
+    const __m128i zero = _mm_setzero_si128();
+    __m128i       acc0 = _mm_setzero_si128();
+    __m128i       acc1 = _mm_setzero_si128();
+
+    for (; len >= 32; p += 32, len -= 32)
+    {
+        __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+        __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 16));
+
+        acc0 = _mm_add_epi64(acc0, _mm_unpacklo_epi32(a, zero));
+        acc1 = _mm_add_epi64(acc1, _mm_unpackhi_epi32(a, zero));
+        acc0 = _mm_add_epi64(acc0, _mm_unpacklo_epi32(b, zero));
+        acc1 = _mm_add_epi64(acc1, _mm_unpackhi_epi32(b, zero));
+    }
+
+    uint64_t lanes[2];
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(lanes), _mm_add_epi64(acc0, acc1));
+
+    return sum_portable(p, len, sum + fold(lanes[0]) + fold(lanes[1]));
+}
+
+
+__attribute__((target("avx2"))) uint64_t sum_avx2(const uint8_t* p, size_t len, uint64_t sum)
+{
+    if (len < 64) return sum_sse2(p, len, sum);
+
+    const __m256i zero = _mm256_setzero_si256();
+    __m256i       acc0 = _mm256_setzero_si256();
+    __m256i       acc1 = _mm256_setzero_si256();
+
+    for (; len >= 64; p += 64, len -= 64)
+    {
+        __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+        __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p + 32));
+
+        acc0 = _mm256_add_epi64(acc0, _mm256_unpacklo_epi32(a, zero));
+        acc1 = _mm256_add_epi64(acc1, _mm256_unpackhi_epi32(a, zero));
+        acc0 = _mm256_add_epi64(acc0, _mm256_unpacklo_epi32(b, zero));
+        acc1 = _mm256_add_epi64(acc1, _mm256_unpackhi_epi32(b, zero));
+    }
+
+    uint64_t lanes[4];
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(lanes), _mm256_add_epi64(acc0, acc1));
+
+    for (auto lane : lanes) sum += fold(lane);
+
+    return sum_sse2(p, len, sum);
+}
+
+#endif
+
+
+using SumFunction = uint64_t (*)(const uint8_t*, size_t, uint64_t);
+
+SumFunction sum_function(ChecksumKernel kernel)
+{
+    switch (kernel)
+    {
+#ifdef SOCKET_WRAPPER_X86_KERNELS
+        case ChecksumKernel::avx2:
+            return sum_avx2;
+        case ChecksumKernel::sse2:
+            return sum_sse2;
+#endif
+        default:
+            return sum_portable;
+    }
+}
+
+
+ChecksumKernel detect_kernel()
+{
+    if (checksum_kernel_supported(ChecksumKernel::avx2)) return ChecksumKernel::avx2;
+    if (checksum_kernel_supported(ChecksumKernel::sse2)) return ChecksumKernel::sse2;
+
+    return ChecksumKernel::portable;
+}
+
+}
+
+
+ChecksumKernel checksum_kernel()
+{
+    static const ChecksumKernel kernel = detect_kernel();
+
+    return kernel;
+}
+
+
+bool checksum_kernel_supported(ChecksumKernel kernel)
+{
+    switch (kernel)
+    {
+        case ChecksumKernel::portable:
+            return true;
+#ifdef SOCKET_WRAPPER_X86_KERNELS
+        case ChecksumKernel::sse2:
+            return __builtin_cpu_supports("sse2");
+        case ChecksumKernel::avx2:
+            return __builtin_cpu_supports("avx2");
+#endif
+        default:
+            return false;
+    }
+}
+
+
+const char* checksum_kernel_name(ChecksumKernel kernel)
+{
+    switch (kernel)
+    {
+        case ChecksumKernel::sse2:
+            return "sse2";
+        case ChecksumKernel::avx2:
+            return "avx2";
+        default:
+            return "portable";
+    }
+}
+
+
+uint16_t checksum_sum(const void* data, size_t len)
+{
+    static const SumFunction sum = sum_function(checksum_kernel());
+
+    return fold(sum(static_cast<const uint8_t*>(data), len, 0));
+}
+
+
+uint16_t checksum_sum(const void* data, size_t len, ChecksumKernel kernel)
+{
+    if (!checksum_kernel_supported(kernel)) kernel = ChecksumKernel::portable;
+
+    return fold(sum_function(kernel)(static_cast<const uint8_t*>(data), len, 0));
+}
+
+
+uint16_t checksum_add(uint16_t sum, uint16_t other)
+{
+    return fold(static_cast<uint64_t>(sum) + other);
+}
+
+}
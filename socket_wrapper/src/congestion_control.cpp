@@ -0,0 +1,357 @@
+#include <socket_wrapper/congestion_control.h>
+
+#include <algorithm>
+#include <limits>
+
+
+namespace socket_wrapper
+{
+
+namespace
+{
+
+using Clock = std::chrono::steady_clock;
+
+constexpr size_t initial_window_packets = 10;
+
+// 2 / ln(2): the smallest gain that doubles the delivery rate every round.
+constexpr double bbr_high_gain        = 2.885;
+constexpr double bbr_window_gain      = 2;
+constexpr double bbr_cycle_gains[]    = { 1.25, 0.75, 1, 1, 1, 1, 1, 1 };
+constexpr size_t bbr_cycle_length     = sizeof(bbr_cycle_gains) / sizeof(bbr_cycle_gains[0]);
+constexpr size_t bbr_min_window       = 4; // packets
+constexpr auto   bbr_min_rtt_window   = std::chrono::seconds(10);
+constexpr auto   bbr_probe_rtt_length = std::chrono::milliseconds(200);
+
+
+double seconds(Clock::duration d)
+{
+    return std::chrono::duration<double>(d).count();
+}
+
+}
+
+
+RttEstimator::RttEstimator(Clock::duration initial_rto, Clock::duration min_rto)
+    : initial_rto_(initial_rto)
+    , min_rto_(min_rto)
+    , has_sample_(false)
+    , latest_(Clock::duration::zero())
+    , smoothed_(Clock::duration::zero())
+    , variation_(Clock::duration::zero())
+    , min_(Clock::duration::zero())
+{
+}
+
+
+void RttEstimator::sample(Clock::duration rtt, Clock::duration ack_delay)
+{
+    latest_ = rtt;
+    min_    = has_sample_ ? std::min(min_, rtt) : rtt;
+
+    const Clock::duration adjusted = rtt - ack_delay >= min_ ? rtt - ack_delay : rtt;
+
+    if (!has_sample_)
+    {
+        smoothed_   = adjusted;
+        variation_  = adjusted / 2;
+        has_sample_ = true;
+        return;
+    }
+
+    const Clock::duration error = smoothed_ > adjusted ? smoothed_ - adjusted : adjusted - smoothed_;
+
+    variation_ = (3 * variation_ + error) / 4;
+    smoothed_  = (7 * smoothed_ + adjusted) / 8;
+}
+
+
+RttEstimator::Clock::duration RttEstimator::rto() const
+{
+    if (!has_sample_) return initial_rto_;
+
+    return std::max<Clock::duration>(min_rto_,
+                                     smoothed_ + std::max<Clock::duration>(4 * variation_, std::chrono::milliseconds(1)));
+}
+
+
+NewReno::NewReno(size_t mss)
+    : mss_(mss)
+    , window_(initial_window_packets * mss)
+    , threshold_(std::numeric_limits<size_t>::max())
+    , acked_in_round_(0)
+    , recovery_start_(Clock::time_point::min())
+    , smoothed_rtt_(Clock::duration::zero())
+{
+}
+
+
+void NewReno::on_ack(const Ack& ack)
+{
+    smoothed_rtt_ = ack.smoothed_rtt;
+
+    // Packets sent before the last reduction do not grow the window.
+    if (ack.sent_time <= recovery_start_) return;
+
+    if (window_ < threshold_)
+    {
+        window_ += ack.acked_bytes;
+        return;
+    }
+
+    acked_in_round_ += ack.acked_bytes;
+    if (acked_in_round_ >= window_)
+    {
+        acked_in_round_ -= window_;
+        window_ += mss_;
+    }
+}
+
+
+void NewReno::on_loss(Clock::time_point now, Clock::time_point sent_time, size_t, size_t)
+{
+    // One reduction per round trip, however many packets it lost.
+    if (sent_time <= recovery_start_) return;
+
+    recovery_start_ = now;
+    window_         = std::max(window_ / 2, 2 * mss_);
+    threshold_      = window_;
+    acked_in_round_ = 0;
+}
+
+
+void NewReno::on_timeout(Clock::time_point now)
+{
+    recovery_start_ = now;
+    threshold_      = std::max(window_ / 2, 2 * mss_);
+    window_         = 2 * mss_;
+    acked_in_round_ = 0;
+}
+
+
+double NewReno::pacing_rate() const
+{
+    if (smoothed_rtt_ <= Clock::duration::zero()) return 0;
+
+    const double gain = window_ < threshold_ ? 2 : 1.25;
+
+    return gain * window_ / seconds(smoothed_rtt_);
+}
+
+
+Bbr::Bbr(size_t mss)
+    : mss_(mss)
+    , state_(State::startup)
+    , pacing_gain_(bbr_high_gain)
+    , window_gain_(bbr_high_gain)
+    , bandwidth_{}
+    , round_(0)
+    , next_round_delivered_(0)
+    , round_start_(false)
+    , min_rtt_(Clock::duration::zero())
+    , min_rtt_expired_(false)
+    , smoothed_rtt_(Clock::duration::zero())
+    , full_bandwidth_(0)
+    , full_bandwidth_rounds_(0)
+    , full_bandwidth_reached_(false)
+    , cycle_index_(0)
+    , timed_out_(false)
+{
+}
+
+
+void Bbr::on_ack(const Ack& ack)
+{
+    smoothed_rtt_ = ack.smoothed_rtt;
+    timed_out_    = false;
+
+    update_round(ack);
+    update_bandwidth(ack);
+    update_min_rtt(ack);
+    update_state(ack);
+}
+
+
+void Bbr::on_loss(Clock::time_point, Clock::time_point, size_t, size_t)
+{
+}
+
+
+void Bbr::on_timeout(Clock::time_point)
+{
+    // Down to the minimum until the next acknowledgement.
+    timed_out_ = true;
+}
+
+
+size_t Bbr::window() const
+{
+    if (state_ == State::probe_rtt || timed_out_) return bbr_min_window * mss_;
+
+    // Plus a few packets for acknowledgements that come in bursts.
+    const size_t window = static_cast<size_t>(window_gain_ * bdp()) + 3 * mss_;
+    const size_t floor  = (state_ == State::startup ? initial_window_packets : bbr_min_window) * mss_;
+
+    return std::max(window, floor);
+}
+
+
+double Bbr::pacing_rate() const
+{
+    const double bandwidth = bottleneck_bandwidth();
+
+    if (bandwidth > 0) return pacing_gain_ * bandwidth;
+    if (smoothed_rtt_ <= Clock::duration::zero()) return 0;
+
+    return pacing_gain_ * initial_window_packets * mss_ / seconds(smoothed_rtt_);
+}
+
+
+double Bbr::bottleneck_bandwidth() const
+{
+    return *std::max_element(std::begin(bandwidth_), std::end(bandwidth_));
+}
+
+
+size_t Bbr::bdp() const
+{
+    const double bandwidth = bottleneck_bandwidth();
+
+    if (bandwidth == 0 || min_rtt_ == Clock::duration::zero()) return initial_window_packets * mss_;
+
+    return static_cast<size_t>(bandwidth * seconds(min_rtt_));
+}
+
+
+// A round trip ends when a packet sent after the previous end is acknowledged.
+void Bbr::update_round(const Ack& ack)
+{
+    round_start_ = false;
+
+    if (ack.prior_delivered < next_round_delivered_) return;
+
+    next_round_delivered_ = ack.delivered;
+    ++round_;
+    round_start_ = true;
+
+    bandwidth_[round_ % bandwidth_rounds] = 0;
+}
+
+
+void Bbr::update_bandwidth(const Ack& ack)
+{
+    if (ack.delivery_rate <= 0) return;
+    // Short of data the sample underestimates the path, unless it is a record.
+    if (ack.app_limited && ack.delivery_rate < bottleneck_bandwidth()) return;
+
+    double& slot = bandwidth_[round_ % bandwidth_rounds];
+    slot         = std::max(slot, ack.delivery_rate);
+}
+
+
+void Bbr::update_min_rtt(const Ack& ack)
+{
+    min_rtt_expired_ = min_rtt_ != Clock::duration::zero() && ack.now > min_rtt_stamp_ + bbr_min_rtt_window;
+
+    if (ack.rtt <= Clock::duration::zero()) return;
+
+    if (min_rtt_ == Clock::duration::zero() || ack.rtt <= min_rtt_ || min_rtt_expired_)
+    {
+        min_rtt_       = ack.rtt;
+        min_rtt_stamp_ = ack.now;
+    }
+}
+
+
+void Bbr::update_state(const Ack& ack)
+{
+    switch (state_)
+    {
+    case State::startup:
+        if (round_start_)
+        {
+            const double bandwidth = bottleneck_bandwidth();
+
+            if (bandwidth >= full_bandwidth_ * 1.25)
+            {
+                full_bandwidth_        = bandwidth;
+                full_bandwidth_rounds_ = 0;
+            }
+            else if (++full_bandwidth_rounds_ >= 3)
+            {
+                full_bandwidth_reached_ = true;
+                state_                  = State::drain;
+                pacing_gain_            = 1 / bbr_high_gain;
+                window_gain_            = bbr_high_gain;
+            }
+        }
+        break;
+
+    case State::drain:
+        // The queue startup built is gone.
+        if (ack.in_flight <= bdp()) enter_probe_bandwidth(ack.now);
+        break;
+
+    case State::probe_bandwidth:
+        if (ack.now - cycle_stamp_ > min_rtt_)
+        {
+            cycle_index_ = (cycle_index_ + 1) % bbr_cycle_length;
+            pacing_gain_ = bbr_cycle_gains[cycle_index_];
+            cycle_stamp_ = ack.now;
+        }
+        break;
+
+    case State::probe_rtt:
+        // Holds the minimum window for 200 ms once in flight has drained to it.
+        if (probe_rtt_done_ == Clock::time_point() && ack.in_flight <= bbr_min_window * mss_)
+        {
+            probe_rtt_done_ = ack.now + bbr_probe_rtt_length;
+        }
+        else if (probe_rtt_done_ != Clock::time_point() && ack.now >= probe_rtt_done_)
+        {
+            min_rtt_stamp_ = ack.now;
+
+            if (full_bandwidth_reached_)
+            {
+                enter_probe_bandwidth(ack.now);
+            }
+            else
+            {
+                state_       = State::startup;
+                pacing_gain_ = bbr_high_gain;
+                window_gain_ = bbr_high_gain;
+            }
+        }
+        return;
+    }
+
+    if (min_rtt_expired_)
+    {
+        state_          = State::probe_rtt;
+        pacing_gain_    = 1;
+        window_gain_    = 1;
+        probe_rtt_done_ = Clock::time_point();
+    }
+}
+
+
+void Bbr::enter_probe_bandwidth(Clock::time_point now)
+{
+    state_       = State::probe_bandwidth;
+    window_gain_ = bbr_window_gain;
+    // Cruising first, the next phase probes.
+    cycle_index_ = bbr_cycle_length - 1;
+    pacing_gain_ = bbr_cycle_gains[cycle_index_];
+    cycle_stamp_ = now;
+}
+
+
+std::unique_ptr<CongestionController> make_congestion_controller(std::string_view name, size_t mss)
+{
+    if (name == "newreno") return std::make_unique<NewReno>(mss);
+    if (name == "bbr") return std::make_unique<Bbr>(mss);
+
+    return nullptr;
+}
+
+} // socket_wrapper
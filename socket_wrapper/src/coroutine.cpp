@@ -0,0 +1,301 @@
+#include <socket_wrapper/coroutine.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <new>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#include <socket_wrapper/sharding.h>
+
+
+namespace socket_wrapper
+{
+
+namespace
+{
+
+const size_t size_class = 64;
+
+
+struct FreeFrame
+{
+    FreeFrame* next;
+};
+
+
+struct ThreadFrames
+{
+    ThreadFrames() : lists(FramePool::max_pooled_size / size_class, nullptr) {}
+
+    ~ThreadFrames()
+    {
+        for (auto frame : lists)
+        {
+            while (frame)
+            {
+                FreeFrame* next = frame->next;
+                ::operator delete(frame);
+                frame = next;
+            }
+        }
+    }
+
+    std::vector<FreeFrame*> lists;
+    FramePool::Stats        stats;
+};
+
+
+ThreadFrames& thread_frames()
+{
+    static thread_local ThreadFrames frames;
+    return frames;
+}
+
+
+thread_local EventLoop* loop_of_thread = nullptr;
+
+
+// Keeps the loop running until the main task finishes, then stops it.
+Task<void> run_main(EventLoop& loop, Task<void> main, std::exception_ptr& error)
+{
+    try
+    {
+        co_await main;
+    }
+    catch (...)
+    {
+        error = std::current_exception();
+    }
+
+    loop.stop();
+}
+
+
+bool would_block()
+{
+    return errno == EAGAIN || errno == EWOULDBLOCK;
+}
+
+}
+
+
+void* FramePool::allocate(size_t size)
+{
+    auto& frames = thread_frames();
+
+    ++frames.stats.allocations;
+
+    if (size > max_pooled_size)
+    {
+        ++frames.stats.heap_allocations;
+        return ::operator new(size);
+    }
+
+    const size_t index = (size - 1) / size_class;
+    FreeFrame*   frame = frames.lists[index];
+
+    if (frame)
+    {
+        frames.lists[index] = frame->next;
+        return frame;
+    }
+
+    ++frames.stats.heap_allocations;
+    return ::operator new((index + 1) * size_class);
+}
+
+
+void FramePool::deallocate(void* frame, size_t size)
+{
+    if (size > max_pooled_size)
+    {
+        ::operator delete(frame);
+        return;
+    }
+
+    // Frames freed on another thread join that thread's lists.
+    auto&        frames = thread_frames();
+    const size_t index  = (size - 1) / size_class;
+    auto         free   = static_cast<FreeFrame*>(frame);
+
+    free->next          = frames.lists[index];
+    frames.lists[index] = free;
+}
+
+
+FramePool::Stats FramePool::stats()
+{
+    return thread_frames().stats;
+}
+
+
+void spawn(Task<void> task)
+{
+    auto handle = task.release();
+
+    handle.promise().detached = true;
+    handle.resume();
+}
+
+
+EventLoop& current_loop()
+{
+    if (!loop_of_thread) throw std::logic_error("No event loop runs on this thread");
+    return *loop_of_thread;
+}
+
+
+void run(EventLoop& loop, Task<void> main)
+{
+    EventLoop*         previous = std::exchange(loop_of_thread, &loop);
+    std::exception_ptr error;
+
+    spawn(run_main(loop, std::move(main), error));
+    loop.run();
+
+    loop_of_thread = previous;
+    if (error) std::rethrow_exception(error);
+}
+
+
+void run_per_core(std::function<Task<void>(unsigned cpu, size_t index)> make_main, size_t threads)
+{
+    auto cpus = allowed_cpus();
+    if (cpus.empty()) cpus.push_back(0);
+    if (threads == 0) threads = cpus.size();
+
+    std::vector<std::thread>        workers;
+    std::vector<std::exception_ptr> errors(threads);
+
+    for (size_t i = 0; i < threads; ++i)
+    {
+        workers.emplace_back([&, i] {
+            const unsigned cpu = cpus[i % cpus.size()];
+
+            if (threads > 1) pin_current_thread(cpu);
+
+            try
+            {
+                EventLoop loop;
+                run(loop, make_main(cpu, i));
+            }
+            catch (...)
+            {
+                errors[i] = std::current_exception();
+            }
+        });
+    }
+
+    for (auto& worker : workers) worker.join();
+
+    for (auto& error : errors)
+    {
+        if (error) std::rethrow_exception(error);
+    }
+}
+
+
+void ResolveAwaiter::await_suspend(std::coroutine_handle<> handle)
+{
+    static Resolver resolver(std::chrono::minutes(5), std::chrono::seconds(30), 4);
+
+    EventLoop* loop = &current_loop();
+
+    // The worker hands the result over through the loop's queue, whose lock
+    // orders the write before the resumed coroutine reads it.
+    resolver.resolve(host_, family_, [this, loop, handle](ResolvedHost resolved) {
+        result_ = std::move(resolved);
+        loop->post([handle] { handle.resume(); });
+    });
+}
+
+
+AsyncSocket::AsyncSocket(Socket&& sock)
+    : sock_(std::move(sock))
+    , loop_(current_loop())
+    , registered_(false)
+{
+    if (!sock_ || sock_.set_nonblocking() != 0) return;
+
+    registered_ = loop_.add(sock_,
+                            EventLoop::readable | EventLoop::writable,
+                            [this](uint32_t events) { on_events(events); }) == 0;
+}
+
+
+AsyncSocket::~AsyncSocket()
+{
+    if (registered_) loop_.remove(sock_);
+}
+
+
+void AsyncSocket::on_events(uint32_t events)
+{
+    // Errors wake both sides, the retried syscall reports them.
+    if ((events & (EventLoop::readable | EventLoop::error)) && reader_)
+    {
+        std::exchange(reader_, {}).resume();
+    }
+    if ((events & (EventLoop::writable | EventLoop::error)) && writer_)
+    {
+        std::exchange(writer_, {}).resume();
+    }
+}
+
+
+Task<ssize_t> AsyncSocket::recv_from(char* data, size_t len, sockaddr* from, socklen_t* from_len, int flags)
+{
+    for (;;)
+    {
+        const ssize_t n = ::recvfrom(sock_, data, len, flags, from, from_len);
+        if (n >= 0 || (errno != EINTR && !would_block())) co_return n;
+        if (would_block()) co_await readable();
+    }
+}
+
+
+Task<ssize_t> AsyncSocket::recv_from(PacketBuffer& buffer, sockaddr_storage* from, socklen_t* from_len)
+{
+    socklen_t     len = sizeof(sockaddr_storage);
+    // MSG_TRUNC: the real length, even if the buffer was too small.
+    const ssize_t n   = co_await recv_from(buffer.data(),
+                                         buffer.capacity(),
+                                         reinterpret_cast<sockaddr*>(from),
+                                         from ? (from_len ? from_len : &len) : nullptr,
+                                         MSG_TRUNC);
+
+    if (n >= 0)
+    {
+        buffer.set_size(std::min<size_t>(n, buffer.capacity()));
+        buffer.set_truncated(static_cast<size_t>(n) > buffer.capacity());
+    }
+
+    co_return n;
+}
+
+
+Task<ssize_t> AsyncSocket::send_to(const char* data, size_t len, const sockaddr* to, socklen_t to_len, int flags)
+{
+    for (;;)
+    {
+        const ssize_t n = ::sendto(sock_, data, len, flags | MSG_NOSIGNAL, to, to_len);
+        if (n >= 0 || (errno != EINTR && !would_block())) co_return n;
+        if (would_block()) co_await writable();
+    }
+}
+
+
+Task<ssize_t> AsyncSocket::recv(char* data, size_t len, int flags)
+{
+    return recv_from(data, len, nullptr, nullptr, flags);
+}
+
+
+Task<ssize_t> AsyncSocket::send(const char* data, size_t len, int flags)
+{
+    return send_to(data, len, nullptr, 0, flags);
+}
+
+} // socket_wrapper
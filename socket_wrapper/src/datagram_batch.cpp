@@ -0,0 +1,345 @@
+#include <socket_wrapper/datagram_batch.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <utility>
+
+#include <netinet/udp.h>
+
+
+namespace socket_wrapper
+{
+
+namespace
+{
+
+// Per slot room for ancillary data (GRO segment size, GSO request).
+constexpr size_t control_size = 128;
+
+// Largest number of segments sent with one fallback sendmmsg().
+constexpr size_t split_chunk = 64;
+
+
+// Errors of a UDP_SEGMENT send on kernels or devices without GSO support.
+bool gso_unsupported(int error)
+{
+    return error == EIO || error == EINVAL || error == ENOPROTOOPT || error == EOPNOTSUPP;
+}
+
+}
+
+
+int enable_udp_gro(SocketDescriptorType sock)
+{
+    int on = 1;
+
+    return setsockopt(sock, SOL_UDP, UDP_GRO, &on, sizeof(on));
+}
+
+
+int probe_udp_gso(SocketDescriptorType sock)
+{
+    // A zero segment size is valid and leaves sends unsegmented.
+    int size = 0;
+
+    return setsockopt(sock, SOL_UDP, UDP_SEGMENT, &size, sizeof(size));
+}
+
+
+int enable_rx_drop_counter(SocketDescriptorType sock)
+{
+    int on = 1;
+
+    return setsockopt(sock, SOL_SOCKET, SO_RXQ_OVFL, &on, sizeof(on));
+}
+
+
+DatagramBatch::DatagramBatch(size_t depth, size_t datagram_size)
+    : own_pool_(std::make_unique<BufferPool>(datagram_size, depth))
+    , pool_(own_pool_.get())
+    , size_(0)
+    , gso_(false)
+    , socket_drops_(0)
+    , slots_(depth)
+    , addresses_(depth)
+    , iovecs_(depth)
+    , msgs_(depth)
+    , segment_sizes_(depth)
+    , control_(new char[depth * control_size])
+{
+    init();
+}
+
+
+DatagramBatch::DatagramBatch(size_t depth, BufferPool& pool)
+    : pool_(&pool)
+    , size_(0)
+    , gso_(false)
+    , socket_drops_(0)
+    , slots_(depth)
+    , addresses_(depth)
+    , iovecs_(depth)
+    , msgs_(depth)
+    , segment_sizes_(depth)
+    , control_(new char[depth * control_size])
+{
+    init();
+}
+
+
+void DatagramBatch::init()
+{
+    for (size_t i = 0; i < msgs_.size(); ++i)
+    {
+        msgs_[i].msg_hdr            = {};
+        msgs_[i].msg_hdr.msg_name   = &addresses_[i];
+        msgs_[i].msg_hdr.msg_iov    = &iovecs_[i];
+        msgs_[i].msg_hdr.msg_iovlen = 1;
+    }
+
+    refill();
+}
+
+
+int DatagramBatch::receive(SocketDescriptorType sock, int flags)
+{
+    const size_t usable = refill();
+
+    if (usable == 0)
+    {
+        errno = ENOBUFS;
+        return -1;
+    }
+
+    for (size_t i = 0; i < usable; ++i)
+    {
+        msgs_[i].msg_hdr.msg_namelen    = sizeof(sockaddr_storage);
+        msgs_[i].msg_hdr.msg_control    = &control_[i * control_size];
+        msgs_[i].msg_hdr.msg_controllen = control_size;
+        msgs_[i].msg_hdr.msg_flags      = 0;
+        iovecs_[i].iov_len              = slots_[i].capacity();
+    }
+
+    int received;
+    do
+    {
+        received = recvmmsg(sock, msgs_.data(), usable, flags, nullptr);
+    } while (received < 0 && errno == EINTR);
+
+    size_ = received > 0 ? received : 0;
+    for (size_t i = 0; i < size_; ++i)
+    {
+        slots_[i].set_size(msgs_[i].msg_len);
+        slots_[i].set_truncated(msgs_[i].msg_hdr.msg_flags & MSG_TRUNC);
+        segment_sizes_[i] = 0;
+
+        auto& hdr = msgs_[i].msg_hdr;
+        for (cmsghdr* cmsg = CMSG_FIRSTHDR(&hdr); cmsg != nullptr; cmsg = CMSG_NXTHDR(&hdr, cmsg))
+        {
+            if (cmsg->cmsg_level == SOL_UDP && cmsg->cmsg_type == UDP_GRO)
+            {
+                int segment = 0;
+                std::memcpy(&segment, CMSG_DATA(cmsg), sizeof(segment));
+                if (static_cast<size_t>(segment) < msgs_[i].msg_len)
+                {
+                    segment_sizes_[i] = static_cast<uint16_t>(segment);
+                }
+            }
+            else if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SO_RXQ_OVFL)
+            {
+                // Cumulative, the kernel only sends it once drops happened.
+                std::memcpy(&socket_drops_, CMSG_DATA(cmsg), sizeof(socket_drops_));
+            }
+        }
+    }
+
+    return received;
+}
+
+
+int DatagramBatch::send(SocketDescriptorType sock, size_t count, int flags)
+{
+    count = std::min(count, msgs_.size());
+
+    size_t sent = 0;
+    while (sent < count)
+    {
+        if (needs_split(sent))
+        {
+            if (send_split(sock, sent, flags) < 0)
+            {
+                if (sent == 0) return -1;
+                break;
+            }
+            ++sent;
+            continue;
+        }
+
+        // The longest run of slots that goes out as is.
+        size_t end = sent;
+        for (; end < count && !needs_split(end); ++end)
+        {
+            prepare_send(end);
+        }
+
+        int result = sendmmsg(sock, &msgs_[sent], end - sent, flags);
+        if (result < 0)
+        {
+            if (errno == EINTR) continue;
+            if (gso_ && segment_sizes_[sent] != 0 && gso_unsupported(errno))
+            {
+                // Retried with software segmentation from now on.
+                gso_ = false;
+                continue;
+            }
+            if (sent == 0) return -1;
+            break;
+        }
+        sent += result;
+    }
+
+    return static_cast<int>(sent);
+}
+
+
+size_t DatagramBatch::segment_count(size_t i) const
+{
+    const size_t length  = slots_[i].size();
+    const size_t segment = segment_sizes_[i];
+
+    if (segment == 0 || length == 0) return 1;
+
+    return (length + segment - 1) / segment;
+}
+
+
+std::string_view DatagramBatch::segment(size_t i, size_t k) const
+{
+    const auto   data    = slots_[i].view();
+    const size_t segment = segment_sizes_[i] ? segment_sizes_[i] : data.size();
+
+    return data.substr(std::min(k * segment, data.size()), segment);
+}
+
+
+const sockaddr* DatagramBatch::address(size_t i) const
+{
+    return reinterpret_cast<const sockaddr*>(&addresses_[i]);
+}
+
+
+socklen_t DatagramBatch::address_length(size_t i) const
+{
+    return msgs_[i].msg_hdr.msg_namelen;
+}
+
+
+void DatagramBatch::set_address(size_t i, const sockaddr* addr, socklen_t len)
+{
+    len = std::min<socklen_t>(len, sizeof(sockaddr_storage));
+    std::memcpy(&addresses_[i], addr, len);
+    msgs_[i].msg_hdr.msg_namelen = len;
+}
+
+
+void DatagramBatch::swap(size_t i, size_t j)
+{
+    if (i == j) return;
+
+    std::swap(slots_[i], slots_[j]);
+    std::swap(addresses_[i], addresses_[j]);
+    std::swap(msgs_[i].msg_hdr.msg_namelen, msgs_[j].msg_hdr.msg_namelen);
+    std::swap(segment_sizes_[i], segment_sizes_[j]);
+}
+
+
+bool DatagramBatch::needs_split(size_t i) const
+{
+    return !gso_ && segment_sizes_[i] != 0 && slots_[i].size() > segment_sizes_[i];
+}
+
+
+void DatagramBatch::prepare_send(size_t i)
+{
+    auto& hdr = msgs_[i].msg_hdr;
+
+    iovecs_[i].iov_base = slots_[i].data();
+    iovecs_[i].iov_len  = slots_[i].size();
+    hdr.msg_control     = nullptr;
+    hdr.msg_controllen  = 0;
+
+    if (gso_ && segment_sizes_[i] != 0 && slots_[i].size() > segment_sizes_[i])
+    {
+        hdr.msg_control    = &control_[i * control_size];
+        hdr.msg_controllen = CMSG_SPACE(sizeof(uint16_t));
+
+        cmsghdr* cmsg    = CMSG_FIRSTHDR(&hdr);
+        cmsg->cmsg_level = SOL_UDP;
+        cmsg->cmsg_type  = UDP_SEGMENT;
+        cmsg->cmsg_len   = CMSG_LEN(sizeof(uint16_t));
+        std::memcpy(CMSG_DATA(cmsg), &segment_sizes_[i], sizeof(uint16_t));
+    }
+}
+
+
+int DatagramBatch::send_split(SocketDescriptorType sock, size_t i, int flags)
+{
+    mmsghdr msgs[split_chunk];
+    iovec   iovecs[split_chunk];
+
+    const size_t count = segment_count(i);
+    size_t       sent  = 0;
+
+    while (sent < count)
+    {
+        const size_t n = std::min(split_chunk, count - sent);
+
+        for (size_t k = 0; k < n; ++k)
+        {
+            auto part          = segment(i, sent + k);
+            iovecs[k].iov_base = const_cast<char*>(part.data());
+            iovecs[k].iov_len  = part.size();
+
+            msgs[k].msg_hdr                = msgs_[i].msg_hdr;
+            msgs[k].msg_hdr.msg_iov        = &iovecs[k];
+            msgs[k].msg_hdr.msg_iovlen     = 1;
+            msgs[k].msg_hdr.msg_control    = nullptr;
+            msgs[k].msg_hdr.msg_controllen = 0;
+        }
+
+        int result = sendmmsg(sock, msgs, n, flags);
+        if (result < 0)
+        {
+            if (errno == EINTR) continue;
+            return sent == 0 ? -1 : 0;
+        }
+        sent += result;
+    }
+
+    return 0;
+}
+
+
+size_t DatagramBatch::refill()
+{
+    size_t usable = 0;
+
+    for (; usable < slots_.size(); ++usable)
+    {
+        auto& slot = slots_[usable];
+
+        if (!slot)
+        {
+            slot = pool_->acquire();
+            if (!slot) break;
+        }
+
+        iovecs_[usable].iov_base = slot.data();
+    }
+
+    return usable;
+}
+
+}
+
@@ -0,0 +1,256 @@
+#include <socket_wrapper/event_loop.h>
+
+#include <cerrno>
+#include <stdexcept>
+#include <string>
+
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+
+
+namespace socket_wrapper
+{
+
+namespace
+{
+
+uint32_t to_epoll_events(uint32_t events)
+{
+    uint32_t result = EPOLLET;
+
+    if (events & EventLoop::readable) result |= EPOLLIN | EPOLLRDHUP;
+    if (events & EventLoop::writable) result |= EPOLLOUT;
+
+    return result;
+}
+
+
+uint32_t from_epoll_events(uint32_t events)
+{
+    uint32_t result = 0;
+
+    if (events & (EPOLLIN | EPOLLRDHUP)) result |= EventLoop::readable;
+    if (events & EPOLLOUT) result |= EventLoop::writable;
+    if (events & (EPOLLERR | EPOLLHUP)) result |= EventLoop::error;
+
+    return result;
+}
+
+}
+
+
+EventLoop::EventLoop()
+    : epoll_fd_(epoll_create1(EPOLL_CLOEXEC))
+    , wakeup_fd_(eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC))
+    , stopped_(false)
+    , events_(new epoll_event[max_events_])
+    , next_timer_id_(1)
+{
+    epoll_event ev = {};
+    ev.events      = EPOLLIN;
+    ev.data.fd     = wakeup_fd_;
+
+    if (epoll_fd_ < 0 || wakeup_fd_ < 0 || epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, wakeup_fd_, &ev) != 0)
+    {
+        const int error = errno;
+
+        // No destructor runs for a constructor that throws.
+        if (wakeup_fd_ >= 0) ::close(wakeup_fd_);
+        if (epoll_fd_ >= 0) ::close(epoll_fd_);
+
+        throw std::runtime_error("Event loop creation failed: " + std::to_string(error));
+    }
+}
+
+
+EventLoop::~EventLoop()
+{
+    if (wakeup_fd_ >= 0) ::close(wakeup_fd_);
+    if (epoll_fd_ >= 0) ::close(epoll_fd_);
+}
+
+
+int EventLoop::add(SocketDescriptorType fd, uint32_t events, IoHandler handler)
+{
+    epoll_event ev = {};
+    ev.events      = to_epoll_events(events);
+    ev.data.fd     = fd;
+
+    if (epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, fd, &ev) != 0) return -1;
+
+    handlers_[fd] = std::make_shared<Handler>(Handler{ std::move(handler) });
+
+    return 0;
+}
+
+
+int EventLoop::modify(SocketDescriptorType fd, uint32_t events)
+{
+    epoll_event ev = {};
+    ev.events      = to_epoll_events(events);
+    ev.data.fd     = fd;
+
+    return epoll_ctl(epoll_fd_, EPOLL_CTL_MOD, fd, &ev);
+}
+
+
+int EventLoop::remove(SocketDescriptorType fd)
+{
+    handlers_.erase(fd);
+
+    return epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, fd, nullptr);
+}
+
+
+EventLoop::TimerId EventLoop::add_timer(Clock::duration delay,
+                                        TimerCallback   callback,
+                                        Clock::duration period)
+{
+    const TimerId id = next_timer_id_++;
+
+    timers_.push(Timer{ Clock::now() + delay, period, id });
+    timer_callbacks_.emplace(id, std::move(callback));
+
+    return id;
+}
+
+
+void EventLoop::cancel_timer(TimerId id)
+{
+    // The heap entry is skipped lazily when it expires.
+    timer_callbacks_.erase(id);
+}
+
+
+void EventLoop::run()
+{
+    while (!stopped_)
+    {
+        run_once(std::chrono::milliseconds(-1));
+    }
+}
+
+
+int EventLoop::run_once(std::chrono::milliseconds timeout)
+{
+    epoll_event* events = events_.get();
+
+    int ready = epoll_wait(epoll_fd_,
+                           events,
+                           static_cast<int>(max_events_),
+                           wait_timeout(timeout));
+
+    if (ready < 0)
+    {
+        if (errno != EINTR)
+        {
+            throw std::runtime_error("epoll_wait failed: " + std::to_string(errno));
+        }
+        ready = 0;
+    }
+
+    for (int i = 0; i < ready; ++i)
+    {
+        const int fd = events[i].data.fd;
+
+        if (fd == wakeup_fd_)
+        {
+            eventfd_t value;
+            eventfd_read(wakeup_fd_, &value);
+            run_posted();
+            continue;
+        }
+
+        auto handler = handlers_.find(fd);
+        if (handler == handlers_.end()) continue;
+
+        // Keep the handler alive even if it removes itself.
+        auto keep = handler->second;
+        keep->callback(from_epoll_events(events[i].events));
+    }
+
+    run_timers();
+
+    return ready;
+}
+
+
+void EventLoop::stop()
+{
+    stopped_ = true;
+    eventfd_write(wakeup_fd_, 1);
+}
+
+
+void EventLoop::post(std::function<void()> job)
+{
+    {
+        std::lock_guard<std::mutex> lock(posted_mutex_);
+        posted_.push_back(std::move(job));
+    }
+    eventfd_write(wakeup_fd_, 1);
+}
+
+
+void EventLoop::run_posted()
+{
+    std::vector<std::function<void()>> jobs;
+
+    {
+        std::lock_guard<std::mutex> lock(posted_mutex_);
+        jobs.swap(posted_);
+    }
+
+    // Jobs may post again, those run on the next wakeup.
+    for (auto& job : jobs) job();
+}
+
+
+int EventLoop::wait_timeout(std::chrono::milliseconds timeout) const
+{
+    using namespace std::chrono;
+
+    auto result = timeout;
+
+    if (!timers_.empty())
+    {
+        // Round up, so a timer never fires earlier than requested.
+        auto until = ceil<milliseconds>(timers_.top().deadline - Clock::now());
+        if (until.count() < 0) until = milliseconds::zero();
+        if (result.count() < 0 || until < result) result = until;
+    }
+
+    return static_cast<int>(result.count());
+}
+
+
+void EventLoop::run_timers()
+{
+    const auto now = Clock::now();
+
+    while (!timers_.empty() && timers_.top().deadline <= now)
+    {
+        Timer timer = timers_.top();
+        timers_.pop();
+
+        auto callback = timer_callbacks_.find(timer.id);
+        if (callback == timer_callbacks_.end()) continue;
+
+        if (timer.period > Clock::duration::zero())
+        {
+            timers_.push(Timer{ timer.deadline + timer.period, timer.period, timer.id });
+            // Copy: the callback may cancel its own timer.
+            auto cb = callback->second;
+            cb();
+        }
+        else
+        {
+            auto cb = std::move(callback->second);
+            timer_callbacks_.erase(callback);
+            cb();
+        }
+    }
+}
+
+}
+
@@ -0,0 +1,133 @@
+#include <socket_wrapper/histogram.h>
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <limits>
+
+
+namespace socket_wrapper
+{
+
+Histogram::Histogram(unsigned precision_bits)
+    : precision_bits_(std::min(std::max(precision_bits, 1u), 16u))
+    // Values below 2^p map to themselves, every further power of two adds
+    // 2^p buckets: (64 - p + 1) << p in total.
+    , buckets_(static_cast<size_t>(65 - precision_bits_) << precision_bits_)
+    , count_(0)
+    , min_(std::numeric_limits<uint64_t>::max())
+    , max_(0)
+    , sum_(0)
+    , sum_squares_(0)
+{
+}
+
+
+void Histogram::record(uint64_t value, uint64_t count)
+{
+    if (count == 0) return;
+
+    buckets_[index(value)] += count;
+    count_ += count;
+    min_ = std::min(min_, value);
+    max_ = std::max(max_, value);
+
+    const double v = static_cast<double>(value);
+    sum_ += v * count;
+    sum_squares_ += v * v * count;
+}
+
+
+void Histogram::merge(const Histogram& h)
+{
+    if (h.precision_bits_ != precision_bits_)
+    {
+        // Different layouts: re-record every bucket at its reported value.
+        for (size_t i = 0; i < h.buckets_.size(); ++i)
+        {
+            if (h.buckets_[i]) buckets_[index(h.highest_value(i))] += h.buckets_[i];
+        }
+    }
+    else
+    {
+        for (size_t i = 0; i < buckets_.size(); ++i) buckets_[i] += h.buckets_[i];
+    }
+
+    count_ += h.count_;
+    min_ = std::min(min_, h.min_);
+    max_ = std::max(max_, h.max_);
+    sum_ += h.sum_;
+    sum_squares_ += h.sum_squares_;
+}
+
+
+void Histogram::reset()
+{
+    std::fill(buckets_.begin(), buckets_.end(), 0);
+    count_       = 0;
+    min_         = std::numeric_limits<uint64_t>::max();
+    max_         = 0;
+    sum_         = 0;
+    sum_squares_ = 0;
+}
+
+
+double Histogram::mean() const
+{
+    return count_ ? sum_ / count_ : 0;
+}
+
+
+double Histogram::stddev() const
+{
+    if (count_ == 0) return 0;
+
+    const double m = mean();
+
+    return std::sqrt(std::max(sum_squares_ / count_ - m * m, 0.0));
+}
+
+
+uint64_t Histogram::percentile(double percent) const
+{
+    if (count_ == 0) return 0;
+
+    const double   clamped = std::min(std::max(percent, 0.0), 100.0);
+    const uint64_t rank    = std::max<uint64_t>(std::ceil(clamped / 100 * count_), 1);
+    uint64_t       seen    = 0;
+
+    for (size_t i = 0; i < buckets_.size(); ++i)
+    {
+        seen += buckets_[i];
+        if (seen >= rank) return std::min(std::max(highest_value(i), min_), max_);
+    }
+
+    return max_;
+}
+
+
+size_t Histogram::index(uint64_t value) const
+{
+    if (value >> precision_bits_ == 0) return static_cast<size_t>(value);
+
+    // value = 1xxx... : the top p + 1 bits select the sub-bucket.
+    const unsigned shift = 63 - std::countl_zero(value) - precision_bits_;
+
+    return (static_cast<size_t>(shift) << precision_bits_) + static_cast<size_t>(value >> shift);
+}
+
+
+uint64_t Histogram::highest_value(size_t index) const
+{
+    const size_t sub_buckets = size_t(1) << precision_bits_;
+
+    if (index < sub_buckets) return index;
+
+    // index = (shift << p) + top, where top = 2^p + k
+    const unsigned shift = static_cast<unsigned>(index >> precision_bits_) - 1;
+    const uint64_t top   = (index & (sub_buckets - 1)) | sub_buckets;
+
+    return ((top + 1) << shift) - 1;
+}
+
+}
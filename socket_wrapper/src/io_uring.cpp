@@ -0,0 +1,362 @@
+#include <socket_wrapper/io_uring.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+
+namespace socket_wrapper
+{
+
+namespace
+{
+
+int io_uring_setup(unsigned entries, io_uring_params* params)
+{
+    return static_cast<int>(syscall(__NR_io_uring_setup, entries, params));
+}
+
+
+int io_uring_enter(int fd, unsigned to_submit, unsigned min_complete, unsigned flags, void* arg, size_t arg_size)
+{
+    return static_cast<int>(syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, arg, arg_size));
+}
+
+
+int io_uring_register(int fd, unsigned opcode, const void* arg, unsigned nr_args)
+{
+    return static_cast<int>(syscall(__NR_io_uring_register, fd, opcode, arg, nr_args));
+}
+
+
+template <typename T>
+T* at(void* base, uint32_t offset)
+{
+    return reinterpret_cast<T*>(static_cast<char*>(base) + offset);
+}
+
+}
+
+
+IoUring::IoUring(unsigned entries, unsigned flags)
+    : fd_(-1)
+    , sq_ring_(MAP_FAILED)
+    , sq_ring_size_(0)
+    , cq_ring_(MAP_FAILED)
+    , cq_ring_size_(0)
+    , sqes_mapping_(MAP_FAILED)
+    , sqes_size_(0)
+    , sqe_tail_(0)
+{
+    io_uring_params params = {};
+    params.flags           = flags;
+
+    const int fd = io_uring_setup(entries, &params);
+    if (fd < 0) return;
+
+    sq_ring_size_ = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    cq_ring_size_ = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    sqes_size_    = params.sq_entries * sizeof(io_uring_sqe);
+
+    // Since 5.4 both rings share one mapping.
+    const bool single_mmap = params.features & IORING_FEAT_SINGLE_MMAP;
+    if (single_mmap) sq_ring_size_ = cq_ring_size_ = std::max(sq_ring_size_, cq_ring_size_);
+
+    sq_ring_ = mmap(nullptr, sq_ring_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+    cq_ring_ = single_mmap ? sq_ring_
+                           : mmap(nullptr, cq_ring_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+    sqes_mapping_ = mmap(nullptr, sqes_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+
+    if (sq_ring_ == MAP_FAILED || cq_ring_ == MAP_FAILED || sqes_mapping_ == MAP_FAILED)
+    {
+        const int error = errno;
+        unmap();
+        ::close(fd);
+        errno = error;
+        return;
+    }
+
+    sq_head_    = at<unsigned>(sq_ring_, params.sq_off.head);
+    sq_tail_    = at<unsigned>(sq_ring_, params.sq_off.tail);
+    sq_mask_    = *at<unsigned>(sq_ring_, params.sq_off.ring_mask);
+    sq_entries_ = *at<unsigned>(sq_ring_, params.sq_off.ring_entries);
+    sq_array_   = at<unsigned>(sq_ring_, params.sq_off.array);
+    sqes_       = static_cast<io_uring_sqe*>(sqes_mapping_);
+    sqe_tail_   = *sq_tail_;
+    cq_head_    = at<unsigned>(cq_ring_, params.cq_off.head);
+    cq_tail_    = at<unsigned>(cq_ring_, params.cq_off.tail);
+    cq_mask_    = *at<unsigned>(cq_ring_, params.cq_off.ring_mask);
+    cqes_       = at<io_uring_cqe>(cq_ring_, params.cq_off.cqes);
+
+    // The array maps ring slots to entries one to one, once and for all.
+    for (unsigned i = 0; i < sq_entries_; ++i) sq_array_[i] = i;
+
+    fd_ = fd;
+}
+
+
+IoUring::~IoUring()
+{
+    unmap();
+    if (fd_ >= 0) ::close(fd_);
+}
+
+
+void IoUring::unmap()
+{
+    if (sqes_mapping_ != MAP_FAILED) munmap(sqes_mapping_, sqes_size_);
+    if (cq_ring_ != MAP_FAILED && cq_ring_ != sq_ring_) munmap(cq_ring_, cq_ring_size_);
+    if (sq_ring_ != MAP_FAILED) munmap(sq_ring_, sq_ring_size_);
+    sqes_mapping_ = cq_ring_ = sq_ring_ = MAP_FAILED;
+}
+
+
+io_uring_sqe* IoUring::get_sqe()
+{
+    const unsigned head = __atomic_load_n(sq_head_, __ATOMIC_ACQUIRE);
+
+    if (sqe_tail_ - head >= sq_entries_) return nullptr;
+
+    io_uring_sqe* sqe = &sqes_[sqe_tail_ & sq_mask_];
+    ++sqe_tail_;
+    std::memset(sqe, 0, sizeof(*sqe));
+
+    return sqe;
+}
+
+
+int IoUring::submit(unsigned wait_nr, std::chrono::nanoseconds timeout)
+{
+    const unsigned to_submit = sqe_tail_ - *sq_tail_;
+
+    // Publishes the filled entries before the kernel reads the tail.
+    __atomic_store_n(sq_tail_, sqe_tail_, __ATOMIC_RELEASE);
+
+    unsigned                flags = wait_nr > 0 ? IORING_ENTER_GETEVENTS : 0;
+    __kernel_timespec       ts    = {};
+    io_uring_getevents_arg  arg   = {};
+    void*                   argp  = nullptr;
+    size_t                  size  = 0;
+
+    if (wait_nr > 0 && timeout.count() >= 0)
+    {
+        ts.tv_sec  = timeout.count() / 1000000000;
+        ts.tv_nsec = timeout.count() % 1000000000;
+        arg.ts     = reinterpret_cast<uint64_t>(&ts);
+        argp       = &arg;
+        size       = sizeof(arg);
+        flags |= IORING_ENTER_EXT_ARG;
+    }
+
+    for (;;)
+    {
+        const int submitted = io_uring_enter(fd_, to_submit, wait_nr, flags, argp, size);
+        if (submitted >= 0) return submitted;
+        if (errno == ETIME) return to_submit;
+        if (errno != EINTR) return -1;
+    }
+}
+
+
+int IoUring::register_files(const int* fds, unsigned count)
+{
+    return io_uring_register(fd_, IORING_REGISTER_FILES, fds, count);
+}
+
+
+BufferRing::BufferRing(IoUring& ring, uint16_t group, unsigned count, size_t buffer_size)
+    : ring_(ring)
+    , group_(group)
+    , mask_(0)
+    , buffer_size_(buffer_size)
+    , entries_(nullptr)
+    , entries_size_(0)
+    , tail_(0)
+    , opened_(false)
+{
+    unsigned entries = 1;
+    while (entries < count && entries < 32768) entries <<= 1;
+    mask_ = entries - 1;
+
+    buffers_.reset(new char[entries * buffer_size_]);
+
+    if (buffer_rings_work())
+    {
+        entries_size_ = entries * sizeof(io_uring_buf);
+        entries_      = map_buffer_ring(ring_.fd(), group_, entries, entries_size_);
+    }
+
+    if (entries_)
+    {
+        for (unsigned id = 0; id < entries; ++id) recycle(id);
+        commit();
+        opened_ = true;
+        return;
+    }
+
+    // All buffers with one entry, they are consecutive.
+    io_uring_sqe* sqe = provide_sqe();
+    if (!sqe) return;
+
+    sqe->fd   = static_cast<int>(entries);
+    sqe->addr = reinterpret_cast<uint64_t>(data(0));
+    opened_   = ring_.submit() >= 0;
+}
+
+
+BufferRing::~BufferRing()
+{
+    if (entries_)
+    {
+        io_uring_buf_reg reg = {};
+        reg.bgid             = group_;
+        io_uring_register(ring_.fd(), IORING_UNREGISTER_PBUF_RING, &reg, 1);
+        munmap(entries_, entries_size_);
+    }
+}
+
+
+void BufferRing::recycle(uint16_t id)
+{
+    if (!entries_)
+    {
+        io_uring_sqe* sqe = provide_sqe();
+        if (!sqe) return;
+
+        sqe->fd   = 1;
+        sqe->addr = reinterpret_cast<uint64_t>(data(id));
+        sqe->off  = id;
+        return;
+    }
+
+    io_uring_buf& buf = entries_->bufs[tail_ & mask_];
+
+    buf.addr = reinterpret_cast<uint64_t>(data(id));
+    buf.len  = static_cast<uint32_t>(buffer_size_);
+    buf.bid  = id;
+    ++tail_;
+}
+
+
+void BufferRing::commit()
+{
+    if (entries_) __atomic_store_n(&entries_->tail, tail_, __ATOMIC_RELEASE);
+}
+
+
+io_uring_sqe* BufferRing::provide_sqe()
+{
+    io_uring_sqe* sqe = ring_.get_sqe();
+    // Full: hand the queued entries to the kernel to make room.
+    while (!sqe && ring_.submit() >= 0) sqe = ring_.get_sqe();
+    if (!sqe) return nullptr;
+
+    sqe->opcode    = IORING_OP_PROVIDE_BUFFERS;
+    sqe->len       = static_cast<uint32_t>(buffer_size_);
+    sqe->buf_group = group_;
+    sqe->flags     = IOSQE_CQE_SKIP_SUCCESS;
+    sqe->user_data = user_data;
+
+    return sqe;
+}
+
+
+io_uring_buf_ring* BufferRing::map_buffer_ring(int ring_fd, uint16_t group, unsigned entries, size_t size)
+{
+    // The ring must be page aligned, an anonymous mapping is.
+    void* mapping = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (mapping == MAP_FAILED) return nullptr;
+
+    // Faults the pages in: the kernel would otherwise pin the shared zero
+    // page and never see the entries written afterwards.
+    std::memset(mapping, 0, size);
+
+    io_uring_buf_reg reg = {};
+    reg.ring_addr        = reinterpret_cast<uint64_t>(mapping);
+    reg.ring_entries     = entries;
+    reg.bgid             = group;
+
+    if (io_uring_register(ring_fd, IORING_REGISTER_PBUF_RING, &reg, 1) != 0)
+    {
+        munmap(mapping, size);
+        return nullptr;
+    }
+
+    return static_cast<io_uring_buf_ring*>(mapping);
+}
+
+
+bool BufferRing::buffer_rings_work()
+{
+    // Some kernels accept the registration yet never take a buffer from the
+    // ring, every selection fails with ENOBUFS: a read from a pipe into a
+    // one-buffer ring on a scratch io_uring tells them apart.
+    static const bool works = [] {
+        IoUring ring(2);
+        if (!ring.opened()) return false;
+
+        const uint16_t     group   = 0;
+        const size_t       size    = sizeof(io_uring_buf);
+        io_uring_buf_ring* entries = map_buffer_ring(ring.fd(), group, 1, size);
+        if (!entries) return false;
+
+        char buffer[1];
+        int  fds[2];
+        int  result = -ENOBUFS;
+
+        entries->bufs[0].addr = reinterpret_cast<uint64_t>(buffer);
+        entries->bufs[0].len  = sizeof(buffer);
+        __atomic_store_n(&entries->tail, 1, __ATOMIC_RELEASE);
+
+        if (pipe2(fds, O_CLOEXEC) == 0)
+        {
+            io_uring_sqe* sqe = ring.get_sqe();
+
+            sqe->opcode    = IORING_OP_READ;
+            sqe->fd        = fds[0];
+            sqe->len       = sizeof(buffer);
+            sqe->flags     = IOSQE_BUFFER_SELECT;
+            sqe->buf_group = group;
+
+            if (::write(fds[1], "x", 1) == 1 && ring.submit(1) >= 0)
+            {
+                ring.for_each_completion([&](const io_uring_cqe& cqe) { result = cqe.res; });
+            }
+
+            ::close(fds[0]);
+            ::close(fds[1]);
+        }
+
+        io_uring_buf_reg reg = {};
+        reg.bgid             = group;
+        io_uring_register(ring.fd(), IORING_UNREGISTER_PBUF_RING, &reg, 1);
+        munmap(entries, size);
+
+        return result == 1;
+    }();
+
+    return works;
+}
+
+
+bool parse_recvmsg_out(const char* buffer, size_t length, const msghdr& msg, RecvmsgOut& out)
+{
+    io_uring_recvmsg_out header;
+    const size_t         prefix = sizeof(header) + msg.msg_namelen + msg.msg_controllen;
+
+    if (length < prefix) return false;
+    std::memcpy(&header, buffer, sizeof(header));
+
+    out.name        = reinterpret_cast<const sockaddr*>(buffer + sizeof(header));
+    out.name_length = std::min<socklen_t>(header.namelen, msg.msg_namelen);
+    out.payload     = std::string_view(buffer + prefix, std::min<size_t>(header.payloadlen, length - prefix));
+    out.truncated   = header.flags & MSG_TRUNC;
+
+    return true;
+}
+
+} // socket_wrapper
@@ -0,0 +1,350 @@
+#include <socket_wrapper/logger.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cinttypes>
+#include <cstdio>
+#include <ctime>
+#include <utility>
+
+#include <unistd.h>
+
+
+namespace socket_wrapper
+{
+
+namespace
+{
+
+const char* level_names[] = { "DEBUG", "INFO ", "WARN ", "ERROR" };
+
+std::atomic<uint64_t> next_logger_id{ 1 };
+
+
+uint64_t realtime_ns()
+{
+    timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+
+    return static_cast<uint64_t>(ts.tv_sec) * 1000000000ull + ts.tv_nsec;
+}
+
+
+void write_all(int fd, const std::string& data)
+{
+    size_t written = 0;
+
+    while (written < data.size())
+    {
+        ssize_t result = ::write(fd, data.data() + written, data.size() - written);
+        if (result < 0)
+        {
+            if (errno == EINTR) continue;
+            return;
+        }
+        written += result;
+    }
+}
+
+}
+
+
+// Single producer (the owning thread), single consumer (the writer thread).
+struct alignas(64) Logger::Ring
+{
+    explicit Ring(size_t capacity)
+        : records(new LogRecord[capacity]), mask(capacity - 1)
+    {
+    }
+
+    alignas(64) std::atomic<uint64_t> head{ 0 }; // consumer position
+    alignas(64) std::atomic<uint64_t> tail{ 0 }; // producer position
+    uint64_t                          cached_head = 0;
+    uint32_t                          sample_counters[4] = {};
+    std::atomic<uint64_t>             dropped{ 0 };
+
+    std::unique_ptr<LogRecord[]> records;
+    const size_t                 mask;
+};
+
+
+bool parse_log_level(const std::string& name, LogLevel& level)
+{
+    static const std::pair<const char*, LogLevel> names[] = {
+        { "debug", LogLevel::debug },     { "info", LogLevel::info },
+        { "warning", LogLevel::warning }, { "error", LogLevel::error },
+        { "off", LogLevel::off },
+    };
+
+    for (const auto& n : names)
+    {
+        if (name == n.first)
+        {
+            level = n.second;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+
+Logger::Logger(int fd, size_t ring_capacity)
+    : fd_(fd)
+    // Rounded up to a power of two, so positions map to slots with a mask.
+    , ring_capacity_(size_t(1) << (64 - __builtin_clzll(std::max<size_t>(ring_capacity, 2) - 1)))
+    , id_(next_logger_id++)
+    , level_(LogLevel::info)
+    , stopping_(false)
+    , flush_requests_(0)
+    , flushed_(0)
+    , reported_drops_(0)
+{
+    for (auto& s : sampling_) s = 1;
+
+    writer_ = std::thread(&Logger::run, this);
+}
+
+
+Logger::~Logger()
+{
+    stopping_ = true;
+    writer_.join();
+}
+
+
+void Logger::set_sampling(LogLevel level, uint32_t every_n)
+{
+    if (level < LogLevel::off)
+    {
+        sampling_[static_cast<size_t>(level)] = std::max<uint32_t>(every_n, 1);
+    }
+}
+
+
+uint64_t Logger::dropped() const
+{
+    std::lock_guard<std::mutex> lock(rings_mutex_);
+    uint64_t                    result = 0;
+
+    for (const auto& ring : rings_) result += ring->dropped.load(std::memory_order_relaxed);
+
+    return result;
+}
+
+
+void Logger::flush()
+{
+    const uint64_t request = ++flush_requests_;
+
+    while (flushed_ < request && !stopping_)
+    {
+        std::this_thread::sleep_for(std::chrono::microseconds(200));
+    }
+}
+
+
+LogRecord* Logger::begin_record(LogLevel level, const char* format, Ring*& ring)
+{
+    ring = &thread_ring();
+
+    const size_t   l     = static_cast<size_t>(level);
+    const uint32_t every = sampling_[l].load(std::memory_order_relaxed);
+    if (every > 1 && ring->sample_counters[l]++ % every != 0) return nullptr;
+
+    const uint64_t tail = ring->tail.load(std::memory_order_relaxed);
+    if (tail - ring->cached_head > ring->mask)
+    {
+        ring->cached_head = ring->head.load(std::memory_order_acquire);
+        if (tail - ring->cached_head > ring->mask)
+        {
+            ring->dropped.store(ring->dropped.load(std::memory_order_relaxed) + 1,
+                                std::memory_order_relaxed);
+            return nullptr;
+        }
+    }
+
+    LogRecord& record   = ring->records[tail & ring->mask];
+    record.timestamp_ns = realtime_ns();
+    record.format       = format;
+    record.level        = level;
+    record.args_count   = 0;
+    record.text_used    = 0;
+
+    return &record;
+}
+
+
+void Logger::commit_record(Ring& ring)
+{
+    ring.tail.store(ring.tail.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+}
+
+
+Logger::Ring& Logger::thread_ring()
+{
+    thread_local uint64_t                                              last_id   = 0;
+    thread_local Ring*                                                 last_ring = nullptr;
+    thread_local std::vector<std::pair<uint64_t, std::shared_ptr<Ring>>> owned;
+
+    if (last_id == id_) return *last_ring;
+
+    auto found = std::find_if(owned.begin(), owned.end(), [this](const auto& r) {
+        return r.first == id_;
+    });
+
+    if (found == owned.end())
+    {
+        auto ring = std::make_shared<Ring>(ring_capacity_);
+        {
+            std::lock_guard<std::mutex> lock(rings_mutex_);
+            rings_.push_back(ring);
+        }
+        owned.emplace_back(id_, ring);
+        found = owned.end() - 1;
+    }
+
+    last_id   = id_;
+    last_ring = found->second.get();
+
+    return *last_ring;
+}
+
+
+void Logger::run()
+{
+    std::string out;
+    auto        last_report = std::chrono::steady_clock::now();
+
+    while (true)
+    {
+        const bool     stopping = stopping_;
+        const uint64_t request  = flush_requests_;
+
+        out.clear();
+        bool busy = drain(out);
+
+        const auto now = std::chrono::steady_clock::now();
+        if (now - last_report > std::chrono::seconds(1) || stopping)
+        {
+            last_report          = now;
+            const uint64_t drops = dropped();
+            if (drops > reported_drops_)
+            {
+                out += "Logger: " + std::to_string(drops - reported_drops_) +
+                       " records dropped (ring full)\n";
+                reported_drops_ = drops;
+            }
+        }
+
+        if (!out.empty()) write_all(fd_, out);
+        flushed_ = request;
+
+        if (stopping) break;
+        if (!busy) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+}
+
+
+bool Logger::drain(std::string& out)
+{
+    std::vector<std::shared_ptr<Ring>> rings;
+    {
+        std::lock_guard<std::mutex> lock(rings_mutex_);
+        rings = rings_;
+    }
+
+    bool busy = false;
+
+    for (auto& ring : rings)
+    {
+        const uint64_t head = ring->head.load(std::memory_order_relaxed);
+        const uint64_t tail = ring->tail.load(std::memory_order_acquire);
+
+        for (uint64_t i = head; i != tail; ++i)
+        {
+            format_record(ring->records[i & ring->mask], out);
+        }
+
+        if (head != tail)
+        {
+            ring->head.store(tail, std::memory_order_release);
+            busy = true;
+        }
+    }
+
+    return busy;
+}
+
+
+void Logger::format_record(const LogRecord& record, std::string& out) const
+{
+    char         prefix[64];
+    const time_t seconds = record.timestamp_ns / 1000000000ull;
+    tm           local;
+
+    localtime_r(&seconds, &local);
+    int len = std::snprintf(prefix,
+                            sizeof(prefix),
+                            "%02d:%02d:%02d.%06u %s ",
+                            local.tm_hour,
+                            local.tm_min,
+                            local.tm_sec,
+                            static_cast<unsigned>(record.timestamp_ns % 1000000000ull / 1000),
+                            level_names[static_cast<size_t>(record.level)]);
+    out.append(prefix, len);
+
+    size_t arg = 0;
+    for (const char* p = record.format; *p != '\0'; ++p)
+    {
+        if (p[0] != '{' || p[1] != '}' || arg >= record.args_count)
+        {
+            out += *p;
+            continue;
+        }
+
+        const uint64_t value = record.args[arg];
+        char           number[32];
+
+        switch (record.types[arg++])
+        {
+            case LogRecord::signed_value:
+                len = std::snprintf(number, sizeof(number), "%" PRId64, static_cast<int64_t>(value));
+                out.append(number, len);
+                break;
+            case LogRecord::unsigned_value:
+                len = std::snprintf(number, sizeof(number), "%" PRIu64, value);
+                out.append(number, len);
+                break;
+            case LogRecord::double_value:
+            {
+                double d;
+                std::memcpy(&d, &value, sizeof(d));
+                len = std::snprintf(number, sizeof(number), "%g", d);
+                out.append(number, len);
+                break;
+            }
+            case LogRecord::text_value:
+                out.append(record.text + (value >> 16), value & 0xffff);
+                break;
+        }
+        ++p;
+    }
+
+    out += '\n';
+}
+
+
+void Logger::append(LogRecord& record, std::string_view value)
+{
+    const size_t length = std::min(value.size(), sizeof(record.text) - record.text_used);
+
+    std::memcpy(record.text + record.text_used, value.data(), length);
+
+    record.args[record.args_count]    = static_cast<uint64_t>(record.text_used) << 16 | length;
+    record.types[record.args_count++] = LogRecord::text_value;
+    record.text_used += length;
+}
+
+}
+
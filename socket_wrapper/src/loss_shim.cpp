@@ -0,0 +1,117 @@
+#include <socket_wrapper/loss_shim.h>
+
+#include <cstring>
+
+
+namespace socket_wrapper
+{
+
+LossShim::LossShim(EventLoop& loop, const Options& options, uint64_t seed)
+    : loop_(loop)
+    , options_(options)
+    , random_(seed)
+    , timer_(0)
+{
+}
+
+
+LossShim::~LossShim()
+{
+    if (timer_ != 0) loop_.cancel_timer(timer_);
+}
+
+
+ssize_t LossShim::send(SocketDescriptorType sock, const msghdr& msg, int flags)
+{
+    std::uniform_real_distribution<double> uniform(0, 1);
+
+    size_t length = 0;
+    for (size_t i = 0; i < msg.msg_iovlen; ++i) length += msg.msg_iov[i].iov_len;
+
+    if (options_.loss > 0 && uniform(random_) < options_.loss)
+    {
+        ++stats_.dropped;
+        return static_cast<ssize_t>(length);
+    }
+
+    Clock::duration delay = options_.delay;
+
+    if (options_.jitter.count() > 0)
+    {
+        delay += std::chrono::duration_cast<Clock::duration>(options_.jitter * uniform(random_));
+    }
+    if (options_.reorder > 0 && uniform(random_) < options_.reorder)
+    {
+        delay += options_.reorder_delay;
+        ++stats_.reordered;
+    }
+
+    if (delay.count() <= 0)
+    {
+        ++stats_.passed;
+        return sendmsg(sock, &msg, flags);
+    }
+
+    Held held;
+    held.sock           = sock;
+    held.address_length = msg.msg_name ? msg.msg_namelen : 0;
+    held.flags          = flags;
+    if (held.address_length) std::memcpy(&held.address, msg.msg_name, held.address_length);
+
+    held.data.reserve(length);
+    for (size_t i = 0; i < msg.msg_iovlen; ++i)
+    {
+        held.data.append(static_cast<const char*>(msg.msg_iov[i].iov_base), msg.msg_iov[i].iov_len);
+    }
+
+    held_.emplace(Clock::now() + delay, std::move(held));
+    ++stats_.delayed;
+    schedule();
+
+    return static_cast<ssize_t>(length);
+}
+
+
+// One timer, for the earliest held datagram.
+void LossShim::schedule()
+{
+    if (held_.empty()) return;
+
+    const Clock::time_point deadline = held_.begin()->first;
+
+    if (timer_ != 0)
+    {
+        if (timer_deadline_ <= deadline) return;
+        loop_.cancel_timer(timer_);
+    }
+
+    timer_deadline_ = deadline;
+    timer_          = loop_.add_timer(deadline - Clock::now(), [this] {
+        timer_ = 0;
+        release();
+    });
+}
+
+
+void LossShim::release()
+{
+    const auto now = Clock::now();
+
+    while (!held_.empty() && held_.begin()->first <= now)
+    {
+        const Held& held = held_.begin()->second;
+
+        sendto(held.sock,
+               held.data.data(),
+               held.data.size(),
+               held.flags,
+               held.address_length ? reinterpret_cast<const sockaddr*>(&held.address) : nullptr,
+               held.address_length);
+
+        held_.erase(held_.begin());
+    }
+
+    schedule();
+}
+
+} // socket_wrapper
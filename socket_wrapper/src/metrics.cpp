@@ -0,0 +1,478 @@
+#include <socket_wrapper/metrics.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cinttypes>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+
+#include <poll.h>
+#include <sys/un.h>
+
+
+namespace socket_wrapper
+{
+
+namespace
+{
+
+std::atomic<uint64_t> next_metrics_id{ 1 };
+
+const char* type_names[] = { "counter", "gauge", "histogram" };
+
+
+void append_number(std::string& out, double value)
+{
+    char buf[32];
+    int  len;
+
+    if (std::isinf(value))
+        len = std::snprintf(buf, sizeof(buf), value > 0 ? "+Inf" : "-Inf");
+    else
+        len = std::snprintf(buf, sizeof(buf), "%.15g", value);
+
+    out.append(buf, len);
+}
+
+
+void append_number(std::string& out, uint64_t value)
+{
+    char buf[32];
+    int  len = std::snprintf(buf, sizeof(buf), "%" PRIu64, value);
+
+    out.append(buf, len);
+}
+
+
+// name{labels,extra} value
+template <typename T>
+void append_sample(std::string&       out,
+                   const std::string& name,
+                   const char*        suffix,
+                   const std::string& labels,
+                   const std::string& extra,
+                   T                  value)
+{
+    out += name;
+    out += suffix;
+    if (!labels.empty() || !extra.empty())
+    {
+        out += '{';
+        out += labels;
+        if (!labels.empty() && !extra.empty()) out += ',';
+        out += extra;
+        out += '}';
+    }
+    out += ' ';
+    append_number(out, value);
+    out += '\n';
+}
+
+
+void write_all(SocketDescriptorType sock, const std::string& data)
+{
+    size_t written = 0;
+
+    while (written < data.size())
+    {
+        ssize_t result = ::send(sock, data.data() + written, data.size() - written, MSG_NOSIGNAL);
+        if (result < 0)
+        {
+            if (errno == EINTR) continue;
+            return;
+        }
+        written += result;
+    }
+}
+
+}
+
+
+Metrics::Metrics(size_t capacity)
+    : capacity_((std::max<size_t>(capacity, 8) + 7) / 8 * 8)
+    , id_(next_metrics_id++)
+    , next_offset_(0)
+    , next_gauge_(0)
+    , gauges_(new std::atomic<int64_t>[capacity_])
+{
+    for (size_t i = 0; i < capacity_; ++i) gauges_[i].store(0, std::memory_order_relaxed);
+}
+
+
+Metrics::Counter Metrics::counter(const std::string& name,
+                                  const std::string& help,
+                                  const std::string& labels)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    const uint32_t offset = allocate(1);
+    descriptors_.push_back(std::make_unique<Descriptor>(
+        Descriptor{ Type::counter, name, help, labels, offset, {}, 1, nullptr }));
+
+    return Counter{ offset };
+}
+
+
+Metrics::Gauge Metrics::gauge(const std::string& name, const std::string& help, const std::string& labels)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    if (next_gauge_ == capacity_) throw std::length_error("Metrics capacity exhausted");
+
+    const uint32_t index = next_gauge_++;
+    descriptors_.push_back(std::make_unique<Descriptor>(
+        Descriptor{ Type::gauge, name, help, labels, index, {}, 1, nullptr }));
+
+    return Gauge{ index };
+}
+
+
+void Metrics::gauge(const std::string&      name,
+                    const std::string&      help,
+                    const std::string&      labels,
+                    std::function<double()> read)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    descriptors_.push_back(std::make_unique<Descriptor>(
+        Descriptor{ Type::gauge, name, help, labels, 0, {}, 1, std::move(read) }));
+}
+
+
+Metrics::Histogram Metrics::histogram(const std::string&    name,
+                                      const std::string&    help,
+                                      const std::string&    labels,
+                                      std::vector<uint64_t> bounds,
+                                      double                scale)
+{
+    std::sort(bounds.begin(), bounds.end());
+    bounds.erase(std::unique(bounds.begin(), bounds.end()), bounds.end());
+
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    // One cell per bound, the +Inf bucket and the sum.
+    const uint32_t offset = allocate(bounds.size() + 2);
+    descriptors_.push_back(std::make_unique<Descriptor>(
+        Descriptor{ Type::histogram, name, help, labels, offset, std::move(bounds), scale, nullptr }));
+
+    // The descriptor is never moved or freed, so the bounds stay valid.
+    const auto& d = *descriptors_.back();
+
+    return Histogram{ offset, d.bounds.data(), static_cast<uint32_t>(d.bounds.size()) };
+}
+
+
+void Metrics::observe(Histogram histogram, uint64_t value)
+{
+    const uint64_t* end    = histogram.bounds + histogram.bounds_count;
+    const size_t    bucket = std::lower_bound(histogram.bounds, end, value) - histogram.bounds;
+
+    const uint32_t sum_offset = histogram.offset + histogram.bounds_count + 1;
+
+    Block& block = thread_block();
+    auto&  count = block[(histogram.offset + bucket) / 8].cells[(histogram.offset + bucket) % 8];
+    auto&  sum   = block[sum_offset / 8].cells[sum_offset % 8];
+
+    count.store(count.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    sum.store(sum.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+}
+
+
+uint64_t Metrics::value(Counter counter) const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    return sum(counter.offset);
+}
+
+
+int64_t Metrics::value(Gauge gauge) const
+{
+    return gauges_[gauge.index].load(std::memory_order_relaxed);
+}
+
+
+std::string Metrics::prometheus() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::string                 out;
+    std::vector<bool>           done(descriptors_.size());
+
+    // Samples of one metric family must be contiguous.
+    for (size_t i = 0; i < descriptors_.size(); ++i)
+    {
+        if (done[i]) continue;
+
+        const Descriptor& family = *descriptors_[i];
+        out += "# HELP " + family.name + ' ' + family.help + '\n';
+        out += "# TYPE " + family.name + ' ' + type_names[static_cast<size_t>(family.type)] + '\n';
+
+        for (size_t j = i; j < descriptors_.size(); ++j)
+        {
+            const Descriptor& d = *descriptors_[j];
+            if (done[j] || d.name != family.name) continue;
+
+            done[j] = true;
+
+            switch (d.type)
+            {
+                case Type::counter:
+                    append_sample(out, d.name, "", d.labels, "", sum(d.offset));
+                    break;
+                case Type::gauge:
+                    if (d.read)
+                        append_sample(out, d.name, "", d.labels, "", d.read());
+                    else
+                        append_sample(out,
+                                      d.name,
+                                      "",
+                                      d.labels,
+                                      "",
+                                      static_cast<double>(gauges_[d.offset].load(std::memory_order_relaxed)));
+                    break;
+                case Type::histogram:
+                {
+                    uint64_t cumulative = 0;
+                    for (size_t b = 0; b <= d.bounds.size(); ++b)
+                    {
+                        std::string le = "le=\"";
+                        if (b < d.bounds.size())
+                            append_number(le, d.bounds[b] * d.scale);
+                        else
+                            le += "+Inf";
+                        le += '"';
+
+                        cumulative += sum(d.offset + b);
+                        append_sample(out, d.name, "_bucket", d.labels, le, cumulative);
+                    }
+                    append_sample(out, d.name, "_sum", d.labels, "", sum(d.offset + d.bounds.size() + 1) * d.scale);
+                    append_sample(out, d.name, "_count", d.labels, "", cumulative);
+                    break;
+                }
+            }
+        }
+    }
+
+    return out;
+}
+
+
+Metrics::Block& Metrics::thread_block()
+{
+    thread_local uint64_t                                                last_id    = 0;
+    thread_local Block*                                                  last_block = nullptr;
+    thread_local std::vector<std::pair<uint64_t, std::shared_ptr<Block>>> owned;
+
+    if (last_id == id_) return *last_block;
+
+    auto found = std::find_if(owned.begin(), owned.end(), [this](const auto& b) {
+        return b.first == id_;
+    });
+
+    if (found == owned.end())
+    {
+        auto block = std::make_shared<Block>(capacity_ / 8);
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            blocks_.push_back(block);
+        }
+        owned.emplace_back(id_, block);
+        found = owned.end() - 1;
+    }
+
+    last_id    = id_;
+    last_block = found->second.get();
+
+    return *last_block;
+}
+
+
+uint32_t Metrics::allocate(size_t cells)
+{
+    if (next_offset_ + cells > capacity_) throw std::length_error("Metrics capacity exhausted");
+
+    const uint32_t offset = next_offset_;
+    next_offset_ += static_cast<uint32_t>(cells);
+
+    return offset;
+}
+
+
+uint64_t Metrics::sum(uint32_t offset) const
+{
+    uint64_t result = 0;
+
+    for (const auto& block : blocks_)
+    {
+        result += (*block)[offset / 8].cells[offset % 8].load(std::memory_order_relaxed);
+    }
+
+    return result;
+}
+
+
+std::vector<uint64_t> exponential_buckets(uint64_t start, double factor, size_t count)
+{
+    std::vector<uint64_t> bounds;
+    double                bound = static_cast<double>(std::max<uint64_t>(start, 1));
+
+    for (size_t i = 0; i < count; ++i, bound *= factor)
+    {
+        bounds.push_back(static_cast<uint64_t>(bound));
+    }
+
+    return bounds;
+}
+
+
+uint64_t proc_udp_drops(uint16_t port)
+{
+    uint64_t drops = 0;
+
+    for (const char* path : { "/proc/net/udp", "/proc/net/udp6" })
+    {
+        std::ifstream file(path);
+        std::string   line;
+
+        // sl local_address rem_address st tx_queue:rx_queue tr:tm->when
+        // retrnsmt uid timeout inode ref pointer drops
+        std::getline(file, line);
+        while (std::getline(file, line))
+        {
+            std::istringstream fields(line);
+            std::string        slot, local, field;
+
+            fields >> slot >> local;
+
+            const auto colon = local.rfind(':');
+            if (colon == std::string::npos ||
+                std::strtoul(local.c_str() + colon + 1, nullptr, 16) != port)
+                continue;
+
+            std::string last;
+            while (fields >> field) last = field;
+            drops += std::strtoull(last.c_str(), nullptr, 10);
+        }
+    }
+
+    return drops;
+}
+
+
+MetricsExporter::MetricsExporter(const Metrics& metrics, const std::string& address)
+    : metrics_(metrics), listener_(INVALID_SOCKET), stopping_(false)
+{
+    SocketDescriptorType sock = INVALID_SOCKET;
+
+    if (address.rfind("unix:", 0) == 0)
+    {
+        sockaddr_un addr = {};
+        addr.sun_family  = AF_UNIX;
+        unix_path_       = address.substr(5);
+        std::strncpy(addr.sun_path, unix_path_.c_str(), sizeof(addr.sun_path) - 1);
+
+        ::unlink(unix_path_.c_str());
+        sock = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (sock != INVALID_SOCKET &&
+            bind(sock, reinterpret_cast<const sockaddr*>(&addr), sizeof(addr)) != 0)
+        {
+            ::close(sock);
+            sock = INVALID_SOCKET;
+        }
+    }
+    else
+    {
+        const auto  colon = address.rfind(':');
+        std::string host  = colon == std::string::npos ? "127.0.0.1" : address.substr(0, colon);
+        std::string port  = colon == std::string::npos ? address : address.substr(colon + 1);
+        addrinfo    hints = {};
+        addrinfo*   info  = nullptr;
+
+        hints.ai_socktype = SOCK_STREAM;
+        hints.ai_flags    = AI_PASSIVE;
+
+        if (getaddrinfo(host.c_str(), port.c_str(), &hints, &info) == 0)
+        {
+            sock = ::socket(info->ai_family, SOCK_STREAM | SOCK_CLOEXEC, 0);
+
+            int on = 1;
+            if (sock != INVALID_SOCKET &&
+                (setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on)) != 0 ||
+                 bind(sock, info->ai_addr, info->ai_addrlen) != 0))
+            {
+                ::close(sock);
+                sock = INVALID_SOCKET;
+            }
+            freeaddrinfo(info);
+        }
+    }
+
+    if (sock == INVALID_SOCKET || listen(sock, 16) != 0)
+    {
+        if (sock != INVALID_SOCKET) ::close(sock);
+        return;
+    }
+
+    listener_ = sock;
+    thread_   = std::thread(&MetricsExporter::run, this);
+}
+
+
+MetricsExporter::~MetricsExporter()
+{
+    stopping_ = true;
+    if (thread_.joinable()) thread_.join();
+
+    if (listener_ != INVALID_SOCKET) ::close(listener_);
+    if (!unix_path_.empty()) ::unlink(unix_path_.c_str());
+}
+
+
+void MetricsExporter::run()
+{
+    while (!stopping_)
+    {
+        pollfd pfd = { listener_, POLLIN, 0 };
+
+        // Short timeout, so the destructor does not wait long.
+        if (poll(&pfd, 1, 200) <= 0) continue;
+
+        SocketDescriptorType client = accept4(listener_, nullptr, nullptr, SOCK_CLOEXEC);
+        if (client == INVALID_SOCKET) continue;
+
+        respond(client);
+        ::close(client);
+    }
+}
+
+
+void MetricsExporter::respond(SocketDescriptorType client)
+{
+    // Any request gets the metrics, only wait for its headers to arrive.
+    std::string request;
+    char        buf[1024];
+
+    while (request.find("\r\n\r\n") == std::string::npos && request.size() < 8192)
+    {
+        pollfd pfd = { client, POLLIN, 0 };
+        if (poll(&pfd, 1, 1000) <= 0) return;
+
+        ssize_t len = ::recv(client, buf, sizeof(buf), 0);
+        if (len <= 0) return;
+        request.append(buf, len);
+    }
+
+    const std::string body = metrics_.prometheus();
+
+    write_all(client,
+              "HTTP/1.0 200 OK\r\n"
+              "Content-Type: text/plain; version=0.0.4\r\n"
+              "Content-Length: " +
+                  std::to_string(body.size()) + "\r\n\r\n" + body);
+}
+
+}
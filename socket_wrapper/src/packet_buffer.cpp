@@ -0,0 +1,119 @@
+#include <socket_wrapper/packet_buffer.h>
+
+#include <algorithm>
+#include <utility>
+
+
+namespace socket_wrapper
+{
+
+namespace
+{
+
+// Keeps every buffer starting on its own cache line.
+constexpr size_t cache_line = 64;
+
+}
+
+
+PacketBuffer::PacketBuffer(BufferPool* pool, uint32_t index, char* data, size_t capacity)
+    : pool_(pool), index_(index), data_(data), capacity_(capacity)
+{
+}
+
+
+PacketBuffer::PacketBuffer(PacketBuffer&& b) noexcept
+    : pool_(b.pool_)
+    , index_(b.index_)
+    , data_(b.data_)
+    , capacity_(b.capacity_)
+    , size_(b.size_)
+    , truncated_(b.truncated_)
+{
+    b.pool_ = nullptr;
+    b.data_ = nullptr;
+}
+
+
+PacketBuffer& PacketBuffer::operator=(PacketBuffer&& b) noexcept
+{
+    if (&b == this) return *this;
+
+    reset();
+    std::swap(pool_, b.pool_);
+    std::swap(index_, b.index_);
+    std::swap(data_, b.data_);
+    std::swap(capacity_, b.capacity_);
+    std::swap(size_, b.size_);
+    std::swap(truncated_, b.truncated_);
+
+    return *this;
+}
+
+
+PacketBuffer::~PacketBuffer()
+{
+    reset();
+}
+
+
+void PacketBuffer::reset()
+{
+    if (pool_ != nullptr) pool_->release(index_);
+
+    pool_      = nullptr;
+    data_      = nullptr;
+    capacity_  = 0;
+    size_      = 0;
+    truncated_ = false;
+}
+
+
+BufferPool::BufferPool(size_t buffer_size, size_t count)
+    : buffer_size_((buffer_size + cache_line - 1) / cache_line * cache_line)
+    , count_(count)
+    , arena_(new char[buffer_size_ * count + cache_line])
+    , high_water_(0)
+    , exhausted_(0)
+{
+    free_.reserve(count);
+    for (size_t i = count; i > 0; --i)
+    {
+        free_.push_back(static_cast<uint32_t>(i - 1));
+    }
+}
+
+
+PacketBuffer BufferPool::acquire()
+{
+    if (free_.empty())
+    {
+        ++exhausted_;
+        return {};
+    }
+
+    const uint32_t index = free_.back();
+    free_.pop_back();
+
+    high_water_ = std::max(high_water_, count_ - free_.size());
+
+    auto base = reinterpret_cast<uintptr_t>(arena_.get());
+    auto data = reinterpret_cast<char*>((base + cache_line - 1) / cache_line * cache_line);
+
+    return PacketBuffer(this, index, data + index * buffer_size_, buffer_size_);
+}
+
+
+BufferPoolStats BufferPool::stats() const
+{
+    return { buffer_size_, count_, count_ - free_.size(), high_water_, exhausted_ };
+}
+
+
+void BufferPool::release(uint32_t index)
+{
+    free_.push_back(index);
+}
+
+}
+
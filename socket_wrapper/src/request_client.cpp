@@ -0,0 +1,248 @@
+#include <socket_wrapper/request_client.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <random>
+
+#include <socket_wrapper/packet_buffer.h>
+
+
+namespace socket_wrapper
+{
+
+namespace
+{
+
+void write_header(char* data, uint32_t session, uint32_t id)
+{
+    session = htonl(session);
+    id      = htonl(id);
+    std::memcpy(data, &session, sizeof(session));
+    std::memcpy(data + sizeof(session), &id, sizeof(id));
+}
+
+
+void read_header(const char* data, uint32_t& session, uint32_t& id)
+{
+    std::memcpy(&session, data, sizeof(session));
+    std::memcpy(&id, data + sizeof(session), sizeof(id));
+    session = ntohl(session);
+    id      = ntohl(id);
+}
+
+}
+
+
+RequestClient::RequestClient(EventLoop&      loop,
+                             const sockaddr* server,
+                             socklen_t       server_len,
+                             size_t          depth,
+                             Framing         framing)
+    : loop_(loop)
+    , sock_(server->sa_family, SOCK_DGRAM, IPPROTO_UDP)
+    , framing_(framing)
+    , depth_(framing == Framing::none ? 1 : std::max<size_t>(depth, 1))
+    , opened_(false)
+    , session_(std::random_device()())
+    , next_id_(0)
+    , rx_(32, max_datagram_size)
+{
+    // Connected: the kernel drops datagrams of other peers and reports
+    // ICMP errors to this socket.
+    if (!sock_ || connect(sock_, server, server_len) != 0 || sock_.set_nonblocking() != 0) return;
+
+    opened_ = loop_.add(sock_, EventLoop::readable, [this](uint32_t) { on_readable(); }) == 0;
+}
+
+
+RequestClient::~RequestClient()
+{
+    for (auto& request : in_flight_) loop_.cancel_timer(request.second.timer);
+    if (opened_) loop_.remove(sock_);
+}
+
+
+RequestClient::RequestId RequestClient::request(std::string_view payload, Callback callback, Options options)
+{
+    const RequestId id = next_id_++;
+    Request         request;
+
+    if (framing_ == Framing::header)
+    {
+        request.datagram.resize(header_size);
+        write_header(&request.datagram[0], session_, id);
+    }
+    request.datagram.append(payload);
+    request.callback = std::move(callback);
+    request.options  = options;
+
+    if (in_flight_.size() < depth_ && queued_.empty())
+    {
+        transmit(id, in_flight_.emplace(id, std::move(request)).first->second);
+    }
+    else
+    {
+        queued_.emplace_back(id, std::move(request));
+    }
+
+    return id;
+}
+
+
+bool RequestClient::cancel(RequestId id)
+{
+    auto request = in_flight_.find(id);
+    if (request != in_flight_.end())
+    {
+        Request r = std::move(request->second);
+        in_flight_.erase(request);
+        loop_.cancel_timer(r.timer);
+        finish(std::move(r), id, ECANCELED, {});
+        start_queued();
+        return true;
+    }
+
+    for (auto queued = queued_.begin(); queued != queued_.end(); ++queued)
+    {
+        if (queued->first != id) continue;
+
+        Request r = std::move(queued->second);
+        queued_.erase(queued);
+        finish(std::move(r), id, ECANCELED, {});
+        return true;
+    }
+
+    return false;
+}
+
+
+void RequestClient::transmit(RequestId id, Request& request)
+{
+    ++request.attempts;
+    ++stats_.sent;
+    if (request.attempts > 1) ++stats_.retransmitted;
+
+    // A failed send is a lost datagram: the timer retries it.
+    if (send(sock_, request.datagram.data(), request.datagram.size(), MSG_DONTWAIT) < 0)
+    {
+        request.last_error = errno;
+    }
+
+    request.timer = loop_.add_timer(request.options.timeout, [this, id] { on_timeout(id); });
+}
+
+
+void RequestClient::on_readable()
+{
+    for (;;)
+    {
+        const int received = rx_.receive(sock_);
+        if (received < 0)
+        {
+            // ICMP errors of earlier sends surface here, keep draining.
+            if (errno == ECONNREFUSED || errno == EINTR) continue;
+            break;
+        }
+
+        for (int i = 0; i < received; ++i)
+        {
+            uint32_t session;
+            uint32_t id;
+
+            if (framing_ == Framing::none)
+            {
+                // Nothing in flight: a late reply to an earlier attempt.
+                if (in_flight_.empty())
+                {
+                    ++stats_.duplicates;
+                    continue;
+                }
+
+                auto      request = in_flight_.begin();
+                Request   r       = std::move(request->second);
+                RequestId done    = request->first;
+                in_flight_.erase(request);
+                loop_.cancel_timer(r.timer);
+                ++stats_.completed;
+                finish(std::move(r), done, 0, rx_.view(i));
+                continue;
+            }
+
+            if (rx_.length(i) < header_size || rx_.truncated(i))
+            {
+                ++stats_.unmatched;
+                continue;
+            }
+
+            read_header(rx_.data(i), session, id);
+            if (session != session_)
+            {
+                ++stats_.unmatched;
+                continue;
+            }
+
+            auto request = in_flight_.find(id);
+            if (request == in_flight_.end())
+            {
+                // Ids go out in order, queued ones have not been sent yet.
+                if (id < (queued_.empty() ? next_id_ : queued_.front().first))
+                    ++stats_.duplicates;
+                else
+                    ++stats_.unmatched;
+                continue;
+            }
+
+            Request r = std::move(request->second);
+            in_flight_.erase(request);
+            loop_.cancel_timer(r.timer);
+            ++stats_.completed;
+            finish(std::move(r), id, 0, rx_.view(i).substr(header_size));
+        }
+
+        // A short batch means the queue is empty.
+        if (static_cast<size_t>(received) < rx_.depth()) break;
+    }
+
+    start_queued();
+}
+
+
+void RequestClient::on_timeout(RequestId id)
+{
+    auto request = in_flight_.find(id);
+    if (request == in_flight_.end()) return;
+
+    if (request->second.attempts <= request->second.options.retries)
+    {
+        transmit(id, request->second);
+        return;
+    }
+
+    Request   r     = std::move(request->second);
+    const int error = r.last_error ? r.last_error : ETIMEDOUT;
+    in_flight_.erase(request);
+    ++stats_.timed_out;
+    finish(std::move(r), id, error, {});
+    start_queued();
+}
+
+
+void RequestClient::finish(Request request, RequestId id, int error, std::string_view reply)
+{
+    // The request is already off the books: the callback may issue new ones.
+    if (request.callback) request.callback(id, error, reply);
+}
+
+
+void RequestClient::start_queued()
+{
+    while (in_flight_.size() < depth_ && !queued_.empty())
+    {
+        auto next = std::move(queued_.front());
+        queued_.pop_front();
+        transmit(next.first, in_flight_.emplace(next.first, std::move(next.second)).first->second);
+    }
+}
+
+} // socket_wrapper
@@ -0,0 +1,274 @@
+#include <socket_wrapper/resolver.h>
+
+#include <algorithm>
+#include <cstring>
+
+
+namespace socket_wrapper
+{
+
+Resolver::Resolver(Clock::duration ttl,
+                   Clock::duration negative_ttl,
+                   size_t          workers,
+                   size_t          max_entries)
+    : ttl_(ttl)
+    , negative_ttl_(negative_ttl)
+    , max_entries_(max_entries)
+    , stopping_(false)
+{
+    for (size_t i = 0; i < std::max<size_t>(workers, 1); ++i)
+    {
+        workers_.emplace_back(&Resolver::work, this);
+    }
+}
+
+
+Resolver::~Resolver()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+    }
+    jobs_ready_.notify_all();
+
+    for (auto& worker : workers_) worker.join();
+}
+
+
+bool Resolver::reverse(const sockaddr* addr, socklen_t addr_len, char* host, size_t host_len)
+{
+    AddressKey key;
+
+    if (make_key(addr, key))
+    {
+        const auto now      = Clock::now();
+        bool       schedule = false;
+
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+
+            auto entry = reverse_cache_.find(key);
+            if (entry != reverse_cache_.end() && entry->second.expires > now)
+            {
+                if (entry->second.state == State::resolved)
+                {
+                    std::strncpy(host, entry->second.name.c_str(), host_len);
+                    host[host_len - 1] = '\0';
+                    return true;
+                }
+            }
+            else if (entry != reverse_cache_.end() || reserve_entry(now))
+            {
+                // Pending until its job is done, however long the queue is:
+                // every queued job runs and settles the entry, so a second one
+                // would only repeat the query. Nor is it swept meanwhile.
+                reverse_cache_[key] = ReverseEntry{ State::pending, {}, Clock::time_point::max() };
+                schedule            = true;
+            }
+        }
+
+        if (schedule)
+        {
+            sockaddr_storage peer = {};
+            std::memcpy(&peer, addr, std::min<size_t>(addr_len, sizeof(peer)));
+
+            post([this, key, peer, addr_len] {
+                char name[NI_MAXHOST];
+                bool ok = getnameinfo(reinterpret_cast<const sockaddr*>(&peer),
+                                      addr_len,
+                                      name,
+                                      sizeof(name),
+                                      nullptr,
+                                      0,
+                                      NI_NAMEREQD) == 0;
+
+                std::lock_guard<std::mutex> lock(mutex_);
+
+                auto entry = reverse_cache_.find(key);
+                if (entry == reverse_cache_.end()) return;
+
+                entry->second.state   = ok ? State::resolved : State::failed;
+                entry->second.name    = ok ? name : "";
+                entry->second.expires = Clock::now() + (ok ? ttl_ : negative_ttl_);
+            });
+        }
+    }
+
+    // Numeric formatting does not touch DNS.
+    if (getnameinfo(addr, addr_len, host, host_len, nullptr, 0, NI_NUMERICHOST) != 0)
+    {
+        std::strncpy(host, "?", host_len);
+    }
+
+    return false;
+}
+
+
+std::future<ResolvedHost> Resolver::resolve(const std::string& host, int family)
+{
+    auto promise = std::make_shared<std::promise<ResolvedHost>>();
+    auto result  = promise->get_future();
+
+    resolve(host, family, [promise](ResolvedHost resolved) { promise->set_value(std::move(resolved)); });
+
+    return result;
+}
+
+
+void Resolver::resolve(const std::string& host, int family, std::function<void(ResolvedHost)> done)
+{
+    std::string key = host + '/' + std::to_string(family);
+
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+
+        auto entry = forward_cache_.find(key);
+        if (entry != forward_cache_.end() && entry->second.expires > Clock::now())
+        {
+            ResolvedHost cached = entry->second.host;
+            lock.unlock();
+            done(std::move(cached));
+            return;
+        }
+    }
+
+    post([this, done = std::move(done), host, family, key] {
+        ResolvedHost resolved;
+        addrinfo     hints = {};
+        addrinfo*    info  = nullptr;
+
+        hints.ai_family   = family;
+        hints.ai_socktype = SOCK_DGRAM;
+        hints.ai_flags    = AI_CANONNAME;
+
+        resolved.error = getaddrinfo(host.c_str(), nullptr, &hints, &info);
+        resolved.name  = host;
+
+        if (resolved.error == 0)
+        {
+            if (info->ai_canonname) resolved.name = info->ai_canonname;
+
+            for (auto ai = info; ai != nullptr; ai = ai->ai_next)
+            {
+                sockaddr_storage addr = {};
+                std::memcpy(&addr, ai->ai_addr, std::min<size_t>(ai->ai_addrlen, sizeof(addr)));
+                resolved.addresses.push_back(addr);
+            }
+            freeaddrinfo(info);
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+
+            const auto now = Clock::now();
+            if (forward_cache_.size() < max_entries_)
+            {
+                forward_cache_[key] =
+                    ForwardEntry{ resolved, now + (resolved.error == 0 ? ttl_ : negative_ttl_) };
+            }
+        }
+
+        done(std::move(resolved));
+    });
+}
+
+
+size_t Resolver::cache_size() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    return reverse_cache_.size() + forward_cache_.size();
+}
+
+
+bool Resolver::AddressKey::operator==(const AddressKey& k) const
+{
+    return family == k.family && std::memcmp(bytes, k.bytes, sizeof(bytes)) == 0;
+}
+
+
+size_t Resolver::AddressKeyHash::operator()(const AddressKey& k) const
+{
+    // FNV-1a
+    uint64_t hash = 14695981039346656037ull ^ k.family;
+
+    for (auto b : k.bytes)
+    {
+        hash = (hash ^ b) * 1099511628211ull;
+    }
+
+    return static_cast<size_t>(hash);
+}
+
+
+bool Resolver::make_key(const sockaddr* addr, AddressKey& key)
+{
+    key = {};
+    key.family = addr->sa_family;
+
+    if (addr->sa_family == AF_INET)
+    {
+        const auto* in = reinterpret_cast<const sockaddr_in*>(addr);
+        std::memcpy(key.bytes, &in->sin_addr, sizeof(in->sin_addr));
+        return true;
+    }
+    if (addr->sa_family == AF_INET6)
+    {
+        const auto* in6 = reinterpret_cast<const sockaddr_in6*>(addr);
+        std::memcpy(key.bytes, &in6->sin6_addr, sizeof(in6->sin6_addr));
+        return true;
+    }
+
+    return false;
+}
+
+
+void Resolver::post(std::function<void()> job)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        jobs_.push_back(std::move(job));
+    }
+    jobs_ready_.notify_one();
+}
+
+
+void Resolver::work()
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+
+    while (true)
+    {
+        jobs_ready_.wait(lock, [this] { return stopping_ || !jobs_.empty(); });
+        if (stopping_) return;
+
+        auto job = std::move(jobs_.front());
+        jobs_.pop_front();
+
+        lock.unlock();
+        job();
+        lock.lock();
+    }
+}
+
+
+bool Resolver::reserve_entry(Clock::time_point now)
+{
+    if (reverse_cache_.size() < max_entries_) return true;
+    // A full sweep is linear, so a flood of new peers runs it once a second.
+    if (now - last_sweep_ < std::chrono::seconds(1)) return false;
+
+    last_sweep_ = now;
+    for (auto entry = reverse_cache_.begin(); entry != reverse_cache_.end();)
+    {
+        if (entry->second.expires <= now)
+            entry = reverse_cache_.erase(entry);
+        else
+            ++entry;
+    }
+
+    return reverse_cache_.size() < max_entries_;
+}
+
+}
+
@@ -0,0 +1,345 @@
+#include <socket_wrapper/session_table.h>
+
+#include <algorithm>
+#include <cstring>
+#include <random>
+
+
+namespace socket_wrapper
+{
+
+namespace
+{
+
+// Finalizer of MurmurHash3, every input bit affects every output bit.
+uint64_t mix(uint64_t h)
+{
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdull;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ull;
+    h ^= h >> 33;
+
+    return h;
+}
+
+
+uint64_t random_seed()
+{
+    std::random_device device;
+
+    return (static_cast<uint64_t>(device()) << 32) | device();
+}
+
+
+size_t index_size(size_t capacity)
+{
+    // At most half full, probe sequences stay short.
+    size_t size = 16;
+    while (size < 2 * capacity) size *= 2;
+
+    return size;
+}
+
+}
+
+
+SessionTable::SessionTable(size_t capacity, double rate, double burst, Clock::duration idle_timeout)
+    : rate_(rate)
+    , burst_(std::max(burst, 1.0))
+    , idle_timeout_(std::max<Clock::duration>(idle_timeout, std::chrono::milliseconds(1)))
+    , tick_(std::max<Clock::duration>(idle_timeout_ / (wheel_slots / 2), std::chrono::microseconds(1)))
+    , seed_(random_seed())
+    , sessions_(std::clamp<size_t>(capacity, 1, none - 1))
+    , index_(index_size(sessions_.size()))
+    , index_mask_(index_.size() - 1)
+    , size_(0)
+    , free_(0)
+    , wheel_(wheel_slots, none)
+    , current_tick_(INT64_MIN)
+{
+    for (size_t i = 0; i < sessions_.size(); ++i)
+    {
+        sessions_[i].next = i + 1 < sessions_.size() ? static_cast<uint32_t>(i + 1) : none;
+    }
+}
+
+
+bool SessionTable::admit(const sockaddr* address, socklen_t length, size_t bytes, Clock::time_point now, size_t datagrams)
+{
+    Key key;
+
+    if (!make_key(address, length, key))
+    {
+        stats_.admitted += datagrams;
+        return true;
+    }
+
+    expire(now);
+
+    const uint32_t h    = hash(key);
+    size_t         slot = probe(key, h);
+    uint32_t       entry;
+
+    if (index_[slot].entry != 0)
+    {
+        entry = index_[slot].entry - 1;
+    }
+    else
+    {
+        if (size_ == sessions_.size())
+        {
+            const uint32_t victim = oldest();
+            unlink(victim);
+            destroy(victim);
+            ++stats_.evicted;
+            // Deletion shifts the index.
+            slot = probe(key, h);
+        }
+        entry = create(key, h, slot, now);
+    }
+
+    Session& s = sessions_[entry];
+
+    if (now > s.last_seen)
+    {
+        if (rate_ > 0)
+        {
+            const double elapsed = std::chrono::duration<double>(now - s.last_seen).count();
+            s.tokens             = std::min(burst_, s.tokens + elapsed * rate_);
+        }
+        s.last_seen = now;
+    }
+
+    if (rate_ > 0)
+    {
+        if (s.tokens < 1)
+        {
+            s.dropped += datagrams;
+            stats_.dropped += datagrams;
+            return false;
+        }
+        s.tokens -= datagrams;
+    }
+
+    s.datagrams += datagrams;
+    s.bytes += bytes;
+    stats_.admitted += datagrams;
+
+    return true;
+}
+
+
+size_t SessionTable::expire(Clock::time_point now)
+{
+    const int64_t now_tick = tick_of(now);
+
+    if (current_tick_ == INT64_MIN) current_tick_ = now_tick;
+    // One turn visits every session.
+    if (now_tick - current_tick_ > static_cast<int64_t>(wheel_slots)) current_tick_ = now_tick - wheel_slots;
+
+    size_t expired = 0;
+
+    for (; current_tick_ < now_tick; ++current_tick_)
+    {
+        const size_t w     = current_tick_ & (wheel_slots - 1);
+        uint32_t     entry = wheel_[w];
+
+        wheel_[w] = none;
+
+        while (entry != none)
+        {
+            const uint32_t next     = sessions_[entry].next;
+            const auto     deadline = sessions_[entry].last_seen + idle_timeout_;
+
+            if (deadline <= now)
+            {
+                destroy(entry);
+                ++expired;
+            }
+            else
+            {
+                // Seen since it was scheduled.
+                link(entry, tick_of(deadline));
+            }
+
+            entry = next;
+        }
+    }
+
+    stats_.expired += expired;
+
+    return expired;
+}
+
+
+const SessionTable::Session* SessionTable::find(const sockaddr* address, socklen_t length) const
+{
+    Key key;
+
+    if (!make_key(address, length, key)) return nullptr;
+
+    const Slot& slot = index_[probe(key, hash(key))];
+
+    return slot.entry != 0 ? &sessions_[slot.entry - 1] : nullptr;
+}
+
+
+bool SessionTable::make_key(const sockaddr* address, socklen_t length, Key& key)
+{
+    std::memset(&key, 0, sizeof(key));
+
+    if (address->sa_family == AF_INET && length >= static_cast<socklen_t>(sizeof(sockaddr_in)))
+    {
+        const auto& in = *reinterpret_cast<const sockaddr_in*>(address);
+        std::memcpy(key.address, &in.sin_addr, sizeof(in.sin_addr));
+        key.port = in.sin_port;
+    }
+    else if (address->sa_family == AF_INET6 && length >= static_cast<socklen_t>(sizeof(sockaddr_in6)))
+    {
+        const auto& in6 = *reinterpret_cast<const sockaddr_in6*>(address);
+        std::memcpy(key.address, &in6.sin6_addr, sizeof(in6.sin6_addr));
+        key.port = in6.sin6_port;
+    }
+    else
+    {
+        return false;
+    }
+
+    key.family = address->sa_family;
+
+    return true;
+}
+
+
+uint32_t SessionTable::hash(const Key& key) const
+{
+    uint64_t words[2];
+    std::memcpy(words, key.address, sizeof(words));
+
+    uint64_t h = seed_;
+    h          = mix(h ^ words[0]);
+    h          = mix(h ^ words[1]);
+    h          = mix(h ^ (key.port | static_cast<uint64_t>(key.family) << 16));
+
+    return static_cast<uint32_t>(h ^ (h >> 32));
+}
+
+
+size_t SessionTable::probe(const Key& key, uint32_t h) const
+{
+    for (size_t i = h & index_mask_;; i = (i + 1) & index_mask_)
+    {
+        const Slot& slot = index_[i];
+
+        if (slot.entry == 0) return i;
+        if (slot.hash == h && sessions_[slot.entry - 1].key == key) return i;
+    }
+}
+
+
+uint32_t SessionTable::create(const Key& key, uint32_t h, size_t slot, Clock::time_point now)
+{
+    const uint32_t entry = free_;
+    Session&       s     = sessions_[entry];
+
+    free_ = s.next;
+
+    s.key       = key;
+    s.hash      = h;
+    s.last_seen = now;
+    s.tokens    = burst_;
+    s.datagrams = 0;
+    s.bytes     = 0;
+    s.dropped   = 0;
+
+    index_[slot] = { h, entry + 1 };
+    link(entry, tick_of(now + idle_timeout_));
+
+    ++size_;
+    ++stats_.created;
+
+    return entry;
+}
+
+
+void SessionTable::destroy(uint32_t entry)
+{
+    Session& s = sessions_[entry];
+
+    erase_slot(probe(s.key, s.hash));
+
+    s.next = free_;
+    free_  = entry;
+    --size_;
+}
+
+
+// Backward shift: the entries after the hole that may live in it move up,
+// so no tombstones build up with churn.
+void SessionTable::erase_slot(size_t slot)
+{
+    size_t hole = slot;
+
+    for (size_t i = (hole + 1) & index_mask_; index_[i].entry != 0; i = (i + 1) & index_mask_)
+    {
+        const size_t home = index_[i].hash & index_mask_;
+
+        // Whether `home` lies cyclically in (hole, i]: then it stays.
+        const bool stays = hole <= i ? (hole < home && home <= i) : (hole < home || home <= i);
+        if (!stays)
+        {
+            index_[hole] = index_[i];
+            hole         = i;
+        }
+    }
+
+    index_[hole] = { 0, 0 };
+}
+
+
+int64_t SessionTable::tick_of(Clock::time_point time) const
+{
+    return time.time_since_epoch() / tick_;
+}
+
+
+void SessionTable::link(uint32_t entry, int64_t tick)
+{
+    Session&     s = sessions_[entry];
+    const size_t w = tick & (wheel_slots - 1);
+
+    s.wheel = static_cast<uint32_t>(w);
+    s.prev  = none;
+    s.next  = wheel_[w];
+
+    if (s.next != none) sessions_[s.next].prev = entry;
+    wheel_[w] = entry;
+}
+
+
+void SessionTable::unlink(uint32_t entry)
+{
+    const Session& s = sessions_[entry];
+
+    if (s.prev != none)
+        sessions_[s.prev].next = s.next;
+    else
+        wheel_[s.wheel] = s.next;
+
+    if (s.next != none) sessions_[s.next].prev = s.prev;
+}
+
+
+uint32_t SessionTable::oldest() const
+{
+    for (size_t k = 0; k < wheel_slots; ++k)
+    {
+        const uint32_t entry = wheel_[(current_tick_ + k) & (wheel_slots - 1)];
+        if (entry != none) return entry;
+    }
+
+    return none;
+}
+
+} // socket_wrapper
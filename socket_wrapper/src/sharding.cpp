@@ -0,0 +1,96 @@
+#include <socket_wrapper/sharding.h>
+
+#include <cerrno>
+
+#include <pthread.h>
+#include <sched.h>
+
+#include <linux/filter.h>
+
+
+namespace socket_wrapper
+{
+
+std::vector<unsigned> allowed_cpus()
+{
+    std::vector<unsigned> result;
+    cpu_set_t             set;
+
+    CPU_ZERO(&set);
+    if (sched_getaffinity(0, sizeof(set), &set) != 0) return result;
+
+    for (unsigned cpu = 0; cpu < CPU_SETSIZE; ++cpu)
+    {
+        if (CPU_ISSET(cpu, &set)) result.push_back(cpu);
+    }
+
+    return result;
+}
+
+
+int pin_current_thread(unsigned cpu)
+{
+    cpu_set_t set;
+
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+
+    int status = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+    if (status != 0)
+    {
+        errno = status;
+        return -1;
+    }
+
+    return 0;
+}
+
+
+int enable_reuseport(SocketDescriptorType sock)
+{
+    int on = 1;
+
+    return setsockopt(sock, SOL_SOCKET, SO_REUSEPORT, &on, sizeof(on));
+}
+
+
+int set_incoming_cpu(SocketDescriptorType sock, unsigned cpu)
+{
+    int value = static_cast<int>(cpu);
+
+    return setsockopt(sock, SOL_SOCKET, SO_INCOMING_CPU, &value, sizeof(value));
+}
+
+
+int attach_reuseport_cpu_steering(SocketDescriptorType sock, const std::vector<unsigned>& shard_cpus)
+{
+    const auto group_size = static_cast<__u32>(shard_cpus.size());
+
+    // A compare and a return per socket, plus the load and the fallback.
+    if (group_size == 0 || 2 * shard_cpus.size() + 3 > BPF_MAXINSNS)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+
+    // A = current CPU
+    std::vector<sock_filter> code = { { BPF_LD | BPF_W | BPF_ABS, 0, 0, static_cast<__u32>(SKF_AD_OFF + SKF_AD_CPU) } };
+
+    for (__u32 i = 0; i < group_size; ++i)
+    {
+        // if A == shard_cpus[i] return i
+        code.push_back({ BPF_JMP | BPF_JEQ | BPF_K, 0, 1, shard_cpus[i] });
+        code.push_back({ BPF_RET | BPF_K, 0, 0, i });
+    }
+
+    // A = A % group_size
+    code.push_back({ BPF_ALU | BPF_MOD | BPF_K, 0, 0, group_size });
+    // return A, the socket index in the group
+    code.push_back({ BPF_RET | BPF_A, 0, 0, 0 });
+
+    sock_fprog program = { .len = static_cast<unsigned short>(code.size()), .filter = code.data() };
+
+    return setsockopt(sock, SOL_SOCKET, SO_ATTACH_REUSEPORT_CBPF, &program, sizeof(program));
+}
+
+}
@@ -0,0 +1,719 @@
+#include <socket_wrapper/shm_transport.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <climits>
+#include <cstddef>
+#include <cstring>
+#include <new>
+
+#include <fcntl.h>
+#include <linux/futex.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+
+namespace socket_wrapper
+{
+
+namespace
+{
+
+const uint32_t shm_magic   = 0x53484d51; // "SHMQ"
+const uint32_t shm_version = 1;
+const size_t   cache_line  = 64;
+
+// Waits are cut into slices of this, so a peer that died is noticed.
+const std::chrono::milliseconds liveness_interval(100);
+
+
+// A futex word and the number of threads sleeping on it, so that the
+// producer of an item only makes a syscall when somebody waits.
+struct EventCount
+{
+    std::atomic<uint32_t> sequence;
+    std::atomic<uint32_t> waiters;
+};
+
+
+struct RingHeader
+{
+    alignas(cache_line) std::atomic<uint64_t> tail; // next slot to claim (producers)
+    alignas(cache_line) std::atomic<uint64_t> head; // next slot to read (consumer)
+    alignas(cache_line) EventCount readable;        // the consumer waits
+    alignas(cache_line) EventCount writable;        // producers wait
+};
+
+
+// Free for the producer claiming position p when sequence == p, holds the
+// datagram of position p when sequence == p + 1.
+struct SlotHeader
+{
+    std::atomic<uint64_t> sequence;
+    uint32_t              length;
+    uint32_t              client;
+};
+
+
+struct Header
+{
+    uint32_t              magic;
+    uint32_t              version;
+    uint32_t              slot_size;
+    uint32_t              slots;
+    uint32_t              reply_slots;
+    uint32_t              max_clients;
+    int32_t               server_pid;
+    std::atomic<uint32_t> ready; // 0 before the server is set up and after it is gone
+};
+
+
+static_assert(std::atomic<uint32_t>::is_always_lock_free && std::atomic<uint64_t>::is_always_lock_free,
+              "Atomics in shared memory must be lock-free");
+
+
+size_t round_up(size_t size, size_t alignment)
+{
+    return (size + alignment - 1) / alignment * alignment;
+}
+
+
+size_t round_up_pow2(size_t n)
+{
+    size_t result = 1;
+    while (result < n) result *= 2;
+
+    return result;
+}
+
+
+// Offsets in the mapping: the header, the client table (one pid per client
+// id, 0 when free), the request ring and the reply rings.
+struct Layout
+{
+    explicit Layout(const Header& header)
+        : stride(round_up(sizeof(SlotHeader) + header.slot_size, cache_line))
+        , clients(round_up(sizeof(Header), cache_line))
+        , requests(round_up(clients + header.max_clients * sizeof(std::atomic<int32_t>), cache_line))
+        , replies(requests + ring_size(header.slots))
+        , reply_size(ring_size(header.reply_slots))
+        , total(replies + header.max_clients * reply_size)
+    {
+    }
+
+    size_t ring_size(size_t slots) const { return sizeof(RingHeader) + slots * stride; }
+
+    size_t stride;
+    size_t clients;
+    size_t requests;
+    size_t replies;
+    size_t reply_size;
+    size_t total;
+};
+
+
+void futex_wait(std::atomic<uint32_t>& word, uint32_t value, std::chrono::nanoseconds timeout)
+{
+    const auto seconds = std::chrono::duration_cast<std::chrono::seconds>(timeout);
+    timespec   ts      = { .tv_sec = seconds.count(), .tv_nsec = (timeout - seconds).count() };
+
+    // Not FUTEX_PRIVATE_FLAG: the word is shared between processes.
+    syscall(SYS_futex, reinterpret_cast<uint32_t*>(&word), FUTEX_WAIT, value, &ts, nullptr, 0);
+}
+
+
+void futex_wake(std::atomic<uint32_t>& word)
+{
+    syscall(SYS_futex, reinterpret_cast<uint32_t*>(&word), FUTEX_WAKE, INT_MAX, nullptr, nullptr, 0);
+}
+
+
+void notify(EventCount& event)
+{
+    // Pairs with the waiter's increment before its last look at the ring:
+    // either the waiter sees the new item or this sees the waiter.
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+
+    if (event.waiters.load(std::memory_order_relaxed) == 0) return;
+
+    event.sequence.fetch_add(1, std::memory_order_relaxed);
+    futex_wake(event.sequence);
+}
+
+
+// Sleeps until `event` is notified or `timeout` passes, unless ready()
+// holds already. Returns ready().
+template <typename Ready>
+bool wait_for(EventCount& event, std::chrono::nanoseconds timeout, Ready&& ready)
+{
+    if (ready()) return true;
+
+    event.waiters.fetch_add(1);
+    const uint32_t key = event.sequence.load();
+
+    if (!ready()) futex_wait(event.sequence, key, timeout);
+
+    event.waiters.fetch_sub(1);
+
+    return ready();
+}
+
+
+// View of a ring in the mapping, `slots` is a power of two.
+class Ring
+{
+public:
+    Ring(char* base, uint32_t slots, size_t stride)
+        : header_(reinterpret_cast<RingHeader*>(base))
+        , slots_(base + sizeof(RingHeader))
+        , mask_(slots - 1)
+        , stride_(stride)
+    {
+    }
+
+public:
+    void init()
+    {
+        new (header_) RingHeader{};
+
+        for (uint64_t i = 0; i <= mask_; ++i)
+        {
+            new (&slot(i)) SlotHeader{};
+            slot(i).sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    // False if the ring is full.
+    bool push(const char* data, size_t len, uint32_t client)
+    {
+        uint64_t pos = header_->tail.load(std::memory_order_relaxed);
+
+        for (;;)
+        {
+            const uint64_t sequence = slot(pos).sequence.load(std::memory_order_acquire);
+            const int64_t  diff     = static_cast<int64_t>(sequence - pos);
+
+            if (diff == 0)
+            {
+                if (header_->tail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) break;
+            }
+            else if (diff < 0)
+            {
+                return false;
+            }
+            else
+            {
+                // Claimed by another producer meanwhile.
+                pos = header_->tail.load(std::memory_order_relaxed);
+            }
+        }
+
+        SlotHeader& s = slot(pos);
+
+        s.length = static_cast<uint32_t>(len);
+        s.client = client;
+        std::memcpy(payload(s), data, len);
+        s.sequence.store(pos + 1, std::memory_order_release);
+
+        notify(header_->readable);
+
+        return true;
+    }
+
+    // False if the ring is empty. Copies at most `len` bytes, `length` is
+    // the full length of the datagram.
+    bool pop(char* data, size_t len, size_t& length, uint32_t& client)
+    {
+        const uint64_t pos = header_->head.load(std::memory_order_relaxed);
+        SlotHeader&    s   = slot(pos);
+
+        if (s.sequence.load(std::memory_order_acquire) != pos + 1) return false;
+
+        length = s.length;
+        client = s.client;
+        std::memcpy(data, payload(s), std::min<size_t>(len, length));
+
+        s.sequence.store(pos + mask_ + 1, std::memory_order_release);
+        header_->head.store(pos + 1, std::memory_order_relaxed);
+
+        notify(header_->writable);
+
+        return true;
+    }
+
+    bool readable() const
+    {
+        const uint64_t pos = header_->head.load(std::memory_order_relaxed);
+
+        return slot(pos).sequence.load(std::memory_order_acquire) == pos + 1;
+    }
+
+    bool writable() const
+    {
+        const uint64_t pos = header_->tail.load(std::memory_order_relaxed);
+
+        return slot(pos).sequence.load(std::memory_order_acquire) == pos;
+    }
+
+    EventCount& readable_event() { return header_->readable; }
+    EventCount& writable_event() { return header_->writable; }
+
+private:
+    SlotHeader& slot(uint64_t pos) const
+    {
+        return *reinterpret_cast<SlotHeader*>(slots_ + (pos & mask_) * stride_);
+    }
+
+    static char* payload(SlotHeader& s) { return reinterpret_cast<char*>(&s + 1); }
+
+private:
+    RingHeader* header_;
+    char*       slots_;
+    uint64_t    mask_;
+    size_t      stride_;
+};
+
+
+Header& header_of(const detail::ShmMapping& mapping)
+{
+    return *reinterpret_cast<Header*>(mapping.data());
+}
+
+
+std::atomic<int32_t>& client_pid(const detail::ShmMapping& mapping, uint32_t id)
+{
+    const Layout layout(header_of(mapping));
+
+    return reinterpret_cast<std::atomic<int32_t>*>(mapping.data() + layout.clients)[id];
+}
+
+
+Ring request_ring(const detail::ShmMapping& mapping)
+{
+    const Header& header = header_of(mapping);
+    const Layout  layout(header);
+
+    return Ring(mapping.data() + layout.requests, header.slots, layout.stride);
+}
+
+
+Ring reply_ring(const detail::ShmMapping& mapping, uint32_t id)
+{
+    const Header& header = header_of(mapping);
+    const Layout  layout(header);
+
+    return Ring(mapping.data() + layout.replies + id * layout.reply_size, header.reply_slots, layout.stride);
+}
+
+
+bool process_alive(int32_t pid)
+{
+    // EPERM: it exists, under another user.
+    return kill(pid, 0) == 0 || errno != ESRCH;
+}
+
+
+// Removes the object `name` if the server that created it is gone. False with
+// errno set if it cannot tell, EADDRINUSE if that server still runs.
+bool unlink_stale(const std::string& name)
+{
+    const int fd = shm_open(name.c_str(), O_RDONLY, 0);
+    if (fd < 0) return errno == ENOENT;
+
+    int32_t     pid = 0;
+    struct stat st;
+
+    // A header not written yet names no server.
+    if (fstat(fd, &st) == 0 && static_cast<size_t>(st.st_size) >= sizeof(Header))
+    {
+        void* data = mmap(nullptr, sizeof(Header), PROT_READ, MAP_SHARED, fd, 0);
+        if (data != MAP_FAILED)
+        {
+            const Header& header = *static_cast<const Header*>(data);
+            if (header.magic == shm_magic) pid = header.server_pid;
+            munmap(data, sizeof(Header));
+        }
+    }
+    close(fd);
+
+    if (pid != 0 && process_alive(pid))
+    {
+        errno = EADDRINUSE;
+        return false;
+    }
+
+    return shm_unlink(name.c_str()) == 0 || errno == ENOENT;
+}
+
+
+// The receive side of both ends: pops one datagram or waits for one as long
+// as `timeout` (0: forever) and alive() allow.
+template <typename Alive>
+ssize_t receive(Ring& ring, char* data, size_t len, uint32_t& client, int flags, std::chrono::microseconds timeout, Alive&& alive)
+{
+    using Clock = std::chrono::steady_clock;
+
+    const auto deadline = timeout.count() > 0 ? Clock::now() + timeout : Clock::time_point::max();
+
+    for (;;)
+    {
+        size_t length;
+        if (ring.pop(data, len, length, client))
+        {
+            return static_cast<ssize_t>((flags & MSG_TRUNC) ? length : std::min(len, length));
+        }
+
+        if (flags & MSG_DONTWAIT)
+        {
+            errno = EAGAIN;
+            return -1;
+        }
+
+        if (!alive())
+        {
+            errno = ECONNREFUSED;
+            return -1;
+        }
+
+        const auto now = Clock::now();
+        if (now >= deadline)
+        {
+            errno = EAGAIN;
+            return -1;
+        }
+
+        wait_for(ring.readable_event(),
+                 std::min<Clock::duration>(deadline - now, liveness_interval),
+                 [&] { return ring.readable(); });
+    }
+}
+
+}
+
+
+namespace detail
+{
+
+ShmMapping::~ShmMapping()
+{
+    if (data_) munmap(data_, size_);
+    if (owner_) shm_unlink(name_.c_str());
+}
+
+
+bool ShmMapping::create(const std::string& name, size_t size)
+{
+    // Left over by a server that did not exit cleanly; a running server's
+    // object is not taken over.
+    if (!unlink_stale(name)) return false;
+
+    const int fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+    if (fd < 0) return false;
+
+    name_  = name;
+    owner_ = true;
+
+    if (ftruncate(fd, size) != 0)
+    {
+        close(fd);
+        return false;
+    }
+
+    void* data = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+
+    if (data == MAP_FAILED) return false;
+
+    data_ = static_cast<char*>(data);
+    size_ = size;
+
+    return true;
+}
+
+
+bool ShmMapping::open(const std::string& name)
+{
+    const int fd = shm_open(name.c_str(), O_RDWR, 0);
+    if (fd < 0) return false;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0)
+    {
+        close(fd);
+        return false;
+    }
+
+    void* data = mmap(nullptr, st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+
+    if (data == MAP_FAILED) return false;
+
+    name_ = name;
+    data_ = static_cast<char*>(data);
+    size_ = st.st_size;
+
+    return true;
+}
+
+} // detail
+
+
+ShmServer::ShmServer(const std::string& name, size_t slots, size_t slot_size, size_t max_clients, size_t reply_slots)
+    : opened_(false)
+    , receive_timeout_(0)
+{
+    Header header      = {};
+    header.magic       = shm_magic;
+    header.version     = shm_version;
+    header.slot_size   = static_cast<uint32_t>(std::clamp<size_t>(slot_size, 1, UINT16_MAX));
+    header.slots       = static_cast<uint32_t>(round_up_pow2(std::clamp<size_t>(slots, 2, 1 << 20)));
+    header.reply_slots = static_cast<uint32_t>(round_up_pow2(std::clamp<size_t>(reply_slots, 2, 1 << 20)));
+    header.max_clients = static_cast<uint32_t>(std::clamp<size_t>(max_clients, 1, 4096));
+    header.server_pid  = getpid();
+
+    const Layout layout(header);
+
+    // The pages stay zero, and unbacked, until a ring first reaches them.
+    if (!mapping_.create(name, layout.total)) return;
+
+    Header& shared = *new (mapping_.data()) Header{};
+
+    shared.magic       = header.magic;
+    shared.version     = header.version;
+    shared.slot_size   = header.slot_size;
+    shared.slots       = header.slots;
+    shared.reply_slots = header.reply_slots;
+    shared.max_clients = header.max_clients;
+    shared.server_pid  = header.server_pid;
+
+    for (uint32_t id = 0; id < header.max_clients; ++id)
+    {
+        new (&client_pid(mapping_, id)) std::atomic<int32_t>(0);
+        reply_ring(mapping_, id).init();
+    }
+    request_ring(mapping_).init();
+
+    shared.ready.store(1, std::memory_order_release);
+    opened_ = true;
+}
+
+
+ShmServer::~ShmServer()
+{
+    if (opened_) header_of(mapping_).ready.store(0, std::memory_order_release);
+}
+
+
+size_t ShmServer::max_datagram_size() const
+{
+    return opened_ ? header_of(mapping_).slot_size : 0;
+}
+
+
+ssize_t ShmServer::recv_from(char* data, size_t len, sockaddr* from, socklen_t* from_len, int flags)
+{
+    if (!opened_)
+    {
+        errno = EBADF;
+        return -1;
+    }
+
+    Ring     ring = request_ring(mapping_);
+    uint32_t id   = 0;
+
+    const ssize_t result = receive(ring, data, len, id, flags, receive_timeout_, [] { return true; });
+
+    if (result >= 0 && from && from_len)
+    {
+        // Abstract AF_UNIX name: a NUL, then the client id.
+        sockaddr_un address = { .sun_family = AF_UNIX };
+        std::memcpy(address.sun_path + 1, &id, sizeof(id));
+
+        const socklen_t length = offsetof(sockaddr_un, sun_path) + 1 + sizeof(id);
+        std::memcpy(from, &address, std::min(*from_len, length));
+        *from_len = length;
+    }
+
+    return result;
+}
+
+
+ssize_t ShmServer::send_to(const char* data, size_t len, const sockaddr* to, socklen_t to_len, int)
+{
+    uint32_t id;
+
+    if (!opened_)
+    {
+        errno = EBADF;
+        return -1;
+    }
+
+    if (!client_id(to, to_len, id) || id >= header_of(mapping_).max_clients)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+
+    if (len > header_of(mapping_).slot_size)
+    {
+        errno = EMSGSIZE;
+        return -1;
+    }
+
+    if (client_pid(mapping_, id).load(std::memory_order_relaxed) == 0)
+    {
+        errno = ECONNREFUSED;
+        return -1;
+    }
+
+    if (!reply_ring(mapping_, id).push(data, len, id))
+    {
+        errno = EAGAIN;
+        return -1;
+    }
+
+    return static_cast<ssize_t>(len);
+}
+
+
+bool ShmServer::client_id(const sockaddr* address, socklen_t len, uint32_t& id)
+{
+    const auto& un = *reinterpret_cast<const sockaddr_un*>(address);
+
+    if (len != offsetof(sockaddr_un, sun_path) + 1 + sizeof(id) || un.sun_family != AF_UNIX || un.sun_path[0] != 0)
+    {
+        return false;
+    }
+
+    std::memcpy(&id, un.sun_path + 1, sizeof(id));
+
+    return true;
+}
+
+
+ShmClient::ShmClient(const std::string& name)
+    : opened_(false)
+    , id_(0)
+    , receive_timeout_(0)
+{
+    if (!mapping_.open(name)) return;
+
+    const Header& header = header_of(mapping_);
+
+    if (mapping_.size() < sizeof(Header) || header.ready.load(std::memory_order_acquire) == 0)
+    {
+        errno = ECONNREFUSED;
+        return;
+    }
+
+    if (header.magic != shm_magic || header.version != shm_version || Layout(header).total > mapping_.size())
+    {
+        errno = EPROTO;
+        return;
+    }
+
+    const int32_t self = getpid();
+
+    for (uint32_t id = 0; id < header.max_clients; ++id)
+    {
+        auto&   pid   = client_pid(mapping_, id);
+        int32_t owner = pid.load();
+
+        if ((owner == 0 || (owner != self && !process_alive(owner))) && pid.compare_exchange_strong(owner, self))
+        {
+            id_     = id;
+            opened_ = true;
+            break;
+        }
+    }
+
+    if (!opened_)
+    {
+        errno = EUSERS;
+        return;
+    }
+
+    // Replies the previous owner of the id left behind.
+    Ring     ring = reply_ring(mapping_, id_);
+    char     discard;
+    size_t   length;
+    uint32_t client;
+    while (ring.pop(&discard, 0, length, client)) {}
+}
+
+
+ShmClient::~ShmClient()
+{
+    if (opened_) client_pid(mapping_, id_).store(0);
+}
+
+
+size_t ShmClient::max_datagram_size() const
+{
+    return opened_ ? header_of(mapping_).slot_size : 0;
+}
+
+
+ssize_t ShmClient::send(const char* data, size_t len, int flags)
+{
+    if (!opened_)
+    {
+        errno = EBADF;
+        return -1;
+    }
+
+    const Header& header = header_of(mapping_);
+
+    if (len > header.slot_size)
+    {
+        errno = EMSGSIZE;
+        return -1;
+    }
+
+    Ring ring = request_ring(mapping_);
+
+    while (!ring.push(data, len, id_))
+    {
+        if (flags & MSG_DONTWAIT)
+        {
+            errno = EAGAIN;
+            return -1;
+        }
+
+        if (header.ready.load(std::memory_order_acquire) == 0 || !process_alive(header.server_pid))
+        {
+            errno = ECONNREFUSED;
+            return -1;
+        }
+
+        // A full queue blocks, as a full socket send buffer does.
+        wait_for(ring.writable_event(), liveness_interval, [&] { return ring.writable(); });
+    }
+
+    return static_cast<ssize_t>(len);
+}
+
+
+ssize_t ShmClient::recv(char* data, size_t len, int flags)
+{
+    if (!opened_)
+    {
+        errno = EBADF;
+        return -1;
+    }
+
+    const Header& header = header_of(mapping_);
+    Ring          ring   = reply_ring(mapping_, id_);
+    uint32_t      id;
+
+    return receive(ring, data, len, id, flags, receive_timeout_, [&] {
+        return header.ready.load(std::memory_order_acquire) != 0 && process_alive(header.server_pid);
+    });
+}
+
+} // socket_wrapper
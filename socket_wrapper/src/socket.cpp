@@ -6,9 +6,12 @@
 #ifdef _WIN32
     constexpr auto close_type = SD_BOTH;
 #   define close_socket closesocket
+#   define ioctl_socket ioctlsocket
 #else
+#   include <sys/ioctl.h>
     constexpr auto close_type = SHUT_RDWR;
 #   define close_socket ::close
+#   define ioctl_socket ::ioctl
 #endif
 
 
@@ -74,5 +77,12 @@ int Socket::close()
 
 }
 
+
+int Socket::set_nonblocking(bool enabled)
+{
+    IoctlType mode = enabled ? 1 : 0;
+
+    return ioctl_socket(socket_descriptor_, FIONBIO, &mode);
 }
 
+}
@@ -0,0 +1,60 @@
+#include <socket_wrapper/socket_message.h>
+
+
+namespace socket_wrapper
+{
+
+ssize_t send_message(SocketDescriptorType   sock,
+                     std::span<const iovec> buffers,
+                     const sockaddr*        to,
+                     socklen_t              to_len,
+                     std::span<const char>  control,
+                     int                    flags)
+{
+    msghdr msg = {};
+
+    msg.msg_name       = const_cast<sockaddr*>(to);
+    msg.msg_namelen    = to ? to_len : 0;
+    msg.msg_iov        = const_cast<iovec*>(buffers.data());
+    msg.msg_iovlen     = buffers.size();
+    msg.msg_control    = control.empty() ? nullptr : const_cast<char*>(control.data());
+    msg.msg_controllen = control.size();
+
+    return sendmsg(sock, &msg, flags);
+}
+
+
+ssize_t receive_message(SocketDescriptorType   sock,
+                        std::span<const iovec> buffers,
+                        ReceivedMessage&       message,
+                        sockaddr*              from,
+                        socklen_t              from_len,
+                        std::span<char>        control,
+                        int                    flags)
+{
+    msghdr msg = {};
+
+    msg.msg_name       = from;
+    msg.msg_namelen    = from ? from_len : 0;
+    msg.msg_iov        = const_cast<iovec*>(buffers.data());
+    msg.msg_iovlen     = buffers.size();
+    msg.msg_control    = control.empty() ? nullptr : control.data();
+    msg.msg_controllen = control.size();
+
+    const ssize_t result = recvmsg(sock, &msg, flags);
+
+    if (result < 0)
+    {
+        message = {};
+        return result;
+    }
+
+    message.length         = static_cast<size_t>(result);
+    message.address_length = msg.msg_namelen;
+    message.flags          = msg.msg_flags;
+    message.control        = ControlMessages(msg);
+
+    return result;
+}
+
+} // socket_wrapper
@@ -0,0 +1,127 @@
+#include <socket_wrapper/socket_options.h>
+
+#include <cerrno>
+
+
+namespace socket_wrapper
+{
+
+namespace
+{
+
+// DSCP Expedited Forwarding (46) in the upper six bits of the TOS byte.
+const int dscp_expedited_forwarding = 46 << 2;
+
+const int low_latency_buffer     = 256 * 1024;
+const int high_throughput_buffer = 16 * 1024 * 1024;
+const int busy_poll_us           = 50;
+const int busy_poll_budget       = 8;
+
+
+// Sets `value`, reporting a failure under the option's name.
+template <SocketOptionType Option>
+bool apply(SocketDescriptorType                               sock,
+           const char*                                        name,
+           const typename Option::value_type&                 value,
+           const std::function<void(const char*, int error)>& on_failure)
+{
+    if (set_option<Option>(sock, value) == 0) return true;
+
+    if (on_failure) on_failure(name, errno);
+    return false;
+}
+
+
+// SO_*BUFFORCE where permitted, the capped SO_*BUF otherwise.
+template <SocketOptionType Force, SocketOptionType Capped>
+bool apply_buffer(SocketDescriptorType                               sock,
+                  const char*                                        name,
+                  int                                                size,
+                  const std::function<void(const char*, int error)>& on_failure)
+{
+    if (set_option<Force>(sock, size) == 0) return true;
+
+    return apply<Capped>(sock, name, size, on_failure);
+}
+
+}
+
+
+bool parse_socket_profile(const std::string& name, SocketProfile& profile)
+{
+    if ("none" == name)
+        profile = SocketProfile::none;
+    else if ("low-latency" == name)
+        profile = SocketProfile::low_latency;
+    else if ("high-throughput" == name)
+        profile = SocketProfile::high_throughput;
+    else
+        return false;
+
+    return true;
+}
+
+
+const char* socket_profile_name(SocketProfile profile)
+{
+    switch (profile)
+    {
+        case SocketProfile::low_latency:
+            return "low-latency";
+        case SocketProfile::high_throughput:
+            return "high-throughput";
+        default:
+            return "none";
+    }
+}
+
+
+int apply_socket_profile(SocketDescriptorType                               sock,
+                         SocketProfile                                      profile,
+                         const std::function<void(const char*, int error)>& on_failure)
+{
+    if (profile == SocketProfile::none) return 0;
+
+    int type   = 0;
+    int domain = 0;
+    if (get_option<option::Type>(sock, type) != 0 || get_option<option::Domain>(sock, domain) != 0)
+    {
+        if (on_failure) on_failure("SO_TYPE", errno);
+        return -1;
+    }
+
+    const bool stream = type == SOCK_STREAM;
+    bool       ok     = true;
+
+    if (profile == SocketProfile::low_latency)
+    {
+        ok &= apply<option::BusyPoll>(sock, "SO_BUSY_POLL", busy_poll_us, on_failure);
+        ok &= apply<option::PreferBusyPoll>(sock, "SO_PREFER_BUSY_POLL", true, on_failure);
+        ok &= apply<option::BusyPollBudget>(sock, "SO_BUSY_POLL_BUDGET", busy_poll_budget, on_failure);
+        ok &= apply<option::ReceiveBuffer>(sock, "SO_RCVBUF", low_latency_buffer, on_failure);
+        ok &= apply<option::SendBuffer>(sock, "SO_SNDBUF", low_latency_buffer, on_failure);
+
+        if (domain == AF_INET)
+            ok &= apply<option::TypeOfService>(sock, "IP_TOS", dscp_expedited_forwarding, on_failure);
+        else if (domain == AF_INET6)
+            ok &= apply<option::TrafficClass>(sock, "IPV6_TCLASS", dscp_expedited_forwarding, on_failure);
+
+        if (stream) ok &= apply<option::TcpNoDelay>(sock, "TCP_NODELAY", true, on_failure);
+    }
+    else if (profile == SocketProfile::high_throughput)
+    {
+        ok &= apply_buffer<option::ReceiveBufferForce, option::ReceiveBuffer>(
+            sock, "SO_RCVBUF", high_throughput_buffer, on_failure);
+        ok &= apply_buffer<option::SendBufferForce, option::SendBuffer>(
+            sock, "SO_SNDBUF", high_throughput_buffer, on_failure);
+
+        if (type == SOCK_DGRAM && (domain == AF_INET || domain == AF_INET6))
+        {
+            ok &= apply<option::UdpGro>(sock, "UDP_GRO", true, on_failure);
+        }
+    }
+
+    return ok ? 0 : -1;
+}
+
+} // socket_wrapper
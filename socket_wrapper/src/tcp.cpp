@@ -0,0 +1,367 @@
+#include <socket_wrapper/tcp.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
+#include <fcntl.h>
+#include <linux/errqueue.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/sendfile.h>
+
+#include <socket_wrapper/socket_options.h>
+
+#ifndef SO_ZEROCOPY
+#    define SO_ZEROCOPY 60
+#endif
+#ifndef MSG_ZEROCOPY
+#    define MSG_ZEROCOPY 0x4000000
+#endif
+
+
+namespace socket_wrapper
+{
+
+namespace
+{
+
+// Free space guaranteed to every recv(), the input buffer grows by at least it.
+const size_t read_chunk = 64 * 1024;
+// Bytes moved per splice() pair, the default pipe capacity.
+const size_t pipe_chunk = 64 * 1024;
+
+
+bool would_block(int error)
+{
+    return error == EAGAIN || error == EWOULDBLOCK;
+}
+
+}
+
+
+TcpConnection::TcpConnection(SocketDescriptorType fd) : Socket(fd)
+{
+}
+
+
+TcpConnection::TcpConnection(const sockaddr* addr, socklen_t addr_len)
+    : Socket(addr->sa_family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, IPPROTO_TCP)
+{
+    if (opened() && connect(*this, addr, addr_len) != 0 && errno != EINPROGRESS) close();
+}
+
+
+int TcpConnection::set_nodelay(bool enabled)
+{
+    return set_option<option::TcpNoDelay>(*this, enabled);
+}
+
+
+int TcpConnection::set_cork(bool enabled)
+{
+    return set_option<option::TcpCork>(*this, enabled);
+}
+
+
+int TcpConnection::connect_error() const
+{
+    int       error = 0;
+    socklen_t len   = sizeof(error);
+
+    if (getsockopt(*this, SOL_SOCKET, SO_ERROR, &error, &len) != 0) return errno;
+
+    return error;
+}
+
+
+ssize_t TcpConnection::receive()
+{
+    ssize_t total = 0;
+
+    // Reclaim the consumed front before growing.
+    if (input_start_ == input_end_) input_start_ = input_end_ = 0;
+
+    for (;;)
+    {
+        reserve_input(read_chunk);
+
+        const ssize_t n = recv(*this, input_.get() + input_end_, input_capacity_ - input_end_, 0);
+
+        if (n > 0)
+        {
+            input_end_ += n;
+            total += n;
+            // Not even a short read ends it: a FIN that came with the last
+            // data raises no further edge, only the next recv() reports it.
+            continue;
+        }
+        if (n == 0)
+        {
+            eof_ = true;
+            return total;
+        }
+        if (errno == EINTR) continue;
+
+        return would_block(errno) || total > 0 ? total : -1;
+    }
+}
+
+
+void TcpConnection::consume(size_t n)
+{
+    input_start_ = std::min(input_start_ + n, input_end_);
+
+    if (input_start_ == input_end_) input_start_ = input_end_ = 0;
+}
+
+
+void TcpConnection::reserve_input(size_t n)
+{
+    if (input_capacity_ - input_end_ >= n) return;
+
+    const size_t used = input_end_ - input_start_;
+
+    // Sliding the unread bytes to the front is enough.
+    if (input_capacity_ - used >= n)
+    {
+        std::memmove(input_.get(), input_.get() + input_start_, used);
+    }
+    else
+    {
+        input_capacity_ = std::max(2 * input_capacity_, used + n);
+
+        auto grown = std::make_unique_for_overwrite<char[]>(input_capacity_);
+        if (used > 0) std::memcpy(grown.get(), input_.get() + input_start_, used);
+        input_ = std::move(grown);
+    }
+
+    input_start_ = 0;
+    input_end_   = used;
+}
+
+
+int TcpConnection::write(std::string_view data)
+{
+    // Straight from the caller's buffer when nothing is queued.
+    if (pending() == 0)
+    {
+        while (!data.empty())
+        {
+            const ssize_t n = ::send(*this, data.data(), data.size(), MSG_NOSIGNAL);
+            if (n < 0)
+            {
+                if (errno == EINTR) continue;
+                if (would_block(errno)) break;
+                return -1;
+            }
+            data.remove_prefix(n);
+        }
+    }
+
+    output_.insert(output_.end(), data.begin(), data.end());
+
+    return 0;
+}
+
+
+int TcpConnection::flush()
+{
+    while (pending() > 0)
+    {
+        const ssize_t n = ::send(*this, output_.data() + output_start_, pending(), MSG_NOSIGNAL);
+        if (n < 0)
+        {
+            if (errno == EINTR) continue;
+            return would_block(errno) ? 1 : -1;
+        }
+        output_start_ += n;
+    }
+
+    output_.clear();
+    output_start_ = 0;
+
+    return 0;
+}
+
+
+ssize_t TcpConnection::send_file(int fd, off_t& offset, size_t count)
+{
+    if (pending() > 0 || pipe_bytes_ > 0)
+    {
+        errno = EAGAIN;
+        return -1;
+    }
+
+    for (;;)
+    {
+        const ssize_t n = sendfile(*this, fd, &offset, count);
+        if (n >= 0 || errno != EINTR) return n;
+    }
+}
+
+
+ssize_t TcpConnection::drain_pipe()
+{
+    ssize_t total = 0;
+
+    while (pipe_bytes_ > 0)
+    {
+        const ssize_t n = splice(pipe_read_, nullptr, *this, nullptr, pipe_bytes_, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+        if (n < 0)
+        {
+            if (errno == EINTR) continue;
+            return total > 0 ? total : -1;
+        }
+        pipe_bytes_ -= n;
+        total += n;
+    }
+
+    return total;
+}
+
+
+ssize_t TcpConnection::splice_file(int fd, off_t& offset, size_t count)
+{
+    if (pending() > 0)
+    {
+        errno = EAGAIN;
+        return -1;
+    }
+
+    if (!pipe_read_)
+    {
+        int fds[2];
+        if (pipe2(fds, O_NONBLOCK | O_CLOEXEC) != 0) return -1;
+        // Socket only owns (and closes) the descriptors.
+        pipe_read_  = Socket(fds[0]);
+        pipe_write_ = Socket(fds[1]);
+    }
+
+    // Bytes left in the pipe by the previous call go first.
+    ssize_t total = drain_pipe();
+    if (total < 0) return -1;
+    if (pipe_bytes_ > 0) return total;
+
+    while (count > 0)
+    {
+        const ssize_t in = splice(fd,
+                                  &offset,
+                                  pipe_write_,
+                                  nullptr,
+                                  std::min(count, pipe_chunk),
+                                  SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+        if (in < 0 && errno == EINTR) continue;
+        if (in <= 0) break; // end of file or error
+
+        pipe_bytes_ += in;
+        count -= in;
+
+        const ssize_t out = drain_pipe();
+        if (out < 0) return total > 0 ? total : -1;
+        total += out;
+        if (pipe_bytes_ > 0) break; // socket buffer full
+    }
+
+    return total;
+}
+
+
+int TcpConnection::enable_zerocopy()
+{
+    int value = 1;
+    return setsockopt(*this, SOL_SOCKET, SO_ZEROCOPY, &value, sizeof(value));
+}
+
+
+ssize_t TcpConnection::write_zerocopy(const void* data, size_t len)
+{
+    if (pending() > 0)
+    {
+        errno = EAGAIN;
+        return -1;
+    }
+
+    for (;;)
+    {
+        const ssize_t n = ::send(*this, data, len, MSG_ZEROCOPY | MSG_NOSIGNAL);
+        if (n >= 0)
+        {
+            // The kernel numbers only the calls that queued data.
+            if (n > 0) ++zerocopy_sent_;
+            return n;
+        }
+        if (errno != EINTR) return -1;
+    }
+}
+
+
+int TcpConnection::read_zerocopy_completions()
+{
+    int count = 0;
+
+    for (;;)
+    {
+        char    control[128];
+        msghdr  msg = {};
+        msg.msg_control    = control;
+        msg.msg_controllen = sizeof(control);
+
+        if (recvmsg(*this, &msg, MSG_ERRQUEUE | MSG_DONTWAIT) < 0)
+        {
+            if (errno == EINTR) continue;
+            return would_block(errno) || count > 0 ? count : -1;
+        }
+
+        for (cmsghdr* cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg))
+        {
+            const bool ip_error = (cmsg->cmsg_level == SOL_IP && cmsg->cmsg_type == IP_RECVERR) ||
+                                  (cmsg->cmsg_level == SOL_IPV6 && cmsg->cmsg_type == IPV6_RECVERR);
+            if (!ip_error) continue;
+
+            sock_extended_err err;
+            std::memcpy(&err, CMSG_DATA(cmsg), sizeof(err));
+            if (err.ee_origin != SO_EE_ORIGIN_ZEROCOPY || err.ee_errno != 0) continue;
+
+            // Calls ee_info .. ee_data completed; TCP completes in order.
+            const uint32_t range = err.ee_data - err.ee_info + 1;
+            zerocopy_completed_  = std::max(zerocopy_completed_, err.ee_data + 1);
+            if (err.ee_code & SO_EE_CODE_ZEROCOPY_COPIED) zerocopy_copied_ += range;
+            count += range;
+        }
+    }
+}
+
+
+TcpListener::TcpListener(const sockaddr* addr, socklen_t addr_len, int backlog, bool reuseport)
+    : Socket(addr->sa_family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, IPPROTO_TCP)
+{
+    int enabled = 1;
+
+    if (!opened() || setsockopt(*this, SOL_SOCKET, SO_REUSEADDR, &enabled, sizeof(enabled)) != 0 ||
+        (reuseport && setsockopt(*this, SOL_SOCKET, SO_REUSEPORT, &enabled, sizeof(enabled)) != 0) ||
+        bind(*this, addr, addr_len) != 0 || listen(*this, backlog) != 0)
+    {
+        return;
+    }
+
+    listening_ = true;
+}
+
+
+TcpConnection TcpListener::accept(sockaddr_storage* peer, socklen_t* peer_len)
+{
+    sockaddr_storage address;
+    socklen_t        address_len = sizeof(address);
+
+    for (;;)
+    {
+        const int fd = accept4(*this,
+                               reinterpret_cast<sockaddr*>(peer ? peer : &address),
+                               peer_len ? peer_len : &address_len,
+                               SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd >= 0 || errno != EINTR) return TcpConnection(fd);
+    }
+}
+
+} // socket_wrapper
@@ -0,0 +1,171 @@
+#include <socket_wrapper/timestamping.h>
+#include <socket_wrapper/socket_message.h>
+
+#include <cerrno>
+#include <cstring>
+
+#include <linux/errqueue.h>
+#include <linux/net_tstamp.h>
+#include <linux/sockios.h>
+#include <net/if.h>
+#include <sys/ioctl.h>
+
+
+namespace socket_wrapper
+{
+
+namespace
+{
+
+// SCM_TIMESTAMPING carries three timespecs, a few more for the error queue.
+constexpr size_t control_size = 512;
+
+
+bool nonzero(const timespec& ts)
+{
+    return ts.tv_sec != 0 || ts.tv_nsec != 0;
+}
+
+}
+
+
+int64_t PacketTimestamp::ns() const
+{
+    const timespec& ts = has_hardware() ? hardware : software;
+
+    return static_cast<int64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+}
+
+
+const char* PacketTimestamp::source() const
+{
+    if (has_hardware()) return "hardware";
+    if (has_software()) return "kernel";
+
+    return "none";
+}
+
+
+int enable_timestamping(SocketDescriptorType sock, uint32_t flags)
+{
+    int options = SOF_TIMESTAMPING_SOFTWARE;
+
+    if (flags & timestamp_rx) options |= SOF_TIMESTAMPING_RX_SOFTWARE;
+    if (flags & timestamp_tx) options |= SOF_TIMESTAMPING_TX_SOFTWARE;
+    if (flags & timestamp_hardware)
+    {
+        options |= SOF_TIMESTAMPING_RAW_HARDWARE;
+        if (flags & timestamp_rx) options |= SOF_TIMESTAMPING_RX_HARDWARE;
+        if (flags & timestamp_tx) options |= SOF_TIMESTAMPING_TX_HARDWARE;
+    }
+
+    if (setsockopt(sock, SOL_SOCKET, SO_TIMESTAMPING, &options, sizeof(options)) == 0)
+    {
+        return static_cast<int>(flags);
+    }
+
+    // Older kernels and other socket types still have nanosecond RX stamps.
+    const int on = 1;
+    if ((flags & timestamp_rx) &&
+        setsockopt(sock, SOL_SOCKET, SO_TIMESTAMPNS, &on, sizeof(on)) == 0)
+    {
+        return timestamp_rx;
+    }
+
+    return -1;
+}
+
+
+int enable_hardware_timestamps(SocketDescriptorType sock, const char* interface)
+{
+    hwtstamp_config config = {};
+    ifreq           request = {};
+
+    config.tx_type   = HWTSTAMP_TX_ON;
+    config.rx_filter = HWTSTAMP_FILTER_ALL;
+
+    std::strncpy(request.ifr_name, interface, sizeof(request.ifr_name) - 1);
+    request.ifr_data = reinterpret_cast<char*>(&config);
+
+    return ioctl(sock, SIOCSHWTSTAMP, &request) == 0 ? 0 : -1;
+}
+
+
+bool read_timestamp(const msghdr& msg, PacketTimestamp& ts)
+{
+    ts = {};
+
+    for (const ControlMessage cmsg : ControlMessages(msg))
+    {
+        if (const auto stamps = cmsg.get<control::Timestamping>())
+        {
+            // [0] software, [1] deprecated, [2] raw hardware.
+            ts.software = stamps->ts[0];
+            ts.hardware = stamps->ts[2];
+        }
+        else if (const auto stamp = cmsg.get<control::TimestampNs>())
+        {
+            ts.software = *stamp;
+        }
+    }
+
+    return nonzero(ts.software) || nonzero(ts.hardware);
+}
+
+
+ssize_t recv_timestamped(SocketDescriptorType sock,
+                         void*                buffer,
+                         size_t               len,
+                         int                  flags,
+                         sockaddr*            from,
+                         socklen_t*           from_len,
+                         PacketTimestamp&     ts)
+{
+    alignas(cmsghdr) char control[control_size];
+    iovec                 iov = { buffer, len };
+    msghdr                msg = {};
+
+    msg.msg_name       = from;
+    msg.msg_namelen    = from_len ? *from_len : 0;
+    msg.msg_iov        = &iov;
+    msg.msg_iovlen     = 1;
+    msg.msg_control    = control;
+    msg.msg_controllen = sizeof(control);
+
+    ssize_t result = recvmsg(sock, &msg, flags);
+    if (result < 0) return result;
+
+    if (from_len) *from_len = msg.msg_namelen;
+    read_timestamp(msg, ts);
+
+    return result;
+}
+
+
+ssize_t read_tx_timestamp(SocketDescriptorType sock,
+                          void*                buffer,
+                          size_t               len,
+                          PacketTimestamp&     ts)
+{
+    alignas(cmsghdr) char control[control_size];
+    iovec                 iov = { buffer, len };
+    msghdr                msg = {};
+
+    msg.msg_iov        = &iov;
+    msg.msg_iovlen     = 1;
+    msg.msg_control    = control;
+    msg.msg_controllen = sizeof(control);
+
+    while (true)
+    {
+        ssize_t result = recvmsg(sock, &msg, MSG_ERRQUEUE | MSG_DONTWAIT);
+        if (result < 0) return result;
+
+        // The error queue also holds ICMP errors, skip anything unstamped.
+        if (read_timestamp(msg, ts)) return result;
+
+        msg.msg_controllen = sizeof(control);
+    }
+}
+
+}
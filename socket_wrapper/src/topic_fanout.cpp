@@ -0,0 +1,353 @@
+#include <socket_wrapper/topic_fanout.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
+
+namespace socket_wrapper
+{
+
+namespace
+{
+
+// Finalizer of MurmurHash3, every input bit affects every output bit.
+uint64_t mix(uint64_t h)
+{
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdull;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ull;
+    h ^= h >> 33;
+
+    return h;
+}
+
+}
+
+
+size_t TopicFanout::KeyHash::operator()(const Key& key) const
+{
+    uint64_t words[2];
+    std::memcpy(words, key.address, sizeof(words));
+
+    return mix(mix(words[0]) ^ words[1] ^ (key.port | static_cast<uint64_t>(key.family) << 16));
+}
+
+
+TopicFanout::TopicFanout(const Options& options)
+    : options_(options)
+    , subscriptions_(0)
+    , payload_{ nullptr, 0 }
+{
+}
+
+
+TopicFanout::TopicId TopicFanout::subscribe(std::string_view  topic,
+                                            const sockaddr*   address,
+                                            socklen_t         length,
+                                            Clock::time_point now)
+{
+    Key      key;
+    Endpoint endpoint;
+
+    if (!make_key(address, length, key, endpoint))
+    {
+        ++stats_.rejected;
+        return no_topic;
+    }
+
+    TopicId id = find(topic);
+
+    if (id == no_topic)
+    {
+        if (names_.size() >= options_.max_topics)
+        {
+            ++stats_.rejected;
+            return no_topic;
+        }
+
+        if (free_ids_.empty())
+        {
+            id = static_cast<TopicId>(topics_.size());
+            topics_.emplace_back();
+        }
+        else
+        {
+            id = free_ids_.back();
+            free_ids_.pop_back();
+        }
+        topics_[id].name = topic;
+        names_.emplace(topic, id);
+    }
+
+    Topic& t = topics_[id];
+
+    // Members of a group are known to the network only.
+    if (multicast())
+    {
+        t.used = now;
+        return id;
+    }
+
+    const auto position = t.positions.find(key);
+
+    if (position != t.positions.end())
+    {
+        t.renewed[position->second] = now;
+        return id;
+    }
+
+    if (t.endpoints.size() >= options_.max_subscribers)
+    {
+        if (t.endpoints.empty()) release(id);
+        ++stats_.rejected;
+        return no_topic;
+    }
+
+    t.positions.emplace(key, static_cast<uint32_t>(t.endpoints.size()));
+    t.endpoints.push_back(endpoint);
+    t.renewed.push_back(now);
+    t.stale = true;
+
+    ++subscriptions_;
+    ++stats_.subscribed;
+
+    return id;
+}
+
+
+bool TopicFanout::unsubscribe(std::string_view topic, const sockaddr* address, socklen_t length)
+{
+    Key      key;
+    Endpoint endpoint;
+
+    const TopicId id = find(topic);
+    if (id == no_topic || !make_key(address, length, key, endpoint)) return false;
+
+    Topic&     t        = topics_[id];
+    const auto position = t.positions.find(key);
+    if (position == t.positions.end()) return false;
+
+    remove(id, position->second);
+    ++stats_.unsubscribed;
+
+    return true;
+}
+
+
+size_t TopicFanout::publish(SocketDescriptorType sock, std::string_view topic, std::span<const char> payload)
+{
+    const TopicId id = find(topic);
+
+    ++stats_.published;
+    if (id == no_topic) return 0;
+
+    if (multicast())
+    {
+        const sockaddr_in to = group(id);
+
+        if (sendto(sock, payload.data(), payload.size(), 0, reinterpret_cast<const sockaddr*>(&to), sizeof(to)) < 0)
+        {
+            ++stats_.send_errors;
+            return 0;
+        }
+
+        ++stats_.delivered;
+        return 1;
+    }
+
+    Topic& t = topics_[id];
+    if (t.stale) rebuild(t);
+
+    // Every message of every topic points here.
+    payload_ = { const_cast<char*>(payload.data()), payload.size() };
+
+    const size_t batch = std::clamp<size_t>(options_.batch, 1, UIO_MAXIOV);
+    size_t       sent  = 0;
+
+    for (size_t first = 0; first < t.messages.size(); first += batch)
+    {
+        const size_t count = std::min(batch, t.messages.size() - first);
+        sent += send(sock, &t.messages[first], count);
+    }
+
+    return sent;
+}
+
+
+size_t TopicFanout::expire(Clock::time_point now)
+{
+    if (options_.ttl == Clock::duration::zero()) return 0;
+
+    size_t expired = 0;
+
+    if (multicast())
+    {
+        for (TopicId id = 0; id < topics_.size(); ++id)
+        {
+            if (topics_[id].used != Clock::time_point() && now - topics_[id].used >= options_.ttl) release(id);
+        }
+        return 0;
+    }
+
+    for (TopicId id = 0; id < topics_.size(); ++id)
+    {
+        Topic& t = topics_[id];
+
+        // Backwards: the last subscriber moves into a removed one's place.
+        for (size_t i = t.endpoints.size(); i-- > 0;)
+        {
+            if (now - t.renewed[i] < options_.ttl) continue;
+
+            remove(id, static_cast<uint32_t>(i));
+            ++expired;
+        }
+    }
+
+    stats_.expired += expired;
+
+    return expired;
+}
+
+
+TopicFanout::TopicId TopicFanout::find(std::string_view topic) const
+{
+    const auto it = names_.find(topic);
+
+    return it == names_.end() ? no_topic : it->second;
+}
+
+
+sockaddr_in TopicFanout::group(TopicId topic) const
+{
+    sockaddr_in to     = *options_.multicast;
+    to.sin_addr.s_addr = htonl(ntohl(to.sin_addr.s_addr) + topic);
+
+    return to;
+}
+
+
+bool TopicFanout::make_key(const sockaddr* address, socklen_t length, Key& key, Endpoint& endpoint)
+{
+    std::memset(&key, 0, sizeof(key));
+    std::memset(&endpoint, 0, sizeof(endpoint));
+
+    if (address->sa_family == AF_INET && length >= static_cast<socklen_t>(sizeof(sockaddr_in)))
+    {
+        std::memcpy(&endpoint.in, address, sizeof(endpoint.in));
+        std::memcpy(key.address, &endpoint.in.sin_addr, sizeof(endpoint.in.sin_addr));
+        key.port = endpoint.in.sin_port;
+    }
+    else if (address->sa_family == AF_INET6 && length >= static_cast<socklen_t>(sizeof(sockaddr_in6)))
+    {
+        std::memcpy(&endpoint.in6, address, sizeof(endpoint.in6));
+        std::memcpy(key.address, &endpoint.in6.sin6_addr, sizeof(endpoint.in6.sin6_addr));
+        key.port = endpoint.in6.sin6_port;
+    }
+    else
+    {
+        return false;
+    }
+
+    key.family = address->sa_family;
+
+    return true;
+}
+
+
+// Swaps the last subscriber into the hole, the array stays dense.
+void TopicFanout::remove(TopicId id, uint32_t position)
+{
+    Topic&         topic = topics_[id];
+    const uint32_t last = static_cast<uint32_t>(topic.endpoints.size() - 1);
+    Key            key;
+    Endpoint       endpoint;
+
+    make_key(&topic.endpoints[position].any, sizeof(Endpoint), key, endpoint);
+    topic.positions.erase(key);
+
+    if (position != last)
+    {
+        topic.endpoints[position] = topic.endpoints[last];
+        topic.renewed[position]   = topic.renewed[last];
+
+        make_key(&topic.endpoints[position].any, sizeof(Endpoint), key, endpoint);
+        topic.positions[key] = position;
+    }
+
+    topic.endpoints.pop_back();
+    topic.renewed.pop_back();
+    topic.stale = true;
+
+    --subscriptions_;
+
+    if (topic.endpoints.empty()) release(id);
+}
+
+
+void TopicFanout::release(TopicId id)
+{
+    names_.erase(topics_[id].name);
+    // Frees the subscriber arrays too.
+    topics_[id] = Topic();
+    free_ids_.push_back(id);
+}
+
+
+void TopicFanout::rebuild(Topic& topic)
+{
+    topic.messages.resize(topic.endpoints.size());
+
+    for (size_t i = 0; i < topic.endpoints.size(); ++i)
+    {
+        Endpoint& endpoint = topic.endpoints[i];
+        msghdr&   msg      = topic.messages[i].msg_hdr;
+
+        msg             = {};
+        msg.msg_name    = &endpoint;
+        msg.msg_namelen = endpoint.any.sa_family == AF_INET ? sizeof(sockaddr_in) : sizeof(sockaddr_in6);
+        msg.msg_iov     = &payload_;
+        msg.msg_iovlen  = 1;
+    }
+
+    topic.stale = false;
+}
+
+
+size_t TopicFanout::send(SocketDescriptorType sock, mmsghdr* messages, size_t count)
+{
+    size_t done      = 0;
+    size_t delivered = 0;
+
+    while (done < count)
+    {
+        const int sent = sendmmsg(sock, messages + done, count - done, 0);
+
+        if (sent > 0)
+        {
+            done += sent;
+            delivered += sent;
+            continue;
+        }
+        if (sent < 0 && errno == EINTR) continue;
+
+        // The socket buffer is full: the rest is dropped.
+        if (sent < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+        {
+            stats_.send_errors += count - done;
+            break;
+        }
+
+        // An error of the first datagram (an unreachable subscriber, say):
+        // skip it, those after it may still go out.
+        ++stats_.send_errors;
+        ++done;
+    }
+
+    stats_.delivered += delivered;
+
+    return delivered;
+}
+
+} // socket_wrapper